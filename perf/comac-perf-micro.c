@@ -619,4 +619,11 @@ const comac_perf_case_t perf_cases[] = {{FUNC (pixel), 1, 1},
 					{FUNC (wave), 500, 500},
 					{FUNC (fill_clip), 16, 512},
 					{FUNC (tiger), 16, 1024},
+					{FUNC (pdf_deflate), 16, 16},
+					{FUNC (pdf_file_output), 16, 16},
+					{FUNC (pdf_image), 16, 16},
+					{FUNC (pdf_pages), 16, 16},
+					{FUNC (pdf_parallel), 16, 16},
+					{FUNC (pdf_path), 16, 16},
+					{FUNC (color_convert), 16, 16},
 					{NULL}};
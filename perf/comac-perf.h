@@ -249,5 +249,12 @@ COMAC_PERF_DECL (a1_pixel);
 COMAC_PERF_DECL (sierpinski);
 COMAC_PERF_DECL (fill_clip);
 COMAC_PERF_DECL (tiger);
+COMAC_PERF_DECL (pdf_deflate);
+COMAC_PERF_DECL (pdf_file_output);
+COMAC_PERF_DECL (pdf_image);
+COMAC_PERF_DECL (pdf_pages);
+COMAC_PERF_DECL (pdf_parallel);
+COMAC_PERF_DECL (pdf_path);
+COMAC_PERF_DECL (color_convert);
 
 #endif
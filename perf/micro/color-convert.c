@@ -0,0 +1,332 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+/* Measures converting a million pixels between colorspaces with the
+ * ICC color engine, in batches of 8 bit colors and one double color at
+ * a time, against the naive formulas of the default conversion. The
+ * CMYK profile is built here with lut16 tables, like those of most
+ * printer profiles.
+ */
+
+#define NUM_PIXELS (1024 * 1024)
+#define HEADER_SIZE 128
+
+static comac_color_engine_t *engine;
+static unsigned char *rgb_pixels;
+static unsigned char *cmyk_pixels;
+static unsigned char *output;
+
+static void
+put_u16 (unsigned char *p, unsigned int v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+put_u32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static double
+clamp (double v)
+{
+    return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+static void
+cmyk_to_pcs (const double *cmyk, double *pcs)
+{
+    int i;
+
+    for (i = 0; i < 3; i++)
+	pcs[i] = 0.5 * (1 - cmyk[i]) * (1 - cmyk[3]);
+}
+
+static void
+pcs_to_cmyk (const double *pcs, double *cmyk)
+{
+    double max = 0;
+    int i;
+
+    for (i = 0; i < 3; i++)
+	max = MAX (max, clamp (2 * pcs[i]));
+    cmyk[3] = 1 - max;
+    for (i = 0; i < 3; i++)
+	cmyk[i] = max > 0 ? (max - clamp (2 * pcs[i])) / max : 0;
+}
+
+/* Writes a lut16Type with identity input and output tables */
+static size_t
+put_lut16 (unsigned char *p,
+	   int num_inputs,
+	   int num_outputs,
+	   int grid,
+	   void (*eval) (const double *in, double *out))
+{
+    int num_points = 1, i, j;
+    unsigned char *q;
+
+    for (i = 0; i < num_inputs; i++)
+	num_points *= grid;
+
+    memcpy (p, "mft2", 4);
+    p[8] = num_inputs;
+    p[9] = num_outputs;
+    p[10] = grid;
+    for (i = 0; i < 3; i++)
+	put_u32 (p + 12 + 16 * i, 0x10000);
+    put_u16 (p + 48, 2);
+    put_u16 (p + 50, 2);
+
+    q = p + 52;
+    for (i = 0; i < num_inputs; i++, q += 4)
+	put_u16 (q + 2, 65535);
+
+    for (i = 0; i < num_points; i++) {
+	double in[4], out[4];
+	int index = i;
+
+	for (j = num_inputs - 1; j >= 0; j--) {
+	    in[j] = (index % grid) / (double) (grid - 1);
+	    index /= grid;
+	}
+	eval (in, out);
+	for (j = 0; j < num_outputs; j++, q += 2)
+	    put_u16 (q, clamp (out[j]) * 65535 + .5);
+    }
+
+    for (i = 0; i < num_outputs; i++, q += 4)
+	put_u16 (q + 2, 65535);
+
+    return q - p;
+}
+
+static comac_status_t
+set_cmyk_profile (void)
+{
+    unsigned char *data, *entry;
+    comac_status_t status;
+    size_t offset, size;
+
+    data = calloc (1, 64 * 1024);
+    if (data == NULL)
+	return COMAC_STATUS_NO_MEMORY;
+
+    offset = HEADER_SIZE + 4 + 2 * 12;
+    entry = data + HEADER_SIZE + 4;
+    size = put_lut16 (data + offset, 4, 3, 5, cmyk_to_pcs);
+    memcpy (entry, "A2B0", 4);
+    put_u32 (entry + 4, offset);
+    put_u32 (entry + 8, size);
+    offset += (size + 3) & ~3;
+
+    entry += 12;
+    size = put_lut16 (data + offset, 3, 4, 17, pcs_to_cmyk);
+    memcpy (entry, "B2A0", 4);
+    put_u32 (entry + 4, offset);
+    put_u32 (entry + 8, size);
+    offset += (size + 3) & ~3;
+
+    put_u32 (data, offset);
+    put_u32 (data + 8, 0x04300000);
+    memcpy (data + 12, "prtr", 4);
+    memcpy (data + 16, "CMYK", 4);
+    memcpy (data + 20, "XYZ ", 4);
+    memcpy (data + 36, "acsp", 4);
+    put_u32 (data + HEADER_SIZE, 2);
+
+    status = comac_color_engine_set_profile (engine,
+					     COMAC_COLORSPACE_CMYK,
+					     data,
+					     offset);
+    free (data);
+
+    return status;
+}
+
+static comac_time_t
+do_convert (comac_color_convert_batch_cb convert,
+	    comac_colorspace_t from_colorspace,
+	    const unsigned char *from,
+	    comac_colorspace_t to_colorspace,
+	    int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	convert (from_colorspace,
+		 from,
+		 to_colorspace,
+		 output,
+		 COMAC_COLOR_LAYOUT_U8,
+		 NUM_PIXELS,
+		 COMAC_RENDERING_INTENT_PERCEPTUAL,
+		 engine);
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_color_convert_default_rgb_cmyk (comac_t *cr,
+				   int width,
+				   int height,
+				   int loops)
+{
+    return do_convert (comac_default_color_convert_batch_func,
+		       COMAC_COLORSPACE_RGB,
+		       rgb_pixels,
+		       COMAC_COLORSPACE_CMYK,
+		       loops);
+}
+
+static comac_time_t
+do_color_convert_rgb_cmyk (comac_t *cr, int width, int height, int loops)
+{
+    return do_convert (comac_color_engine_convert_batch_func,
+		       COMAC_COLORSPACE_RGB,
+		       rgb_pixels,
+		       COMAC_COLORSPACE_CMYK,
+		       loops);
+}
+
+static comac_time_t
+do_color_convert_cmyk_rgb (comac_t *cr, int width, int height, int loops)
+{
+    return do_convert (comac_color_engine_convert_batch_func,
+		       COMAC_COLORSPACE_CMYK,
+		       cmyk_pixels,
+		       COMAC_COLORSPACE_RGB,
+		       loops);
+}
+
+static comac_time_t
+do_color_convert_rgb_gray (comac_t *cr, int width, int height, int loops)
+{
+    return do_convert (comac_color_engine_convert_batch_func,
+		       COMAC_COLORSPACE_RGB,
+		       rgb_pixels,
+		       COMAC_COLORSPACE_GRAY,
+		       loops);
+}
+
+/* What a surface does with a callback that only converts single colors */
+static comac_time_t
+do_color_convert_rgb_cmyk_single (comac_t *cr,
+				  int width,
+				  int height,
+				  int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	int i, j;
+
+	for (i = 0; i < NUM_PIXELS; i++) {
+	    double from[4], to[5];
+
+	    for (j = 0; j < 4; j++)
+		from[j] = rgb_pixels[4 * i + j] / 255.;
+	    comac_color_engine_convert_func (COMAC_COLORSPACE_RGB,
+					     from,
+					     COMAC_COLORSPACE_CMYK,
+					     to,
+					     COMAC_RENDERING_INTENT_PERCEPTUAL,
+					     engine);
+	    for (j = 0; j < 5; j++)
+		output[5 * i + j] = to[j] * 255 + .5;
+	}
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+comac_bool_t
+color_convert_enabled (comac_perf_t *perf)
+{
+    return comac_perf_can_run (perf, "color-convert", NULL);
+}
+
+void
+color_convert (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+    uint32_t seed = 0x12345678;
+    int i;
+
+    engine = comac_color_engine_create ();
+    rgb_pixels = malloc (4 * NUM_PIXELS);
+    cmyk_pixels = malloc (5 * NUM_PIXELS);
+    output = malloc (5 * NUM_PIXELS);
+    if (engine == NULL || rgb_pixels == NULL || cmyk_pixels == NULL ||
+	output == NULL || set_cmyk_profile ())
+	goto CLEANUP;
+
+    for (i = 0; i < 4 * NUM_PIXELS; i++) {
+	seed = seed * 1103515245 + 12345;
+	rgb_pixels[i] = seed >> 16;
+    }
+    for (i = 0; i < 5 * NUM_PIXELS; i++) {
+	seed = seed * 1103515245 + 12345;
+	cmyk_pixels[i] = seed >> 16;
+    }
+
+    comac_perf_run (perf,
+		    "color-convert-default-rgb-cmyk",
+		    do_color_convert_default_rgb_cmyk,
+		    NULL);
+    comac_perf_run (perf,
+		    "color-convert-rgb-cmyk",
+		    do_color_convert_rgb_cmyk,
+		    NULL);
+    comac_perf_run (perf,
+		    "color-convert-rgb-cmyk-single",
+		    do_color_convert_rgb_cmyk_single,
+		    NULL);
+    comac_perf_run (perf,
+		    "color-convert-cmyk-rgb",
+		    do_color_convert_cmyk_rgb,
+		    NULL);
+    comac_perf_run (perf,
+		    "color-convert-rgb-gray",
+		    do_color_convert_rgb_gray,
+		    NULL);
+
+CLEANUP:
+    comac_color_engine_destroy (engine);
+    engine = NULL;
+    free (rgb_pixels);
+    free (cmyk_pixels);
+    free (output);
+}
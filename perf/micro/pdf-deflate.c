@@ -0,0 +1,157 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+/* Measures the throughput of compressing a large image into a PDF
+ * stream with an increasing number of compression threads. The time
+ * per iteration should drop roughly in proportion to the thread count
+ * up to the number of available cores.
+ */
+
+#define IMAGE_SIZE 2048
+
+#if COMAC_HAS_PDF_SURFACE
+
+static comac_surface_t *image;
+
+static comac_status_t
+null_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_time_t
+do_pdf_deflate (int num_threads, int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	comac_surface_t *surface;
+	comac_t *cr;
+
+	surface = comac_pdf_surface_create_for_stream (null_write,
+						       NULL,
+						       IMAGE_SIZE,
+						       IMAGE_SIZE);
+	comac_pdf_surface_set_compression_threads (surface, num_threads);
+
+	cr = comac_create (surface);
+	comac_set_source_surface (cr, image, 0, 0);
+	comac_paint (cr);
+	comac_destroy (cr);
+
+	comac_surface_finish (surface);
+	comac_surface_destroy (surface);
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_pdf_deflate_1 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_deflate (1, loops);
+}
+
+static comac_time_t
+do_pdf_deflate_2 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_deflate (2, loops);
+}
+
+static comac_time_t
+do_pdf_deflate_4 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_deflate (4, loops);
+}
+
+static comac_time_t
+do_pdf_deflate_8 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_deflate (8, loops);
+}
+
+static comac_surface_t *
+create_noise_image (void)
+{
+    comac_surface_t *surface;
+    uint32_t *data;
+    uint32_t seed = 0x12345678;
+    int stride, x, y;
+
+    surface =
+	comac_image_surface_create (COMAC_FORMAT_RGB24, IMAGE_SIZE, IMAGE_SIZE);
+    comac_surface_flush (surface);
+    data = (uint32_t *) comac_image_surface_get_data (surface);
+    stride = comac_image_surface_get_stride (surface) / 4;
+
+    /* A gradient with some low order noise compresses to about a third,
+     * which is typical for photographic content. */
+    for (y = 0; y < IMAGE_SIZE; y++) {
+	for (x = 0; x < IMAGE_SIZE; x++) {
+	    seed = seed * 1103515245 + 12345;
+	    data[y * stride + x] = (((x >> 3) & 0xff) << 16) |
+				   (((y >> 3) & 0xff) << 8) |
+				   ((seed >> 16) & 0x0f);
+	}
+    }
+    comac_surface_mark_dirty (surface);
+
+    return surface;
+}
+
+#endif
+
+comac_bool_t
+pdf_deflate_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-deflate", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_deflate (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    image = create_noise_image ();
+
+    comac_perf_run (perf, "pdf-deflate-1", do_pdf_deflate_1, NULL);
+    comac_perf_run (perf, "pdf-deflate-2", do_pdf_deflate_2, NULL);
+    comac_perf_run (perf, "pdf-deflate-4", do_pdf_deflate_4, NULL);
+    comac_perf_run (perf, "pdf-deflate-8", do_pdf_deflate_8, NULL);
+
+    comac_surface_destroy (image);
+    image = NULL;
+#endif
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/* Writes documents to a file, through stdio as an application would
+ * with comac_pdf_surface_create_for_stream(), through the file stream
+ * used by comac_pdf_surface_create(), and through the same stream
+ * with a writer thread. Each page has a noisy image, which does not
+ * compress, and a lot of text and lines written in small pieces.
+ * Besides the time per document, the number of write system calls per
+ * MB of output is reported.
+ */
+
+#define PAGE_WIDTH 595
+#define PAGE_HEIGHT 842
+#define PAGES 8
+#define IMAGE_SIZE 512
+#define OUTPUT_FILE "comac-perf-pdf-file-output.pdf"
+
+#if COMAC_HAS_PDF_SURFACE
+
+typedef enum {
+    OUTPUT_STDIO,
+    OUTPUT_FILE_STREAM,
+    OUTPUT_WRITE_THREAD
+} output_t;
+
+static comac_surface_t *image;
+
+static comac_status_t
+stdio_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    if (fwrite (data, 1, length, closure) != length)
+	return COMAC_STATUS_WRITE_ERROR;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_surface_t *
+create_noise (void)
+{
+    comac_surface_t *noise;
+    unsigned char *data;
+    uint32_t seed = 1;
+    int stride, x, y;
+
+    noise = comac_image_surface_create (COMAC_FORMAT_RGB24,
+					IMAGE_SIZE,
+					IMAGE_SIZE);
+    comac_surface_flush (noise);
+    data = comac_image_surface_get_data (noise);
+    stride = comac_image_surface_get_stride (noise);
+    for (y = 0; y < IMAGE_SIZE; y++) {
+	for (x = 0; x < IMAGE_SIZE; x++) {
+	    seed = seed * 1103515245 + 12345;
+	    ((uint32_t *) (data + y * stride))[x] = seed >> 8;
+	}
+    }
+    comac_surface_mark_dirty (noise);
+
+    return noise;
+}
+
+static void
+draw_page (comac_t *cr, int page)
+{
+    char text[64];
+    int y;
+
+    comac_save (cr);
+    comac_translate (cr, page, 0);
+    comac_set_source_surface (cr, image, 36, 36);
+    comac_paint (cr);
+    comac_restore (cr);
+
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_set_font_size (cr, 6);
+    for (y = 0; y < 400; y++) {
+	snprintf (text, sizeof (text), "Page %d, line %d: 1234.56", page, y);
+	comac_move_to (cr, 36 + (y % 4) * 130, 560 + 2 * (y / 4));
+	comac_show_text (cr, text);
+    }
+
+    comac_set_line_width (cr, 0.5);
+    for (y = 0; y < 2000; y++)
+	comac_line_to (cr, 36 + y * 0.26, 800 - 20 * sin (y * 0.05 + page));
+    comac_stroke (cr);
+
+    comac_show_page (cr);
+}
+
+static void
+write_document (output_t output)
+{
+    comac_surface_t *surface;
+    comac_t *cr;
+    FILE *file = NULL;
+    int page;
+
+    if (output == OUTPUT_STDIO) {
+	file = fopen (OUTPUT_FILE, "wb");
+	surface = comac_pdf_surface_create_for_stream (stdio_write,
+						       file,
+						       PAGE_WIDTH,
+						       PAGE_HEIGHT);
+    } else {
+	surface =
+	    comac_pdf_surface_create (OUTPUT_FILE, PAGE_WIDTH, PAGE_HEIGHT);
+	comac_pdf_surface_set_write_thread (surface,
+					    output == OUTPUT_WRITE_THREAD);
+    }
+    comac_pdf_surface_set_compression (surface, COMAC_PDF_COMPRESSION_FAST);
+
+    cr = comac_create (surface);
+    for (page = 0; page < PAGES; page++)
+	draw_page (cr, page);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    comac_surface_destroy (surface);
+    if (file)
+	fclose (file);
+}
+
+static comac_time_t
+do_pdf_file_output (output_t output, int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--)
+	write_document (output);
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_pdf_file_output_stdio (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_file_output (OUTPUT_STDIO, loops);
+}
+
+static comac_time_t
+do_pdf_file_output_stream (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_file_output (OUTPUT_FILE_STREAM, loops);
+}
+
+static comac_time_t
+do_pdf_file_output_thread (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_file_output (OUTPUT_WRITE_THREAD, loops);
+}
+
+static double
+count_pdf_file_output (comac_t *cr, int width, int height)
+{
+    return PAGES;
+}
+
+/* Reads the number of write system calls made and bytes written by
+ * this process so far. */
+static comac_bool_t
+read_io_counters (long long *syscalls, long long *bytes)
+{
+    comac_bool_t found = FALSE;
+#ifdef __linux__
+    char line[128];
+    FILE *file;
+    int count = 0;
+
+    file = fopen ("/proc/self/io", "r");
+    if (file == NULL)
+	return FALSE;
+
+    while (fgets (line, sizeof (line), file)) {
+	if (sscanf (line, "wchar: %lld", bytes) == 1 ||
+	    sscanf (line, "syscw: %lld", syscalls) == 1)
+	    count++;
+    }
+    fclose (file);
+    found = count == 2;
+#endif
+    return found;
+}
+
+static void
+report_syscalls (comac_perf_t *perf, const char *name, output_t output)
+{
+    long long syscalls, bytes, end_syscalls, end_bytes;
+
+    if (perf->list_only) {
+	printf ("%s\n", name);
+	return;
+    }
+
+    if (perf->summary == NULL || ! read_io_counters (&syscalls, &bytes))
+	return;
+
+    write_document (output);
+    if (! read_io_counters (&end_syscalls, &end_bytes) || end_bytes == bytes)
+	return;
+
+    fprintf (perf->summary,
+	     "[ # ] %s: %.1f write syscalls per MB\n",
+	     name,
+	     (end_syscalls - syscalls) * 1048576. / (end_bytes - bytes));
+    fflush (perf->summary);
+}
+
+#endif
+
+comac_bool_t
+pdf_file_output_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-file-output", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_file_output (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    image = create_noise ();
+
+    comac_perf_run (perf,
+		    "pdf-file-output-stdio",
+		    do_pdf_file_output_stdio,
+		    count_pdf_file_output);
+    comac_perf_run (perf,
+		    "pdf-file-output-stream",
+		    do_pdf_file_output_stream,
+		    count_pdf_file_output);
+    comac_perf_run (perf,
+		    "pdf-file-output-thread",
+		    do_pdf_file_output_thread,
+		    count_pdf_file_output);
+
+    report_syscalls (perf, "pdf-file-output-syscalls-stdio", OUTPUT_STDIO);
+    report_syscalls (perf,
+		     "pdf-file-output-syscalls-stream",
+		     OUTPUT_FILE_STREAM);
+    report_syscalls (perf,
+		     "pdf-file-output-syscalls-thread",
+		     OUTPUT_WRITE_THREAD);
+
+    comac_surface_destroy (image);
+    remove (OUTPUT_FILE);
+#endif
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+/* Measures the conversion of image surfaces to PDF image data:
+ * unpremultiplying and packing the color components and extracting the
+ * soft mask. Compression of image streams is turned off so that the
+ * conversion dominates.
+ */
+
+#define IMAGE_SIZE 1024
+
+#if COMAC_HAS_PDF_SURFACE
+
+static comac_surface_t *image;
+
+static comac_status_t
+null_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_time_t
+do_pdf_image (comac_t *cr, int width, int height, int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	comac_surface_t *surface;
+	comac_t *cr2;
+
+	surface = comac_pdf_surface_create_for_stream (null_write,
+						       NULL,
+						       IMAGE_SIZE,
+						       IMAGE_SIZE);
+	comac_pdf_surface_set_stream_compression (
+	    surface,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
+	    0,
+	    COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT);
+
+	cr2 = comac_create (surface);
+	comac_set_source_surface (cr2, image, 0, 0);
+	comac_paint (cr2);
+	comac_destroy (cr2);
+
+	comac_surface_finish (surface);
+	comac_surface_destroy (surface);
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_surface_t *
+create_image (comac_format_t format)
+{
+    comac_surface_t *surface;
+    unsigned char *data;
+    uint32_t seed = 0x12345678;
+    int stride, x, y;
+
+    surface = comac_image_surface_create (format, IMAGE_SIZE, IMAGE_SIZE);
+    comac_surface_flush (surface);
+    data = comac_image_surface_get_data (surface);
+    stride = comac_image_surface_get_stride (surface);
+
+    for (y = 0; y < IMAGE_SIZE; y++) {
+	for (x = 0; x < IMAGE_SIZE; x++) {
+	    uint32_t a, r, g, b;
+
+	    seed = seed * 1103515245 + 12345;
+	    if (format == COMAC_FORMAT_A8) {
+		data[y * stride + x] = seed >> 24;
+		continue;
+	    }
+
+	    a = format == COMAC_FORMAT_ARGB32 ? 128 + (x & 127) : 255;
+	    r = ((seed >> 8) & 0xff) * a / 255;
+	    g = ((seed >> 16) & 0xff) * a / 255;
+	    b = ((seed >> 24) & 0xff) * a / 255;
+	    ((uint32_t *) (data + y * stride))[x] =
+		(a << 24) | (r << 16) | (g << 8) | b;
+	}
+    }
+    comac_surface_mark_dirty (surface);
+
+    return surface;
+}
+
+static void
+run (comac_perf_t *perf, const char *name, comac_format_t format)
+{
+    image = create_image (format);
+    comac_perf_run (perf, name, do_pdf_image, NULL);
+    comac_surface_destroy (image);
+    image = NULL;
+}
+
+#endif
+
+comac_bool_t
+pdf_image_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-image", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_image (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    run (perf, "pdf-image-argb32", COMAC_FORMAT_ARGB32);
+    run (perf, "pdf-image-rgb24", COMAC_FORMAT_RGB24);
+    run (perf, "pdf-image-a8", COMAC_FORMAT_A8);
+#endif
+}
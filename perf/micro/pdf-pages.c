@@ -0,0 +1,250 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+/* Generates long documents in which every page draws some text, a
+ * gradient, a small image and an unbounded recording surface, as a
+ * statement run would. Besides the time per document, the resident
+ * set size is reported every REPORT_INTERVAL pages, with and without
+ * streaming mode. In streaming mode it should stay flat as the page
+ * count grows.
+ */
+
+#define PAGE_WIDTH 595
+#define PAGE_HEIGHT 842
+#define PAGES 100
+#define REPORT_PAGES 5000
+#define REPORT_INTERVAL 1000
+
+#if COMAC_HAS_PDF_SURFACE
+
+static comac_status_t
+null_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+draw_page (comac_t *cr, int page)
+{
+    comac_surface_t *image, *watermark;
+    comac_pattern_t *gradient;
+    comac_t *cr2;
+    unsigned char *data;
+    char text[64];
+    int stride, x, y;
+
+    gradient = comac_pattern_create_linear (0, 0, PAGE_WIDTH, 0);
+    comac_pattern_add_color_stop_rgb (gradient, 0, (page % 10) / 10., 0, 1);
+    comac_pattern_add_color_stop_rgb (gradient, 1, 1, (page % 7) / 7., 0);
+    comac_set_source (cr, gradient);
+    comac_rectangle (cr, 36, 36, PAGE_WIDTH - 72, 40);
+    comac_fill (cr);
+    comac_pattern_destroy (gradient);
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24, 32, 32);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    for (y = 0; y < 32; y++) {
+	for (x = 0; x < 32; x++) {
+	    uint32_t *pixel = (uint32_t *) (data + y * stride) + x;
+	    *pixel = ((x + page) & 1) ^ (y & 1) ? 0xffffff : 0;
+	}
+    }
+    comac_surface_mark_dirty (image);
+    comac_set_source_surface (cr, image, PAGE_WIDTH - 68, 90);
+    comac_paint (cr);
+    comac_surface_destroy (image);
+
+    watermark = comac_recording_surface_create (COMAC_CONTENT_COLOR_ALPHA,
+						NULL);
+    cr2 = comac_create (watermark);
+    comac_set_source_rgba (cr2, 0.5, 0.5, 0.5, 0.2);
+    comac_move_to (cr2, 100, 400);
+    comac_line_to (cr2, 500, 600);
+    comac_set_line_width (cr2, 20);
+    comac_stroke (cr2);
+    comac_destroy (cr2);
+    comac_set_source_surface (cr, watermark, 0, 0);
+    comac_paint (cr);
+    comac_surface_destroy (watermark);
+
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_set_font_size (cr, 12);
+    for (y = 0; y < 20; y++) {
+	snprintf (text, sizeof (text), "Page %d, line %d: 1234.56", page, y);
+	comac_move_to (cr, 36, 140 + 14 * y);
+	comac_show_text (cr, text);
+    }
+
+    comac_show_page (cr);
+}
+
+static comac_time_t
+do_pdf_pages (comac_bool_t streaming, int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	comac_surface_t *surface;
+	comac_t *cr;
+	int page;
+
+	surface = comac_pdf_surface_create_for_stream (null_write,
+						       NULL,
+						       PAGE_WIDTH,
+						       PAGE_HEIGHT);
+	comac_pdf_surface_set_streaming (surface, streaming);
+
+	cr = comac_create (surface);
+	for (page = 0; page < PAGES; page++)
+	    draw_page (cr, page);
+	comac_destroy (cr);
+
+	comac_surface_finish (surface);
+	comac_surface_destroy (surface);
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_pdf_pages_buffered (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_pages (FALSE, loops);
+}
+
+static comac_time_t
+do_pdf_pages_streaming (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_pages (TRUE, loops);
+}
+
+static double
+count_pdf_pages (comac_t *cr, int width, int height)
+{
+    return PAGES;
+}
+
+/* Resident set size in KiB, or -1 where it cannot be read. */
+static long
+current_rss (void)
+{
+    long rss = -1;
+#ifdef __linux__
+    FILE *file;
+    long size, resident;
+
+    file = fopen ("/proc/self/statm", "r");
+    if (file == NULL)
+	return -1;
+
+    if (fscanf (file, "%ld %ld", &size, &resident) == 2)
+	rss = resident * (sysconf (_SC_PAGESIZE) / 1024);
+    fclose (file);
+#endif
+    return rss;
+}
+
+static void
+report_rss (comac_perf_t *perf, const char *name, comac_bool_t streaming)
+{
+    comac_surface_t *surface;
+    comac_t *cr;
+    long start;
+    int page;
+
+    if (perf->list_only) {
+	printf ("%s\n", name);
+	return;
+    }
+
+    start = current_rss ();
+    if (start < 0 || perf->summary == NULL)
+	return;
+
+    surface = comac_pdf_surface_create_for_stream (null_write,
+						   NULL,
+						   PAGE_WIDTH,
+						   PAGE_HEIGHT);
+    comac_pdf_surface_set_streaming (surface, streaming);
+
+    fprintf (perf->summary, "[ # ] %s: rss growth (KiB) by page count:", name);
+    cr = comac_create (surface);
+    for (page = 1; page <= REPORT_PAGES; page++) {
+	draw_page (cr, page);
+	if (page % REPORT_INTERVAL == 0)
+	    fprintf (perf->summary, " %d:%ld", page, current_rss () - start);
+    }
+    comac_destroy (cr);
+    fprintf (perf->summary, "\n");
+    fflush (perf->summary);
+
+    comac_surface_finish (surface);
+    comac_surface_destroy (surface);
+}
+
+#endif
+
+comac_bool_t
+pdf_pages_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-pages", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_pages (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    comac_perf_run (perf,
+		    "pdf-pages-buffered",
+		    do_pdf_pages_buffered,
+		    count_pdf_pages);
+    comac_perf_run (perf,
+		    "pdf-pages-streaming",
+		    do_pdf_pages_streaming,
+		    count_pdf_pages);
+
+    /* Streaming first, so that the heap it leaves behind does not hide
+     * the growth of the buffered run. */
+    report_rss (perf, "pdf-pages-rss-streaming", TRUE);
+    report_rss (perf, "pdf-pages-rss-buffered", FALSE);
+#endif
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+#if COMAC_HAS_REAL_PTHREAD
+#include <pthread.h>
+#endif
+
+/* Generates a report whose pages are drawn by several threads, each
+ * into its own page surface, and appended to the document in page
+ * order. The serial run draws the same pages on the document itself.
+ * Every page uses the same logo image and fonts, which end up written
+ * once in the document either way.
+ */
+
+#define PAGE_WIDTH 595
+#define PAGE_HEIGHT 842
+#define PAGES 64
+#define MAX_THREADS 16
+
+#if COMAC_HAS_PDF_SURFACE
+
+static comac_status_t
+null_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+draw_page (comac_t *cr, comac_surface_t *logo, int page)
+{
+    comac_pattern_t *gradient;
+    char text[64];
+    int y;
+
+    comac_set_source_surface (cr, logo, PAGE_WIDTH - 100, 36);
+    comac_paint (cr);
+
+    gradient = comac_pattern_create_linear (0, 0, PAGE_WIDTH, 0);
+    comac_pattern_add_color_stop_rgb (gradient, 0, (page % 10) / 10., 0, 1);
+    comac_pattern_add_color_stop_rgb (gradient, 1, 1, (page % 7) / 7., 0);
+    comac_set_source (cr, gradient);
+    comac_rectangle (cr, 36, 36, PAGE_WIDTH - 150, 40);
+    comac_fill (cr);
+    comac_pattern_destroy (gradient);
+
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_set_font_size (cr, 10);
+    for (y = 0; y < 50; y++) {
+	snprintf (text,
+		  sizeof (text),
+		  "Page %d, row %d: %d.%02d  %d.%02d",
+		  page,
+		  y,
+		  page * y,
+		  y,
+		  page + y,
+		  page);
+	comac_move_to (cr, 36, 100 + 14 * y);
+	comac_show_text (cr, text);
+    }
+
+    comac_set_line_width (cr, 0.5);
+    for (y = 0; y < 200; y++)
+	comac_line_to (cr, 36 + 2.5 * y, 780 - 20 * sin (y * 0.1 + page));
+    comac_stroke (cr);
+
+    comac_show_page (cr);
+}
+
+static comac_surface_t *
+create_logo (void)
+{
+    comac_surface_t *logo;
+    comac_t *cr;
+
+    logo = comac_image_surface_create (COMAC_FORMAT_RGB24, 64, 64);
+    cr = comac_create (logo);
+    comac_set_source_rgb (cr, 1, 1, 1);
+    comac_paint (cr);
+    comac_set_source_rgb (cr, 0.8, 0.1, 0.1);
+    comac_arc (cr, 32, 32, 24, 0, 2 * M_PI);
+    comac_fill (cr);
+    comac_destroy (cr);
+
+    return logo;
+}
+
+#if COMAC_HAS_REAL_PTHREAD
+typedef struct _worker {
+    comac_surface_t *document;
+    comac_surface_t *logo;
+    comac_surface_t **pages;
+    int first;
+    int step;
+} worker_t;
+
+static void *
+draw_pages (void *closure)
+{
+    worker_t *worker = closure;
+    int page;
+
+    for (page = worker->first; page < PAGES; page += worker->step) {
+	comac_t *cr;
+
+	worker->pages[page] = comac_pdf_surface_create_page (worker->document,
+							     PAGE_WIDTH,
+							     PAGE_HEIGHT);
+	cr = comac_create (worker->pages[page]);
+	draw_page (cr, worker->logo, page);
+	comac_destroy (cr);
+    }
+
+    return NULL;
+}
+#endif
+
+static comac_time_t
+do_pdf_parallel (int num_threads, int loops)
+{
+    comac_surface_t *logo;
+
+    logo = create_logo ();
+
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	comac_surface_t *document;
+	int page;
+
+	document = comac_pdf_surface_create_for_stream (null_write,
+							NULL,
+							PAGE_WIDTH,
+							PAGE_HEIGHT);
+
+	if (num_threads == 0) {
+	    comac_t *cr;
+
+	    cr = comac_create (document);
+	    for (page = 0; page < PAGES; page++)
+		draw_page (cr, logo, page);
+	    comac_destroy (cr);
+	} else {
+#if COMAC_HAS_REAL_PTHREAD
+	    comac_surface_t *pages[PAGES];
+	    pthread_t threads[MAX_THREADS];
+	    worker_t workers[MAX_THREADS];
+	    int i;
+
+	    for (i = 0; i < num_threads; i++) {
+		workers[i].document = document;
+		workers[i].logo = logo;
+		workers[i].pages = pages;
+		workers[i].first = i;
+		workers[i].step = num_threads;
+		pthread_create (&threads[i], NULL, draw_pages, &workers[i]);
+	    }
+	    for (i = 0; i < num_threads; i++)
+		pthread_join (threads[i], NULL);
+
+	    for (page = 0; page < PAGES; page++) {
+		comac_pdf_surface_append_page (document, pages[page]);
+		comac_surface_destroy (pages[page]);
+	    }
+#endif
+	}
+
+	comac_surface_finish (document);
+	comac_surface_destroy (document);
+    }
+
+    comac_perf_timer_stop ();
+
+    comac_surface_destroy (logo);
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_pdf_parallel_serial (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_parallel (0, loops);
+}
+
+static comac_time_t
+do_pdf_parallel_1 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_parallel (1, loops);
+}
+
+static comac_time_t
+do_pdf_parallel_4 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_parallel (4, loops);
+}
+
+static comac_time_t
+do_pdf_parallel_16 (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_parallel (16, loops);
+}
+
+static double
+count_pdf_parallel (comac_t *cr, int width, int height)
+{
+    return PAGES;
+}
+
+#endif
+
+comac_bool_t
+pdf_parallel_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-parallel", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_parallel (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    comac_perf_run (perf,
+		    "pdf-parallel-serial",
+		    do_pdf_parallel_serial,
+		    count_pdf_parallel);
+#if COMAC_HAS_REAL_PTHREAD
+    comac_perf_run (perf,
+		    "pdf-parallel-1",
+		    do_pdf_parallel_1,
+		    count_pdf_parallel);
+    comac_perf_run (perf,
+		    "pdf-parallel-4",
+		    do_pdf_parallel_4,
+		    count_pdf_parallel);
+    comac_perf_run (perf,
+		    "pdf-parallel-16",
+		    do_pdf_parallel_16,
+		    count_pdf_parallel);
+#endif
+#endif
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-perf.h"
+
+#if COMAC_HAS_PDF_SURFACE
+#include <comac-pdf.h>
+#endif
+
+/* Writes pages made of many short curves and lines at fractional
+ * coordinates to a PDF stream. Nearly all of the content stream is
+ * numbers, so this measures how fast they are formatted.
+ */
+
+#define PAGE_SIZE 512
+#define NUM_SEGMENTS 20000
+
+#if COMAC_HAS_PDF_SURFACE
+
+static comac_status_t
+null_write (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+draw_path (comac_t *cr, comac_bool_t curves)
+{
+    uint32_t seed = 0x12345678;
+    double x[3], y[3];
+    int i, j;
+
+    comac_move_to (cr, PAGE_SIZE / 2, PAGE_SIZE / 2);
+    for (i = 0; i < NUM_SEGMENTS; i++) {
+	for (j = 0; j < 3; j++) {
+	    seed = seed * 1103515245 + 12345;
+	    x[j] = (seed >> 8) % (PAGE_SIZE * 1000) / 1000.;
+	    seed = seed * 1103515245 + 12345;
+	    y[j] = (seed >> 8) % (PAGE_SIZE * 1000) / 1000.;
+	}
+	if (curves)
+	    comac_curve_to (cr, x[0], y[0], x[1], y[1], x[2], y[2]);
+	else
+	    comac_line_to (cr, x[0], y[0]);
+    }
+}
+
+static comac_time_t
+do_pdf_path (comac_bool_t curves, int loops)
+{
+    comac_perf_timer_start ();
+
+    while (loops--) {
+	comac_surface_t *surface;
+	comac_t *cr;
+
+	surface = comac_pdf_surface_create_for_stream (null_write,
+						       NULL,
+						       PAGE_SIZE,
+						       PAGE_SIZE);
+
+	cr = comac_create (surface);
+	draw_path (cr, curves);
+	comac_fill (cr);
+	comac_destroy (cr);
+
+	comac_surface_finish (surface);
+	comac_surface_destroy (surface);
+    }
+
+    comac_perf_timer_stop ();
+
+    return comac_perf_timer_elapsed ();
+}
+
+static comac_time_t
+do_pdf_path_lines (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_path (FALSE, loops);
+}
+
+static comac_time_t
+do_pdf_path_curves (comac_t *cr, int width, int height, int loops)
+{
+    return do_pdf_path (TRUE, loops);
+}
+
+static double
+count_pdf_path (comac_t *cr, int width, int height)
+{
+    return NUM_SEGMENTS;
+}
+
+#endif
+
+comac_bool_t
+pdf_path_enabled (comac_perf_t *perf)
+{
+#if COMAC_HAS_PDF_SURFACE
+    return comac_perf_can_run (perf, "pdf-path", NULL);
+#else
+    return FALSE;
+#endif
+}
+
+void
+pdf_path (comac_perf_t *perf, comac_t *cr, int width, int height)
+{
+#if COMAC_HAS_PDF_SURFACE
+    comac_perf_run (perf, "pdf-path-lines", do_pdf_path_lines, count_pdf_path);
+    comac_perf_run (perf,
+		    "pdf-path-curves",
+		    do_pdf_path_curves,
+		    count_pdf_path);
+#endif
+}
@@ -46,6 +46,7 @@ pixel_direct (comac_t *cr, int width, int height, int loops)
     default:
     case COMAC_FORMAT_INVALID:
     case COMAC_FORMAT_A1:
+    case COMAC_FORMAT_CMYKA:
 	bpp = 0;
 	break;
     case COMAC_FORMAT_A8:
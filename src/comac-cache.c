@@ -325,3 +325,97 @@ _comac_hash_bytes (uintptr_t hash, const void *ptr, unsigned int length)
 	hash = ((hash << 5) + hash) + *bytes++;
     return hash;
 }
+
+static inline uint64_t
+_comac_rotl64 (uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+_comac_fmix64 (uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/**
+ * _comac_hash128_bytes:
+ * @hash: the 128-bit hash to update
+ * @ptr: the data to hash
+ * @length: the number of bytes at @ptr
+ *
+ * Mixes @length bytes into @hash. The result is suitable for detecting
+ * identical data, e.g. the contents of two images. Unlike
+ * _comac_hash_bytes() collisions are improbable enough for equal hashes
+ * to be treated as equal data.
+ *
+ * This is MurmurHash3_x64_128 seeded with the previous value of @hash,
+ * so that it can be computed incrementally.
+ **/
+void
+_comac_hash128_bytes (uint64_t hash[2], const void *ptr, size_t length)
+{
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+    const uint8_t *bytes = ptr;
+    uint64_t h1 = hash[0];
+    uint64_t h2 = hash[1];
+    uint64_t k1, k2;
+    uint8_t tail[16];
+    size_t n;
+
+    for (n = length; n >= 16; n -= 16, bytes += 16) {
+	memcpy (&k1, bytes, 8);
+	memcpy (&k2, bytes + 8, 8);
+
+	k1 *= c1;
+	k1 = _comac_rotl64 (k1, 31);
+	k1 *= c2;
+	h1 ^= k1;
+	h1 = _comac_rotl64 (h1, 27);
+	h1 += h2;
+	h1 = h1 * 5 + 0x52dce729;
+
+	k2 *= c2;
+	k2 = _comac_rotl64 (k2, 33);
+	k2 *= c1;
+	h2 ^= k2;
+	h2 = _comac_rotl64 (h2, 31);
+	h2 += h1;
+	h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    if (n) {
+	memset (tail, 0, sizeof (tail));
+	memcpy (tail, bytes, n);
+	memcpy (&k1, tail, 8);
+	memcpy (&k2, tail + 8, 8);
+
+	k2 *= c2;
+	k2 = _comac_rotl64 (k2, 33);
+	k2 *= c1;
+	h2 ^= k2;
+
+	k1 *= c1;
+	k1 = _comac_rotl64 (k1, 31);
+	k1 *= c2;
+	h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = _comac_fmix64 (h1);
+    h2 = _comac_fmix64 (h2);
+    h1 += h2;
+    h2 += h1;
+
+    hash[0] = h1;
+    hash[1] = h2;
+}
@@ -0,0 +1,1757 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-atomic-private.h"
+#include "comac-error-private.h"
+
+/* Converts colors between ICC profiles.
+ *
+ * A profile is read into curves, matrices and multi-dimensional
+ * tables that map device colors to the profile connection space (PCS)
+ * and back, either as a matrix with tone reproduction curves (TRC) or
+ * as lut8, lut16, lutAtoB or lutBtoA tags. Evaluating these for every
+ * color would be slow, so the first conversion between two
+ * colorspaces samples the whole chain from one device to the other
+ * into a single table: 256 entries for gray, a 33x33x33 grid for RGB
+ * and a 17x17x17x17 grid for CMYK. Colors are then looked up with
+ * tetrahedral interpolation, for CMYK between the two nearest slices
+ * of black.
+ */
+
+#define ICC_HEADER_SIZE 128
+#define ICC_MAX_CHANNELS 4
+#define ICC_INVERSE_CURVE_SIZE 4096
+
+#define ICC_SIG(a, b, c, d)                                                    \
+    ((uint32_t) (a) << 24 | (uint32_t) (b) << 16 | (uint32_t) (c) << 8 |      \
+     (uint32_t) (d))
+
+/* The D50 white of the profile connection space */
+static const double d50[3] = {0.9642, 1.0, 0.8249};
+
+typedef struct _comac_icc_curve {
+    int num_entries; /* 0 for a parametric curve */
+    float *table;
+    int function;
+    double params[7];
+} comac_icc_curve_t;
+
+typedef enum _comac_icc_lut_type {
+    ICC_LUT_MFT, /* lut8Type and lut16Type */
+    ICC_LUT_A_TO_B,
+    ICC_LUT_B_TO_A
+} comac_icc_lut_type_t;
+
+typedef struct _comac_icc_lut {
+    comac_icc_lut_type_t type;
+    comac_bool_t legacy_lab;
+    int num_inputs;
+    int num_outputs;
+
+    comac_bool_t has_matrix;
+    double matrix[12];
+
+    int num_a_curves;
+    int num_m_curves;
+    int num_b_curves;
+    comac_icc_curve_t a_curves[ICC_MAX_CHANNELS];
+    comac_icc_curve_t m_curves[3];
+    comac_icc_curve_t b_curves[ICC_MAX_CHANNELS];
+
+    int grid[ICC_MAX_CHANNELS];
+    float *clut;
+} comac_icc_lut_t;
+
+typedef struct _comac_icc_profile {
+    comac_colorspace_t colorspace;
+    comac_bool_t pcs_is_lab;
+    double white[3];
+
+    /* A matrix and curves for RGB, a single curve for gray */
+    comac_bool_t has_trc;
+    double matrix[9];
+    double inverse[9];
+    comac_icc_curve_t trc[3];
+    float *inverse_trc[3];
+
+    /* Indexed by perceptual, relative colorimetric and saturation */
+    comac_icc_lut_t *a_to_b[3];
+    comac_icc_lut_t *b_to_a[3];
+} comac_icc_profile_t;
+
+/* The sampled conversion from one device colorspace to another */
+typedef struct _comac_color_lut {
+    int num_inputs;
+    int num_outputs;
+    int grid;
+    float table[1];
+} comac_color_lut_t;
+
+#define NUM_INTENTS 4
+
+struct _comac_color_engine {
+    comac_icc_profile_t *profiles[COMAC_COLORSPACE_NUM_COLORSPACES];
+    comac_color_lut_t *luts[COMAC_COLORSPACE_NUM_COLORSPACES]
+			   [COMAC_COLORSPACE_NUM_COLORSPACES][NUM_INTENTS];
+};
+
+static uint32_t
+_read_u32 (const unsigned char *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 |
+	   (uint32_t) p[2] << 8 | p[3];
+}
+
+static uint16_t
+_read_u16 (const unsigned char *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static double
+_read_s15fixed16 (const unsigned char *p)
+{
+    return (int32_t) _read_u32 (p) / 65536.;
+}
+
+/* Broken profiles can produce NaN, which these turn into 0 */
+static double
+_clamp (double v)
+{
+    return v > 0. ? (v < 1. ? v : 1.) : 0.;
+}
+
+static float
+_clampf (float v)
+{
+    return v > 0.f ? (v < 1.f ? v : 1.f) : 0.f;
+}
+
+/* Curves */
+
+static double
+_comac_icc_curve_eval (const comac_icc_curve_t *curve, double x)
+{
+    const double *p = curve->params;
+    double pos, frac;
+    int i;
+
+    x = _clamp (x);
+
+    if (curve->num_entries == 1)
+	return curve->table[0];
+
+    if (curve->num_entries > 1) {
+	pos = x * (curve->num_entries - 1);
+	i = pos;
+	if (i >= curve->num_entries - 1)
+	    return curve->table[curve->num_entries - 1];
+	frac = pos - i;
+	return curve->table[i] + frac * (curve->table[i + 1] - curve->table[i]);
+    }
+
+    switch (curve->function) {
+    case 0:
+	return _clamp (pow (x, p[0]));
+    case 1:
+	if (x >= -p[2] / p[1])
+	    return _clamp (pow (p[1] * x + p[2], p[0]));
+	return 0.;
+    case 2:
+	if (x >= -p[2] / p[1])
+	    return _clamp (pow (p[1] * x + p[2], p[0]) + p[3]);
+	return _clamp (p[3]);
+    case 3:
+	if (x >= p[4])
+	    return _clamp (pow (p[1] * x + p[2], p[0]));
+	return _clamp (p[3] * x);
+    case 4:
+	if (x >= p[4])
+	    return _clamp (pow (p[1] * x + p[2], p[0]) + p[5]);
+	return _clamp (p[3] * x + p[6]);
+    }
+
+    ASSERT_NOT_REACHED;
+    return x;
+}
+
+static void
+_comac_icc_curve_fini (comac_icc_curve_t *curve)
+{
+    free (curve->table);
+    curve->table = NULL;
+}
+
+/* Reads the curveType or parametricCurveType at @offset into @curve
+ * and returns its size, padded to four bytes, in @size. */
+static comac_status_t
+_comac_icc_read_curve (const unsigned char *data,
+		       uint32_t length,
+		       uint32_t offset,
+		       comac_icc_curve_t *curve,
+		       uint32_t *size)
+{
+    static const int num_params[] = {1, 3, 4, 5, 7};
+    uint32_t type, count, i;
+
+    memset (curve, 0, sizeof (comac_icc_curve_t));
+
+    if (offset > length || length - offset < 12)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    type = _read_u32 (data + offset);
+    if (type == ICC_SIG ('c', 'u', 'r', 'v')) {
+	count = _read_u32 (data + offset + 8);
+	if (count > (length - offset - 12) / 2)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	*size = (12 + 2 * count + 3) & ~3;
+	if (count == 0) {
+	    /* The identity */
+	    curve->function = 0;
+	    curve->params[0] = 1.;
+	    return COMAC_STATUS_SUCCESS;
+	}
+	if (count == 1) {
+	    curve->function = 0;
+	    curve->params[0] = _read_u16 (data + offset + 12) / 256.;
+	    return COMAC_STATUS_SUCCESS;
+	}
+
+	curve->table = _comac_malloc_ab (count, sizeof (float));
+	if (unlikely (curve->table == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+	curve->num_entries = count;
+	for (i = 0; i < count; i++)
+	    curve->table[i] = _read_u16 (data + offset + 12 + 2 * i) / 65535.;
+
+	return COMAC_STATUS_SUCCESS;
+    }
+
+    if (type == ICC_SIG ('p', 'a', 'r', 'a')) {
+	curve->function = _read_u16 (data + offset + 8);
+	if (curve->function >= ARRAY_LENGTH (num_params))
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	count = num_params[curve->function];
+	if (length - offset - 12 < 4 * count)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	for (i = 0; i < count; i++)
+	    curve->params[i] = _read_s15fixed16 (data + offset + 12 + 4 * i);
+
+	/* Avoid dividing by zero at the break point */
+	if ((curve->function == 1 || curve->function == 2) &&
+	    curve->params[1] == 0.)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	*size = 12 + 4 * count;
+	return COMAC_STATUS_SUCCESS;
+    }
+
+    return _comac_error (COMAC_STATUS_READ_ERROR);
+}
+
+/* Reads the input or output tables of a lut8Type or lut16Type */
+static comac_status_t
+_comac_icc_read_table_curve (const unsigned char *p,
+			     int num_entries,
+			     int bytes,
+			     comac_icc_curve_t *curve)
+{
+    int i;
+
+    memset (curve, 0, sizeof (comac_icc_curve_t));
+    curve->table = _comac_malloc_ab (num_entries, sizeof (float));
+    if (unlikely (curve->table == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    curve->num_entries = num_entries;
+    for (i = 0; i < num_entries; i++) {
+	if (bytes == 1)
+	    curve->table[i] = p[i] / 255.;
+	else
+	    curve->table[i] = _read_u16 (p + 2 * i) / 65535.;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Tabulates the inverse of @curve, which must be monotonic */
+static float *
+_comac_icc_curve_invert (const comac_icc_curve_t *curve)
+{
+    comac_bool_t increasing;
+    float *table;
+    int i, j;
+
+    table = _comac_malloc_ab (ICC_INVERSE_CURVE_SIZE, sizeof (float));
+    if (unlikely (table == NULL))
+	return NULL;
+
+    increasing =
+	_comac_icc_curve_eval (curve, 1.) >= _comac_icc_curve_eval (curve, 0.);
+    for (i = 0; i < ICC_INVERSE_CURVE_SIZE; i++) {
+	double y = i / (double) (ICC_INVERSE_CURVE_SIZE - 1);
+	double lo = 0., hi = 1.;
+
+	for (j = 0; j < 24; j++) {
+	    double mid = (lo + hi) / 2;
+
+	    if ((_comac_icc_curve_eval (curve, mid) < y) == increasing)
+		lo = mid;
+	    else
+		hi = mid;
+	}
+	table[i] = (lo + hi) / 2;
+    }
+
+    return table;
+}
+
+static double
+_comac_icc_inverse_eval (const float *table, double y)
+{
+    double pos = _clamp (y) * (ICC_INVERSE_CURVE_SIZE - 1);
+    int i = pos;
+
+    if (i >= ICC_INVERSE_CURVE_SIZE - 1)
+	return table[ICC_INVERSE_CURVE_SIZE - 1];
+
+    return table[i] + (pos - i) * (table[i + 1] - table[i]);
+}
+
+/* Luts */
+
+static void
+_comac_icc_lut_destroy (comac_icc_lut_t *lut)
+{
+    int i;
+
+    if (lut == NULL)
+	return;
+
+    for (i = 0; i < lut->num_a_curves; i++)
+	_comac_icc_curve_fini (&lut->a_curves[i]);
+    for (i = 0; i < lut->num_m_curves; i++)
+	_comac_icc_curve_fini (&lut->m_curves[i]);
+    for (i = 0; i < lut->num_b_curves; i++)
+	_comac_icc_curve_fini (&lut->b_curves[i]);
+    free (lut->clut);
+    free (lut);
+}
+
+/* Returns the number of entries in the color table of @lut, or 0 if it
+ * would be unreasonably large. */
+static uint32_t
+_comac_icc_clut_size (const comac_icc_lut_t *lut)
+{
+    uint32_t size = lut->num_outputs;
+    int i;
+
+    for (i = 0; i < lut->num_inputs; i++) {
+	if (lut->grid[i] < 2 || size > (1 << 24) / lut->grid[i])
+	    return 0;
+	size *= lut->grid[i];
+    }
+
+    return size;
+}
+
+static comac_status_t
+_comac_icc_read_clut (const unsigned char *p,
+		      uint32_t available,
+		      int bytes,
+		      comac_icc_lut_t *lut)
+{
+    uint32_t size, i;
+
+    size = _comac_icc_clut_size (lut);
+    if (size == 0 || size > available / bytes)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    lut->clut = _comac_malloc_ab (size, sizeof (float));
+    if (unlikely (lut->clut == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    for (i = 0; i < size; i++) {
+	if (bytes == 1)
+	    lut->clut[i] = p[i] / 255.;
+	else
+	    lut->clut[i] = _read_u16 (p + 2 * i) / 65535.;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_comac_icc_read_mft (const unsigned char *data,
+		     uint32_t length,
+		     comac_icc_lut_t *lut)
+{
+    comac_bool_t is_lut16 = _read_u32 (data) == ICC_SIG ('m', 'f', 't', '2');
+    int bytes = is_lut16 ? 2 : 1;
+    uint32_t num_in_entries = 256, num_out_entries = 256;
+    uint32_t pos, clut_size;
+    comac_status_t status;
+    int i;
+
+    if (length < 48)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    lut->type = ICC_LUT_MFT;
+    lut->num_inputs = data[8];
+    lut->num_outputs = data[9];
+    if (lut->num_inputs < 1 || lut->num_inputs > ICC_MAX_CHANNELS ||
+	lut->num_outputs < 1 || lut->num_outputs > ICC_MAX_CHANNELS)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    for (i = 0; i < lut->num_inputs; i++)
+	lut->grid[i] = data[10];
+
+    /* The matrix is only used with XYZ input, which is always three
+     * channels, and is commonly the identity anyway */
+    for (i = 0; i < 9; i++)
+	lut->matrix[i] = _read_s15fixed16 (data + 12 + 4 * i);
+    lut->has_matrix = lut->num_inputs == 3;
+
+    pos = 48;
+    if (is_lut16) {
+	if (length < 52)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	num_in_entries = _read_u16 (data + 48);
+	num_out_entries = _read_u16 (data + 50);
+	if (num_in_entries < 2 || num_out_entries < 2)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	pos = 52;
+    }
+
+    if ((length - pos) / bytes / num_in_entries < (uint32_t) lut->num_inputs)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+    for (i = 0; i < lut->num_inputs; i++) {
+	status = _comac_icc_read_table_curve (data + pos,
+					      num_in_entries,
+					      bytes,
+					      &lut->a_curves[i]);
+	lut->num_a_curves = i + 1;
+	if (unlikely (status))
+	    return status;
+	pos += num_in_entries * bytes;
+    }
+
+    status = _comac_icc_read_clut (data + pos, length - pos, bytes, lut);
+    if (unlikely (status))
+	return status;
+    clut_size = _comac_icc_clut_size (lut);
+    pos += clut_size * bytes;
+
+    if ((length - pos) / bytes / num_out_entries < (uint32_t) lut->num_outputs)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+    for (i = 0; i < lut->num_outputs; i++) {
+	status = _comac_icc_read_table_curve (data + pos,
+					      num_out_entries,
+					      bytes,
+					      &lut->b_curves[i]);
+	lut->num_b_curves = i + 1;
+	if (unlikely (status))
+	    return status;
+	pos += num_out_entries * bytes;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_comac_icc_read_curves (const unsigned char *data,
+			uint32_t length,
+			uint32_t offset,
+			int count,
+			comac_icc_curve_t *curves,
+			int *num_curves)
+{
+    comac_status_t status;
+    uint32_t size;
+    int i;
+
+    for (i = 0; i < count; i++) {
+	status =
+	    _comac_icc_read_curve (data, length, offset, &curves[i], &size);
+	if (unlikely (status))
+	    return status;
+	*num_curves = i + 1;
+	offset += size;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_comac_icc_read_mab (const unsigned char *data,
+		     uint32_t length,
+		     comac_icc_lut_t *lut)
+{
+    uint32_t b, matrix, m, clut, a;
+    int num_pcs, num_device;
+    comac_status_t status;
+    int i;
+
+    if (length < 32)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    lut->type = _read_u32 (data) == ICC_SIG ('m', 'A', 'B', ' ')
+		    ? ICC_LUT_A_TO_B
+		    : ICC_LUT_B_TO_A;
+    lut->num_inputs = data[8];
+    lut->num_outputs = data[9];
+    if (lut->num_inputs < 1 || lut->num_inputs > ICC_MAX_CHANNELS ||
+	lut->num_outputs < 1 || lut->num_outputs > ICC_MAX_CHANNELS)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    b = _read_u32 (data + 12);
+    matrix = _read_u32 (data + 16);
+    m = _read_u32 (data + 20);
+    clut = _read_u32 (data + 24);
+    a = _read_u32 (data + 28);
+
+    if (lut->type == ICC_LUT_A_TO_B) {
+	num_device = lut->num_inputs;
+	num_pcs = lut->num_outputs;
+    } else {
+	num_device = lut->num_outputs;
+	num_pcs = lut->num_inputs;
+    }
+
+    /* Without a color table both sides have the same channels */
+    if (b == 0 || num_pcs != 3 || (clut == 0 && num_device != num_pcs))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    status = _comac_icc_read_curves (data,
+				     length,
+				     b,
+				     num_pcs,
+				     lut->b_curves,
+				     &lut->num_b_curves);
+    if (unlikely (status))
+	return status;
+
+    if (m != 0) {
+	status = _comac_icc_read_curves (data,
+					 length,
+					 m,
+					 num_pcs,
+					 lut->m_curves,
+					 &lut->num_m_curves);
+	if (unlikely (status))
+	    return status;
+    }
+
+    if (a != 0) {
+	status = _comac_icc_read_curves (data,
+					 length,
+					 a,
+					 num_device,
+					 lut->a_curves,
+					 &lut->num_a_curves);
+	if (unlikely (status))
+	    return status;
+    }
+
+    if (matrix != 0) {
+	if (matrix > length || length - matrix < 48)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	for (i = 0; i < 12; i++)
+	    lut->matrix[i] = _read_s15fixed16 (data + matrix + 4 * i);
+	lut->has_matrix = TRUE;
+    }
+
+    if (clut != 0) {
+	if (clut > length || length - clut < 20)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	for (i = 0; i < lut->num_inputs; i++)
+	    lut->grid[i] = data[clut + i];
+	if (data[clut + 16] != 1 && data[clut + 16] != 2)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	status = _comac_icc_read_clut (data + clut + 20,
+				       length - clut - 20,
+				       data[clut + 16],
+				       lut);
+	if (unlikely (status))
+	    return status;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+_comac_icc_apply_curves (const comac_icc_curve_t *curves,
+			 int num_curves,
+			 double *v)
+{
+    int i;
+
+    for (i = 0; i < num_curves; i++)
+	v[i] = _comac_icc_curve_eval (&curves[i], v[i]);
+}
+
+static void
+_comac_icc_apply_matrix (const double *matrix,
+			 comac_bool_t has_offset,
+			 double *v)
+{
+    double r[3];
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	r[i] = matrix[3 * i] * v[0] + matrix[3 * i + 1] * v[1] +
+	       matrix[3 * i + 2] * v[2];
+	if (has_offset)
+	    r[i] += matrix[9 + i];
+    }
+
+    for (i = 0; i < 3; i++)
+	v[i] = _clamp (r[i]);
+}
+
+/* Multilinear interpolation in the color table of a profile. This is
+ * only used to sample the profile, so it favours being simple. */
+static void
+_comac_icc_clut_eval (const comac_icc_lut_t *lut, double *v)
+{
+    int base[ICC_MAX_CHANNELS], stride[ICC_MAX_CHANNELS];
+    double frac[ICC_MAX_CHANNELS], out[ICC_MAX_CHANNELS];
+    int n = lut->num_inputs;
+    int corner, i, o;
+
+    stride[n - 1] = lut->num_outputs;
+    for (i = n - 2; i >= 0; i--)
+	stride[i] = stride[i + 1] * lut->grid[i + 1];
+
+    for (i = 0; i < n; i++) {
+	double pos = _clamp (v[i]) * (lut->grid[i] - 1);
+
+	base[i] = pos;
+	if (base[i] >= lut->grid[i] - 1)
+	    base[i] = lut->grid[i] - 2;
+	frac[i] = pos - base[i];
+    }
+
+    for (o = 0; o < lut->num_outputs; o++)
+	out[o] = 0.;
+
+    for (corner = 0; corner < 1 << n; corner++) {
+	double weight = 1.;
+	int index = 0;
+
+	for (i = 0; i < n; i++) {
+	    if (corner & (1 << i)) {
+		weight *= frac[i];
+		index += (base[i] + 1) * stride[i];
+	    } else {
+		weight *= 1. - frac[i];
+		index += base[i] * stride[i];
+	    }
+	}
+
+	if (weight == 0.)
+	    continue;
+
+	for (o = 0; o < lut->num_outputs; o++)
+	    out[o] += weight * lut->clut[index + o];
+    }
+
+    for (o = 0; o < lut->num_outputs; o++)
+	v[o] = out[o];
+}
+
+/* Evaluates @lut in place on @v, which has room for ICC_MAX_CHANNELS */
+static void
+_comac_icc_lut_eval (const comac_icc_lut_t *lut, double *v)
+{
+    int i;
+
+    for (i = 0; i < lut->num_inputs; i++)
+	v[i] = _clamp (v[i]);
+
+    switch (lut->type) {
+    case ICC_LUT_MFT:
+	if (lut->has_matrix)
+	    _comac_icc_apply_matrix (lut->matrix, FALSE, v);
+	_comac_icc_apply_curves (lut->a_curves, lut->num_a_curves, v);
+	_comac_icc_clut_eval (lut, v);
+	_comac_icc_apply_curves (lut->b_curves, lut->num_b_curves, v);
+	break;
+
+    case ICC_LUT_A_TO_B:
+	_comac_icc_apply_curves (lut->a_curves, lut->num_a_curves, v);
+	if (lut->clut)
+	    _comac_icc_clut_eval (lut, v);
+	_comac_icc_apply_curves (lut->m_curves, lut->num_m_curves, v);
+	if (lut->has_matrix)
+	    _comac_icc_apply_matrix (lut->matrix, TRUE, v);
+	_comac_icc_apply_curves (lut->b_curves, lut->num_b_curves, v);
+	break;
+
+    case ICC_LUT_B_TO_A:
+	_comac_icc_apply_curves (lut->b_curves, lut->num_b_curves, v);
+	if (lut->has_matrix)
+	    _comac_icc_apply_matrix (lut->matrix, TRUE, v);
+	_comac_icc_apply_curves (lut->m_curves, lut->num_m_curves, v);
+	if (lut->clut)
+	    _comac_icc_clut_eval (lut, v);
+	_comac_icc_apply_curves (lut->a_curves, lut->num_a_curves, v);
+	break;
+    }
+
+    for (i = 0; i < lut->num_outputs; i++)
+	v[i] = _clamp (v[i]);
+}
+
+/* Profiles */
+
+static void
+_comac_icc_profile_destroy (comac_icc_profile_t *profile)
+{
+    int i;
+
+    if (profile == NULL)
+	return;
+
+    for (i = 0; i < 3; i++) {
+	_comac_icc_curve_fini (&profile->trc[i]);
+	free (profile->inverse_trc[i]);
+	_comac_icc_lut_destroy (profile->a_to_b[i]);
+	_comac_icc_lut_destroy (profile->b_to_a[i]);
+    }
+    free (profile);
+}
+
+static comac_bool_t
+_invert_matrix (const double *m, double *inverse)
+{
+    double det;
+
+    det = m[0] * (m[4] * m[8] - m[5] * m[7]) -
+	  m[1] * (m[3] * m[8] - m[5] * m[6]) +
+	  m[2] * (m[3] * m[7] - m[4] * m[6]);
+    if (fabs (det) < 1e-9)
+	return FALSE;
+
+    inverse[0] = (m[4] * m[8] - m[5] * m[7]) / det;
+    inverse[1] = (m[2] * m[7] - m[1] * m[8]) / det;
+    inverse[2] = (m[1] * m[5] - m[2] * m[4]) / det;
+    inverse[3] = (m[5] * m[6] - m[3] * m[8]) / det;
+    inverse[4] = (m[0] * m[8] - m[2] * m[6]) / det;
+    inverse[5] = (m[2] * m[3] - m[0] * m[5]) / det;
+    inverse[6] = (m[3] * m[7] - m[4] * m[6]) / det;
+    inverse[7] = (m[1] * m[6] - m[0] * m[7]) / det;
+    inverse[8] = (m[0] * m[4] - m[1] * m[3]) / det;
+
+    return TRUE;
+}
+
+/* Computes the inverses of the matrix and curves of @profile */
+static comac_status_t
+_comac_icc_profile_init_trc (comac_icc_profile_t *profile)
+{
+    int i, num_curves;
+
+    num_curves = profile->colorspace == COMAC_COLORSPACE_RGB ? 3 : 1;
+    if (num_curves == 3 && ! _invert_matrix (profile->matrix, profile->inverse))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    for (i = 0; i < num_curves; i++) {
+	profile->inverse_trc[i] = _comac_icc_curve_invert (&profile->trc[i]);
+	if (unlikely (profile->inverse_trc[i] == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    profile->has_trc = TRUE;
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Finds the tag @sig and returns its data and length */
+static const unsigned char *
+_comac_icc_find_tag (const unsigned char *data,
+		     uint32_t length,
+		     uint32_t sig,
+		     uint32_t *tag_length)
+{
+    uint32_t count, i;
+
+    count = _read_u32 (data + ICC_HEADER_SIZE);
+    if (count > (length - ICC_HEADER_SIZE - 4) / 12)
+	return NULL;
+
+    for (i = 0; i < count; i++) {
+	const unsigned char *entry = data + ICC_HEADER_SIZE + 4 + 12 * i;
+	uint32_t offset, size;
+
+	if (_read_u32 (entry) != sig)
+	    continue;
+
+	offset = _read_u32 (entry + 4);
+	size = _read_u32 (entry + 8);
+	if (offset > length || size > length - offset || size < 12)
+	    return NULL;
+
+	*tag_length = size;
+	return data + offset;
+    }
+
+    return NULL;
+}
+
+static comac_status_t
+_comac_icc_read_xyz_tag (const unsigned char *data,
+			 uint32_t length,
+			 uint32_t sig,
+			 double *xyz)
+{
+    const unsigned char *tag;
+    uint32_t tag_length;
+    int i;
+
+    tag = _comac_icc_find_tag (data, length, sig, &tag_length);
+    if (tag == NULL || tag_length < 20 ||
+	_read_u32 (tag) != ICC_SIG ('X', 'Y', 'Z', ' '))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    for (i = 0; i < 3; i++)
+	xyz[i] = _read_s15fixed16 (tag + 8 + 4 * i);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_comac_icc_read_curve_tag (const unsigned char *data,
+			   uint32_t length,
+			   uint32_t sig,
+			   comac_icc_curve_t *curve)
+{
+    const unsigned char *tag;
+    uint32_t tag_length, size;
+
+    tag = _comac_icc_find_tag (data, length, sig, &tag_length);
+    if (tag == NULL)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    return _comac_icc_read_curve (tag, tag_length, 0, curve, &size);
+}
+
+static comac_status_t
+_comac_icc_read_lut_tag (const unsigned char *data,
+			 uint32_t length,
+			 uint32_t sig,
+			 comac_icc_lut_t **lut_out)
+{
+    const unsigned char *tag;
+    uint32_t tag_length, type;
+    comac_icc_lut_t *lut;
+    comac_status_t status;
+
+    *lut_out = NULL;
+    tag = _comac_icc_find_tag (data, length, sig, &tag_length);
+    if (tag == NULL)
+	return COMAC_STATUS_SUCCESS;
+
+    lut = calloc (1, sizeof (comac_icc_lut_t));
+    if (unlikely (lut == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    type = _read_u32 (tag);
+    if (type == ICC_SIG ('m', 'f', 't', '1') ||
+	type == ICC_SIG ('m', 'f', 't', '2')) {
+	status = _comac_icc_read_mft (tag, tag_length, lut);
+	lut->legacy_lab = type == ICC_SIG ('m', 'f', 't', '2');
+    } else if (type == ICC_SIG ('m', 'A', 'B', ' ') ||
+	       type == ICC_SIG ('m', 'B', 'A', ' ')) {
+	status = _comac_icc_read_mab (tag, tag_length, lut);
+    } else {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+    }
+
+    if (unlikely (status)) {
+	_comac_icc_lut_destroy (lut);
+	return status;
+    }
+
+    *lut_out = lut;
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_comac_icc_profile_create (const unsigned char *data,
+			   unsigned long data_length,
+			   comac_colorspace_t colorspace,
+			   comac_icc_profile_t **profile_out)
+{
+    static const uint32_t a_to_b_sigs[3] = {ICC_SIG ('A', '2', 'B', '0'),
+					    ICC_SIG ('A', '2', 'B', '1'),
+					    ICC_SIG ('A', '2', 'B', '2')};
+    static const uint32_t b_to_a_sigs[3] = {ICC_SIG ('B', '2', 'A', '0'),
+					    ICC_SIG ('B', '2', 'A', '1'),
+					    ICC_SIG ('B', '2', 'A', '2')};
+    static const uint32_t colorspace_sigs[COMAC_COLORSPACE_NUM_COLORSPACES] = {
+	ICC_SIG ('R', 'G', 'B', ' '),
+	ICC_SIG ('G', 'R', 'A', 'Y'),
+	ICC_SIG ('C', 'M', 'Y', 'K')};
+    comac_icc_profile_t *profile;
+    comac_status_t status;
+    uint32_t length, pcs, channels;
+    int i;
+
+    if (data_length < ICC_HEADER_SIZE + 4 ||
+	_read_u32 (data + 36) != ICC_SIG ('a', 'c', 's', 'p'))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    length = _read_u32 (data);
+    if (length > data_length || length < ICC_HEADER_SIZE + 4)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    pcs = _read_u32 (data + 20);
+    if (_read_u32 (data + 16) != colorspace_sigs[colorspace] ||
+	(pcs != ICC_SIG ('X', 'Y', 'Z', ' ') &&
+	 pcs != ICC_SIG ('L', 'a', 'b', ' ')))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    profile = calloc (1, sizeof (comac_icc_profile_t));
+    if (unlikely (profile == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    profile->colorspace = colorspace;
+    profile->pcs_is_lab = pcs == ICC_SIG ('L', 'a', 'b', ' ');
+    if (_comac_icc_read_xyz_tag (data,
+				 length,
+				 ICC_SIG ('w', 't', 'p', 't'),
+				 profile->white))
+	memcpy (profile->white, d50, sizeof (d50));
+
+    channels = _comac_colorspace_num_components (colorspace);
+    for (i = 0; i < 3; i++) {
+	status = _comac_icc_read_lut_tag (data,
+					  length,
+					  a_to_b_sigs[i],
+					  &profile->a_to_b[i]);
+	if (unlikely (status))
+	    goto FAIL;
+	status = _comac_icc_read_lut_tag (data,
+					  length,
+					  b_to_a_sigs[i],
+					  &profile->b_to_a[i]);
+	if (unlikely (status))
+	    goto FAIL;
+
+	if ((profile->a_to_b[i] &&
+	     (profile->a_to_b[i]->num_inputs != (int) channels ||
+	      profile->a_to_b[i]->num_outputs != 3)) ||
+	    (profile->b_to_a[i] &&
+	     (profile->b_to_a[i]->num_inputs != 3 ||
+	      profile->b_to_a[i]->num_outputs != (int) channels))) {
+	    status = _comac_error (COMAC_STATUS_READ_ERROR);
+	    goto FAIL;
+	}
+    }
+
+    if (profile->a_to_b[0] && profile->b_to_a[0]) {
+	*profile_out = profile;
+	return COMAC_STATUS_SUCCESS;
+    }
+
+    /* Without tables in both directions there have to be curves */
+    if (colorspace == COMAC_COLORSPACE_RGB && ! profile->pcs_is_lab) {
+	static const uint32_t trc_sigs[3] = {ICC_SIG ('r', 'T', 'R', 'C'),
+					     ICC_SIG ('g', 'T', 'R', 'C'),
+					     ICC_SIG ('b', 'T', 'R', 'C')};
+	static const uint32_t xyz_sigs[3] = {ICC_SIG ('r', 'X', 'Y', 'Z'),
+					     ICC_SIG ('g', 'X', 'Y', 'Z'),
+					     ICC_SIG ('b', 'X', 'Y', 'Z')};
+
+	for (i = 0; i < 3; i++) {
+	    double xyz[3];
+
+	    status = _comac_icc_read_curve_tag (data,
+						length,
+						trc_sigs[i],
+						&profile->trc[i]);
+	    if (unlikely (status))
+		goto FAIL;
+
+	    status = _comac_icc_read_xyz_tag (data, length, xyz_sigs[i], xyz);
+	    if (unlikely (status))
+		goto FAIL;
+
+	    /* The primaries are the columns of the matrix */
+	    profile->matrix[i] = xyz[0];
+	    profile->matrix[3 + i] = xyz[1];
+	    profile->matrix[6 + i] = xyz[2];
+	}
+    } else if (colorspace == COMAC_COLORSPACE_GRAY) {
+	status = _comac_icc_read_curve_tag (data,
+					    length,
+					    ICC_SIG ('k', 'T', 'R', 'C'),
+					    &profile->trc[0]);
+	if (unlikely (status))
+	    goto FAIL;
+    } else {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+	goto FAIL;
+    }
+
+    status = _comac_icc_profile_init_trc (profile);
+    if (unlikely (status))
+	goto FAIL;
+
+    *profile_out = profile;
+    return COMAC_STATUS_SUCCESS;
+
+FAIL:
+    _comac_icc_profile_destroy (profile);
+    return status;
+}
+
+/* The sRGB tone curve, as an ICC parametric curve */
+static void
+_comac_icc_curve_init_srgb (comac_icc_curve_t *curve)
+{
+    memset (curve, 0, sizeof (comac_icc_curve_t));
+    curve->function = 3;
+    curve->params[0] = 2.4;
+    curve->params[1] = 1. / 1.055;
+    curve->params[2] = 0.055 / 1.055;
+    curve->params[3] = 1. / 12.92;
+    curve->params[4] = 0.04045;
+}
+
+static comac_status_t
+_comac_icc_profile_create_srgb (comac_colorspace_t colorspace,
+				comac_icc_profile_t **profile_out)
+{
+    /* The sRGB primaries adapted to D50, as in the ICC sRGB profiles */
+    static const double srgb[9] = {0.4361,
+				   0.3851,
+				   0.1431,
+				   0.2225,
+				   0.7169,
+				   0.0606,
+				   0.0139,
+				   0.0971,
+				   0.7141};
+    comac_icc_profile_t *profile;
+    comac_status_t status;
+    int i;
+
+    profile = calloc (1, sizeof (comac_icc_profile_t));
+    if (unlikely (profile == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    profile->colorspace = colorspace;
+    memcpy (profile->white, d50, sizeof (d50));
+    memcpy (profile->matrix, srgb, sizeof (srgb));
+    for (i = 0; i < 3; i++)
+	_comac_icc_curve_init_srgb (&profile->trc[i]);
+
+    status = _comac_icc_profile_init_trc (profile);
+    if (unlikely (status)) {
+	_comac_icc_profile_destroy (profile);
+	return status;
+    }
+
+    *profile_out = profile;
+    return COMAC_STATUS_SUCCESS;
+}
+
+static double
+_lab_f (double t)
+{
+    if (t > 216. / 24389.)
+	return cbrt (t);
+    return (24389. / 27. * t + 16.) / 116.;
+}
+
+static double
+_lab_f_inverse (double t)
+{
+    if (t > 6. / 29.)
+	return t * t * t;
+    return (116. * t - 16.) * 27. / 24389.;
+}
+
+/* Decodes the PCS values of a table of @profile to XYZ */
+static void
+_comac_icc_pcs_to_xyz (const comac_icc_profile_t *profile,
+		       const comac_icc_lut_t *lut,
+		       const double *pcs,
+		       double *xyz)
+{
+    double v[3], fx, fy, fz;
+    int i;
+
+    if (! profile->pcs_is_lab) {
+	for (i = 0; i < 3; i++)
+	    xyz[i] = pcs[i] * 65535. / 32768.;
+	return;
+    }
+
+    for (i = 0; i < 3; i++)
+	v[i] = lut->legacy_lab ? pcs[i] * 65535. / 65280. : pcs[i];
+
+    fy = (v[0] * 100. + 16.) / 116.;
+    fx = fy + (v[1] * 255. - 128.) / 500.;
+    fz = fy - (v[2] * 255. - 128.) / 200.;
+    xyz[0] = d50[0] * _lab_f_inverse (fx);
+    xyz[1] = d50[1] * _lab_f_inverse (fy);
+    xyz[2] = d50[2] * _lab_f_inverse (fz);
+}
+
+static void
+_comac_icc_xyz_to_pcs (const comac_icc_profile_t *profile,
+		       const comac_icc_lut_t *lut,
+		       const double *xyz,
+		       double *pcs)
+{
+    double fx, fy, fz;
+    int i;
+
+    if (! profile->pcs_is_lab) {
+	for (i = 0; i < 3; i++)
+	    pcs[i] = _clamp (xyz[i] * 32768. / 65535.);
+	return;
+    }
+
+    fx = _lab_f (xyz[0] / d50[0]);
+    fy = _lab_f (xyz[1] / d50[1]);
+    fz = _lab_f (xyz[2] / d50[2]);
+    pcs[0] = (116. * fy - 16.) / 100.;
+    pcs[1] = (500. * (fx - fy) + 128.) / 255.;
+    pcs[2] = (200. * (fy - fz) + 128.) / 255.;
+    for (i = 0; i < 3; i++) {
+	if (lut->legacy_lab)
+	    pcs[i] *= 65280. / 65535.;
+	pcs[i] = _clamp (pcs[i]);
+    }
+}
+
+static int
+_comac_icc_intent_index (comac_rendering_intent_t intent)
+{
+    switch (intent) {
+    case COMAC_RENDERING_INTENT_PERCEPTUAL:
+	return 0;
+    case COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC:
+    case COMAC_RENDERING_INTENT_ABSOLUTE_COLORIMETRIC:
+	return 1;
+    case COMAC_RENDERING_INTENT_SATURATION:
+	return 2;
+    }
+
+    return 0;
+}
+
+static void
+_comac_icc_device_to_xyz (const comac_icc_profile_t *profile,
+			  comac_rendering_intent_t intent,
+			  const double *in,
+			  double *xyz)
+{
+    int index = _comac_icc_intent_index (intent);
+    const comac_icc_lut_t *lut;
+    double v[ICC_MAX_CHANNELS];
+    int i;
+
+    lut = profile->a_to_b[index] ? profile->a_to_b[index] : profile->a_to_b[0];
+    if (lut != NULL) {
+	memcpy (v, in, lut->num_inputs * sizeof (double));
+	_comac_icc_lut_eval (lut, v);
+	_comac_icc_pcs_to_xyz (profile, lut, v, xyz);
+    } else if (profile->colorspace == COMAC_COLORSPACE_RGB) {
+	for (i = 0; i < 3; i++)
+	    v[i] = _comac_icc_curve_eval (&profile->trc[i], in[i]);
+	for (i = 0; i < 3; i++) {
+	    xyz[i] = profile->matrix[3 * i] * v[0] +
+		     profile->matrix[3 * i + 1] * v[1] +
+		     profile->matrix[3 * i + 2] * v[2];
+	}
+    } else {
+	double y = _comac_icc_curve_eval (&profile->trc[0], in[0]);
+
+	for (i = 0; i < 3; i++)
+	    xyz[i] = d50[i] * y;
+    }
+
+    /* Absolute colorimetry keeps the white of the medium */
+    if (intent == COMAC_RENDERING_INTENT_ABSOLUTE_COLORIMETRIC) {
+	for (i = 0; i < 3; i++)
+	    xyz[i] *= profile->white[i] / d50[i];
+    }
+}
+
+static void
+_comac_icc_xyz_to_device (const comac_icc_profile_t *profile,
+			  comac_rendering_intent_t intent,
+			  const double *in,
+			  double *out)
+{
+    int index = _comac_icc_intent_index (intent);
+    const comac_icc_lut_t *lut;
+    double xyz[3], v[ICC_MAX_CHANNELS];
+    int i;
+
+    memcpy (xyz, in, sizeof (xyz));
+    if (intent == COMAC_RENDERING_INTENT_ABSOLUTE_COLORIMETRIC) {
+	for (i = 0; i < 3; i++)
+	    xyz[i] *= d50[i] / profile->white[i];
+    }
+
+    lut = profile->b_to_a[index] ? profile->b_to_a[index] : profile->b_to_a[0];
+    if (lut != NULL) {
+	_comac_icc_xyz_to_pcs (profile, lut, xyz, v);
+	_comac_icc_lut_eval (lut, v);
+	memcpy (out, v, lut->num_outputs * sizeof (double));
+    } else if (profile->colorspace == COMAC_COLORSPACE_RGB) {
+	for (i = 0; i < 3; i++) {
+	    v[i] = profile->inverse[3 * i] * xyz[0] +
+		   profile->inverse[3 * i + 1] * xyz[1] +
+		   profile->inverse[3 * i + 2] * xyz[2];
+	    out[i] = _comac_icc_inverse_eval (profile->inverse_trc[i], v[i]);
+	}
+    } else {
+	out[0] = _comac_icc_inverse_eval (profile->inverse_trc[0], xyz[1]);
+    }
+}
+
+/* Color luts */
+
+static int
+_comac_color_lut_grid (comac_colorspace_t colorspace)
+{
+    switch (colorspace) {
+    case COMAC_COLORSPACE_GRAY:
+	return 256;
+    case COMAC_COLORSPACE_RGB:
+	return 33;
+    case COMAC_COLORSPACE_CMYK:
+	return 17;
+    case COMAC_COLORSPACE_NUM_COLORSPACES:
+	break;
+    }
+
+    ASSERT_NOT_REACHED;
+    return 0;
+}
+
+static comac_color_lut_t *
+_comac_color_lut_create (const comac_icc_profile_t *from,
+			 const comac_icc_profile_t *to,
+			 comac_rendering_intent_t intent)
+{
+    comac_color_lut_t *lut;
+    int num_inputs, num_outputs, grid, num_points, i, j;
+
+    num_inputs = _comac_colorspace_num_components (from->colorspace);
+    num_outputs = _comac_colorspace_num_components (to->colorspace);
+    grid = _comac_color_lut_grid (from->colorspace);
+
+    num_points = 1;
+    for (i = 0; i < num_inputs; i++)
+	num_points *= grid;
+
+    lut = _comac_malloc_ab_plus_c (num_points * num_outputs,
+				   sizeof (float),
+				   sizeof (comac_color_lut_t));
+    if (unlikely (lut == NULL))
+	return NULL;
+
+    lut->num_inputs = num_inputs;
+    lut->num_outputs = num_outputs;
+    lut->grid = grid;
+
+    /* The last input varies fastest, except that black is the slowest
+     * for CMYK so that each value of black is a 3D table of its own */
+    for (i = 0; i < num_points; i++) {
+	double in[ICC_MAX_CHANNELS], xyz[3], out[ICC_MAX_CHANNELS];
+	int index = i;
+
+	for (j = num_inputs - 1; j >= 0; j--) {
+	    int channel = num_inputs == 4 ? (j + 3) % 4 : j;
+
+	    in[channel] = (index % grid) / (double) (grid - 1);
+	    index /= grid;
+	}
+
+	_comac_icc_device_to_xyz (from, intent, in, xyz);
+	_comac_icc_xyz_to_device (to, intent, xyz, out);
+	for (j = 0; j < num_outputs; j++)
+	    lut->table[i * num_outputs + j] = _clamp (out[j]);
+    }
+
+    return lut;
+}
+
+static void
+_comac_color_lut_eval_1d (const comac_color_lut_t *lut,
+			  const float *in,
+			  float *out)
+{
+    const float *p;
+    float pos, frac;
+    int i, o;
+
+    pos = _clampf (in[0]) * (lut->grid - 1);
+    i = pos;
+    if (i >= lut->grid - 1)
+	i = lut->grid - 2;
+    frac = pos - i;
+
+    p = lut->table + i * lut->num_outputs;
+    for (o = 0; o < lut->num_outputs; o++)
+	out[o] = p[o] + frac * (p[lut->num_outputs + o] - p[o]);
+}
+
+/* Tetrahedral interpolation in the 3D table at @table. The cube
+ * around the color is split into six tetrahedra along its diagonal and
+ * the color interpolated between the four corners of the one it is
+ * in, which is cheaper and smoother than trilinear interpolation. */
+static void
+_comac_color_lut_eval_tetrahedral (const float *table,
+				   int grid,
+				   int num_outputs,
+				   const float *in,
+				   float *out)
+{
+    const float *c000, *c111, *ca, *cb;
+    int ix, iy, iz, sx, sy, sz, o;
+    float px, py, pz, fx, fy, fz, f1, f2, f3;
+
+    px = _clampf (in[0]) * (grid - 1);
+    py = _clampf (in[1]) * (grid - 1);
+    pz = _clampf (in[2]) * (grid - 1);
+    ix = MIN ((int) px, grid - 2);
+    iy = MIN ((int) py, grid - 2);
+    iz = MIN ((int) pz, grid - 2);
+    fx = px - ix;
+    fy = py - iy;
+    fz = pz - iz;
+
+    sz = num_outputs;
+    sy = sz * grid;
+    sx = sy * grid;
+
+    c000 = table + ix * sx + iy * sy + iz * sz;
+    c111 = c000 + sx + sy + sz;
+
+    /* Walk from c000 to c111 along the edges of the tetrahedron, in
+     * the order of decreasing fractions */
+    if (fx >= fy) {
+	if (fy >= fz) {
+	    ca = c000 + sx;
+	    cb = ca + sy;
+	    f1 = fx, f2 = fy, f3 = fz;
+	} else if (fx >= fz) {
+	    ca = c000 + sx;
+	    cb = ca + sz;
+	    f1 = fx, f2 = fz, f3 = fy;
+	} else {
+	    ca = c000 + sz;
+	    cb = ca + sx;
+	    f1 = fz, f2 = fx, f3 = fy;
+	}
+    } else {
+	if (fz >= fy) {
+	    ca = c000 + sz;
+	    cb = ca + sy;
+	    f1 = fz, f2 = fy, f3 = fx;
+	} else if (fz >= fx) {
+	    ca = c000 + sy;
+	    cb = ca + sz;
+	    f1 = fy, f2 = fz, f3 = fx;
+	} else {
+	    ca = c000 + sy;
+	    cb = ca + sx;
+	    f1 = fy, f2 = fx, f3 = fz;
+	}
+    }
+
+    for (o = 0; o < num_outputs; o++) {
+	out[o] = c000[o] + f1 * (ca[o] - c000[o]) + f2 * (cb[o] - ca[o]) +
+		 f3 * (c111[o] - cb[o]);
+    }
+}
+
+static void
+_comac_color_lut_eval (const comac_color_lut_t *lut,
+		       const float *in,
+		       float *out)
+{
+    float lo[ICC_MAX_CHANNELS], hi[ICC_MAX_CHANNELS];
+    int grid = lut->grid;
+    float pos, frac;
+    int k, o, slice;
+
+    switch (lut->num_inputs) {
+    case 1:
+	_comac_color_lut_eval_1d (lut, in, out);
+	return;
+
+    case 3:
+	_comac_color_lut_eval_tetrahedral (lut->table,
+					   grid,
+					   lut->num_outputs,
+					   in,
+					   out);
+	return;
+
+    case 4:
+	/* Interpolate between the two slices of black */
+	pos = _clampf (in[3]) * (grid - 1);
+	k = MIN ((int) pos, grid - 2);
+	frac = pos - k;
+	slice = grid * grid * grid * lut->num_outputs;
+
+	_comac_color_lut_eval_tetrahedral (lut->table + k * slice,
+					   grid,
+					   lut->num_outputs,
+					   in,
+					   lo);
+	if (frac == 0.f) {
+	    memcpy (out, lo, lut->num_outputs * sizeof (float));
+	    return;
+	}
+	_comac_color_lut_eval_tetrahedral (lut->table + (k + 1) * slice,
+					   grid,
+					   lut->num_outputs,
+					   in,
+					   hi);
+	for (o = 0; o < lut->num_outputs; o++)
+	    out[o] = lo[o] + frac * (hi[o] - lo[o]);
+	return;
+    }
+
+    ASSERT_NOT_REACHED;
+}
+
+/* Engine */
+
+static void
+_comac_color_engine_reset_luts (comac_color_engine_t *engine)
+{
+    int from, to, intent;
+
+    for (from = 0; from < COMAC_COLORSPACE_NUM_COLORSPACES; from++) {
+	for (to = 0; to < COMAC_COLORSPACE_NUM_COLORSPACES; to++) {
+	    for (intent = 0; intent < NUM_INTENTS; intent++) {
+		free (engine->luts[from][to][intent]);
+		engine->luts[from][to][intent] = NULL;
+	    }
+	}
+    }
+}
+
+/**
+ * comac_color_engine_create:
+ *
+ * Creates a color engine that converts RGB as sRGB and gray with the
+ * sRGB tone curve. Use comac_color_engine_set_profile() to use other
+ * profiles or to convert CMYK with a profile. The conversions are
+ * done with comac_color_engine_convert_func() or
+ * comac_color_engine_convert_batch_func(), passing the engine as their
+ * context, for instance as the callbacks of a surface.
+ *
+ * Return value: the new engine, or %NULL if there is not enough
+ * memory. Free it with comac_color_engine_destroy() once no surface
+ * converts colors with it any more.
+ *
+ * Since: TBD
+ **/
+comac_color_engine_t *
+comac_color_engine_create (void)
+{
+    comac_color_engine_t *engine;
+
+    engine = calloc (1, sizeof (comac_color_engine_t));
+    if (unlikely (engine == NULL))
+	return NULL;
+
+    if (_comac_icc_profile_create_srgb (
+	    COMAC_COLORSPACE_RGB,
+	    &engine->profiles[COMAC_COLORSPACE_RGB]) ||
+	_comac_icc_profile_create_srgb (
+	    COMAC_COLORSPACE_GRAY,
+	    &engine->profiles[COMAC_COLORSPACE_GRAY])) {
+	comac_color_engine_destroy (engine);
+	return NULL;
+    }
+
+    return engine;
+}
+
+/**
+ * comac_color_engine_destroy:
+ * @engine: a #comac_color_engine_t
+ *
+ * Frees @engine, its profiles and the tables computed from them.
+ *
+ * Since: TBD
+ **/
+void
+comac_color_engine_destroy (comac_color_engine_t *engine)
+{
+    int i;
+
+    if (engine == NULL)
+	return;
+
+    _comac_color_engine_reset_luts (engine);
+    for (i = 0; i < COMAC_COLORSPACE_NUM_COLORSPACES; i++)
+	_comac_icc_profile_destroy (engine->profiles[i]);
+    free (engine);
+}
+
+/**
+ * comac_color_engine_set_profile:
+ * @engine: a #comac_color_engine_t
+ * @colorspace: the colorspace @data describes
+ * @data: an ICC profile
+ * @length: the length of @data in bytes
+ *
+ * Uses the ICC profile in @data for the colors of @colorspace. Profiles
+ * with a matrix and tone reproduction curves are supported for RGB and
+ * gray, and profiles with lut8, lut16, lutAtoB and lutBtoA tables for
+ * all colorspaces. @data is not needed after this returns.
+ *
+ * This must not be called while colors are being converted with
+ * @engine.
+ *
+ * Return value: %COMAC_STATUS_SUCCESS, %COMAC_STATUS_READ_ERROR if
+ * @data is not a profile of @colorspace that can be used, leaving the
+ * previous profile in place, or %COMAC_STATUS_NO_MEMORY.
+ *
+ * Since: TBD
+ **/
+comac_status_t
+comac_color_engine_set_profile (comac_color_engine_t *engine,
+				comac_colorspace_t colorspace,
+				const unsigned char *data,
+				unsigned long length)
+{
+    comac_icc_profile_t *profile = NULL;
+    comac_status_t status;
+
+    if (colorspace >= COMAC_COLORSPACE_NUM_COLORSPACES)
+	return _comac_error (COMAC_STATUS_INVALID_FORMAT);
+
+    status = _comac_icc_profile_create (data, length, colorspace, &profile);
+    if (unlikely (status))
+	return status;
+
+    _comac_color_engine_reset_luts (engine);
+    _comac_icc_profile_destroy (engine->profiles[colorspace]);
+    engine->profiles[colorspace] = profile;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Returns the table converting @from to @to, computing it on first
+ * use. Surfaces may convert colors from several threads, so the table
+ * is published with a compare and swap rather than under a lock. */
+static const comac_color_lut_t *
+_comac_color_engine_get_lut (comac_color_engine_t *engine,
+			     comac_colorspace_t from,
+			     comac_colorspace_t to,
+			     comac_rendering_intent_t intent)
+{
+    comac_color_lut_t *lut, **slot;
+
+    if (from == to || engine->profiles[from] == NULL ||
+	engine->profiles[to] == NULL || (unsigned) intent >= NUM_INTENTS)
+	return NULL;
+
+    slot = &engine->luts[from][to][intent];
+    lut = _comac_atomic_ptr_get ((void **) slot);
+    if (likely (lut != NULL))
+	return lut;
+
+    lut = _comac_color_lut_create (engine->profiles[from],
+				   engine->profiles[to],
+				   intent);
+    if (unlikely (lut == NULL))
+	return NULL;
+
+    if (! _comac_atomic_ptr_cmpxchg ((void **) slot, NULL, lut)) {
+	free (lut);
+	lut = _comac_atomic_ptr_get ((void **) slot);
+    }
+
+    return lut;
+}
+
+/**
+ * comac_color_engine_convert_func:
+ * @from_colorspace: the colorspace of @from_data
+ * @from_data: the color to convert, followed by its alpha
+ * @to_colorspace: the colorspace to convert to
+ * @to_data: the converted color, followed by its alpha
+ * @intent: the rendering intent
+ * @ctx: a #comac_color_engine_t
+ *
+ * A #comac_color_convert_cb converting with the profiles of the engine
+ * given as @ctx.
+ *
+ * Since: TBD
+ **/
+void
+comac_color_engine_convert_func (comac_colorspace_t from_colorspace,
+				 const double *from_data,
+				 comac_colorspace_t to_colorspace,
+				 double *to_data,
+				 comac_rendering_intent_t intent,
+				 void *ctx)
+{
+    const comac_color_lut_t *lut;
+    float in[ICC_MAX_CHANNELS], out[ICC_MAX_CHANNELS];
+    int i;
+
+    lut = _comac_color_engine_get_lut (ctx,
+				       from_colorspace,
+				       to_colorspace,
+				       intent);
+    if (lut == NULL) {
+	comac_default_color_convert_func (from_colorspace,
+					  from_data,
+					  to_colorspace,
+					  to_data,
+					  intent,
+					  NULL);
+	return;
+    }
+
+    for (i = 0; i < lut->num_inputs; i++)
+	in[i] = from_data[i];
+    _comac_color_lut_eval (lut, in, out);
+    for (i = 0; i < lut->num_outputs; i++)
+	to_data[i] = out[i];
+    to_data[lut->num_outputs] = from_data[lut->num_inputs];
+}
+
+/**
+ * comac_color_engine_convert_batch_func:
+ * @from_colorspace: the colorspace of @from_data
+ * @from_data: the colors to convert
+ * @to_colorspace: the colorspace to convert to
+ * @to_data: the converted colors
+ * @layout: the layout of @from_data and @to_data
+ * @num_colors: the number of colors to convert
+ * @intent: the rendering intent
+ * @ctx: a #comac_color_engine_t
+ *
+ * A #comac_color_convert_batch_cb converting with the profiles of the
+ * engine given as @ctx.
+ *
+ * Since: TBD
+ **/
+void
+comac_color_engine_convert_batch_func (comac_colorspace_t from_colorspace,
+				       const void *from_data,
+				       comac_colorspace_t to_colorspace,
+				       void *to_data,
+				       comac_color_layout_t layout,
+				       unsigned int num_colors,
+				       comac_rendering_intent_t intent,
+				       void *ctx)
+{
+    const comac_color_lut_t *lut;
+    float in[ICC_MAX_CHANNELS + 1], out[ICC_MAX_CHANNELS + 1];
+    unsigned int n;
+    int from_n, to_n, i;
+
+    lut = _comac_color_engine_get_lut (ctx,
+				       from_colorspace,
+				       to_colorspace,
+				       intent);
+    if (lut == NULL) {
+	comac_default_color_convert_batch_func (from_colorspace,
+						from_data,
+						to_colorspace,
+						to_data,
+						layout,
+						num_colors,
+						intent,
+						NULL);
+	return;
+    }
+
+    from_n = lut->num_inputs + 1;
+    to_n = lut->num_outputs + 1;
+
+    switch (layout) {
+    case COMAC_COLOR_LAYOUT_DOUBLE: {
+	const double *src = from_data;
+	double *dst = to_data;
+
+	for (n = 0; n < num_colors; n++, src += from_n, dst += to_n) {
+	    for (i = 0; i < from_n; i++)
+		in[i] = src[i];
+	    _comac_color_lut_eval (lut, in, out);
+	    for (i = 0; i < lut->num_outputs; i++)
+		dst[i] = out[i];
+	    dst[lut->num_outputs] = src[lut->num_inputs];
+	}
+	break;
+    }
+
+    case COMAC_COLOR_LAYOUT_FLOAT: {
+	const float *src = from_data;
+	float *dst = to_data;
+
+	for (n = 0; n < num_colors; n++, src += from_n, dst += to_n) {
+	    _comac_color_lut_eval (lut, src, dst);
+	    dst[lut->num_outputs] = src[lut->num_inputs];
+	}
+	break;
+    }
+
+    case COMAC_COLOR_LAYOUT_U8: {
+	const uint8_t *src = from_data;
+	uint8_t *dst = to_data;
+
+	for (n = 0; n < num_colors; n++, src += from_n, dst += to_n) {
+	    for (i = 0; i < lut->num_inputs; i++)
+		in[i] = src[i] * (1.f / 255.f);
+	    _comac_color_lut_eval (lut, in, out);
+	    for (i = 0; i < lut->num_outputs; i++)
+		dst[i] = out[i] * 255.f + .5f;
+	    dst[lut->num_outputs] = src[lut->num_inputs];
+	}
+	break;
+    }
+    }
+}
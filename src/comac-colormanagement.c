@@ -141,3 +141,269 @@ comac_default_color_convert_func (comac_colorspace_t from_colorspace,
 	abort ();
     }
 }
+
+int
+_comac_colorspace_num_components (comac_colorspace_t colorspace)
+{
+    switch (colorspace) {
+    case COMAC_COLORSPACE_RGB:
+	return 3;
+    case COMAC_COLORSPACE_GRAY:
+	return 1;
+    case COMAC_COLORSPACE_CMYK:
+	return 4;
+    case COMAC_COLORSPACE_NUM_COLORSPACES:
+	break;
+    }
+
+    ASSERT_NOT_REACHED;
+    return 0;
+}
+
+static size_t
+_comac_color_layout_size (comac_color_layout_t layout)
+{
+    switch (layout) {
+    case COMAC_COLOR_LAYOUT_DOUBLE:
+	return sizeof (double);
+    case COMAC_COLOR_LAYOUT_FLOAT:
+	return sizeof (float);
+    case COMAC_COLOR_LAYOUT_U8:
+	return sizeof (uint8_t);
+    }
+
+    ASSERT_NOT_REACHED;
+    return 0;
+}
+
+static void
+_comac_color_load (const void *data,
+		   comac_color_layout_t layout,
+		   unsigned int index,
+		   int n,
+		   double *color)
+{
+    const float *f = (const float *) data + index * n;
+    const uint8_t *u = (const uint8_t *) data + index * n;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (layout == COMAC_COLOR_LAYOUT_FLOAT)
+	    color[i] = f[i];
+	else
+	    color[i] = u[i] / 255.;
+    }
+}
+
+static void
+_comac_color_store (void *data,
+		    comac_color_layout_t layout,
+		    unsigned int index,
+		    int n,
+		    const double *color)
+{
+    float *f = (float *) data + index * n;
+    uint8_t *u = (uint8_t *) data + index * n;
+    int i;
+
+    for (i = 0; i < n; i++) {
+	if (layout == COMAC_COLOR_LAYOUT_FLOAT)
+	    f[i] = color[i];
+	else
+	    u[i] = _comac_restrict_value (color[i], 0., 1.) * 255. + .5;
+    }
+}
+
+/* A direct mapped cache of single color conversions. A color replaces
+ * whatever was in its slot before, which is enough for the handful of
+ * colors a document usually uses. */
+#define COLOR_CACHE_SIZE 256
+
+typedef struct _comac_color_cache_entry {
+    comac_bool_t valid;
+    comac_colorspace_t from_colorspace;
+    comac_colorspace_t to_colorspace;
+    comac_rendering_intent_t intent;
+    double from[5];
+    double to[5];
+} comac_color_cache_entry_t;
+
+struct _comac_color_cache {
+    unsigned int hits;
+    unsigned int misses;
+    comac_color_cache_entry_t entries[COLOR_CACHE_SIZE];
+};
+
+comac_color_cache_t *
+_comac_color_cache_create (void)
+{
+    return calloc (1, sizeof (comac_color_cache_t));
+}
+
+void
+_comac_color_cache_clear (comac_color_cache_t *cache)
+{
+    int i;
+
+    for (i = 0; i < COLOR_CACHE_SIZE; i++)
+	cache->entries[i].valid = FALSE;
+}
+
+static comac_color_cache_entry_t *
+_comac_color_cache_slot (comac_color_cache_t *cache,
+			 comac_colorspace_t from_colorspace,
+			 const double *from_data,
+			 comac_colorspace_t to_colorspace,
+			 comac_rendering_intent_t intent)
+{
+    uintptr_t hash;
+    int n = _comac_colorspace_num_components (from_colorspace) + 1;
+
+    hash = _comac_hash_bytes (_COMAC_HASH_INIT_VALUE,
+			      from_data,
+			      n * sizeof (double));
+    hash = hash * 31 + from_colorspace;
+    hash = hash * 31 + to_colorspace;
+    hash = hash * 31 + intent;
+
+    return &cache->entries[(hash ^ (hash >> 16)) % COLOR_CACHE_SIZE];
+}
+
+comac_bool_t
+_comac_color_cache_lookup (comac_color_cache_t *cache,
+			   comac_colorspace_t from_colorspace,
+			   const double *from_data,
+			   comac_colorspace_t to_colorspace,
+			   comac_rendering_intent_t intent,
+			   double *to_data)
+{
+    comac_color_cache_entry_t *entry;
+    int from_n = _comac_colorspace_num_components (from_colorspace) + 1;
+    int to_n = _comac_colorspace_num_components (to_colorspace) + 1;
+
+    entry = _comac_color_cache_slot (cache,
+				     from_colorspace,
+				     from_data,
+				     to_colorspace,
+				     intent);
+    if (! entry->valid || entry->from_colorspace != from_colorspace ||
+	entry->to_colorspace != to_colorspace || entry->intent != intent ||
+	memcmp (entry->from, from_data, from_n * sizeof (double))) {
+	cache->misses++;
+	return FALSE;
+    }
+
+    memcpy (to_data, entry->to, to_n * sizeof (double));
+    cache->hits++;
+    return TRUE;
+}
+
+void
+_comac_color_cache_insert (comac_color_cache_t *cache,
+			   comac_colorspace_t from_colorspace,
+			   const double *from_data,
+			   comac_colorspace_t to_colorspace,
+			   comac_rendering_intent_t intent,
+			   const double *to_data)
+{
+    comac_color_cache_entry_t *entry;
+    int from_n = _comac_colorspace_num_components (from_colorspace) + 1;
+    int to_n = _comac_colorspace_num_components (to_colorspace) + 1;
+
+    entry = _comac_color_cache_slot (cache,
+				     from_colorspace,
+				     from_data,
+				     to_colorspace,
+				     intent);
+    entry->valid = TRUE;
+    entry->from_colorspace = from_colorspace;
+    entry->to_colorspace = to_colorspace;
+    entry->intent = intent;
+    memcpy (entry->from, from_data, from_n * sizeof (double));
+    memcpy (entry->to, to_data, to_n * sizeof (double));
+}
+
+void
+_comac_color_cache_get_stats (const comac_color_cache_t *cache,
+			      unsigned int *hits,
+			      unsigned int *misses)
+{
+    *hits = cache->hits;
+    *misses = cache->misses;
+}
+
+/* Converts a batch of colors with a callback that converts one color
+ * at a time. The double layout is handed to @convert in place, the
+ * others go through a double color on the stack. */
+void
+_comac_color_convert_batch (comac_color_convert_cb convert,
+			    void *ctx,
+			    comac_colorspace_t from_colorspace,
+			    const void *from_data,
+			    comac_colorspace_t to_colorspace,
+			    void *to_data,
+			    comac_color_layout_t layout,
+			    unsigned int num_colors,
+			    comac_rendering_intent_t intent)
+{
+    int from_n = _comac_colorspace_num_components (from_colorspace) + 1;
+    int to_n = _comac_colorspace_num_components (to_colorspace) + 1;
+    double from_color[5], to_color[5];
+    unsigned int i;
+
+    if (layout == COMAC_COLOR_LAYOUT_DOUBLE) {
+	const double *from = from_data;
+	double *to = to_data;
+
+	for (i = 0; i < num_colors; i++) {
+	    convert (from_colorspace,
+		     from + i * from_n,
+		     to_colorspace,
+		     to + i * to_n,
+		     intent,
+		     ctx);
+	}
+	return;
+    }
+
+    for (i = 0; i < num_colors; i++) {
+	_comac_color_load (from_data, layout, i, from_n, from_color);
+	convert (from_colorspace,
+		 from_color,
+		 to_colorspace,
+		 to_color,
+		 intent,
+		 ctx);
+	_comac_color_store (to_data, layout, i, to_n, to_color);
+    }
+}
+
+void
+comac_default_color_convert_batch_func (comac_colorspace_t from_colorspace,
+					const void *from_data,
+					comac_colorspace_t to_colorspace,
+					void *to_data,
+					comac_color_layout_t layout,
+					unsigned int num_colors,
+					comac_rendering_intent_t intent,
+					void *ctx)
+{
+    if (from_colorspace == to_colorspace) {
+	int n = _comac_colorspace_num_components (from_colorspace) + 1;
+
+	memcpy (to_data,
+		from_data,
+		(size_t) num_colors * n * _comac_color_layout_size (layout));
+	return;
+    }
+
+    _comac_color_convert_batch (comac_default_color_convert_func,
+				ctx,
+				from_colorspace,
+				from_data,
+				to_colorspace,
+				to_data,
+				layout,
+				num_colors,
+				intent);
+}
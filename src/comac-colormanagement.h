@@ -66,9 +66,6 @@ typedef enum {
  * const callback_rgb *d = (const callback_rgb) in_data;
  */
 
-// FIXME, maybe this should take arrays instead of individual values
-// for more efficient batch processing?
-
 typedef void (*comac_color_convert_cb) (comac_colorspace_t,
 					const double *,
 					comac_colorspace_t,
@@ -76,6 +73,34 @@ typedef void (*comac_color_convert_cb) (comac_colorspace_t,
 					comac_rendering_intent_t,
 					void *);
 
+/*
+ * The layout of the colors given to a batch conversion callback. Each
+ * color is its components (r g b, gray or c m y k) followed by alpha,
+ * packed one color after another with no padding. The components are
+ * in the range 0 to 1 for the double and float layouts and 0 to 255
+ * for the 8 bit one, so that a row of pixels can be converted without
+ * unpacking it first.
+ */
+typedef enum {
+    COMAC_COLOR_LAYOUT_DOUBLE,
+    COMAC_COLOR_LAYOUT_FLOAT,
+    COMAC_COLOR_LAYOUT_U8,
+} comac_color_layout_t;
+
+/*
+ * Converts num_colors colors at once, for instance all the stops of a
+ * gradient or a row of an image. from_data and to_data point to the
+ * packed colors in the given layout and never overlap.
+ */
+typedef void (*comac_color_convert_batch_cb) (comac_colorspace_t,
+					      const void *,
+					      comac_colorspace_t,
+					      void *,
+					      comac_color_layout_t,
+					      unsigned int,
+					      comac_rendering_intent_t,
+					      void *);
+
 void
 comac_default_color_convert_func (comac_colorspace_t from_colorspace,
 				  const double *from_data,
@@ -84,4 +109,14 @@ comac_default_color_convert_func (comac_colorspace_t from_colorspace,
 				  comac_rendering_intent_t intent,
 				  void *ctx);
 
+void
+comac_default_color_convert_batch_func (comac_colorspace_t from_colorspace,
+					const void *from_data,
+					comac_colorspace_t to_colorspace,
+					void *to_data,
+					comac_color_layout_t layout,
+					unsigned int num_colors,
+					comac_rendering_intent_t intent,
+					void *ctx);
+
 #endif // COMAC_COLORMANAGEMENT_H
@@ -64,6 +64,11 @@ comac_debug_reset_static_data (void)
 {
     COMAC_MUTEX_INITIALIZE ();
 
+#if COMAC_HAS_PDF_SURFACE
+    /* Drops the font faces referenced by the cached subsets */
+    _comac_pdf_font_cache_reset_static_data ();
+#endif
+
     _comac_scaled_font_map_destroy ();
 
     _comac_toy_font_face_reset_static_data ();
@@ -129,6 +134,9 @@ _comac_debug_check_image_surface_is_defined (const comac_surface_t *surface)
     case COMAC_FORMAT_RGBA128F:
 	width = image->width * 16;
 	break;
+    case COMAC_FORMAT_CMYKA:
+	width = image->width * 5;
+	break;
     case COMAC_FORMAT_INVALID:
     default:
 	/* XXX compute width from pixman bpp */
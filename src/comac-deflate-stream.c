@@ -42,6 +42,10 @@
 #include "comac-output-stream-private.h"
 #include <zlib.h>
 
+#if COMAC_HAS_REAL_PTHREAD
+#include <pthread.h>
+#endif
+
 #define BUFFER_SIZE 16384
 
 typedef struct _comac_deflate_stream {
@@ -117,8 +121,10 @@ _comac_deflate_stream_close (comac_output_stream_t *base)
     return _comac_output_stream_get_status (stream->output);
 }
 
-comac_output_stream_t *
-_comac_deflate_stream_create (comac_output_stream_t *output)
+static comac_output_stream_t *
+_comac_deflate_stream_create_serial (comac_output_stream_t *output,
+				     int level,
+				     int strategy)
 {
     comac_deflate_stream_t *stream;
 
@@ -141,7 +147,12 @@ _comac_deflate_stream_create (comac_output_stream_t *output)
     stream->zlib_stream.zfree = Z_NULL;
     stream->zlib_stream.opaque = Z_NULL;
 
-    if (deflateInit (&stream->zlib_stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    if (deflateInit2 (&stream->zlib_stream,
+		      level,
+		      Z_DEFLATED,
+		      MAX_WBITS,
+		      8,
+		      strategy) != Z_OK) {
 	free (stream);
 	return (comac_output_stream_t *) &_comac_output_stream_nil;
     }
@@ -154,4 +165,374 @@ _comac_deflate_stream_create (comac_output_stream_t *output)
     return &stream->base;
 }
 
+comac_output_stream_t *
+_comac_deflate_stream_create (comac_output_stream_t *output)
+{
+    return _comac_deflate_stream_create_serial (output,
+						Z_DEFAULT_COMPRESSION,
+						Z_DEFAULT_STRATEGY);
+}
+
+#if COMAC_HAS_REAL_PTHREAD
+
+/* Threaded deflate stream.
+ *
+ * The input is split into blocks of THREADED_BLOCK_SIZE bytes which are
+ * compressed concurrently, one block per worker, in the same manner as
+ * pigz. Each block is a raw deflate stream primed with the last 32 KiB of
+ * the preceding block as a preset dictionary and terminated with a sync
+ * flush so that the concatenation of all blocks is a single valid deflate
+ * stream. The zlib header and the combined adler32 checksum are written
+ * by the stream itself, so the output is a regular zlib stream that any
+ * inflater can decode.
+ */
+
+#define THREADED_BLOCK_SIZE (128 * 1024)
+#define THREADED_DICT_SIZE (32 * 1024)
+#define THREADED_MAX_THREADS 64
+
+typedef struct _comac_deflate_job {
+    const unsigned char *dict;
+    unsigned int dict_length;
+    const unsigned char *input;
+    unsigned int input_length;
+    comac_bool_t last;
+    int level;
+    int strategy;
+
+    unsigned char *output;
+    unsigned long output_size;
+    unsigned long output_length;
+    unsigned long adler;
+    comac_status_t status;
+} comac_deflate_job_t;
+
+typedef struct _comac_deflate_threaded_stream {
+    comac_output_stream_t base;
+    comac_output_stream_t *output;
+    int level;
+    int strategy;
+    int num_threads;
+
+    /* THREADED_DICT_SIZE bytes of dictionary followed by
+     * num_threads * THREADED_BLOCK_SIZE bytes of pending input. */
+    unsigned char *input_buf;
+    unsigned int dict_length;
+    unsigned int input_length;
+
+    comac_deflate_job_t *jobs;
+    unsigned long adler;
+    comac_bool_t header_written;
+} comac_deflate_threaded_stream_t;
+
+static void
+_comac_deflate_job_run (comac_deflate_job_t *job)
+{
+    z_stream zs;
+    int ret;
+
+    job->adler = adler32 (adler32 (0, Z_NULL, 0),
+			  job->input,
+			  job->input_length);
+
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (deflateInit2 (&zs,
+		      job->level,
+		      Z_DEFLATED,
+		      -MAX_WBITS,
+		      8,
+		      job->strategy) != Z_OK) {
+	job->status = COMAC_STATUS_NO_MEMORY;
+	return;
+    }
+
+    if (job->dict_length)
+	deflateSetDictionary (&zs, job->dict, job->dict_length);
+
+    zs.next_in = (Bytef *) job->input;
+    zs.avail_in = job->input_length;
+    zs.next_out = job->output;
+    zs.avail_out = job->output_size;
+
+    /* The output buffer is sized with deflateBound() so a single call
+     * always consumes all input. */
+    ret = deflate (&zs, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+    if ((job->last && ret != Z_STREAM_END) || zs.avail_in != 0)
+	job->status = COMAC_STATUS_NO_MEMORY;
+    else
+	job->status = COMAC_STATUS_SUCCESS;
+
+    job->output_length = job->output_size - zs.avail_out;
+    deflateEnd (&zs);
+}
+
+static void *
+_comac_deflate_job_thread (void *closure)
+{
+    _comac_deflate_job_run (closure);
+    return NULL;
+}
+
+static void
+_comac_deflate_threaded_stream_write_header (
+    comac_deflate_threaded_stream_t *stream)
+{
+    unsigned char header[2];
+    unsigned int h, level_flags;
+
+    /* CMF: deflate, 32 KiB window. FLG: level hint, no dictionary. */
+    h = (Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8;
+    if (stream->strategy >= Z_HUFFMAN_ONLY || stream->level < 2)
+	level_flags = 0;
+    else if (stream->level < 6)
+	level_flags = 1;
+    else if (stream->level == 6)
+	level_flags = 2;
+    else
+	level_flags = 3;
+    h |= level_flags << 6;
+    h += 31 - (h % 31);
+    header[0] = h >> 8;
+    header[1] = h & 0xff;
+    _comac_output_stream_write (stream->output, header, 2);
+    stream->header_written = TRUE;
+}
+
+static void
+_comac_deflate_threaded_stream_compress (
+    comac_deflate_threaded_stream_t *stream, comac_bool_t last)
+{
+    unsigned char *dict = stream->input_buf + THREADED_DICT_SIZE -
+			  stream->dict_length;
+    unsigned char *input = stream->input_buf + THREADED_DICT_SIZE;
+    pthread_t threads[THREADED_MAX_THREADS];
+    comac_bool_t started[THREADED_MAX_THREADS];
+    unsigned int remaining = stream->input_length;
+    int num_jobs, i;
+
+    if (! stream->header_written)
+	_comac_deflate_threaded_stream_write_header (stream);
+
+    num_jobs = 0;
+    do {
+	comac_deflate_job_t *job = &stream->jobs[num_jobs];
+
+	job->input = input;
+	job->input_length = MIN (remaining, THREADED_BLOCK_SIZE);
+	if (input == stream->input_buf + THREADED_DICT_SIZE) {
+	    job->dict = dict;
+	    job->dict_length = stream->dict_length;
+	} else {
+	    job->dict = input - THREADED_DICT_SIZE;
+	    job->dict_length = THREADED_DICT_SIZE;
+	}
+	input += job->input_length;
+	remaining -= job->input_length;
+	job->last = last && remaining == 0;
+	job->level = stream->level;
+	job->strategy = stream->strategy;
+	num_jobs++;
+    } while (remaining);
+
+    /* The first block is compressed on the calling thread. */
+    for (i = 1; i < num_jobs; i++) {
+	started[i] = pthread_create (&threads[i],
+				     NULL,
+				     _comac_deflate_job_thread,
+				     &stream->jobs[i]) == 0;
+	if (! started[i])
+	    _comac_deflate_job_run (&stream->jobs[i]);
+    }
+    _comac_deflate_job_run (&stream->jobs[0]);
+    for (i = 1; i < num_jobs; i++) {
+	if (started[i])
+	    pthread_join (threads[i], NULL);
+    }
+
+    for (i = 0; i < num_jobs; i++) {
+	comac_deflate_job_t *job = &stream->jobs[i];
+
+	if (unlikely (job->status)) {
+	    if (stream->base.status == COMAC_STATUS_SUCCESS)
+		stream->base.status = _comac_error (job->status);
+	    continue;
+	}
+
+	_comac_output_stream_write (stream->output,
+				    job->output,
+				    job->output_length);
+	stream->adler =
+	    adler32_combine (stream->adler, job->adler, job->input_length);
+    }
+
+    /* Keep the tail of this batch as the dictionary for the next one. */
+    if (stream->input_length) {
+	stream->dict_length = MIN (stream->dict_length + stream->input_length,
+				   THREADED_DICT_SIZE);
+	memmove (stream->input_buf + THREADED_DICT_SIZE - stream->dict_length,
+		 stream->input_buf + THREADED_DICT_SIZE + stream->input_length -
+		     stream->dict_length,
+		 stream->dict_length);
+    }
+    stream->input_length = 0;
+}
+
+static comac_status_t
+_comac_deflate_threaded_stream_write (comac_output_stream_t *base,
+				      const unsigned char *data,
+				      unsigned int length)
+{
+    comac_deflate_threaded_stream_t *stream =
+	(comac_deflate_threaded_stream_t *) base;
+    unsigned int capacity = stream->num_threads * THREADED_BLOCK_SIZE;
+    unsigned int count;
+
+    while (length) {
+	count = MIN (length, capacity - stream->input_length);
+	memcpy (stream->input_buf + THREADED_DICT_SIZE + stream->input_length,
+		data,
+		count);
+	data += count;
+	stream->input_length += count;
+	length -= count;
+
+	if (stream->input_length == capacity)
+	    _comac_deflate_threaded_stream_compress (stream, FALSE);
+    }
+
+    return _comac_output_stream_get_status (stream->output);
+}
+
+static comac_status_t
+_comac_deflate_threaded_stream_close (comac_output_stream_t *base)
+{
+    comac_deflate_threaded_stream_t *stream =
+	(comac_deflate_threaded_stream_t *) base;
+    unsigned char trailer[4];
+    int i;
+
+    _comac_deflate_threaded_stream_compress (stream, TRUE);
+
+    trailer[0] = stream->adler >> 24;
+    trailer[1] = stream->adler >> 16;
+    trailer[2] = stream->adler >> 8;
+    trailer[3] = stream->adler;
+    _comac_output_stream_write (stream->output, trailer, 4);
+
+    for (i = 0; i < stream->num_threads; i++)
+	free (stream->jobs[i].output);
+    free (stream->jobs);
+    free (stream->input_buf);
+
+    return _comac_output_stream_get_status (stream->output);
+}
+
+/**
+ * _comac_deflate_stream_create_full:
+ * @output: the stream to write the compressed data to
+ * @level: the zlib compression level, or Z_DEFAULT_COMPRESSION
+ * @strategy: the zlib compression strategy
+ * @num_threads: the maximum number of blocks to compress concurrently
+ *
+ * Creates a deflate stream with the given compression parameters. If
+ * @num_threads is greater than 1 the input is compressed in
+ * independent blocks on up to @num_threads threads. The output is a
+ * zlib stream in either case.
+ **/
+comac_output_stream_t *
+_comac_deflate_stream_create_full (comac_output_stream_t *output,
+				   int level,
+				   int strategy,
+				   int num_threads)
+{
+    comac_deflate_threaded_stream_t *stream;
+    z_stream zs;
+    unsigned long bound;
+    int i;
+
+    if (num_threads < 2)
+	return _comac_deflate_stream_create_serial (output, level, strategy);
+
+    if (output->status)
+	return _comac_output_stream_create_in_error (output->status);
+
+    if (level == Z_DEFAULT_COMPRESSION)
+	level = 6;
+
+    if (num_threads > THREADED_MAX_THREADS)
+	num_threads = THREADED_MAX_THREADS;
+
+    /* Sync flush adds an empty stored block to each job's output. */
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    if (deflateInit2 (&zs, level, Z_DEFLATED, -MAX_WBITS, 8, strategy) !=
+	Z_OK)
+	return (comac_output_stream_t *) &_comac_output_stream_nil;
+    bound = deflateBound (&zs, THREADED_BLOCK_SIZE) + 16;
+    deflateEnd (&zs);
+
+    stream = calloc (1, sizeof (comac_deflate_threaded_stream_t));
+    if (unlikely (stream == NULL))
+	goto fail;
+
+    stream->input_buf =
+	_comac_malloc_ab_plus_c (num_threads,
+				 THREADED_BLOCK_SIZE,
+				 THREADED_DICT_SIZE);
+    if (unlikely (stream->input_buf == NULL))
+	goto fail;
+
+    stream->jobs = calloc (num_threads, sizeof (comac_deflate_job_t));
+    if (unlikely (stream->jobs == NULL))
+	goto fail;
+
+    for (i = 0; i < num_threads; i++) {
+	stream->jobs[i].output = _comac_malloc (bound);
+	if (unlikely (stream->jobs[i].output == NULL))
+	    goto fail;
+	stream->jobs[i].output_size = bound;
+    }
+
+    _comac_output_stream_init (&stream->base,
+			       _comac_deflate_threaded_stream_write,
+			       NULL,
+			       _comac_deflate_threaded_stream_close);
+    stream->output = output;
+    stream->level = level;
+    stream->strategy = strategy;
+    stream->num_threads = num_threads;
+    stream->adler = adler32 (0, Z_NULL, 0);
+
+    return &stream->base;
+
+fail:
+    if (stream) {
+	if (stream->jobs) {
+	    for (i = 0; i < num_threads; i++)
+		free (stream->jobs[i].output);
+	}
+	free (stream->jobs);
+	free (stream->input_buf);
+	free (stream);
+    }
+    _comac_error_throw (COMAC_STATUS_NO_MEMORY);
+    return (comac_output_stream_t *) &_comac_output_stream_nil;
+}
+
+#else /* COMAC_HAS_REAL_PTHREAD */
+
+comac_output_stream_t *
+_comac_deflate_stream_create_full (comac_output_stream_t *output,
+				   int level,
+				   int strategy,
+				   int num_threads)
+{
+    return _comac_deflate_stream_create_serial (output, level, strategy);
+}
+
+#endif /* COMAC_HAS_REAL_PTHREAD */
+
 #endif /* COMAC_HAS_DEFLATE_STREAM */
@@ -0,0 +1,1291 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-image-surface-private.h"
+#include "comac-compositor-private.h"
+#include "comac-spans-compositor-private.h"
+#include "comac-surface-offset-private.h"
+#include "comac-pattern-private.h"
+#include "comac-pattern-inline.h"
+
+/* Compositing to COMAC_FORMAT_CMYKA image surfaces.
+ *
+ * pixman has no CMYK formats, so these surfaces are drawn to with
+ * byte loops of their own for OVER, SOURCE and CLEAR. The other
+ * operators have no meaning for subtractive colors; they are applied
+ * as in RGB, to an ARGB32 copy of the area that they change, whose
+ * changed pixels are then converted back.
+ *
+ * The spans compositor produces the coverage. Coverage masks that it
+ * builds as A8 scratch surfaces (for clipping, or for masks other than
+ * an opacity) are still rendered by pixman, which is why surfaces in any
+ * other format are passed on to the pixman spans compositor. Drawing
+ * operations that the span renderer cannot take are rendered into an
+ * A8 mask first and then composited through the mask path.
+ *
+ * Sources are converted to CMYK with the destination's color callbacks:
+ * solid colors once per operation, other patterns by rendering them to
+ * an RGB scratch image that is converted in batches. CMYKA images are
+ * used as they are.
+ *
+ * A solid color is applied to a run of pixels by repeating a block of
+ * BLOCK_PIXELS pixels, so that the blend is a plain byte loop that the
+ * compiler can vectorize instead of one that walks the 5 channels.
+ */
+
+#define BLOCK_PIXELS 16
+#define CONVERT_PIXELS 256
+
+static const comac_spans_compositor_t *pixman_spans;
+
+static inline uint8_t
+mul8 (uint8_t a, uint8_t b)
+{
+    uint16_t t = a * (uint16_t) b + 0x80;
+    return ((t >> 8) + t) >> 8;
+}
+
+static inline comac_bool_t
+_is_cmyka (const void *surface)
+{
+    return ((const comac_image_surface_t *) surface)->format ==
+	   COMAC_FORMAT_CMYKA;
+}
+
+static void
+_cmyk_color (comac_image_surface_t *dst,
+	     const comac_color_t *color,
+	     uint8_t pixel[5])
+{
+    double cmyk[5];
+    double alpha = color->c.rgb.alpha;
+    int i;
+
+    assert (color->colorspace == COMAC_COLORSPACE_RGB);
+
+    _comac_surface_convert_color (&dst->base,
+				  COMAC_COLORSPACE_RGB,
+				  &color->c.rgb.red,
+				  COMAC_COLORSPACE_CMYK,
+				  cmyk);
+    for (i = 0; i < 4; i++)
+	pixel[i] = _comac_restrict_value (cmyk[i], 0, 1) * alpha * 255 + .5;
+    pixel[4] = alpha * 255 + .5;
+}
+
+/* The pixel and the factor that a solid color with coverage c applies
+ * to the destination: d = pixel + d * inv. */
+static void
+_cmyk_solid_setup (comac_operator_t op,
+		   const uint8_t color[5],
+		   uint8_t c,
+		   uint8_t pixel[5],
+		   uint8_t *inv)
+{
+    int i;
+
+    if (op == COMAC_OPERATOR_CLEAR) {
+	memset (pixel, 0, 5);
+	*inv = ~c;
+	return;
+    }
+
+    for (i = 0; i < 5; i++)
+	pixel[i] = mul8 (color[i], c);
+    *inv = op == COMAC_OPERATOR_SOURCE ? ~c : ~pixel[4];
+}
+
+static void
+_cmyk_fill_run (uint8_t *d, const uint8_t pixel[5], uint8_t inv, int len)
+{
+    uint8_t block[5 * BLOCK_PIXELS];
+    int i;
+
+    if (len < BLOCK_PIXELS) {
+	for (; len--; d += 5) {
+	    for (i = 0; i < 5; i++)
+		d[i] = pixel[i] + mul8 (d[i], inv);
+	}
+	return;
+    }
+
+    for (i = 0; i < BLOCK_PIXELS; i++)
+	memcpy (block + 5 * i, pixel, 5);
+
+    if (inv == 0) {
+	for (; len >= BLOCK_PIXELS; len -= BLOCK_PIXELS, d += sizeof (block))
+	    memcpy (d, block, sizeof (block));
+	memcpy (d, block, 5 * len);
+	return;
+    }
+
+    for (; len >= BLOCK_PIXELS; len -= BLOCK_PIXELS, d += sizeof (block)) {
+	for (i = 0; i < (int) sizeof (block); i++)
+	    d[i] = block[i] + mul8 (d[i], inv);
+    }
+    for (i = 0; i < 5 * len; i++)
+	d[i] = block[i] + mul8 (d[i], inv);
+}
+
+static void
+_cmyk_composite_run (comac_operator_t op,
+		     uint8_t *d,
+		     const uint8_t *s,
+		     uint8_t c,
+		     int len)
+{
+    uint8_t inv = ~c;
+    int i, n = 5 * len;
+
+    if (op == COMAC_OPERATOR_CLEAR) {
+	if (c == 0xff) {
+	    memset (d, 0, n);
+	} else {
+	    for (i = 0; i < n; i++)
+		d[i] = mul8 (d[i], inv);
+	}
+    } else if (op == COMAC_OPERATOR_SOURCE) {
+	if (c == 0xff) {
+	    memmove (d, s, n);
+	} else {
+	    for (i = 0; i < n; i++)
+		d[i] = mul8 (s[i], c) + mul8 (d[i], inv);
+	}
+    } else {
+	for (; len--; s += 5, d += 5) {
+	    uint8_t a = mul8 (s[4], c);
+
+	    if (a == 0xff) {
+		memcpy (d, s, 5);
+	    } else if (a) {
+		inv = ~a;
+		for (i = 0; i < 5; i++)
+		    d[i] = mul8 (s[i], c) + mul8 (d[i], inv);
+	    }
+	}
+    }
+}
+
+/* Converts premultiplied ARGB32 pixels to CMYKA with the colors
+ * callbacks of surface. */
+static void
+_cmyk_from_argb32 (comac_surface_t *surface,
+		   const uint32_t *src,
+		   uint8_t *dst,
+		   int width)
+{
+    uint8_t rgba[4 * CONVERT_PIXELS];
+
+    while (width) {
+	int i, k, n = MIN (width, CONVERT_PIXELS);
+
+	for (i = 0; i < n; i++) {
+	    uint32_t p = src[i];
+	    uint8_t a = p >> 24;
+	    uint8_t *q = rgba + 4 * i;
+
+	    if (a) {
+		q[0] = (((p >> 16) & 0xff) * 255 + a / 2) / a;
+		q[1] = (((p >> 8) & 0xff) * 255 + a / 2) / a;
+		q[2] = ((p & 0xff) * 255 + a / 2) / a;
+	    } else {
+		q[0] = q[1] = q[2] = 0;
+	    }
+	    q[3] = a;
+	}
+
+	_comac_surface_convert_colors (surface,
+				       COMAC_COLORSPACE_RGB,
+				       rgba,
+				       COMAC_COLORSPACE_CMYK,
+				       dst,
+				       COMAC_COLOR_LAYOUT_U8,
+				       n);
+
+	for (i = 0; i < n; i++, dst += 5) {
+	    uint8_t a = rgba[4 * i + 3];
+
+	    for (k = 0; k < 4; k++)
+		dst[k] = mul8 (dst[k], a);
+	    dst[4] = a;
+	}
+
+	src += n;
+	width -= n;
+    }
+}
+
+static void
+_argb32_from_cmyk (comac_surface_t *surface,
+		   const uint8_t *src,
+		   uint32_t *dst,
+		   int width)
+{
+    uint8_t cmyka[5 * CONVERT_PIXELS];
+    uint8_t rgba[4 * CONVERT_PIXELS];
+
+    while (width) {
+	int i, k, n = MIN (width, CONVERT_PIXELS);
+
+	for (i = 0; i < n; i++) {
+	    const uint8_t *p = src + 5 * i;
+	    uint8_t *q = cmyka + 5 * i;
+	    uint8_t a = p[4];
+
+	    for (k = 0; k < 4; k++)
+		q[k] = a ? (MIN (p[k], a) * 255 + a / 2) / a : 0;
+	    q[4] = a;
+	}
+
+	_comac_surface_convert_colors (surface,
+				       COMAC_COLORSPACE_CMYK,
+				       cmyka,
+				       COMAC_COLORSPACE_RGB,
+				       rgba,
+				       COMAC_COLOR_LAYOUT_U8,
+				       n);
+
+	for (i = 0; i < n; i++) {
+	    const uint8_t *q = rgba + 4 * i;
+	    uint8_t a = cmyka[5 * i + 4];
+
+	    dst[i] = (uint32_t) a << 24 | (uint32_t) mul8 (q[0], a) << 16 |
+		     (uint32_t) mul8 (q[1], a) << 8 | mul8 (q[2], a);
+	}
+
+	src += 5 * n;
+	dst += n;
+	width -= n;
+    }
+}
+
+comac_image_surface_t *
+_comac_image_surface_cmyka_to_argb32 (comac_image_surface_t *image)
+{
+    comac_image_surface_t *clone;
+    int y;
+
+    clone = (comac_image_surface_t *)
+	comac_image_surface_create (COMAC_FORMAT_ARGB32,
+				    image->width,
+				    image->height);
+    if (unlikely (clone->base.status))
+	return clone;
+
+    for (y = 0; y < image->height; y++) {
+	_argb32_from_cmyk (&image->base,
+			   image->data + y * image->stride,
+			   (uint32_t *) (clone->data + y * clone->stride),
+			   image->width);
+    }
+    clone->base.is_clear = FALSE;
+
+    clone->base.device_transform = image->base.device_transform;
+    clone->base.device_transform_inverse =
+	image->base.device_transform_inverse;
+
+    return clone;
+}
+
+/* A CMYKA image source that needs no conversion, or NULL */
+static comac_image_surface_t *
+_cmyk_source_for_surface (const comac_surface_pattern_t *pattern,
+			  const comac_rectangle_int_t *extents,
+			  int *src_x,
+			  int *src_y)
+{
+    comac_image_surface_t *image, *clone;
+    comac_rectangle_int_t limit, r;
+    comac_surface_t *surface;
+    int tx, ty, y;
+
+    surface = _comac_pattern_get_source (pattern, &limit);
+    if (surface->type != COMAC_SURFACE_TYPE_IMAGE || ! _is_cmyka (surface))
+	return NULL;
+
+    image = (comac_image_surface_t *) surface;
+    if (limit.x != 0 || limit.y != 0 || limit.width != image->width ||
+	limit.height != image->height)
+	return NULL;
+
+    if (! _comac_matrix_is_integer_translation (&pattern->base.matrix,
+						&tx,
+						&ty))
+	return NULL;
+
+    r = *extents;
+    r.x += tx;
+    r.y += ty;
+    if (_comac_rectangle_contains_rectangle (&limit, &r)) {
+	*src_x = tx;
+	*src_y = ty;
+	return (comac_image_surface_t *) comac_surface_reference (surface);
+    }
+
+    if (pattern->base.extend != COMAC_EXTEND_NONE)
+	return NULL;
+
+    clone = (comac_image_surface_t *)
+	_comac_image_surface_create_cmyka (NULL,
+					   extents->width,
+					   extents->height,
+					   0);
+    if (unlikely (clone->base.status))
+	return clone;
+
+    if (_comac_rectangle_intersect (&r, &limit)) {
+	for (y = 0; y < r.height; y++) {
+	    memcpy (clone->data +
+			(r.y - ty - extents->y + y) * clone->stride +
+			5 * (r.x - tx - extents->x),
+		    image->data + (r.y + y) * image->stride + 5 * r.x,
+		    5 * r.width);
+	}
+    }
+
+    *src_x = -extents->x;
+    *src_y = -extents->y;
+    return clone;
+}
+
+/* Returns the source as a CMYKA image, with the offsets from the
+ * destination to it in src_x and src_y. */
+static comac_image_surface_t *
+_cmyk_source_for_pattern (comac_image_surface_t *dst,
+			  const comac_pattern_t *pattern,
+			  const comac_rectangle_int_t *extents,
+			  int *src_x,
+			  int *src_y)
+{
+    comac_image_surface_t *image, *scratch;
+    comac_status_t status;
+    int y;
+
+    *src_x = -extents->x;
+    *src_y = -extents->y;
+
+    if (pattern->type == COMAC_PATTERN_TYPE_SOLID) {
+	const comac_solid_pattern_t *solid =
+	    (const comac_solid_pattern_t *) pattern;
+	uint8_t *row;
+	int x;
+
+	/* A single row, repeated with a zero stride */
+	row = _comac_malloc_ab (MAX (extents->width, 1), 5);
+	if (unlikely (row == NULL))
+	    return (comac_image_surface_t *) _comac_surface_create_in_error (
+		_comac_error (COMAC_STATUS_NO_MEMORY));
+
+	_cmyk_color (dst, &solid->color, row);
+	for (x = 1; x < extents->width; x++)
+	    memcpy (row + 5 * x, row, 5);
+
+	image = (comac_image_surface_t *)
+	    _comac_image_surface_create_cmyka (row,
+					       extents->width,
+					       extents->height,
+					       0);
+	if (unlikely (image->base.status)) {
+	    free (row);
+	    return image;
+	}
+	_comac_image_surface_assume_ownership_of_data (image);
+	return image;
+    }
+
+    if (pattern->type == COMAC_PATTERN_TYPE_SURFACE) {
+	image = _cmyk_source_for_surface (
+	    (const comac_surface_pattern_t *) pattern,
+	    extents,
+	    src_x,
+	    src_y);
+	if (image != NULL)
+	    return image;
+    }
+
+    scratch = (comac_image_surface_t *)
+	comac_image_surface_create (COMAC_FORMAT_ARGB32,
+				    extents->width,
+				    extents->height);
+    if (unlikely (scratch->base.status))
+	return scratch;
+
+    status = _comac_surface_offset_paint (&scratch->base,
+					  extents->x,
+					  extents->y,
+					  COMAC_OPERATOR_SOURCE,
+					  pattern,
+					  NULL);
+    if (unlikely (status)) {
+	comac_surface_destroy (&scratch->base);
+	return (comac_image_surface_t *) _comac_surface_create_in_error (
+	    status);
+    }
+
+    image = (comac_image_surface_t *)
+	_comac_image_surface_create_cmyka (NULL,
+					   extents->width,
+					   extents->height,
+					   0);
+    if (likely (image->base.status == COMAC_STATUS_SUCCESS)) {
+	for (y = 0; y < extents->height; y++) {
+	    _cmyk_from_argb32 (
+		&dst->base,
+		(const uint32_t *) (scratch->data + y * scratch->stride),
+		image->data + y * image->stride,
+		extents->width);
+	}
+	image->base.is_clear = FALSE;
+    }
+
+    comac_surface_destroy (&scratch->base);
+    return image;
+}
+
+static comac_int_status_t
+fill_boxes (void *_dst,
+	    comac_operator_t op,
+	    const comac_color_t *color,
+	    comac_boxes_t *boxes)
+{
+    comac_image_surface_t *dst = _dst;
+    struct _comac_boxes_chunk *chunk;
+    uint8_t pixel[5], inv;
+    int i;
+
+    if (! _is_cmyka (dst))
+	return pixman_spans->fill_boxes (_dst, op, color, boxes);
+
+    _cmyk_color (dst, color, pixel);
+    _cmyk_solid_setup (op, pixel, 0xff, pixel, &inv);
+
+    for (chunk = &boxes->chunks; chunk; chunk = chunk->next) {
+	for (i = 0; i < chunk->count; i++) {
+	    int x = _comac_fixed_integer_part (chunk->base[i].p1.x);
+	    int y = _comac_fixed_integer_part (chunk->base[i].p1.y);
+	    int w = _comac_fixed_integer_part (chunk->base[i].p2.x) - x;
+	    int h = _comac_fixed_integer_part (chunk->base[i].p2.y) - y;
+	    uint8_t *d = dst->data + y * dst->stride + 5 * x;
+
+	    while (h--) {
+		_cmyk_fill_run (d, pixel, inv, w);
+		d += dst->stride;
+	    }
+	}
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_int_status_t
+draw_image_boxes (void *_dst,
+		  comac_image_surface_t *image,
+		  comac_boxes_t *boxes,
+		  int dx,
+		  int dy)
+{
+    comac_image_surface_t *dst = _dst;
+    struct _comac_boxes_chunk *chunk;
+    int i;
+
+    if (! _is_cmyka (dst))
+	return pixman_spans->draw_image_boxes (_dst, image, boxes, dx, dy);
+
+    if (image->format != COMAC_FORMAT_CMYKA)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    for (chunk = &boxes->chunks; chunk; chunk = chunk->next) {
+	for (i = 0; i < chunk->count; i++) {
+	    int x = _comac_fixed_integer_part (chunk->base[i].p1.x);
+	    int y = _comac_fixed_integer_part (chunk->base[i].p1.y);
+	    int w = _comac_fixed_integer_part (chunk->base[i].p2.x) - x;
+	    int h = _comac_fixed_integer_part (chunk->base[i].p2.y) - y;
+	    uint8_t *d = dst->data + y * dst->stride + 5 * x;
+	    uint8_t *s =
+		image->data + (y + dy) * image->stride + 5 * (x + dx);
+
+	    while (h--) {
+		memmove (d, s, 5 * w);
+		d += dst->stride;
+		s += image->stride;
+	    }
+	}
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_surface_t *
+pattern_to_surface (comac_surface_t *dst,
+		    const comac_pattern_t *pattern,
+		    comac_bool_t is_mask,
+		    const comac_rectangle_int_t *extents,
+		    const comac_rectangle_int_t *sample,
+		    int *src_x,
+		    int *src_y)
+{
+    if (is_mask || ! _is_cmyka (dst)) {
+	return _comac_image_source_create_for_pattern (dst,
+						       pattern,
+						       is_mask,
+						       extents,
+						       sample,
+						       src_x,
+						       src_y);
+    }
+
+    return &_cmyk_source_for_pattern ((comac_image_surface_t *) dst,
+				      pattern,
+				      extents,
+				      src_x,
+				      src_y)
+		->base;
+}
+
+static comac_int_status_t
+composite_boxes (void *_dst,
+		 comac_operator_t op,
+		 comac_surface_t *abstract_src,
+		 comac_surface_t *abstract_mask,
+		 int src_x,
+		 int src_y,
+		 int mask_x,
+		 int mask_y,
+		 int dst_x,
+		 int dst_y,
+		 comac_boxes_t *boxes,
+		 const comac_rectangle_int_t *extents)
+{
+    comac_image_surface_t *dst = _dst;
+    comac_image_surface_t *src = (comac_image_surface_t *) abstract_src;
+    pixman_image_t *mask = NULL;
+    struct _comac_boxes_chunk *chunk;
+    int i;
+
+    if (! _is_cmyka (dst)) {
+	return pixman_spans->composite_boxes (_dst,
+					      op,
+					      abstract_src,
+					      abstract_mask,
+					      src_x,
+					      src_y,
+					      mask_x,
+					      mask_y,
+					      dst_x,
+					      dst_y,
+					      boxes,
+					      extents);
+    }
+
+    if (abstract_mask)
+	mask = ((comac_image_source_t *) abstract_mask)->pixman_image;
+
+    for (chunk = &boxes->chunks; chunk; chunk = chunk->next) {
+	for (i = 0; i < chunk->count; i++) {
+	    int x1 = _comac_fixed_integer_part (chunk->base[i].p1.x);
+	    int y1 = _comac_fixed_integer_part (chunk->base[i].p1.y);
+	    int x2 = _comac_fixed_integer_part (chunk->base[i].p2.x);
+	    int y2 = _comac_fixed_integer_part (chunk->base[i].p2.y);
+	    pixman_image_t *coverage = NULL;
+	    uint8_t *m = NULL;
+	    int m_stride = 0;
+	    int x, y, w;
+
+	    x1 = MAX (x1, extents->x);
+	    y1 = MAX (y1, extents->y);
+	    x2 = MIN (x2, extents->x + extents->width);
+	    y2 = MIN (y2, extents->y + extents->height);
+	    if (x2 <= x1 || y2 <= y1)
+		continue;
+	    w = x2 - x1;
+
+	    if (mask) {
+		coverage =
+		    pixman_image_create_bits (PIXMAN_a8, w, y2 - y1, NULL, 0);
+		if (unlikely (coverage == NULL))
+		    return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+		pixman_image_composite32 (PIXMAN_OP_SRC,
+					  mask,
+					  NULL,
+					  coverage,
+					  x1 + mask_x,
+					  y1 + mask_y,
+					  0,
+					  0,
+					  0,
+					  0,
+					  w,
+					  y2 - y1);
+		m = (uint8_t *) pixman_image_get_data (coverage);
+		m_stride = pixman_image_get_stride (coverage);
+	    }
+
+	    for (y = y1; y < y2; y++) {
+		uint8_t *d =
+		    dst->data + (y + dst_y) * dst->stride + 5 * (x1 + dst_x);
+		const uint8_t *s =
+		    src->data + (y + src_y) * src->stride + 5 * (x1 + src_x);
+
+		if (m == NULL) {
+		    _cmyk_composite_run (op, d, s, 0xff, w);
+		    continue;
+		}
+
+		for (x = 0; x < w; x++) {
+		    if (m[x])
+			_cmyk_composite_run (op, d + 5 * x, s + 5 * x, m[x], 1);
+		}
+		m += m_stride;
+	    }
+
+	    if (coverage)
+		pixman_image_unref (coverage);
+	}
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+typedef struct _comac_image_cmyk_span_renderer {
+    comac_span_renderer_t base;
+
+    comac_operator_t op;
+    uint8_t opacity;
+    uint8_t color[5];
+    comac_image_surface_t *src;
+    int src_x, src_y;
+
+    uint8_t *data;
+    int stride;
+} comac_image_cmyk_span_renderer_t;
+COMPILE_TIME_ASSERT (sizeof (comac_image_cmyk_span_renderer_t) <=
+		     sizeof (comac_abstract_span_renderer_t));
+
+static comac_status_t
+_cmyk_solid_spans (void *abstract_renderer,
+		   int y,
+		   int h,
+		   const comac_half_open_span_t *spans,
+		   unsigned num_spans)
+{
+    comac_image_cmyk_span_renderer_t *r = abstract_renderer;
+
+    if (num_spans == 0)
+	return COMAC_STATUS_SUCCESS;
+
+    do {
+	uint8_t c = mul8 (spans[0].coverage, r->opacity);
+
+	if (c) {
+	    uint8_t *d = r->data + y * r->stride + 5 * spans[0].x;
+	    int len = spans[1].x - spans[0].x;
+	    uint8_t pixel[5], inv;
+	    int yy;
+
+	    _cmyk_solid_setup (r->op, r->color, c, pixel, &inv);
+	    for (yy = 0; yy < h; yy++, d += r->stride)
+		_cmyk_fill_run (d, pixel, inv, len);
+	}
+	spans++;
+    } while (--num_spans > 1);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_cmyk_image_spans (void *abstract_renderer,
+		   int y,
+		   int h,
+		   const comac_half_open_span_t *spans,
+		   unsigned num_spans)
+{
+    comac_image_cmyk_span_renderer_t *r = abstract_renderer;
+    comac_image_surface_t *src = r->src;
+
+    if (num_spans == 0)
+	return COMAC_STATUS_SUCCESS;
+
+    do {
+	uint8_t c = mul8 (spans[0].coverage, r->opacity);
+
+	if (c) {
+	    int x = spans[0].x;
+	    int len = spans[1].x - x;
+	    int yy;
+
+	    for (yy = y; yy < y + h; yy++) {
+		_cmyk_composite_run (r->op,
+				     r->data + yy * r->stride + 5 * x,
+				     src->data + (yy + r->src_y) * src->stride +
+					 5 * (x + r->src_x),
+				     c,
+				     len);
+	    }
+	}
+	spans++;
+    } while (--num_spans > 1);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Marks a renderer set up by span_renderer_init(), it is never called */
+static comac_status_t
+_cmyk_spans_finish (void *abstract_renderer)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_int_status_t
+span_renderer_init (comac_abstract_span_renderer_t *_r,
+		    const comac_composite_rectangles_t *composite,
+		    comac_antialias_t antialias,
+		    comac_bool_t needs_clip)
+{
+    comac_image_cmyk_span_renderer_t *r =
+	(comac_image_cmyk_span_renderer_t *) _r;
+    comac_image_surface_t *dst = (comac_image_surface_t *) composite->surface;
+    const comac_pattern_t *source = &composite->source_pattern.base;
+    const comac_pattern_t *mask = &composite->mask_pattern.base;
+
+    if (! _is_cmyka (dst)) {
+	r->base.finish = NULL;
+	return pixman_spans->renderer_init (_r,
+					    composite,
+					    antialias,
+					    needs_clip);
+    }
+
+    r->base.finish = _cmyk_spans_finish;
+    r->src = NULL;
+
+    if (needs_clip)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    if (mask->type != COMAC_PATTERN_TYPE_SOLID)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    r->op = composite->op;
+    r->opacity =
+	((const comac_solid_pattern_t *) mask)->color.c.rgb.alpha * 255 + .5;
+    r->data = dst->data;
+    r->stride = dst->stride;
+
+    if (composite->op == COMAC_OPERATOR_CLEAR) {
+	memset (r->color, 0, sizeof (r->color));
+	r->base.render_rows = _cmyk_solid_spans;
+    } else if (source->type == COMAC_PATTERN_TYPE_SOLID) {
+	_cmyk_color (dst,
+		     &((const comac_solid_pattern_t *) source)->color,
+		     r->color);
+	r->base.render_rows = _cmyk_solid_spans;
+    } else {
+	comac_status_t status;
+
+	r->src = _cmyk_source_for_pattern (dst,
+					   source,
+					   &composite->unbounded,
+					   &r->src_x,
+					   &r->src_y);
+	status = r->src->base.status;
+	if (unlikely (status)) {
+	    comac_surface_destroy (&r->src->base);
+	    r->src = NULL;
+	    return status;
+	}
+	r->base.render_rows = _cmyk_image_spans;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+span_renderer_fini (comac_abstract_span_renderer_t *_r,
+		    comac_int_status_t status)
+{
+    comac_image_cmyk_span_renderer_t *r =
+	(comac_image_cmyk_span_renderer_t *) _r;
+
+    if (r->base.finish != _cmyk_spans_finish) {
+	pixman_spans->renderer_fini (_r, status);
+	return;
+    }
+
+    if (r->src)
+	comac_surface_destroy (&r->src->base);
+}
+
+/* What the spans compositor cannot draw directly is rendered into an A8
+ * mask, and the mask is then composited by the spans compositor. */
+static comac_int_status_t
+composite_mask (const comac_composite_rectangles_t *extents,
+		comac_surface_t *mask)
+{
+    comac_surface_pattern_t pattern;
+    comac_status_t status;
+
+    _comac_pattern_init_for_surface (&pattern, mask);
+    comac_matrix_init_translate (&pattern.base.matrix,
+				 -extents->bounded.x,
+				 -extents->bounded.y);
+    pattern.base.filter = COMAC_FILTER_NEAREST;
+    pattern.base.extend = COMAC_EXTEND_NONE;
+
+    status = _comac_surface_mask (extents->surface,
+				  extents->op,
+				  &extents->source_pattern.base,
+				  &pattern.base,
+				  NULL);
+    _comac_pattern_fini (&pattern.base);
+
+    return status;
+}
+
+static comac_surface_t *
+create_mask (const comac_composite_rectangles_t *extents)
+{
+    return _comac_surface_create_scratch (extents->surface,
+					  COMAC_CONTENT_ALPHA,
+					  extents->bounded.width,
+					  extents->bounded.height,
+					  NULL);
+}
+
+static comac_int_status_t
+mask_paint (const comac_compositor_t *compositor,
+	    comac_composite_rectangles_t *extents)
+{
+    comac_surface_t *mask;
+    comac_status_t status;
+
+    mask = create_mask (extents);
+    if (unlikely (mask->status))
+	return mask->status;
+
+    status = _comac_surface_offset_paint (mask,
+					  extents->bounded.x,
+					  extents->bounded.y,
+					  COMAC_OPERATOR_ADD,
+					  &_comac_pattern_white.base,
+					  extents->clip);
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = composite_mask (extents, mask);
+
+    comac_surface_destroy (mask);
+    return status;
+}
+
+static comac_int_status_t
+mask_mask (const comac_compositor_t *compositor,
+	   comac_composite_rectangles_t *extents)
+{
+    comac_surface_t *mask;
+    comac_status_t status;
+
+    mask = create_mask (extents);
+    if (unlikely (mask->status))
+	return mask->status;
+
+    status = _comac_surface_offset_mask (mask,
+					 extents->bounded.x,
+					 extents->bounded.y,
+					 COMAC_OPERATOR_ADD,
+					 &_comac_pattern_white.base,
+					 &extents->mask_pattern.base,
+					 extents->clip);
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = composite_mask (extents, mask);
+
+    comac_surface_destroy (mask);
+    return status;
+}
+
+static comac_int_status_t
+mask_stroke (const comac_compositor_t *compositor,
+	     comac_composite_rectangles_t *extents,
+	     const comac_path_fixed_t *path,
+	     const comac_stroke_style_t *style,
+	     const comac_matrix_t *ctm,
+	     const comac_matrix_t *ctm_inverse,
+	     double tolerance,
+	     comac_antialias_t antialias)
+{
+    comac_surface_t *mask;
+    comac_status_t status;
+
+    mask = create_mask (extents);
+    if (unlikely (mask->status))
+	return mask->status;
+
+    status = _comac_surface_offset_stroke (mask,
+					   extents->bounded.x,
+					   extents->bounded.y,
+					   COMAC_OPERATOR_ADD,
+					   &_comac_pattern_white.base,
+					   path,
+					   style,
+					   ctm,
+					   ctm_inverse,
+					   tolerance,
+					   antialias,
+					   extents->clip);
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = composite_mask (extents, mask);
+
+    comac_surface_destroy (mask);
+    return status;
+}
+
+static comac_int_status_t
+mask_fill (const comac_compositor_t *compositor,
+	   comac_composite_rectangles_t *extents,
+	   const comac_path_fixed_t *path,
+	   comac_fill_rule_t fill_rule,
+	   double tolerance,
+	   comac_antialias_t antialias)
+{
+    comac_surface_t *mask;
+    comac_status_t status;
+
+    mask = create_mask (extents);
+    if (unlikely (mask->status))
+	return mask->status;
+
+    status = _comac_surface_offset_fill (mask,
+					 extents->bounded.x,
+					 extents->bounded.y,
+					 COMAC_OPERATOR_ADD,
+					 &_comac_pattern_white.base,
+					 path,
+					 fill_rule,
+					 tolerance,
+					 antialias,
+					 extents->clip);
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = composite_mask (extents, mask);
+
+    comac_surface_destroy (mask);
+    return status;
+}
+
+static comac_int_status_t
+mask_glyphs (const comac_compositor_t *compositor,
+	     comac_composite_rectangles_t *extents,
+	     comac_scaled_font_t *scaled_font,
+	     comac_glyph_t *glyphs,
+	     int num_glyphs,
+	     comac_bool_t overlap)
+{
+    comac_surface_t *mask;
+    comac_status_t status;
+
+    mask = create_mask (extents);
+    if (unlikely (mask->status))
+	return mask->status;
+
+    status = _comac_surface_offset_glyphs (mask,
+					   extents->bounded.x,
+					   extents->bounded.y,
+					   COMAC_OPERATOR_ADD,
+					   &_comac_pattern_white.base,
+					   scaled_font,
+					   glyphs,
+					   num_glyphs,
+					   extents->clip);
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = composite_mask (extents, mask);
+
+    comac_surface_destroy (mask);
+    return status;
+}
+
+static comac_bool_t
+is_cmyk_operator (comac_operator_t op)
+{
+    return op == COMAC_OPERATOR_OVER || op == COMAC_OPERATOR_SOURCE ||
+	   op == COMAC_OPERATOR_CLEAR;
+}
+
+/* An ARGB32 copy of the area of the destination that the operation
+ * may change */
+static comac_surface_t *
+rgb_scratch_create (const comac_composite_rectangles_t *extents)
+{
+    comac_image_surface_t *dst = (comac_image_surface_t *) extents->surface;
+    const comac_rectangle_int_t *r = &extents->unbounded;
+    comac_image_surface_t *scratch;
+    int y;
+
+    scratch = (comac_image_surface_t *)
+	comac_image_surface_create (COMAC_FORMAT_ARGB32, r->width, r->height);
+    if (unlikely (scratch->base.status))
+	return &scratch->base;
+
+    for (y = 0; y < r->height; y++) {
+	_argb32_from_cmyk (&dst->base,
+			   dst->data + (r->y + y) * dst->stride + 5 * r->x,
+			   (uint32_t *) (scratch->data + y * scratch->stride),
+			   r->width);
+    }
+    scratch->base.is_clear = FALSE;
+
+    return &scratch->base;
+}
+
+/* Converts the pixels of the scratch that were changed by drawing to it
+ * back to the destination, so that the others keep their CMYK values
+ * exactly. */
+static comac_int_status_t
+rgb_scratch_composite (const comac_composite_rectangles_t *extents,
+		       comac_surface_t *_scratch,
+		       comac_status_t status)
+{
+    comac_image_surface_t *dst = (comac_image_surface_t *) extents->surface;
+    comac_image_surface_t *scratch = (comac_image_surface_t *) _scratch;
+    const comac_rectangle_int_t *r = &extents->unbounded;
+    uint32_t *row;
+    int x, y, n;
+
+    if (unlikely (status))
+	goto CLEANUP;
+
+    row = _comac_malloc_ab (r->width, sizeof (uint32_t));
+    if (unlikely (row == NULL)) {
+	status = _comac_error (COMAC_STATUS_NO_MEMORY);
+	goto CLEANUP;
+    }
+
+    for (y = 0; y < r->height; y++) {
+	const uint32_t *s =
+	    (const uint32_t *) (scratch->data + y * scratch->stride);
+	uint8_t *d = dst->data + (r->y + y) * dst->stride + 5 * r->x;
+
+	_argb32_from_cmyk (&dst->base, d, row, r->width);
+	for (x = 0; x < r->width; x = n) {
+	    if (s[x] == row[x]) {
+		n = x + 1;
+		continue;
+	    }
+
+	    for (n = x + 1; n < r->width && s[n] != row[n]; n++)
+		;
+	    _cmyk_from_argb32 (&dst->base, s + x, d + 5 * x, n - x);
+	}
+    }
+    free (row);
+
+CLEANUP:
+    comac_surface_destroy (_scratch);
+    return status;
+}
+
+static comac_int_status_t
+check_paint (const comac_compositor_t *compositor,
+	     comac_composite_rectangles_t *extents)
+{
+    comac_surface_t *scratch;
+    comac_status_t status;
+
+    if (is_cmyk_operator (extents->op))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    scratch = rgb_scratch_create (extents);
+    if (unlikely (scratch->status))
+	return scratch->status;
+
+    status = _comac_surface_offset_paint (scratch,
+					  extents->unbounded.x,
+					  extents->unbounded.y,
+					  extents->op,
+					  &extents->source_pattern.base,
+					  extents->clip);
+    return rgb_scratch_composite (extents, scratch, status);
+}
+
+static comac_int_status_t
+check_mask (const comac_compositor_t *compositor,
+	    comac_composite_rectangles_t *extents)
+{
+    comac_surface_t *scratch;
+    comac_status_t status;
+
+    if (is_cmyk_operator (extents->op))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    scratch = rgb_scratch_create (extents);
+    if (unlikely (scratch->status))
+	return scratch->status;
+
+    status = _comac_surface_offset_mask (scratch,
+					 extents->unbounded.x,
+					 extents->unbounded.y,
+					 extents->op,
+					 &extents->source_pattern.base,
+					 &extents->mask_pattern.base,
+					 extents->clip);
+    return rgb_scratch_composite (extents, scratch, status);
+}
+
+static comac_int_status_t
+check_stroke (const comac_compositor_t *compositor,
+	      comac_composite_rectangles_t *extents,
+	      const comac_path_fixed_t *path,
+	      const comac_stroke_style_t *style,
+	      const comac_matrix_t *ctm,
+	      const comac_matrix_t *ctm_inverse,
+	      double tolerance,
+	      comac_antialias_t antialias)
+{
+    comac_surface_t *scratch;
+    comac_status_t status;
+
+    if (is_cmyk_operator (extents->op))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    scratch = rgb_scratch_create (extents);
+    if (unlikely (scratch->status))
+	return scratch->status;
+
+    status = _comac_surface_offset_stroke (scratch,
+					   extents->unbounded.x,
+					   extents->unbounded.y,
+					   extents->op,
+					   &extents->source_pattern.base,
+					   path,
+					   style,
+					   ctm,
+					   ctm_inverse,
+					   tolerance,
+					   antialias,
+					   extents->clip);
+    return rgb_scratch_composite (extents, scratch, status);
+}
+
+static comac_int_status_t
+check_fill (const comac_compositor_t *compositor,
+	    comac_composite_rectangles_t *extents,
+	    const comac_path_fixed_t *path,
+	    comac_fill_rule_t fill_rule,
+	    double tolerance,
+	    comac_antialias_t antialias)
+{
+    comac_surface_t *scratch;
+    comac_status_t status;
+
+    if (is_cmyk_operator (extents->op))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    scratch = rgb_scratch_create (extents);
+    if (unlikely (scratch->status))
+	return scratch->status;
+
+    status = _comac_surface_offset_fill (scratch,
+					 extents->unbounded.x,
+					 extents->unbounded.y,
+					 extents->op,
+					 &extents->source_pattern.base,
+					 path,
+					 fill_rule,
+					 tolerance,
+					 antialias,
+					 extents->clip);
+    return rgb_scratch_composite (extents, scratch, status);
+}
+
+static comac_int_status_t
+check_glyphs (const comac_compositor_t *compositor,
+	      comac_composite_rectangles_t *extents,
+	      comac_scaled_font_t *scaled_font,
+	      comac_glyph_t *glyphs,
+	      int num_glyphs,
+	      comac_bool_t overlap)
+{
+    comac_surface_t *scratch;
+    comac_status_t status;
+
+    if (is_cmyk_operator (extents->op))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    scratch = rgb_scratch_create (extents);
+    if (unlikely (scratch->status))
+	return scratch->status;
+
+    status = _comac_surface_offset_glyphs (scratch,
+					   extents->unbounded.x,
+					   extents->unbounded.y,
+					   extents->op,
+					   &extents->source_pattern.base,
+					   scaled_font,
+					   glyphs,
+					   num_glyphs,
+					   extents->clip);
+    return rgb_scratch_composite (extents, scratch, status);
+}
+
+const comac_compositor_t *
+_comac_image_cmyk_compositor_get (void)
+{
+    static comac_atomic_once_t once = COMAC_ATOMIC_ONCE_INIT;
+    static comac_compositor_t check, mask;
+    static comac_spans_compositor_t spans;
+
+    if (_comac_atomic_init_once_enter (&once)) {
+	pixman_spans = (const comac_spans_compositor_t *)
+	    _comac_image_spans_compositor_get ();
+
+	mask.delegate = &__comac_no_compositor;
+	mask.paint = mask_paint;
+	mask.mask = mask_mask;
+	mask.stroke = mask_stroke;
+	mask.fill = mask_fill;
+	mask.glyphs = mask_glyphs;
+
+	_comac_spans_compositor_init (&spans, &mask);
+	spans.flags |= COMAC_SPANS_COMPOSITOR_HAS_LERP;
+	spans.fill_boxes = fill_boxes;
+	spans.draw_image_boxes = draw_image_boxes;
+	spans.pattern_to_surface = pattern_to_surface;
+	spans.composite_boxes = composite_boxes;
+	spans.renderer_init = span_renderer_init;
+	spans.renderer_fini = span_renderer_fini;
+
+	check.delegate = &spans.base;
+	check.paint = check_paint;
+	check.mask = check_mask;
+	check.stroke = check_stroke;
+	check.fill = check_fill;
+	check.glyphs = check_glyphs;
+
+	_comac_atomic_init_once_leave (&once);
+    }
+
+    return &check;
+}
@@ -97,6 +97,9 @@ draw_image_boxes (void *_dst,
 
     TRACE ((stderr, "%s x %d\n", __FUNCTION__, boxes->num_boxes));
 
+    if (image->format == COMAC_FORMAT_CMYKA)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
     for (chunk = &boxes->chunks; chunk; chunk = chunk->next) {
 	for (i = 0; i < chunk->count; i++) {
 	    comac_box_t *b = &chunk->base[i];
@@ -3340,6 +3343,7 @@ inplace_renderer_init (comac_image_span_renderer_t *r,
 		case COMAC_FORMAT_RGB30:
 		case COMAC_FORMAT_RGB96F:
 		case COMAC_FORMAT_RGBA128F:
+		case COMAC_FORMAT_CMYKA:
 		case COMAC_FORMAT_INVALID:
 		default:
 		    break;
@@ -3358,6 +3362,7 @@ inplace_renderer_init (comac_image_span_renderer_t *r,
 		case COMAC_FORMAT_RGB30:
 		case COMAC_FORMAT_RGB96F:
 		case COMAC_FORMAT_RGBA128F:
+		case COMAC_FORMAT_CMYKA:
 		case COMAC_FORMAT_INVALID:
 		default:
 		    break;
@@ -60,6 +60,23 @@ _comac_image_info_get_png_info (comac_image_info_t *info,
 				const unsigned char *data,
 				unsigned long length);
 
+typedef comac_int_status_t (*comac_image_info_png_func_t) (
+    void *closure,
+    const unsigned char *data,
+    unsigned long length);
+
+/* Checks that @data is a PNG that can be used without decoding it:
+ * not interlaced, not a palette image, without a tRNS chunk and with
+ * all of its IDAT chunks together. If so and @func is not %NULL,
+ * calls @func with the data of each IDAT chunk in turn. Together they
+ * form the zlib stream of the filtered image rows.
+ */
+comac_private comac_int_status_t
+_comac_image_info_png_foreach_idat (const unsigned char *data,
+				    unsigned long length,
+				    comac_image_info_png_func_t func,
+				    void *closure);
+
 comac_private comac_int_status_t
 _comac_image_info_get_jbig2_info (comac_image_info_t *info,
 				  const unsigned char *data,
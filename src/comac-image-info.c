@@ -252,6 +252,15 @@ _comac_image_info_get_jpx_info (comac_image_info_t *info,
  */
 
 #define PNG_IHDR 0x49484452
+#define PNG_IDAT 0x49444154
+#define PNG_IEND 0x49454e44
+#define PNG_tRNS 0x74524e53
+
+#define PNG_COLOR_TYPE_GRAY 0
+#define PNG_COLOR_TYPE_RGB 2
+#define PNG_COLOR_TYPE_PALETTE 3
+#define PNG_COLOR_TYPE_GRAY_ALPHA 4
+#define PNG_COLOR_TYPE_RGB_ALPHA 6
 
 static const unsigned char _png_magic[8] = {137, 80, 78, 71, 13, 10, 26, 10};
 
@@ -281,6 +290,103 @@ _comac_image_info_get_png_info (comac_image_info_t *info,
     info->width = get_unaligned_be32 (p);
     p += 4;
     info->height = get_unaligned_be32 (p);
+    p += 4;
+    info->bits_per_component = p[0];
+    switch (p[1]) {
+    case PNG_COLOR_TYPE_GRAY:
+    case PNG_COLOR_TYPE_PALETTE:
+	info->num_components = 1;
+	break;
+    case PNG_COLOR_TYPE_GRAY_ALPHA:
+	info->num_components = 2;
+	break;
+    case PNG_COLOR_TYPE_RGB:
+	info->num_components = 3;
+	break;
+    case PNG_COLOR_TYPE_RGB_ALPHA:
+	info->num_components = 4;
+	break;
+    default:
+	return COMAC_INT_STATUS_UNSUPPORTED;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+comac_int_status_t
+_comac_image_info_png_foreach_idat (const unsigned char *data,
+				    unsigned long length,
+				    comac_image_info_png_func_t func,
+				    void *closure)
+{
+    const unsigned char *p = data + 8;
+    const unsigned char *end = data + length;
+    const unsigned char *ihdr;
+    unsigned long chunk_length;
+    uint32_t type, prev_type = 0;
+    comac_bool_t seen_idat = FALSE;
+    comac_int_status_t status;
+
+    if (length < 8 || memcmp (data, _png_magic, 8) != 0)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    /* Check every chunk before calling func, so that nothing is
+     * written for data that turns out to be unsupported. */
+    ihdr = NULL;
+    while (TRUE) {
+	if (end - p < 12)
+	    return COMAC_INT_STATUS_UNSUPPORTED;
+
+	chunk_length = get_unaligned_be32 (p);
+	type = get_unaligned_be32 (p + 4);
+	if (chunk_length > (unsigned long) (end - p) - 12)
+	    return COMAC_INT_STATUS_UNSUPPORTED;
+
+	if (ihdr == NULL) {
+	    if (type != PNG_IHDR || chunk_length < 13)
+		return COMAC_INT_STATUS_UNSUPPORTED;
+	    ihdr = p + 8;
+	}
+
+	/* Transparency would be lost, and all IDAT chunks have to
+	 * follow each other to form a single zlib stream. */
+	if (type == PNG_tRNS)
+	    return COMAC_INT_STATUS_UNSUPPORTED;
+	if (type == PNG_IDAT) {
+	    if (seen_idat && prev_type != PNG_IDAT)
+		return COMAC_INT_STATUS_UNSUPPORTED;
+	    seen_idat = TRUE;
+	}
+
+	p += chunk_length + 12;
+	prev_type = type;
+	if (type == PNG_IEND)
+	    break;
+    }
+
+    /* Palette images would need their PLTE chunk as well. Otherwise
+     * only compression method 0, filter method 0 and no interlacing
+     * are supported. */
+    if (! seen_idat || ihdr[9] == PNG_COLOR_TYPE_PALETTE || ihdr[10] != 0 ||
+	ihdr[11] != 0 || ihdr[12] != 0)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    if (func == NULL)
+	return COMAC_STATUS_SUCCESS;
+
+    p = data + 8;
+    while (TRUE) {
+	chunk_length = get_unaligned_be32 (p);
+	type = get_unaligned_be32 (p + 4);
+	if (type == PNG_IDAT) {
+	    status = func (closure, p + 8, chunk_length);
+	    if (unlikely (status))
+		return status;
+	}
+	if (type == PNG_IEND)
+	    break;
+	p += chunk_length + 12;
+    }
 
     return COMAC_STATUS_SUCCESS;
 }
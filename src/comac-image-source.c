@@ -470,6 +470,7 @@ _pixel_to_solid (comac_image_surface_t *image, int x, int y)
 
     switch (image->format) {
     default:
+    case COMAC_FORMAT_CMYKA:
     case COMAC_FORMAT_INVALID:
 	ASSERT_NOT_REACHED;
 	return NULL;
@@ -1332,7 +1333,11 @@ _pixman_image_for_surface (comac_image_surface_t *dst,
 	}
 
 	type = source->base.backend->type;
-	if (type == COMAC_SURFACE_TYPE_IMAGE) {
+	if (type == COMAC_SURFACE_TYPE_IMAGE &&
+	    source->format == COMAC_FORMAT_CMYKA) {
+	    /* Converted to RGB when acquired below */
+	    comac_surface_destroy (defer_free);
+	} else if (type == COMAC_SURFACE_TYPE_IMAGE) {
 	    if (extend != COMAC_EXTEND_NONE && sample->x >= 0 &&
 		sample->y >= 0 && sample->x + sample->width <= source->width &&
 		sample->y + sample->height <= source->height) {
@@ -1383,7 +1388,10 @@ _pixman_image_for_surface (comac_image_surface_t *dst,
 						   _defer_free_cleanup,
 						   defer_free);
 	    }
-	} else if (type == COMAC_SURFACE_TYPE_SUBSURFACE) {
+	} else if (type == COMAC_SURFACE_TYPE_SUBSURFACE &&
+		   to_image_surface (
+		       ((comac_surface_subsurface_t *) source)->target)
+			   ->format != COMAC_FORMAT_CMYKA) {
 	    comac_surface_subsurface_t *sub;
 	    comac_bool_t is_contained = FALSE;
 
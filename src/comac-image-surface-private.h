@@ -101,6 +101,9 @@ _comac_image_traps_compositor_get (void);
 comac_private const comac_compositor_t *
 _comac_image_spans_compositor_get (void);
 
+comac_private const comac_compositor_t *
+_comac_image_cmyk_compositor_get (void);
+
 #define _comac_image_default_compositor_get _comac_image_spans_compositor_get
 
 comac_private comac_int_status_t
@@ -152,6 +155,15 @@ _comac_image_surface_init (comac_image_surface_t *surface,
 			   pixman_image_t *pixman_image,
 			   pixman_format_code_t pixman_format);
 
+comac_private comac_surface_t *
+_comac_image_surface_create_cmyka (unsigned char *data,
+				   int width,
+				   int height,
+				   int stride);
+
+comac_private comac_image_surface_t *
+_comac_image_surface_cmyka_to_argb32 (comac_image_surface_t *image);
+
 comac_private comac_surface_t *
 _comac_image_surface_create_similar (void *abstract_other,
 				     comac_content_t content,
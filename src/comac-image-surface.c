@@ -357,6 +357,7 @@ _comac_format_to_pixman_format_code (comac_format_t format)
 	ret = PIXMAN_rgba_float;
 	break;
     case COMAC_FORMAT_ARGB32:
+    case COMAC_FORMAT_CMYKA:
     case COMAC_FORMAT_INVALID:
     default:
 	ret = PIXMAN_a8r8g8b8;
@@ -403,6 +404,86 @@ _comac_image_surface_create_with_pixman_format (
     return surface;
 }
 
+/* CMYKA has no pixman format, so these surfaces carry no pixman image
+ * and are drawn to by their own compositor. They convert the colors
+ * drawn to them from RGB like the other CMYK surfaces, with the
+ * default conversion until the user sets callbacks. */
+comac_surface_t *
+_comac_image_surface_create_cmyka (unsigned char *data,
+				   int width,
+				   int height,
+				   int stride)
+{
+    comac_image_surface_t *surface;
+    unsigned char *mem = NULL;
+
+    if (! _comac_image_surface_is_size_valid (width, height)) {
+	return _comac_surface_create_in_error (
+	    _comac_error (COMAC_STATUS_INVALID_SIZE));
+    }
+
+    if (data == NULL) {
+	stride = comac_format_stride_for_width (COMAC_FORMAT_CMYKA, width);
+	if (stride && height) {
+	    mem = calloc (height, stride);
+	    if (unlikely (mem == NULL))
+		return _comac_surface_create_in_error (
+		    _comac_error (COMAC_STATUS_NO_MEMORY));
+	}
+	data = mem;
+    }
+
+    surface = _comac_malloc (sizeof (comac_image_surface_t));
+    if (unlikely (surface == NULL)) {
+	free (mem);
+	return _comac_surface_create_in_error (
+	    _comac_error (COMAC_STATUS_NO_MEMORY));
+    }
+
+    _comac_surface_init (&surface->base,
+			 &_comac_image_surface_backend,
+			 NULL, /* device */
+			 COMAC_CONTENT_COLOR_ALPHA,
+			 FALSE, /* is_vector */
+			 COMAC_COLORSPACE_CMYK,
+			 COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
+			 comac_default_color_convert_func,
+			 NULL);
+
+    surface->parent = NULL;
+    surface->pixman_image = NULL;
+    surface->pixman_format = 0;
+    surface->format = COMAC_FORMAT_CMYKA;
+    surface->data = data;
+    surface->owns_data = mem != NULL;
+    surface->transparency = COMAC_IMAGE_UNKNOWN;
+    surface->color = COMAC_IMAGE_UNKNOWN_COLOR;
+
+    surface->width = width;
+    surface->height = height;
+    surface->stride = stride;
+    surface->depth = 40;
+
+    surface->base.is_clear = data == mem || width == 0 || height == 0;
+
+    surface->compositor = _comac_image_cmyk_compositor_get ();
+
+    return &surface->base;
+}
+
+/* Surfaces made to hold the contents of a CMYKA surface convert their
+ * colors the same way. */
+static void
+_comac_image_surface_copy_color_conversion (comac_surface_t *surface,
+					    const comac_surface_t *other)
+{
+    surface->intent = other->intent;
+    surface->color_convert = other->color_convert;
+    surface->color_convert_ctx = other->color_convert_ctx;
+    surface->color_convert_batch = other->color_convert_batch;
+    surface->color_convert_batch_ctx = other->color_convert_batch_ctx;
+}
+
 /**
  * comac_image_surface_create:
  * @format: format of pixels in the surface to create
@@ -434,6 +515,9 @@ comac_image_surface_create (comac_format_t format, int width, int height)
 	return _comac_surface_create_in_error (
 	    _comac_error (COMAC_STATUS_INVALID_FORMAT));
 
+    if (format == COMAC_FORMAT_CMYKA)
+	return _comac_image_surface_create_cmyka (NULL, width, height, 0);
+
     pixman_format = _comac_format_to_pixman_format_code (format);
 
     return _comac_image_surface_create_with_pixman_format (NULL,
@@ -577,6 +661,9 @@ comac_image_surface_create_for_data (unsigned char *data,
 	}
     }
 
+    if (format == COMAC_FORMAT_CMYKA)
+	return _comac_image_surface_create_cmyka (data, width, height, stride);
+
     pixman_format = _comac_format_to_pixman_format_code (format);
     return _comac_image_surface_create_with_pixman_format (data,
 							   pixman_format,
@@ -734,6 +821,7 @@ _comac_content_from_format (comac_format_t format)
     switch (format) {
     case COMAC_FORMAT_RGBA128F:
     case COMAC_FORMAT_ARGB32:
+    case COMAC_FORMAT_CMYKA:
 	return COMAC_CONTENT_COLOR_ALPHA;
     case COMAC_FORMAT_RGB96F:
     case COMAC_FORMAT_RGB30:
@@ -761,6 +849,8 @@ _comac_format_bits_per_pixel (comac_format_t format)
 	return 128;
     case COMAC_FORMAT_RGB96F:
 	return 96;
+    case COMAC_FORMAT_CMYKA:
+	return 40;
     case COMAC_FORMAT_ARGB32:
     case COMAC_FORMAT_RGB30:
     case COMAC_FORMAT_RGB24:
@@ -792,6 +882,16 @@ _comac_image_surface_create_similar (void *abstract_other,
 	return _comac_surface_create_in_error (
 	    _comac_error (COMAC_STATUS_INVALID_SIZE));
 
+    if (content == other->base.content &&
+	other->format == COMAC_FORMAT_CMYKA) {
+	comac_surface_t *surface;
+
+	surface = _comac_image_surface_create_cmyka (NULL, width, height, 0);
+	if (likely (surface->status == COMAC_STATUS_SUCCESS))
+	    _comac_image_surface_copy_color_conversion (surface, &other->base);
+	return surface;
+    }
+
     if (content == other->base.content) {
 	return _comac_image_surface_create_with_pixman_format (
 	    NULL,
@@ -804,12 +904,37 @@ _comac_image_surface_create_similar (void *abstract_other,
     return _comac_image_surface_create_with_content (content, width, height);
 }
 
+static comac_surface_t *
+_comac_image_surface_snapshot_cmyka (comac_image_surface_t *image)
+{
+    comac_image_surface_t *clone;
+    int y;
+
+    clone = (comac_image_surface_t *)
+	_comac_image_surface_create_cmyka (NULL, image->width, image->height, 0);
+    if (unlikely (clone->base.status))
+	return &clone->base;
+
+    for (y = 0; y < image->height; y++) {
+	memcpy (clone->data + y * clone->stride,
+		image->data + y * image->stride,
+		5 * image->width);
+    }
+    _comac_image_surface_copy_color_conversion (&clone->base, &image->base);
+
+    clone->base.is_clear = FALSE;
+    return &clone->base;
+}
+
 comac_surface_t *
 _comac_image_surface_snapshot (void *abstract_surface)
 {
     comac_image_surface_t *image = abstract_surface;
     comac_image_surface_t *clone;
 
+    if (image->format == COMAC_FORMAT_CMYKA)
+	return _comac_image_surface_snapshot_cmyka (image);
+
     /* If we own the image, we can simply steal the memory for the snapshot */
     if (image->owns_data && image->base._finishing) {
 	clone = (comac_image_surface_t *)
@@ -867,6 +992,20 @@ _comac_image_surface_map_to_image (void *abstract_other,
 
     data = other->data;
     data += extents->y * other->stride;
+
+    if (other->format == COMAC_FORMAT_CMYKA) {
+	data += extents->x * 5;
+	surface = _comac_image_surface_create_cmyka (data,
+						     extents->width,
+						     extents->height,
+						     other->stride);
+	if (likely (surface->status == COMAC_STATUS_SUCCESS))
+	    _comac_image_surface_copy_color_conversion (surface, &other->base);
+
+	comac_surface_set_device_offset (surface, -extents->x, -extents->y);
+	return (comac_image_surface_t *) surface;
+    }
+
     data += extents->x * PIXMAN_FORMAT_BPP (other->pixman_format) / 8;
 
     surface =
@@ -940,6 +1079,26 @@ _comac_image_surface_acquire_source_image (void *abstract_surface,
 					   comac_image_surface_t **image_out,
 					   void **image_extra)
 {
+    comac_image_surface_t *surface = abstract_surface;
+
+    /* Readers of the pixels expect a pixman format, so hand them the
+     * contents of CMYKA surfaces converted to RGB */
+    if (surface->format == COMAC_FORMAT_CMYKA) {
+	comac_image_surface_t *image;
+	comac_status_t status;
+
+	image = _comac_image_surface_cmyka_to_argb32 (surface);
+	status = image->base.status;
+	if (unlikely (status)) {
+	    comac_surface_destroy (&image->base);
+	    return status;
+	}
+
+	*image_out = image;
+	*image_extra = image;
+	return COMAC_STATUS_SUCCESS;
+    }
+
     *image_out = abstract_surface;
     *image_extra = NULL;
 
@@ -951,6 +1110,8 @@ _comac_image_surface_release_source_image (void *abstract_surface,
 					   comac_image_surface_t *image,
 					   void *image_extra)
 {
+    if (image_extra != NULL)
+	comac_surface_destroy (&image->base);
 }
 
 /* high level image interface */
@@ -1158,6 +1319,18 @@ _comac_image_surface_coerce_to_format (comac_image_surface_t *surface,
 	return (comac_image_surface_t *) comac_surface_reference (
 	    &surface->base);
 
+    if (surface->format == COMAC_FORMAT_CMYKA) {
+	comac_image_surface_t *rgb;
+
+	rgb = _comac_image_surface_cmyka_to_argb32 (surface);
+	if (unlikely (rgb->base.status))
+	    return rgb;
+
+	clone = _comac_image_surface_coerce_to_format (rgb, format);
+	comac_surface_destroy (&rgb->base);
+	return clone;
+    }
+
     clone =
 	(comac_image_surface_t *) comac_image_surface_create (format,
 							      surface->width,
@@ -1392,6 +1565,32 @@ _comac_image_analyze_color (comac_image_surface_t *image)
     return _comac_image_compute_color (image);
 }
 
+/**
+ * _comac_image_compute_content_hash:
+ * @image: an image surface
+ * @hash: return location for the hash
+ *
+ * Computes a 128-bit hash of the pixel format, size and pixel data of
+ * @image. Padding at the end of each row is not included, so images
+ * with identical pixels but different strides hash the same.
+ **/
+void
+_comac_image_compute_content_hash (comac_image_surface_t *image,
+				   uint64_t hash[2])
+{
+    size_t row_length;
+    int y;
+
+    hash[0] = image->pixman_format;
+    hash[1] = ((uint64_t) image->width << 32) | (uint32_t) image->height;
+
+    row_length =
+	((size_t) image->width * PIXMAN_FORMAT_BPP (image->pixman_format) + 7) /
+	8;
+    for (y = 0; y < image->height; y++)
+	_comac_hash128_bytes (hash, image->data + y * image->stride, row_length);
+}
+
 comac_image_surface_t *
 _comac_image_surface_clone_subimage (comac_surface_t *surface,
 				     const comac_rectangle_int_t *extents)
@@ -51,6 +51,10 @@ COMAC_MUTEX_DECLARE (_comac_glyph_cache_mutex)
 COMAC_MUTEX_DECLARE (_comac_ft_unscaled_font_map_mutex)
 #endif
 
+#if COMAC_HAS_PDF_SURFACE
+COMAC_MUTEX_DECLARE (_comac_pdf_font_cache_mutex)
+#endif
+
 #if COMAC_HAS_WIN32_FONT
 COMAC_MUTEX_DECLARE (_comac_win32_font_face_mutex)
 COMAC_MUTEX_DECLARE (_comac_win32_font_dc_mutex)
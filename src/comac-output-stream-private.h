@@ -156,6 +156,25 @@ _comac_output_stream_get_status (comac_output_stream_t *stream);
 comac_private comac_output_stream_t *
 _comac_output_stream_create_for_filename (const char *filename);
 
+/* Like _comac_output_stream_create_for_filename(), but writes after
+ * the existing contents of @filename, which must exist. The position
+ * of the stream starts at the length of the file. */
+comac_private comac_output_stream_t *
+_comac_output_stream_create_for_append (const char *filename);
+
+/* Makes a stream created by _comac_output_stream_create_for_filename()
+ * write to the file from a separate thread, so that producing the
+ * output overlaps with writing it. Does nothing for other streams or
+ * where threads are not available. */
+comac_private void
+_comac_output_stream_set_write_thread (comac_output_stream_t *stream,
+				       comac_bool_t enabled);
+
+/* The number of buffers the writer thread of @stream has written to
+ * the file, for the test suite. */
+comac_private unsigned long
+_comac_output_stream_get_thread_buffers (comac_output_stream_t *stream);
+
 /* This function never returns %NULL. If an error occurs (NO_MEMORY or
  * WRITE_ERROR) while trying to create the output stream this function
  * returns a valid pointer to a nil output stream.
@@ -169,11 +188,18 @@ _comac_output_stream_create_for_file (FILE *file);
 comac_private comac_output_stream_t *
 _comac_memory_stream_create (void);
 
+/* Like _comac_memory_stream_create() but once more than @limit bytes
+ * have been written the data is moved to an unlinked temporary file,
+ * so that large streams do not have to be held in memory. A @limit of
+ * 0 keeps everything in memory. */
+comac_private comac_output_stream_t *
+_comac_memory_stream_create_with_limit (size_t limit);
+
 comac_private void
 _comac_memory_stream_copy (comac_output_stream_t *base,
 			   comac_output_stream_t *dest);
 
-comac_private int
+comac_private long long
 _comac_memory_stream_length (comac_output_stream_t *stream);
 
 comac_private comac_status_t
@@ -196,4 +222,10 @@ _comac_base64_stream_create (comac_output_stream_t *output);
 comac_private comac_output_stream_t *
 _comac_deflate_stream_create (comac_output_stream_t *output);
 
+comac_private comac_output_stream_t *
+_comac_deflate_stream_create_full (comac_output_stream_t *output,
+				   int level,
+				   int strategy,
+				   int num_threads);
+
 #endif /* COMAC_OUTPUT_STREAM_PRIVATE_H */
@@ -46,6 +46,22 @@
 #include <stdio.h>
 #include <errno.h>
 
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+#if COMAC_HAS_REAL_PTHREAD
+#include <pthread.h>
+#endif
+
 /* Numbers printed with %f are printed with this number of significant
  * digits after the decimal.
  */
@@ -387,12 +403,135 @@ _comac_dtostr (char *buffer,
     }
 }
 
+/* Enough for any number formatted by _comac_dtostr_fast(). */
+#define DTOSTR_FAST_BUFFER_SIZE 24
+
+/* Largest scaled value that can be rounded exactly, 2^52. */
+#define DTOSTR_FAST_LIMIT 4503599627370496.0
+
+static const double _comac_pow10[] = {
+    1e0,  1e1,	1e2,  1e3,  1e4,  1e5,	1e6,  1e7,  1e8,  1e9,
+    1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18,
+};
+
+static const double _comac_neg_pow10[] = {
+    1e0,   1e-1,  1e-2,  1e-3,	1e-4,  1e-5,  1e-6,  1e-7,  1e-8,  1e-9,
+    1e-10, 1e-11, 1e-12, 1e-13, 1e-14, 1e-15, 1e-16, 1e-17, 1e-18,
+};
+
+static const uint64_t _comac_pow10_int[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+};
+
+/* Format a double exactly as _comac_dtostr() does, without calling
+ * snprintf().  The number of decimal places is chosen the same way,
+ * then the value is scaled by that power of ten and rounded to an
+ * integer the way printf() rounds it: to nearest, ties to even, based
+ * on the exact binary value.  The product is rounded when it is
+ * computed, but as long as it stays below 2^52 that can only make a
+ * difference when it lands exactly halfway between two integers, and
+ * fma() recovers the discarded error in that case.
+ *
+ * @buffer must hold DTOSTR_FAST_BUFFER_SIZE bytes.  Returns the length
+ * of the formatted number, or 0 if @d is not finite or too large, in
+ * which case _comac_dtostr() has to be used.
+ */
+static int
+_comac_dtostr_fast (char *buffer, double d, comac_bool_t limited_precision)
+{
+    char digits[DTOSTR_FAST_BUFFER_SIZE];
+    double a, scaled, frac, err;
+    uint64_t r, integer, fraction;
+    int decimals, zeros, n;
+    char *p;
+
+    a = fabs (d);
+    if (limited_precision) {
+	decimals = FIXED_POINT_DECIMAL_DIGITS;
+    } else if (a >= 0.1) {
+	decimals = SIGNIFICANT_DIGITS_AFTER_DECIMAL;
+    } else {
+	/* Count the zeros after the decimal point, at most 18. */
+	zeros = 1;
+	while (zeros < 18 && a < _comac_neg_pow10[zeros + 1])
+	    zeros++;
+	decimals = MIN (zeros + SIGNIFICANT_DIGITS_AFTER_DECIMAL, 18);
+    }
+
+    scaled = a * _comac_pow10[decimals];
+    if (! (scaled < DTOSTR_FAST_LIMIT))
+	return 0;
+
+    r = (uint64_t) scaled;
+    frac = scaled - r;
+    if (frac > 0.5) {
+	r++;
+    } else if (frac == 0.5) {
+	err = fma (a, _comac_pow10[decimals], -scaled);
+	if (err > 0 || (err == 0 && (r & 1)))
+	    r++;
+    }
+
+    p = buffer;
+    /* Omit the minus sign from negative zero. */
+    if (d < 0)
+	*p++ = '-';
+
+    integer = r / _comac_pow10_int[decimals];
+    fraction = r % _comac_pow10_int[decimals];
+
+    n = 0;
+    do {
+	digits[n++] = '0' + integer % 10;
+	integer /= 10;
+    } while (integer);
+    while (n)
+	*p++ = digits[--n];
+
+    if (fraction) {
+	/* Remove trailing zeros. */
+	while (fraction % 10 == 0) {
+	    fraction /= 10;
+	    decimals--;
+	}
+
+	*p++ = '.';
+	for (n = decimals; n > 0; n--) {
+	    p[n - 1] = '0' + fraction % 10;
+	    fraction /= 10;
+	}
+	p += decimals;
+    }
+    *p = '\0';
+
+    return p - buffer;
+}
+
 enum { LENGTH_MODIFIER_LONG = 0x100, LENGTH_MODIFIER_LONG_LONG = 0x200 };
 
 /* Here's a limited reimplementation of printf.  The reason for doing
  * this is primarily to special case handling of doubles.  We want
  * locale independent formatting of doubles and we want to trim
- * trailing zeros.  This is handled by dtostr() above, and the code
+ * trailing zeros.  This is handled by _comac_dtostr_fast() above,
+ * or dtostr() for numbers it cannot handle, and the code
  * below handles everything else by calling snprintf() to do the
  * formatting.  This functionality is only for internal use and we
  * only implement the formats we actually use.
@@ -451,6 +590,30 @@ _comac_output_stream_vprintf (comac_output_stream_t *stream,
 	    }
 	}
 
+	/* Doubles are most of what goes into a content stream, so they
+	 * are formatted straight into the buffer. */
+	if ((*f == 'f' || *f == 'g') && length_modifier == 0) {
+	    double d = va_arg (ap, double);
+	    comac_bool_t limited_precision = *f == 'g';
+	    int len;
+
+	    if (buffer + sizeof (buffer) - p < DTOSTR_FAST_BUFFER_SIZE) {
+		_comac_output_stream_write (stream, buffer, p - buffer);
+		p = buffer;
+	    }
+
+	    len = _comac_dtostr_fast (p, d, limited_precision);
+	    if (len == 0) {
+		_comac_output_stream_write (stream, buffer, p - buffer);
+		_comac_dtostr (buffer, sizeof buffer, d, limited_precision);
+		p = buffer;
+		len = strlen (buffer);
+	    }
+	    p += len;
+	    f++;
+	    continue;
+	}
+
 	/* The only format strings exist in the comac implementation
 	 * itself. So there's an internal consistency problem if any
 	 * of them is larger than our format buffer size. */
@@ -533,12 +696,6 @@ _comac_output_stream_vprintf (comac_output_stream_t *stream,
 	    _comac_output_stream_write (stream, s, len);
 	    buffer[0] = 0;
 	} break;
-	case 'f':
-	    _comac_dtostr (buffer, sizeof buffer, va_arg (ap, double), FALSE);
-	    break;
-	case 'g':
-	    _comac_dtostr (buffer, sizeof buffer, va_arg (ap, double), TRUE);
-	    break;
 	case 'c':
 	    buffer[0] = va_arg (ap, int);
 	    buffer[1] = 0;
@@ -657,19 +814,6 @@ stdio_flush (comac_output_stream_t *base)
 	return COMAC_STATUS_SUCCESS;
 }
 
-static comac_status_t
-stdio_close (comac_output_stream_t *base)
-{
-    comac_status_t status;
-    stdio_stream_t *stream = (stdio_stream_t *) base;
-
-    status = stdio_flush (base);
-
-    fclose (stream->file);
-
-    return status;
-}
-
 comac_output_stream_t *
 _comac_output_stream_create_for_file (FILE *file)
 {
@@ -695,21 +839,444 @@ _comac_output_stream_create_for_file (FILE *file)
     return &stream->base;
 }
 
+#if HAVE_WRITEV && HAVE_UNISTD_H && HAVE_FCNTL_H
+/* File output stream.
+ *
+ * Output is collected in a buffer of FILE_BUFFER_SIZE bytes that is
+ * written out with a single system call once it fills up, instead of
+ * going through stdio. A write larger than the buffer is passed to
+ * writev() together with whatever is buffered, without being copied.
+ *
+ * With a writer thread, full buffers are handed over to the thread and
+ * writing continues into a second buffer, so that formatting the
+ * output overlaps with the file I/O. Only one buffer is ever pending
+ * so the thread writes them in order.
+ */
+
+#define FILE_BUFFER_SIZE (1024 * 1024)
+
+typedef struct _file_stream {
+    comac_output_stream_t base;
+    int fd;
+    unsigned char *buffer;
+    size_t length;
+
+#if COMAC_HAS_REAL_PTHREAD
+    comac_bool_t threaded;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned char *spare;
+    unsigned char *pending;
+    size_t pending_length;
+    comac_bool_t quit;
+    comac_status_t thread_status;
+    unsigned long thread_buffers;
+#endif
+} file_stream_t;
+
+static comac_status_t
+file_writev (int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+
+    while (iovcnt) {
+	ret = writev (fd, iov, iovcnt);
+	if (ret < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return COMAC_STATUS_WRITE_ERROR;
+	}
+
+	while (iovcnt && (size_t) ret >= iov->iov_len) {
+	    ret -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (iovcnt) {
+	    iov->iov_base = (char *) iov->iov_base + ret;
+	    iov->iov_len -= ret;
+	}
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+file_write_buffer (int fd, const unsigned char *data, size_t length)
+{
+    struct iovec iov;
+
+    iov.iov_base = (void *) data;
+    iov.iov_len = length;
+
+    return file_writev (fd, &iov, 1);
+}
+
+#if COMAC_HAS_REAL_PTHREAD
+static void *
+file_thread (void *closure)
+{
+    file_stream_t *stream = closure;
+    comac_status_t status;
+
+    pthread_mutex_lock (&stream->mutex);
+    for (;;) {
+	while (stream->pending == NULL && ! stream->quit)
+	    pthread_cond_wait (&stream->cond, &stream->mutex);
+	if (stream->pending == NULL)
+	    break;
+
+	pthread_mutex_unlock (&stream->mutex);
+	status = file_write_buffer (stream->fd,
+				    stream->pending,
+				    stream->pending_length);
+	pthread_mutex_lock (&stream->mutex);
+
+	if (stream->thread_status == COMAC_STATUS_SUCCESS)
+	    stream->thread_status = status;
+	stream->thread_buffers++;
+	stream->pending = NULL;
+	pthread_cond_broadcast (&stream->cond);
+    }
+    pthread_mutex_unlock (&stream->mutex);
+
+    return NULL;
+}
+
+/* Waits for the writer thread to finish the pending buffer and, if
+ * @hand_off, gives it the current one. */
+static comac_status_t
+file_sync_thread (file_stream_t *stream, comac_bool_t hand_off)
+{
+    comac_status_t status;
+    unsigned char *buffer;
+
+    pthread_mutex_lock (&stream->mutex);
+    while (stream->pending != NULL)
+	pthread_cond_wait (&stream->cond, &stream->mutex);
+
+    if (hand_off && stream->length) {
+	buffer = stream->buffer;
+	stream->buffer = stream->spare;
+	stream->spare = buffer;
+	stream->pending = buffer;
+	stream->pending_length = stream->length;
+	stream->length = 0;
+	pthread_cond_broadcast (&stream->cond);
+    }
+    status = stream->thread_status;
+    pthread_mutex_unlock (&stream->mutex);
+
+    if (unlikely (status))
+	return _comac_error (status);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+file_stop_thread (file_stream_t *stream)
+{
+    pthread_mutex_lock (&stream->mutex);
+    stream->quit = TRUE;
+    pthread_cond_broadcast (&stream->cond);
+    pthread_mutex_unlock (&stream->mutex);
+    pthread_join (stream->thread, NULL);
+
+    pthread_cond_destroy (&stream->cond);
+    pthread_mutex_destroy (&stream->mutex);
+    free (stream->spare);
+    stream->spare = NULL;
+    stream->threaded = FALSE;
+}
+#endif
+
+/* Writes out everything that is buffered and, with a writer thread,
+ * waits for it to reach the file. */
+static comac_status_t
+file_flush_buffer (file_stream_t *stream)
+{
+    comac_status_t status;
+
+#if COMAC_HAS_REAL_PTHREAD
+    if (stream->threaded) {
+	status = file_sync_thread (stream, TRUE);
+	if (unlikely (status))
+	    return status;
+
+	return file_sync_thread (stream, FALSE);
+    }
+#endif
+
+    if (stream->length == 0)
+	return COMAC_STATUS_SUCCESS;
+
+    status = file_write_buffer (stream->fd, stream->buffer, stream->length);
+    stream->length = 0;
+    if (unlikely (status))
+	return _comac_error (status);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+file_write (comac_output_stream_t *base,
+	    const unsigned char *data,
+	    unsigned int length)
+{
+    file_stream_t *stream = (file_stream_t *) base;
+    struct iovec iov[2];
+    comac_status_t status;
+    size_t count;
+
+    if (stream->length + length <= FILE_BUFFER_SIZE) {
+	memcpy (stream->buffer + stream->length, data, length);
+	stream->length += length;
+	return COMAC_STATUS_SUCCESS;
+    }
+
+#if COMAC_HAS_REAL_PTHREAD
+    if (stream->threaded) {
+	while (length) {
+	    count = MIN (length, FILE_BUFFER_SIZE - stream->length);
+	    memcpy (stream->buffer + stream->length, data, count);
+	    stream->length += count;
+	    data += count;
+	    length -= count;
+
+	    if (stream->length == FILE_BUFFER_SIZE) {
+		status = file_sync_thread (stream, TRUE);
+		if (unlikely (status))
+		    return status;
+	    }
+	}
+
+	return COMAC_STATUS_SUCCESS;
+    }
+#endif
+
+    if (length < FILE_BUFFER_SIZE) {
+	count = FILE_BUFFER_SIZE - stream->length;
+	memcpy (stream->buffer + stream->length, data, count);
+	stream->length = FILE_BUFFER_SIZE;
+
+	status = file_flush_buffer (stream);
+	if (unlikely (status))
+	    return status;
+
+	memcpy (stream->buffer, data + count, length - count);
+	stream->length = length - count;
+	return COMAC_STATUS_SUCCESS;
+    }
+
+    iov[0].iov_base = stream->buffer;
+    iov[0].iov_len = stream->length;
+    iov[1].iov_base = (void *) data;
+    iov[1].iov_len = length;
+    stream->length = 0;
+    status = file_writev (stream->fd, iov, 2);
+    if (unlikely (status))
+	return _comac_error (status);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+file_flush (comac_output_stream_t *base)
+{
+    return file_flush_buffer ((file_stream_t *) base);
+}
+
+static comac_status_t
+file_close (comac_output_stream_t *base)
+{
+    file_stream_t *stream = (file_stream_t *) base;
+    comac_status_t status = COMAC_STATUS_SUCCESS;
+
+    if (base->status == COMAC_STATUS_SUCCESS)
+	status = file_flush (base);
+
+#if COMAC_HAS_REAL_PTHREAD
+    if (stream->threaded)
+	file_stop_thread (stream);
+#endif
+
+    if (close (stream->fd) != 0 && status == COMAC_STATUS_SUCCESS)
+	status = _comac_error (COMAC_STATUS_WRITE_ERROR);
+    free (stream->buffer);
+
+    return status;
+}
+
+static comac_output_stream_t *
+_comac_file_stream_create (const char *filename, comac_bool_t append)
+{
+    file_stream_t *stream;
+    off_t position = 0;
+    int fd, flags;
+
+    flags = O_WRONLY;
+    if (! append)
+	flags |= O_CREAT | O_TRUNC;
+#ifdef O_CLOEXEC
+    flags |= O_CLOEXEC;
+#endif
+    fd = open (filename, flags, 0666);
+    if (fd >= 0 && append) {
+	position = lseek (fd, 0, SEEK_END);
+	if (position < 0) {
+	    close (fd);
+	    fd = -1;
+	}
+    }
+    if (fd < 0) {
+	switch (errno) {
+	case ENOMEM:
+	    _comac_error_throw (COMAC_STATUS_NO_MEMORY);
+	    return (comac_output_stream_t *) &_comac_output_stream_nil;
+	default:
+	    _comac_error_throw (COMAC_STATUS_WRITE_ERROR);
+	    return (
+		comac_output_stream_t *) &_comac_output_stream_nil_write_error;
+	}
+    }
+
+    stream = _comac_malloc (sizeof *stream);
+    if (unlikely (stream == NULL)) {
+	close (fd);
+	_comac_error_throw (COMAC_STATUS_NO_MEMORY);
+	return (comac_output_stream_t *) &_comac_output_stream_nil;
+    }
+
+    stream->buffer = _comac_malloc (FILE_BUFFER_SIZE);
+    if (unlikely (stream->buffer == NULL)) {
+	free (stream);
+	close (fd);
+	_comac_error_throw (COMAC_STATUS_NO_MEMORY);
+	return (comac_output_stream_t *) &_comac_output_stream_nil;
+    }
+
+    _comac_output_stream_init (&stream->base,
+			       file_write,
+			       file_flush,
+			       file_close);
+    stream->base.position = position;
+    stream->fd = fd;
+    stream->length = 0;
+#if COMAC_HAS_REAL_PTHREAD
+    stream->threaded = FALSE;
+    stream->spare = NULL;
+    stream->thread_buffers = 0;
+#endif
+
+    return &stream->base;
+}
+
 comac_output_stream_t *
 _comac_output_stream_create_for_filename (const char *filename)
+{
+    if (filename == NULL)
+	return _comac_null_stream_create ();
+
+    return _comac_file_stream_create (filename, FALSE);
+}
+
+comac_output_stream_t *
+_comac_output_stream_create_for_append (const char *filename)
+{
+    return _comac_file_stream_create (filename, TRUE);
+}
+
+void
+_comac_output_stream_set_write_thread (comac_output_stream_t *base,
+				       comac_bool_t enabled)
+{
+#if COMAC_HAS_REAL_PTHREAD
+    file_stream_t *stream = (file_stream_t *) base;
+
+    if (base->write_func != file_write || base->status ||
+	stream->threaded == enabled)
+	return;
+
+    if (! enabled) {
+	base->status = file_flush_buffer (stream);
+	file_stop_thread (stream);
+	return;
+    }
+
+    stream->spare = _comac_malloc (FILE_BUFFER_SIZE);
+    if (unlikely (stream->spare == NULL))
+	return;
+
+    pthread_mutex_init (&stream->mutex, NULL);
+    pthread_cond_init (&stream->cond, NULL);
+    stream->pending = NULL;
+    stream->quit = FALSE;
+    stream->thread_status = COMAC_STATUS_SUCCESS;
+    if (pthread_create (&stream->thread, NULL, file_thread, stream) != 0) {
+	pthread_cond_destroy (&stream->cond);
+	pthread_mutex_destroy (&stream->mutex);
+	free (stream->spare);
+	stream->spare = NULL;
+	return;
+    }
+    stream->threaded = TRUE;
+#endif
+}
+
+unsigned long
+_comac_output_stream_get_thread_buffers (comac_output_stream_t *base)
+{
+#if COMAC_HAS_REAL_PTHREAD
+    file_stream_t *stream = (file_stream_t *) base;
+    unsigned long count;
+
+    if (base->write_func != file_write || ! stream->threaded)
+	return 0;
+
+    pthread_mutex_lock (&stream->mutex);
+    count = stream->thread_buffers;
+    pthread_mutex_unlock (&stream->mutex);
+
+    return count;
+#else
+    return 0;
+#endif
+}
+#else
+static comac_status_t
+stdio_close (comac_output_stream_t *base)
+{
+    comac_status_t status;
+    stdio_stream_t *stream = (stdio_stream_t *) base;
+
+    status = stdio_flush (base);
+
+    fclose (stream->file);
+
+    return status;
+}
+
+static comac_output_stream_t *
+_comac_stdio_stream_create (const char *filename, comac_bool_t append)
 {
     stdio_stream_t *stream;
     FILE *file;
+    long position = 0;
     comac_status_t status;
 
-    if (filename == NULL)
-	return _comac_null_stream_create ();
-
-    status = _comac_fopen (filename, "wb", &file);
+    status = _comac_fopen (filename, append ? "r+b" : "wb", &file);
 
     if (status != COMAC_STATUS_SUCCESS)
 	return _comac_output_stream_create_in_error (status);
 
+    if (file != NULL && append) {
+	if (fseek (file, 0, SEEK_END) != 0 || (position = ftell (file)) < 0) {
+	    fclose (file);
+	    file = NULL;
+	}
+    }
+
     if (file == NULL) {
 	switch (errno) {
 	case ENOMEM:
@@ -733,22 +1300,120 @@ _comac_output_stream_create_for_filename (const char *filename)
 			       stdio_write,
 			       stdio_flush,
 			       stdio_close);
+    stream->base.position = position;
     stream->file = file;
 
     return &stream->base;
 }
 
+comac_output_stream_t *
+_comac_output_stream_create_for_filename (const char *filename)
+{
+    if (filename == NULL)
+	return _comac_null_stream_create ();
+
+    return _comac_stdio_stream_create (filename, FALSE);
+}
+
+comac_output_stream_t *
+_comac_output_stream_create_for_append (const char *filename)
+{
+    return _comac_stdio_stream_create (filename, TRUE);
+}
+
+void
+_comac_output_stream_set_write_thread (comac_output_stream_t *stream,
+				       comac_bool_t enabled)
+{
+}
+
+unsigned long
+_comac_output_stream_get_thread_buffers (comac_output_stream_t *stream)
+{
+    return 0;
+}
+#endif
+
+#if (HAVE_COPY_FILE_RANGE || HAVE_SENDFILE) && HAVE_UNISTD_H
+/* Returns the file descriptor that @stream writes to, with everything
+ * written so far already in the file, or -1. */
+static int
+_comac_output_stream_get_fd (comac_output_stream_t *stream)
+{
+#if HAVE_WRITEV && HAVE_UNISTD_H && HAVE_FCNTL_H
+    if (stream->write_func == file_write) {
+	if (file_flush_buffer ((file_stream_t *) stream))
+	    return -1;
+
+	return ((file_stream_t *) stream)->fd;
+    }
+#endif
+
+    if (stream->write_func == stdio_write) {
+	if (fflush (((stdio_stream_t *) stream)->file) != 0)
+	    return -1;
+
+	return fileno (((stdio_stream_t *) stream)->file);
+    }
+
+    return -1;
+}
+#endif
+
 typedef struct _memory_stream {
     comac_output_stream_t base;
     comac_array_t array;
+    size_t limit;
+    FILE *file;
 } memory_stream_t;
 
+/* Moves the data held in memory to an unlinked temporary file, where
+ * everything written afterwards goes as well. */
+static comac_status_t
+memory_spill (memory_stream_t *stream)
+{
+    unsigned int length;
+
+    stream->file = tmpfile ();
+    if (unlikely (stream->file == NULL))
+	return _comac_error (COMAC_STATUS_WRITE_ERROR);
+
+    length = _comac_array_num_elements (&stream->array);
+    if (length &&
+	fwrite (_comac_array_index (&stream->array, 0),
+		1,
+		length,
+		stream->file) != length)
+	return _comac_error (COMAC_STATUS_WRITE_ERROR);
+
+    _comac_array_fini (&stream->array);
+    _comac_array_init (&stream->array, 1);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
 static comac_status_t
 memory_write (comac_output_stream_t *base,
 	      const unsigned char *data,
 	      unsigned int length)
 {
     memory_stream_t *stream = (memory_stream_t *) base;
+    comac_status_t status;
+
+    if (stream->file == NULL && stream->limit &&
+	_comac_array_num_elements (&stream->array) + (size_t) length >
+	    stream->limit) {
+	status = memory_spill (stream);
+	if (unlikely (status))
+	    return status;
+    }
+
+    if (stream->file) {
+	if (fwrite (data, 1, length, stream->file) != length)
+	    return _comac_error (COMAC_STATUS_WRITE_ERROR);
+
+	return COMAC_STATUS_SUCCESS;
+    }
 
     return _comac_array_append_multiple (&stream->array, data, length);
 }
@@ -759,12 +1424,20 @@ memory_close (comac_output_stream_t *base)
     memory_stream_t *stream = (memory_stream_t *) base;
 
     _comac_array_fini (&stream->array);
+    if (stream->file)
+	fclose (stream->file);
 
     return COMAC_STATUS_SUCCESS;
 }
 
 comac_output_stream_t *
 _comac_memory_stream_create (void)
+{
+    return _comac_memory_stream_create_with_limit (0);
+}
+
+comac_output_stream_t *
+_comac_memory_stream_create_with_limit (size_t limit)
 {
     memory_stream_t *stream;
 
@@ -776,10 +1449,40 @@ _comac_memory_stream_create (void)
 
     _comac_output_stream_init (&stream->base, memory_write, NULL, memory_close);
     _comac_array_init (&stream->array, 1);
+    stream->limit = limit;
+    stream->file = NULL;
 
     return &stream->base;
 }
 
+/* Writes the temporary file from @offset onwards to @dest. The file
+ * position is left at the end for any later writes. */
+static void
+memory_copy_file (memory_stream_t *stream,
+		  long long offset,
+		  comac_output_stream_t *dest)
+{
+    unsigned char buf[64 * 1024];
+    size_t length;
+
+    if (fflush (stream->file) != 0 ||
+	fseek (stream->file, offset, SEEK_SET) != 0) {
+	dest->status = _comac_error (COMAC_STATUS_WRITE_ERROR);
+	return;
+    }
+
+    while ((length = fread (buf, 1, sizeof (buf), stream->file)) > 0) {
+	_comac_output_stream_write (dest, buf, length);
+	if (unlikely (dest->status))
+	    break;
+    }
+
+    if (ferror (stream->file) || fseek (stream->file, 0, SEEK_END) != 0) {
+	if (dest->status == COMAC_STATUS_SUCCESS)
+	    dest->status = _comac_error (COMAC_STATUS_WRITE_ERROR);
+    }
+}
+
 comac_status_t
 _comac_memory_stream_destroy (comac_output_stream_t *abstract_stream,
 			      unsigned char **data_out,
@@ -787,6 +1490,7 @@ _comac_memory_stream_destroy (comac_output_stream_t *abstract_stream,
 {
     memory_stream_t *stream;
     comac_status_t status;
+    long long length;
 
     status = abstract_stream->status;
     if (unlikely (status))
@@ -794,23 +1498,92 @@ _comac_memory_stream_destroy (comac_output_stream_t *abstract_stream,
 
     stream = (memory_stream_t *) abstract_stream;
 
-    *length_out = _comac_array_num_elements (&stream->array);
+    length = _comac_memory_stream_length (abstract_stream);
+    if (unlikely ((long long) (unsigned long) length != length)) {
+	status = _comac_output_stream_destroy (abstract_stream);
+	assert (status == COMAC_STATUS_SUCCESS);
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    *length_out = length;
     *data_out = _comac_malloc (*length_out);
     if (unlikely (*data_out == NULL)) {
 	status = _comac_output_stream_destroy (abstract_stream);
 	assert (status == COMAC_STATUS_SUCCESS);
 	return _comac_error (COMAC_STATUS_NO_MEMORY);
     }
-    memcpy (*data_out, _comac_array_index (&stream->array, 0), *length_out);
+
+    if (stream->file) {
+	if (fflush (stream->file) != 0 ||
+	    fseek (stream->file, 0, SEEK_SET) != 0 ||
+	    fread (*data_out, 1, length, stream->file) != *length_out) {
+	    free (*data_out);
+	    status = _comac_output_stream_destroy (abstract_stream);
+	    assert (status == COMAC_STATUS_SUCCESS);
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	}
+    } else {
+	memcpy (*data_out, _comac_array_index (&stream->array, 0), length);
+    }
 
     return _comac_output_stream_destroy (abstract_stream);
 }
 
+/* Copies a spilled stream to @dest with copy_file_range() or sendfile()
+ * when @dest writes to a file descriptor, so the data does not pass
+ * through user space. Returns the number of bytes copied, which may
+ * be less than @length if the copy could not be completed that way. */
+static long long
+memory_copy_file_range (memory_stream_t *stream,
+			comac_output_stream_t *dest,
+			long long length)
+{
+    long long copied = 0;
+#if (HAVE_COPY_FILE_RANGE || HAVE_SENDFILE) && HAVE_UNISTD_H
+    off_t offset = 0;
+    ssize_t ret;
+    int fd_in, fd_out;
+
+    fd_out = _comac_output_stream_get_fd (dest);
+    if (fd_out < 0 || fflush (stream->file) != 0)
+	return 0;
+
+    fd_in = fileno (stream->file);
+    if (fd_in < 0)
+	return 0;
+
+#if HAVE_COPY_FILE_RANGE
+    while (copied < length) {
+	ret = copy_file_range (fd_in,
+			       &offset,
+			       fd_out,
+			       NULL,
+			       length - copied,
+			       0);
+	if (ret <= 0)
+	    break;
+	copied += ret;
+    }
+#endif
+#if HAVE_SENDFILE
+    while (copied < length) {
+	ret = sendfile (fd_out, fd_in, &offset, length - copied);
+	if (ret <= 0)
+	    break;
+	copied += ret;
+    }
+#endif
+#endif
+
+    return copied;
+}
+
 void
 _comac_memory_stream_copy (comac_output_stream_t *base,
 			   comac_output_stream_t *dest)
 {
     memory_stream_t *stream = (memory_stream_t *) base;
+    long long copied;
 
     if (dest->status)
 	return;
@@ -820,16 +1593,27 @@ _comac_memory_stream_copy (comac_output_stream_t *base,
 	return;
     }
 
-    _comac_output_stream_write (dest,
-				_comac_array_index (&stream->array, 0),
-				_comac_array_num_elements (&stream->array));
+    if (stream->file == NULL) {
+	_comac_output_stream_write (dest,
+				    _comac_array_index (&stream->array, 0),
+				    _comac_array_num_elements (&stream->array));
+	return;
+    }
+
+    copied = memory_copy_file_range (stream, dest, base->position);
+    dest->position += copied;
+    if (copied < base->position)
+	memory_copy_file (stream, copied, dest);
 }
 
-int
+long long
 _comac_memory_stream_length (comac_output_stream_t *base)
 {
     memory_stream_t *stream = (memory_stream_t *) base;
 
+    if (stream->file)
+	return base->position;
+
     return _comac_array_num_elements (&stream->array);
 }
 
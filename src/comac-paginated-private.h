@@ -176,4 +176,8 @@ _comac_paginated_surface_set_size (comac_surface_t *surface,
 				   int width,
 				   int height);
 
+comac_private void
+_comac_paginated_surface_count_pages (comac_surface_t *surface,
+				      int num_pages);
+
 #endif /* COMAC_PAGINATED_H */
@@ -48,6 +48,7 @@
 #include "comac-paginated-surface-private.h"
 #include "comac-recording-surface-private.h"
 #include "comac-analysis-surface-private.h"
+#include "comac-default-context-private.h"
 #include "comac-error-private.h"
 #include "comac-image-surface-private.h"
 #include "comac-surface-subsurface-inline.h"
@@ -199,6 +200,21 @@ _comac_paginated_surface_set_size (comac_surface_t *surface,
     return COMAC_STATUS_SUCCESS;
 }
 
+/* Accounts for pages that were written to the target without going
+ * through the paginated surface, so that finishing it does not add a
+ * blank page to a document that already has some. */
+void
+_comac_paginated_surface_count_pages (comac_surface_t *surface,
+				      int num_pages)
+{
+    comac_paginated_surface_t *paginated_surface;
+
+    assert (_comac_surface_is_paginated (surface));
+
+    paginated_surface = (comac_paginated_surface_t *) surface;
+    paginated_surface->page_num += num_pages;
+}
+
 static comac_status_t
 _comac_paginated_surface_finish (void *abstract_surface)
 {
@@ -217,8 +233,14 @@ _comac_paginated_surface_finish (void *abstract_surface)
       * and check the status afterwards. However, we can only call finish()
       * on the target, if we own it.
       */
-    if (COMAC_REFERENCE_COUNT_GET_VALUE (&surface->target->ref_count) == 1)
+    if (COMAC_REFERENCE_COUNT_GET_VALUE (&surface->target->ref_count) == 1) {
 	comac_surface_finish (surface->target);
+
+	/* Keep the color cache statistics of the target for observers */
+	free (surface->base.color_cache);
+	surface->base.color_cache = surface->target->color_cache;
+	surface->target->color_cache = NULL;
+    }
     if (status == COMAC_STATUS_SUCCESS)
 	status = comac_surface_status (surface->target);
     comac_surface_destroy (surface->target);
@@ -424,23 +446,54 @@ CLEANUP_IMAGE:
 static comac_int_status_t
 _paint_page (comac_paginated_surface_t *surface)
 {
-    comac_surface_t *analysis;
+    comac_surface_t *analysis = NULL;
     comac_int_status_t status;
     comac_bool_t has_supported, has_page_fallback, has_finegrained_fallback;
+    comac_bool_t is_native = FALSE;
 
     if (unlikely (surface->target->status))
 	return surface->target->status;
 
-    analysis = _comac_analysis_surface_create (surface->target);
-    if (unlikely (analysis->status))
-	return _comac_surface_set_error (surface->target, analysis->status);
-
     status =
 	surface->backend->set_paginated_mode (surface->target,
 					      COMAC_PAGINATED_MODE_ANALYZE);
     if (unlikely (status))
 	goto FAIL;
 
+    /* Most pages are drawn without a single fallback image. Unless the
+     * target needs the bounding box that only the analysis surface
+     * computes, first ask it whether it supports all of the page, and
+     * skip the analysis replay if it does. */
+    if (surface->backend->set_bounding_box == NULL) {
+	status = _comac_recording_surface_analyze_native (
+	    surface->recording_surface,
+	    surface->target,
+	    &is_native);
+	if (unlikely (status))
+	    goto FAIL;
+    }
+
+    if (is_native) {
+	if (surface->backend->set_fallback_images_required) {
+	    status = surface->backend->set_fallback_images_required (
+		surface->target,
+		FALSE);
+	    if (unlikely (status))
+		goto FAIL;
+	}
+
+	has_supported = TRUE;
+	has_page_fallback = FALSE;
+	has_finegrained_fallback = FALSE;
+	goto RENDER;
+    }
+
+    analysis = _comac_analysis_surface_create (surface->target);
+    if (unlikely (analysis->status)) {
+	status = analysis->status;
+	goto FAIL;
+    }
+
     status = _comac_recording_surface_replay_and_create_regions (
 	surface->recording_surface,
 	NULL,
@@ -490,6 +543,7 @@ _paint_page (comac_paginated_surface_t *surface)
 	has_finegrained_fallback = FALSE;
     }
 
+RENDER:
     if (has_supported) {
 	status =
 	    surface->backend->set_paginated_mode (surface->target,
@@ -817,14 +871,10 @@ _comac_paginated_surface_snapshot (void *abstract_other)
 static comac_t *
 _comac_paginated_context_create (void *target)
 {
-    comac_paginated_surface_t *surface = target;
-
-    if (_comac_surface_is_subsurface (&surface->base))
-	surface =
-	    (comac_paginated_surface_t *) _comac_surface_subsurface_get_target (
-		&surface->base);
-
-    return surface->recording_surface->backend->create_context (target);
+    /* @target may also be a surface wrapping this one, such as an
+     * observer, so it must not be taken for a paginated surface. The
+     * recording surface uses the default context as well. */
+    return _comac_default_context_create (target);
 }
 
 static const comac_surface_backend_t comac_paginated_surface_backend = {
@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#ifndef COMAC_PDF_FONT_CACHE_PRIVATE_H
+#define COMAC_PDF_FONT_CACHE_PRIVATE_H
+
+#include "comacint.h"
+#include "comac-scaled-font-subsets-private.h"
+
+/* A process-wide cache of the results of font subsetting, shared by
+ * the PDF surfaces that enable it with
+ * comac_pdf_surface_set_font_subset_cache(). Entries are keyed by the
+ * font face, the font and subset ids and the glyphs of the subset, so
+ * a document using the same fonts and glyphs as an earlier one gets
+ * copies of the earlier subsets without parsing the fonts again.
+ * Subsetters that do not support a font are not tried again either. */
+
+/**
+ * _comac_pdf_font_cache_truetype_subset_init:
+ * @subset: a #comac_truetype_subset_t to initialize
+ * @font_subset: the #comac_scaled_font_subset_t to initialize from
+ *
+ * Like _comac_truetype_subset_init_pdf(), which is called on a cache
+ * miss. @subset must be freed with _comac_truetype_subset_fini().
+ **/
+comac_private comac_status_t
+_comac_pdf_font_cache_truetype_subset_init (
+    comac_truetype_subset_t *subset, comac_scaled_font_subset_t *font_subset);
+
+/**
+ * _comac_pdf_font_cache_cff_subset_init:
+ * @subset: a #comac_cff_subset_t to initialize
+ * @name: the name passed on to the subsetter
+ * @font_subset: the #comac_scaled_font_subset_t to initialize from
+ * @fallback: %TRUE to use _comac_cff_fallback_init() rather than
+ * _comac_cff_subset_init()
+ *
+ * Like _comac_cff_subset_init() or _comac_cff_fallback_init(), which
+ * is called on a cache miss. @subset must be freed with the matching
+ * fini function.
+ **/
+comac_private comac_status_t
+_comac_pdf_font_cache_cff_subset_init (comac_cff_subset_t *subset,
+				       const char *name,
+				       comac_scaled_font_subset_t *font_subset,
+				       comac_bool_t fallback);
+
+#endif /* COMAC_PDF_FONT_CACHE_PRIVATE_H */
@@ -0,0 +1,451 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-pdf-font-cache-private.h"
+#include "comac-cache-private.h"
+#include "comac-error-private.h"
+#include "comac-scaled-font-private.h"
+
+/* The total size of the cached subsets. A document with a few fonts
+ * needs a few hundred kilobytes. */
+#define PDF_FONT_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
+typedef enum _comac_pdf_font_cache_type {
+    PDF_FONT_CACHE_TRUETYPE,
+    PDF_FONT_CACHE_CFF,
+    PDF_FONT_CACHE_CFF_FALLBACK
+} comac_pdf_font_cache_type_t;
+
+/* The fields shared by #comac_truetype_subset_t and #comac_cff_subset_t
+ * that the PDF surface uses. */
+typedef struct _comac_pdf_font_cache_value {
+    char *family_name_utf8;
+    char *ps_name;
+    double *widths;
+    double x_min, y_min, x_max, y_max;
+    double ascent, descent;
+    unsigned char *data;
+    unsigned long data_length;
+} comac_pdf_font_cache_value_t;
+
+typedef struct _comac_pdf_font_cache_entry {
+    comac_cache_entry_t base;
+
+    comac_pdf_font_cache_type_t type;
+    comac_font_face_t *font_face; /* a reference is held by the cache */
+    comac_bool_t is_synthetic;
+    unsigned int font_id;
+    unsigned int subset_id;
+    comac_bool_t is_latin;
+    unsigned int num_glyphs;
+    unsigned long *glyphs;
+    int *to_latin_char; /* NULL unless is_latin */
+
+    /* %COMAC_INT_STATUS_UNSUPPORTED records that the subsetter does not
+     * handle the font, so that it is not parsed again either. */
+    comac_int_status_t status;
+    comac_pdf_font_cache_value_t value;
+} comac_pdf_font_cache_entry_t;
+
+static comac_cache_t comac_pdf_font_cache;
+
+/* The scaled fonts of a face only differ in ways the subsetters ignore,
+ * apart from synthetic styles, which they do not support. The font ids
+ * are part of the key because the subsetters use them to name fonts
+ * without a PostScript name. */
+static comac_bool_t
+_comac_pdf_font_cache_init_key (comac_pdf_font_cache_entry_t *key,
+				comac_pdf_font_cache_type_t type,
+				comac_scaled_font_subset_t *font_subset)
+{
+    comac_scaled_font_t *scaled_font = font_subset->scaled_font;
+    uintptr_t hash;
+
+    if (scaled_font->font_face == NULL)
+	return FALSE;
+
+    key->is_synthetic = FALSE;
+    if (scaled_font->backend->is_synthetic &&
+	scaled_font->backend->is_synthetic (scaled_font, &key->is_synthetic))
+	return FALSE;
+
+    key->type = type;
+    key->font_face = scaled_font->font_face;
+    key->font_id = font_subset->font_id;
+    key->subset_id = font_subset->subset_id;
+    key->is_latin = font_subset->is_latin;
+    key->num_glyphs = font_subset->num_glyphs;
+    key->glyphs = font_subset->glyphs;
+    key->to_latin_char =
+	font_subset->is_latin ? font_subset->to_latin_char : NULL;
+
+    hash = _COMAC_HASH_INIT_VALUE;
+    hash = _comac_hash_bytes (hash, &key->type, sizeof (key->type));
+    hash = _comac_hash_bytes (hash, &key->font_face, sizeof (key->font_face));
+    hash = _comac_hash_bytes (hash,
+			      &key->is_synthetic,
+			      sizeof (key->is_synthetic));
+    hash = _comac_hash_bytes (hash, &key->font_id, sizeof (key->font_id));
+    hash = _comac_hash_bytes (hash, &key->subset_id, sizeof (key->subset_id));
+    hash = _comac_hash_bytes (hash, &key->is_latin, sizeof (key->is_latin));
+    hash = _comac_hash_bytes (hash,
+			      key->glyphs,
+			      key->num_glyphs * sizeof (unsigned long));
+    if (key->to_latin_char) {
+	hash = _comac_hash_bytes (hash,
+				  key->to_latin_char,
+				  key->num_glyphs * sizeof (int));
+    }
+    key->base.hash = hash;
+
+    return TRUE;
+}
+
+static comac_bool_t
+_comac_pdf_font_cache_keys_equal (const void *key_a, const void *key_b)
+{
+    const comac_pdf_font_cache_entry_t *a = key_a;
+    const comac_pdf_font_cache_entry_t *b = key_b;
+
+    if (a->type != b->type || a->font_face != b->font_face ||
+	a->is_synthetic != b->is_synthetic || a->font_id != b->font_id ||
+	a->subset_id != b->subset_id || a->is_latin != b->is_latin ||
+	a->num_glyphs != b->num_glyphs)
+	return FALSE;
+
+    if (memcmp (a->glyphs, b->glyphs, a->num_glyphs * sizeof (unsigned long)))
+	return FALSE;
+
+    if (a->to_latin_char && memcmp (a->to_latin_char,
+				    b->to_latin_char,
+				    a->num_glyphs * sizeof (int)))
+	return FALSE;
+
+    return TRUE;
+}
+
+static void
+_comac_pdf_font_cache_value_fini (comac_pdf_font_cache_value_t *value)
+{
+    free (value->family_name_utf8);
+    free (value->ps_name);
+    free (value->widths);
+    free (value->data);
+}
+
+static comac_status_t
+_comac_pdf_font_cache_value_copy (comac_pdf_font_cache_value_t *dst,
+				  const comac_pdf_font_cache_value_t *src,
+				  unsigned int num_glyphs)
+{
+    *dst = *src;
+    dst->family_name_utf8 = NULL;
+    dst->ps_name = NULL;
+    dst->widths = NULL;
+    dst->data = NULL;
+
+    if (src->family_name_utf8) {
+	dst->family_name_utf8 = strdup (src->family_name_utf8);
+	if (unlikely (dst->family_name_utf8 == NULL))
+	    goto FAIL;
+    }
+
+    if (src->ps_name) {
+	dst->ps_name = strdup (src->ps_name);
+	if (unlikely (dst->ps_name == NULL))
+	    goto FAIL;
+    }
+
+    dst->widths = _comac_malloc_ab (num_glyphs, sizeof (double));
+    if (unlikely (dst->widths == NULL))
+	goto FAIL;
+    memcpy (dst->widths, src->widths, num_glyphs * sizeof (double));
+
+    dst->data = _comac_malloc (src->data_length);
+    if (unlikely (dst->data == NULL))
+	goto FAIL;
+    memcpy (dst->data, src->data, src->data_length);
+
+    return COMAC_STATUS_SUCCESS;
+
+FAIL:
+    _comac_pdf_font_cache_value_fini (dst);
+    memset (dst, 0, sizeof (comac_pdf_font_cache_value_t));
+    return _comac_error (COMAC_STATUS_NO_MEMORY);
+}
+
+static void
+_comac_pdf_font_cache_entry_destroy (void *closure)
+{
+    comac_pdf_font_cache_entry_t *entry = closure;
+
+    _comac_pdf_font_cache_value_fini (&entry->value);
+    free (entry->glyphs);
+    free (entry->to_latin_char);
+    comac_font_face_destroy (entry->font_face);
+    free (entry);
+}
+
+/* Copies the value cached for @key to @value. Returns
+ * %COMAC_INT_STATUS_NOTHING_TO_DO if there is none, or the cached
+ * %COMAC_INT_STATUS_UNSUPPORTED. */
+static comac_int_status_t
+_comac_pdf_font_cache_lookup (comac_pdf_font_cache_entry_t *key,
+			      comac_pdf_font_cache_value_t *value)
+{
+    comac_pdf_font_cache_entry_t *entry = NULL;
+    comac_int_status_t status;
+
+    COMAC_MUTEX_LOCK (_comac_pdf_font_cache_mutex);
+    if (comac_pdf_font_cache.hash_table != NULL)
+	entry = _comac_cache_lookup (&comac_pdf_font_cache, &key->base);
+
+    if (entry != NULL && entry->status) {
+	status = entry->status;
+    } else if (entry != NULL) {
+	status = _comac_pdf_font_cache_value_copy (value,
+						   &entry->value,
+						   entry->num_glyphs);
+    } else {
+	status = COMAC_INT_STATUS_NOTHING_TO_DO;
+    }
+    COMAC_MUTEX_UNLOCK (_comac_pdf_font_cache_mutex);
+
+    return status;
+}
+
+/* Adds a copy of @value to the cache, or records @status if it is
+ * %COMAC_INT_STATUS_UNSUPPORTED. This is only an optimization, so
+ * errors are ignored. */
+static void
+_comac_pdf_font_cache_insert (comac_pdf_font_cache_entry_t *key,
+			      comac_int_status_t status,
+			      const comac_pdf_font_cache_value_t *value)
+{
+    comac_pdf_font_cache_entry_t *entry;
+
+    if (status != COMAC_INT_STATUS_SUCCESS &&
+	status != COMAC_INT_STATUS_UNSUPPORTED)
+	return;
+
+    entry = _comac_malloc (sizeof (comac_pdf_font_cache_entry_t));
+    if (unlikely (entry == NULL))
+	return;
+
+    *entry = *key;
+    entry->glyphs = NULL;
+    entry->to_latin_char = NULL;
+    entry->font_face = comac_font_face_reference (key->font_face);
+    entry->status = status;
+    memset (&entry->value, 0, sizeof (comac_pdf_font_cache_value_t));
+    if (status == COMAC_INT_STATUS_SUCCESS) {
+	status = _comac_pdf_font_cache_value_copy (&entry->value,
+						   value,
+						   key->num_glyphs);
+	if (unlikely (status))
+	    goto FAIL;
+    }
+
+    entry->glyphs = _comac_malloc_ab (key->num_glyphs, sizeof (unsigned long));
+    if (unlikely (entry->glyphs == NULL))
+	goto FAIL;
+    memcpy (entry->glyphs,
+	    key->glyphs,
+	    key->num_glyphs * sizeof (unsigned long));
+
+    if (key->to_latin_char) {
+	entry->to_latin_char = _comac_malloc_ab (key->num_glyphs, sizeof (int));
+	if (unlikely (entry->to_latin_char == NULL))
+	    goto FAIL;
+	memcpy (entry->to_latin_char,
+		key->to_latin_char,
+		key->num_glyphs * sizeof (int));
+    }
+
+    entry->base.size = sizeof (comac_pdf_font_cache_entry_t) +
+		       entry->value.data_length +
+		       key->num_glyphs * (sizeof (unsigned long) +
+					  sizeof (int) + sizeof (double));
+
+    COMAC_MUTEX_LOCK (_comac_pdf_font_cache_mutex);
+    if (comac_pdf_font_cache.hash_table == NULL) {
+	status = _comac_cache_init (&comac_pdf_font_cache,
+				    _comac_pdf_font_cache_keys_equal,
+				    NULL,
+				    _comac_pdf_font_cache_entry_destroy,
+				    PDF_FONT_CACHE_MAX_SIZE);
+	if (unlikely (status))
+	    goto UNLOCK;
+    }
+
+    /* Another thread may have added the same subset meanwhile */
+    if (_comac_cache_lookup (&comac_pdf_font_cache, &entry->base) == NULL) {
+	status = _comac_cache_insert (&comac_pdf_font_cache, &entry->base);
+	if (likely (status == COMAC_INT_STATUS_SUCCESS))
+	    entry = NULL;
+    }
+
+UNLOCK:
+    COMAC_MUTEX_UNLOCK (_comac_pdf_font_cache_mutex);
+    if (entry == NULL)
+	return;
+
+FAIL:
+    _comac_pdf_font_cache_entry_destroy (entry);
+}
+
+comac_status_t
+_comac_pdf_font_cache_truetype_subset_init (
+    comac_truetype_subset_t *subset, comac_scaled_font_subset_t *font_subset)
+{
+    comac_pdf_font_cache_entry_t key;
+    comac_pdf_font_cache_value_t value;
+    comac_int_status_t status;
+
+    if (! _comac_pdf_font_cache_init_key (&key,
+					  PDF_FONT_CACHE_TRUETYPE,
+					  font_subset))
+	return _comac_truetype_subset_init_pdf (subset, font_subset);
+
+    status = _comac_pdf_font_cache_lookup (&key, &value);
+    if (status == COMAC_INT_STATUS_SUCCESS) {
+	subset->family_name_utf8 = value.family_name_utf8;
+	subset->ps_name = value.ps_name;
+	subset->widths = value.widths;
+	subset->x_min = value.x_min;
+	subset->y_min = value.y_min;
+	subset->x_max = value.x_max;
+	subset->y_max = value.y_max;
+	subset->ascent = value.ascent;
+	subset->descent = value.descent;
+	subset->data = value.data;
+	subset->data_length = value.data_length;
+	subset->string_offsets = NULL;
+	subset->num_string_offsets = 0;
+	return COMAC_STATUS_SUCCESS;
+    }
+    if (status != COMAC_INT_STATUS_NOTHING_TO_DO)
+	return status;
+
+    status = _comac_truetype_subset_init_pdf (subset, font_subset);
+    if (unlikely (status)) {
+	_comac_pdf_font_cache_insert (&key, status, NULL);
+	return status;
+    }
+
+    value.family_name_utf8 = subset->family_name_utf8;
+    value.ps_name = subset->ps_name;
+    value.widths = subset->widths;
+    value.x_min = subset->x_min;
+    value.y_min = subset->y_min;
+    value.x_max = subset->x_max;
+    value.y_max = subset->y_max;
+    value.ascent = subset->ascent;
+    value.descent = subset->descent;
+    value.data = subset->data;
+    value.data_length = subset->data_length;
+    _comac_pdf_font_cache_insert (&key, status, &value);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+comac_status_t
+_comac_pdf_font_cache_cff_subset_init (comac_cff_subset_t *subset,
+				       const char *name,
+				       comac_scaled_font_subset_t *font_subset,
+				       comac_bool_t fallback)
+{
+    comac_pdf_font_cache_entry_t key;
+    comac_pdf_font_cache_value_t value;
+    comac_int_status_t status;
+
+    if (! _comac_pdf_font_cache_init_key (
+	    &key,
+	    fallback ? PDF_FONT_CACHE_CFF_FALLBACK : PDF_FONT_CACHE_CFF,
+	    font_subset)) {
+	if (fallback)
+	    return _comac_cff_fallback_init (subset, name, font_subset);
+	return _comac_cff_subset_init (subset, name, font_subset);
+    }
+
+    status = _comac_pdf_font_cache_lookup (&key, &value);
+    if (status == COMAC_INT_STATUS_SUCCESS) {
+	subset->family_name_utf8 = value.family_name_utf8;
+	subset->ps_name = value.ps_name;
+	subset->widths = value.widths;
+	subset->x_min = value.x_min;
+	subset->y_min = value.y_min;
+	subset->x_max = value.x_max;
+	subset->y_max = value.y_max;
+	subset->ascent = value.ascent;
+	subset->descent = value.descent;
+	subset->data = (char *) value.data;
+	subset->data_length = value.data_length;
+	return COMAC_STATUS_SUCCESS;
+    }
+    if (status != COMAC_INT_STATUS_NOTHING_TO_DO)
+	return status;
+
+    if (fallback)
+	status = _comac_cff_fallback_init (subset, name, font_subset);
+    else
+	status = _comac_cff_subset_init (subset, name, font_subset);
+    if (unlikely (status)) {
+	_comac_pdf_font_cache_insert (&key, status, NULL);
+	return status;
+    }
+
+    value.family_name_utf8 = subset->family_name_utf8;
+    value.ps_name = subset->ps_name;
+    value.widths = subset->widths;
+    value.x_min = subset->x_min;
+    value.y_min = subset->y_min;
+    value.x_max = subset->x_max;
+    value.y_max = subset->y_max;
+    value.ascent = subset->ascent;
+    value.descent = subset->descent;
+    value.data = (unsigned char *) subset->data;
+    value.data_length = subset->data_length;
+    _comac_pdf_font_cache_insert (&key, status, &value);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+void
+_comac_pdf_font_cache_reset_static_data (void)
+{
+    COMAC_MUTEX_LOCK (_comac_pdf_font_cache_mutex);
+    if (comac_pdf_font_cache.hash_table != NULL) {
+	_comac_cache_fini (&comac_pdf_font_cache);
+	comac_pdf_font_cache.hash_table = NULL;
+    }
+    COMAC_MUTEX_UNLOCK (_comac_pdf_font_cache_mutex);
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#ifndef COMAC_PDF_IMAGE_PRIVATE_H
+#define COMAC_PDF_IMAGE_PRIVATE_H
+
+#include "comac-compiler-private.h"
+#include "comac-types-private.h"
+
+/* The color and alpha planes of an image, in the layout used by PDF
+ * image XObjects: rows are tightly packed, 1-bit data is most
+ * significant bit first and color components are not premultiplied.
+ */
+typedef struct _comac_pdf_image_planes {
+    comac_image_color_t color;
+    comac_colorspace_t colorspace;
+    unsigned char *color_data;
+    unsigned long color_size;
+
+    comac_image_transparency_t transparency;
+    unsigned char *alpha_data;
+    unsigned long alpha_size;
+} comac_pdf_image_planes_t;
+
+/**
+ * _comac_pdf_image_planes_init:
+ * @planes: the planes to initialize
+ * @image: an ARGB32, RGB24, A8 or A1 image
+ * @need_color: whether to produce the color plane
+ * @need_alpha: whether to produce the alpha plane
+ *
+ * Classifies @image and converts it to PDF image data in a single
+ * pass over its pixels. The result is the same as that of
+ * _comac_image_analyze_color() and _comac_image_analyze_transparency()
+ * followed by a conversion of the image to the smallest data that
+ * represents it.
+ *
+ * If @need_color is %TRUE, @planes->color is set and @planes->color_data
+ * holds 8-bit RGB, 8-bit gray or 1-bit data accordingly, in the
+ * colorspace given by @planes->colorspace. If
+ * @need_alpha is %TRUE, @planes->transparency is set and
+ * @planes->alpha_data holds 8-bit alpha for %COMAC_IMAGE_HAS_ALPHA,
+ * 1-bit alpha for %COMAC_IMAGE_HAS_BILEVEL_ALPHA and is %NULL for
+ * %COMAC_IMAGE_IS_OPAQUE. Planes that are not requested are left
+ * %NULL and unclassified.
+ *
+ * Return value: %COMAC_STATUS_SUCCESS or %COMAC_STATUS_NO_MEMORY.
+ **/
+comac_private comac_status_t
+_comac_pdf_image_planes_init (comac_pdf_image_planes_t *planes,
+			      comac_image_surface_t *image,
+			      comac_bool_t need_color,
+			      comac_bool_t need_alpha);
+
+/**
+ * _comac_pdf_image_planes_convert:
+ * @planes: planes with a color plane
+ * @surface: the surface the image is written to
+ * @width: the width of the image
+ * @height: the height of the image
+ *
+ * Converts the color plane of @planes to the colorspace of @surface,
+ * with the same conversion as solid colors: the naive formulas of
+ * comac_default_color_convert_func() unless @surface has conversion
+ * callbacks. Gray images are left as they are on gray surfaces, and so
+ * are 1-bit images, which are only black and white, on any surface.
+ *
+ * Return value: %COMAC_STATUS_SUCCESS or %COMAC_STATUS_NO_MEMORY.
+ **/
+comac_private comac_status_t
+_comac_pdf_image_planes_convert (comac_pdf_image_planes_t *planes,
+				 comac_surface_t *surface,
+				 int width,
+				 int height);
+
+/**
+ * _comac_pdf_image_planes_fini:
+ * @planes: the planes to free
+ *
+ * Frees the data of planes initialized by _comac_pdf_image_planes_init().
+ **/
+comac_private void
+_comac_pdf_image_planes_fini (comac_pdf_image_planes_t *planes);
+
+/**
+ * _comac_pdf_image_write_predicted:
+ * @output: the stream to write to
+ * @data: image data, @row_size bytes per row
+ * @row_size: the number of bytes in a row
+ * @height: the number of rows
+ * @bpp: the number of bytes per pixel, at least 1
+ *
+ * Writes @data to @output encoded with PNG predictors, picking a
+ * filter for each row. The stream must be described with
+ * /DecodeParms << /Predictor 15 ... >>.
+ *
+ * Return value: the status of @output, or %COMAC_STATUS_NO_MEMORY.
+ **/
+comac_private comac_status_t
+_comac_pdf_image_write_predicted (comac_output_stream_t *output,
+				  const unsigned char *data,
+				  int row_size,
+				  int height,
+				  int bpp);
+
+#endif /* COMAC_PDF_IMAGE_PRIVATE_H */
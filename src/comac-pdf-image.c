@@ -0,0 +1,960 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-pdf-image-private.h"
+#include "comac-image-surface-private.h"
+#include "comac-output-stream-private.h"
+#include "comac-surface-snapshot-inline.h"
+
+/* Conversion of image surfaces to the data of PDF image XObjects.
+ *
+ * Classifying an image and converting it used to take a pass over the
+ * pixels each. Here a single pass unpremultiplies the pixels into an
+ * RGB plane and an 8-bit alpha plane while collecting the bits needed
+ * to classify them. The planes are then narrowed in place to gray or
+ * 1-bit data, which only touches the much smaller output buffers.
+ * The loops are kept free of divisions and of branches on the pixel
+ * format so that the compiler can vectorize them. */
+
+/* Reciprocals used to unpremultiply color values without a division
+ * per channel. For every alpha value a > 0 and every 8-bit value v,
+ * (v * mul[a] + bias[a]) >> 16 is equal to (v * 255 + a / 2) / a.
+ */
+typedef struct _comac_pdf_unpremultiply {
+    uint32_t mul[256];
+    uint32_t bias[256];
+} comac_pdf_unpremultiply_t;
+
+/* What a pass over the pixels has seen, or-ed together over all rows. */
+typedef struct _comac_pdf_image_stats {
+    uint32_t not_gray;      /* some pixel has unequal components */
+    uint32_t mid_gray;      /* some component is neither 0 nor 255 */
+    uint32_t zero_alpha;    /* some pixel is fully transparent */
+    uint32_t partial_alpha; /* some alpha is neither 0 nor 255 */
+} comac_pdf_image_stats_t;
+
+static void
+_comac_pdf_unpremultiply_init (comac_pdf_unpremultiply_t *table)
+{
+    uint32_t a;
+
+    table->mul[0] = 0;
+    table->bias[0] = 0;
+    for (a = 1; a < 256; a++) {
+	table->mul[a] = ((255 << 16) + a - 1) / a;
+	table->bias[a] = ((a / 2) << 16) / a;
+    }
+}
+
+static inline uint32_t
+_unpremultiply (const comac_pdf_unpremultiply_t *table, uint32_t v, uint32_t a)
+{
+    return (v * table->mul[a] + table->bias[a]) >> 16;
+}
+
+/* Tracking what has been seen costs about a third of the loop, so
+ * callers stop doing it once the answer is known. Inlined with
+ * constant @classify_color and @classify_alpha. */
+static comac_always_inline void
+_row_split_argb32 (const comac_pdf_unpremultiply_t *table,
+		   const uint32_t *src,
+		   int width,
+		   unsigned char *rgb,
+		   unsigned char *alpha,
+		   comac_pdf_image_stats_t *stats,
+		   comac_bool_t classify_color,
+		   comac_bool_t classify_alpha)
+{
+    uint32_t not_gray = 0, mid_gray = 0, zero_alpha = 0, partial_alpha = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+	uint32_t p = src[x];
+	uint32_t a = p >> 24;
+	uint32_t r = (p >> 16) & 0xff;
+	uint32_t g = (p >> 8) & 0xff;
+	uint32_t b = p & 0xff;
+
+	if (a != 0xff) {
+	    r = _unpremultiply (table, r, a);
+	    g = _unpremultiply (table, g, a);
+	    b = _unpremultiply (table, b, a);
+	}
+	rgb[0] = r;
+	rgb[1] = g;
+	rgb[2] = b;
+	rgb += 3;
+	alpha[x] = a;
+
+	if (classify_color) {
+	    not_gray |= (r ^ g) | (g ^ b);
+	    mid_gray |= r - 1 < 254;
+	}
+	if (classify_alpha) {
+	    zero_alpha |= a == 0;
+	    partial_alpha |= a - 1 < 254;
+	}
+    }
+
+    stats->not_gray |= not_gray;
+    stats->mid_gray |= mid_gray;
+    stats->zero_alpha |= zero_alpha;
+    stats->partial_alpha |= partial_alpha;
+}
+
+static void
+_row_split_rgb24 (const uint32_t *src,
+		  int width,
+		  unsigned char *rgb,
+		  comac_pdf_image_stats_t *stats)
+{
+    uint32_t not_gray = 0, mid_gray = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+	uint32_t p = src[x];
+	uint32_t r = (p >> 16) & 0xff;
+	uint32_t g = (p >> 8) & 0xff;
+	uint32_t b = p & 0xff;
+
+	rgb[0] = r;
+	rgb[1] = g;
+	rgb[2] = b;
+	rgb += 3;
+
+	not_gray |= (r ^ g) | (g ^ b);
+	mid_gray |= r - 1 < 254;
+    }
+
+    stats->not_gray |= not_gray;
+    stats->mid_gray |= mid_gray;
+}
+
+static void
+_row_alpha_argb32 (const uint32_t *src,
+		   int width,
+		   unsigned char *alpha,
+		   comac_pdf_image_stats_t *stats)
+{
+    uint32_t zero_alpha = 0, partial_alpha = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+	uint32_t a = src[x] >> 24;
+
+	alpha[x] = a;
+	zero_alpha |= a == 0;
+	partial_alpha |= a - 1 < 254;
+    }
+
+    stats->zero_alpha |= zero_alpha;
+    stats->partial_alpha |= partial_alpha;
+}
+
+static void
+_row_copy_a8 (const uint8_t *src,
+	      int width,
+	      unsigned char *alpha,
+	      comac_pdf_image_stats_t *stats)
+{
+    uint32_t partial_alpha = 0;
+    int x;
+
+    for (x = 0; x < width; x++) {
+	uint32_t a = src[x];
+
+	alpha[x] = a;
+	partial_alpha |= a - 1 < 254;
+    }
+
+    stats->partial_alpha |= partial_alpha;
+}
+
+/* Packs a row of bytes into bits, most significant bit first, setting
+ * a bit if its byte is not zero. @src is read @step bytes at a time.
+ * @dst may point into @src as long as it does not come after it. */
+static void
+_row_pack_bits (const unsigned char *src,
+		int step,
+		int width,
+		unsigned char *dst)
+{
+    int x, bit;
+    uint8_t byte;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+	byte = 0;
+	for (bit = 0; bit < 8; bit++)
+	    byte |= (src[(x + bit) * step] != 0) << (7 - bit);
+	*dst++ = byte;
+    }
+
+    if (x < width) {
+	byte = 0;
+	for (bit = 0; x + bit < width; bit++)
+	    byte |= (src[(x + bit) * step] != 0) << (7 - bit);
+	*dst = byte;
+    }
+}
+
+/* Narrows the 8-bit RGB plane to gray or 1-bit data in place. */
+static void
+_narrow_color (comac_pdf_image_planes_t *planes, int width, int height)
+{
+    unsigned long i, n;
+    int y, row_size;
+
+    switch (planes->color) {
+    default:
+    case COMAC_IMAGE_UNKNOWN_COLOR:
+	ASSERT_NOT_REACHED;
+    case COMAC_IMAGE_IS_COLOR:
+	break;
+
+    case COMAC_IMAGE_IS_GRAYSCALE:
+	n = (unsigned long) width * height;
+	for (i = 0; i < n; i++)
+	    planes->color_data[i] = planes->color_data[3 * i];
+	planes->color_size = n;
+	break;
+
+    case COMAC_IMAGE_IS_MONOCHROME:
+	row_size = (width + 7) / 8;
+	for (y = 0; y < height; y++) {
+	    _row_pack_bits (planes->color_data + (unsigned long) y * width * 3,
+			    3,
+			    width,
+			    planes->color_data + (unsigned long) y * row_size);
+	}
+	planes->color_size = (unsigned long) row_size * height;
+	break;
+    }
+}
+
+/* The conversions of comac_default_color_convert_func() on 8-bit
+ * values. The gray weights are scaled by 65536 and add up to it, so
+ * white stays white. The cyan, magenta and yellow of a pixel are its
+ * distances to the largest component, scaled by the reciprocal of
+ * that, and are zero when black is above 0.99 as for solid colors.
+ * The distances are masked and the reciprocal is taken of a nonzero
+ * value rather than using conditionals, which would keep the compiler
+ * from vectorizing the loop. */
+static void
+_row_rgb_to_gray (const unsigned char *rgb, int width, unsigned char *gray)
+{
+    int x;
+
+    for (x = 0; x < width; x++) {
+	uint32_t r = rgb[3 * x + 0];
+	uint32_t g = rgb[3 * x + 1];
+	uint32_t b = rgb[3 * x + 2];
+
+	gray[x] = (r * 13933 + g * 46871 + b * 4732 + 32768) >> 16;
+    }
+}
+
+static void
+_row_rgb_to_cmyk (const unsigned char *rgb, int width, unsigned char *cmyk)
+{
+    int x;
+
+    for (x = 0; x < width; x++) {
+	int32_t r = rgb[3 * x + 0];
+	int32_t g = rgb[3 * x + 1];
+	int32_t b = rgb[3 * x + 2];
+	int32_t max = MAX (r, MAX (g, b));
+	int32_t mask = -(max > 2);
+	float scale = 255.f / (max + (max == 0));
+
+	cmyk[4 * x + 0] = (int32_t) (((max - r) & mask) * scale + .5f);
+	cmyk[4 * x + 1] = (int32_t) (((max - g) & mask) * scale + .5f);
+	cmyk[4 * x + 2] = (int32_t) (((max - b) & mask) * scale + .5f);
+	cmyk[4 * x + 3] = 255 - max;
+    }
+}
+
+static void
+_row_gray_to_cmyk (const unsigned char *gray, int width, unsigned char *cmyk)
+{
+    int x;
+
+    for (x = 0; x < width; x++) {
+	cmyk[4 * x + 0] = 0;
+	cmyk[4 * x + 1] = 0;
+	cmyk[4 * x + 2] = 0;
+	cmyk[4 * x + 3] = 255 - gray[x];
+    }
+}
+
+#define CONVERT_CHUNK_SIZE 1024
+
+/* Converts @num_pixels pixels of @src, RGB or gray, to @dst in
+ * @colorspace with the conversion callbacks of @surface. The pixels go
+ * through 8-bit RGBA colors, a chunk at a time, so that a batch
+ * callback gets many colors in each call. */
+static void
+_convert_with_callbacks (comac_surface_t *surface,
+			 const unsigned char *src,
+			 int src_components,
+			 comac_colorspace_t colorspace,
+			 unsigned char *dst,
+			 unsigned long num_pixels)
+{
+    unsigned char from[4 * CONVERT_CHUNK_SIZE];
+    unsigned char to[5 * CONVERT_CHUNK_SIZE];
+    int components = _comac_colorspace_num_components (colorspace);
+    unsigned long i;
+    int n, j, c;
+
+    for (i = 0; i < num_pixels; i += n) {
+	n = MIN (num_pixels - i, CONVERT_CHUNK_SIZE);
+	for (j = 0; j < n; j++) {
+	    for (c = 0; c < 3; c++)
+		from[4 * j + c] = src[src_components == 3 ? 3 * j + c : j];
+	    from[4 * j + 3] = 0xff;
+	}
+	_comac_surface_convert_colors (surface,
+				       COMAC_COLORSPACE_RGB,
+				       from,
+				       colorspace,
+				       to,
+				       COMAC_COLOR_LAYOUT_U8,
+				       n);
+	for (j = 0; j < n; j++) {
+	    for (c = 0; c < components; c++)
+		dst[components * j + c] = to[(components + 1) * j + c];
+	}
+	src += (unsigned long) src_components * n;
+	dst += (unsigned long) components * n;
+    }
+}
+
+/* Narrows the 8-bit alpha plane to 1-bit data in place, or drops it. */
+static void
+_narrow_alpha (comac_pdf_image_planes_t *planes, int width, int height)
+{
+    int y, row_size;
+
+    switch (planes->transparency) {
+    default:
+    case COMAC_IMAGE_UNKNOWN:
+	ASSERT_NOT_REACHED;
+    case COMAC_IMAGE_HAS_ALPHA:
+	break;
+
+    case COMAC_IMAGE_HAS_BILEVEL_ALPHA:
+	row_size = (width + 7) / 8;
+	for (y = 0; y < height; y++) {
+	    _row_pack_bits (planes->alpha_data + (unsigned long) y * width,
+			    1,
+			    width,
+			    planes->alpha_data + (unsigned long) y * row_size);
+	}
+	planes->alpha_size = (unsigned long) row_size * height;
+	break;
+
+    case COMAC_IMAGE_IS_OPAQUE:
+	free (planes->alpha_data);
+	planes->alpha_data = NULL;
+	planes->alpha_size = 0;
+	break;
+    }
+}
+
+/* The same rules as _comac_image_analyze_transparency(). A clear
+ * image is taken to have bilevel alpha whatever its pixels hold. */
+static comac_image_transparency_t
+_classify_alpha (comac_image_surface_t *image,
+		 const comac_pdf_image_stats_t *stats)
+{
+    if (image->base.is_clear)
+	return COMAC_IMAGE_HAS_BILEVEL_ALPHA;
+
+    if (stats->partial_alpha)
+	return COMAC_IMAGE_HAS_ALPHA;
+
+    /* An A8 image is never considered opaque. */
+    if (stats->zero_alpha || image->format == COMAC_FORMAT_A8)
+	return COMAC_IMAGE_HAS_BILEVEL_ALPHA;
+
+    return COMAC_IMAGE_IS_OPAQUE;
+}
+
+/* Allocates the 8-bit alpha plane, with the first @opaque_rows rows
+ * set to opaque. */
+static comac_status_t
+_start_alpha_plane (comac_pdf_image_planes_t *planes,
+		    comac_image_surface_t *image,
+		    int opaque_rows)
+{
+    planes->alpha_size = (unsigned long) image->width * image->height;
+    planes->alpha_data = _comac_malloc_ab (image->width, image->height);
+    if (unlikely (planes->alpha_data == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    memset (planes->alpha_data,
+	    0xff,
+	    (unsigned long) image->width * opaque_rows);
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_split_rgb (comac_pdf_image_planes_t *planes,
+	    comac_image_surface_t *image,
+	    comac_bool_t scan_alpha)
+{
+    comac_pdf_unpremultiply_t table;
+    comac_pdf_image_stats_t stats = {0};
+    comac_pdf_image_stats_t row_stats;
+    const uint32_t *src;
+    unsigned char *rgb_row, *scratch, *alpha_row;
+    comac_bool_t classify_color, classify_alpha;
+    comac_status_t status;
+    int y;
+
+    planes->color_size = (unsigned long) image->width * image->height * 3;
+    planes->color_data = _comac_malloc_abc (image->width, image->height, 3);
+    if (unlikely (planes->color_data == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    if (image->format == COMAC_FORMAT_RGB24) {
+	for (y = 0; y < image->height; y++) {
+	    _row_split_rgb24 (
+		(const uint32_t *) (image->data + y * image->stride),
+		image->width,
+		planes->color_data + (unsigned long) y * image->width * 3,
+		&stats);
+	}
+	goto CLASSIFY;
+    }
+
+    /* Most images are opaque, so the alpha plane is only allocated
+     * once a row that is not opaque turns up. Until then the alpha
+     * goes to a scratch row. */
+    scratch = _comac_malloc (image->width);
+    if (unlikely (scratch == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    _comac_pdf_unpremultiply_init (&table);
+    for (y = 0; y < image->height; y++) {
+	alpha_row = scratch;
+	if (planes->alpha_data != NULL)
+	    alpha_row = planes->alpha_data + (unsigned long) y * image->width;
+
+	src = (const uint32_t *) (image->data + y * image->stride);
+	rgb_row = planes->color_data + (unsigned long) y * image->width * 3;
+	memset (&row_stats, 0, sizeof (row_stats));
+	classify_color = stats.not_gray == 0;
+	classify_alpha = scan_alpha && stats.partial_alpha == 0;
+	if (classify_color && classify_alpha) {
+	    _row_split_argb32 (&table,
+			       src,
+			       image->width,
+			       rgb_row,
+			       alpha_row,
+			       &row_stats,
+			       TRUE,
+			       TRUE);
+	} else if (classify_color) {
+	    _row_split_argb32 (&table,
+			       src,
+			       image->width,
+			       rgb_row,
+			       alpha_row,
+			       &row_stats,
+			       TRUE,
+			       FALSE);
+	} else if (classify_alpha) {
+	    _row_split_argb32 (&table,
+			       src,
+			       image->width,
+			       rgb_row,
+			       alpha_row,
+			       &row_stats,
+			       FALSE,
+			       TRUE);
+	} else {
+	    _row_split_argb32 (&table,
+			       src,
+			       image->width,
+			       rgb_row,
+			       alpha_row,
+			       &row_stats,
+			       FALSE,
+			       FALSE);
+	}
+
+	if (scan_alpha && planes->alpha_data == NULL &&
+	    (row_stats.zero_alpha | row_stats.partial_alpha)) {
+	    status = _start_alpha_plane (planes, image, y);
+	    if (unlikely (status)) {
+		free (scratch);
+		return status;
+	    }
+	    memcpy (planes->alpha_data + (unsigned long) y * image->width,
+		    scratch,
+		    image->width);
+	}
+
+	stats.not_gray |= row_stats.not_gray;
+	stats.mid_gray |= row_stats.mid_gray;
+	stats.zero_alpha |= row_stats.zero_alpha;
+	stats.partial_alpha |= row_stats.partial_alpha;
+    }
+    free (scratch);
+
+CLASSIFY:
+    if (stats.not_gray)
+	planes->color = COMAC_IMAGE_IS_COLOR;
+    else if (stats.mid_gray)
+	planes->color = COMAC_IMAGE_IS_GRAYSCALE;
+    else
+	planes->color = COMAC_IMAGE_IS_MONOCHROME;
+    _narrow_color (planes, image->width, image->height);
+
+    if (scan_alpha) {
+	planes->transparency = _classify_alpha (image, &stats);
+	if (planes->transparency != COMAC_IMAGE_IS_OPAQUE &&
+	    planes->alpha_data == NULL) {
+	    /* A clear image whose pixels are all opaque. */
+	    status = _start_alpha_plane (planes, image, image->height);
+	    if (unlikely (status))
+		return status;
+	}
+	_narrow_alpha (planes, image->width, image->height);
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_status_t
+_copy_alpha (comac_pdf_image_planes_t *planes, comac_image_surface_t *image)
+{
+    comac_pdf_image_stats_t stats = {0};
+    unsigned char *dst;
+    int x, y, row_size;
+
+    if (image->format == COMAC_FORMAT_A1) {
+	row_size = (image->width + 7) / 8;
+	planes->alpha_size = (unsigned long) row_size * image->height;
+	planes->alpha_data = _comac_malloc_ab (row_size, image->height);
+	if (unlikely (planes->alpha_data == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+	for (y = 0; y < image->height; y++) {
+	    const uint8_t *row = image->data + y * image->stride;
+
+	    dst = planes->alpha_data + (unsigned long) y * row_size;
+	    for (x = 0; x < row_size; x++)
+		dst[x] = COMAC_BITSWAP8_IF_LITTLE_ENDIAN (row[x]);
+	}
+	planes->transparency = COMAC_IMAGE_HAS_BILEVEL_ALPHA;
+	return COMAC_STATUS_SUCCESS;
+    }
+
+    planes->alpha_size = (unsigned long) image->width * image->height;
+    planes->alpha_data = _comac_malloc_ab (image->width, image->height);
+    if (unlikely (planes->alpha_data == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    for (y = 0; y < image->height; y++) {
+	const uint8_t *row = image->data + y * image->stride;
+
+	dst = planes->alpha_data + (unsigned long) y * image->width;
+	if (image->format == COMAC_FORMAT_A8) {
+	    _row_copy_a8 (row, image->width, dst, &stats);
+	} else {
+	    _row_alpha_argb32 ((const uint32_t *) row,
+			       image->width,
+			       dst,
+			       &stats);
+	}
+    }
+
+    planes->transparency = _classify_alpha (image, &stats);
+    _narrow_alpha (planes, image->width, image->height);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+comac_status_t
+_comac_pdf_image_planes_init (comac_pdf_image_planes_t *planes,
+			      comac_image_surface_t *image,
+			      comac_bool_t need_color,
+			      comac_bool_t need_alpha)
+{
+    comac_bool_t scan_alpha;
+    comac_status_t status;
+
+    assert (image->format == COMAC_FORMAT_ARGB32 ||
+	    image->format == COMAC_FORMAT_RGB24 ||
+	    image->format == COMAC_FORMAT_A8 ||
+	    image->format == COMAC_FORMAT_A1);
+
+    planes->color = COMAC_IMAGE_UNKNOWN_COLOR;
+    planes->colorspace = COMAC_COLORSPACE_GRAY;
+    planes->color_data = NULL;
+    planes->color_size = 0;
+    planes->transparency = COMAC_IMAGE_UNKNOWN;
+    planes->alpha_data = NULL;
+    planes->alpha_size = 0;
+
+    scan_alpha = need_alpha && image->format != COMAC_FORMAT_RGB24 &&
+		 (image->base.content & COMAC_CONTENT_ALPHA) != 0;
+
+    if (need_color && (image->format == COMAC_FORMAT_ARGB32 ||
+		       image->format == COMAC_FORMAT_RGB24)) {
+	status = _split_rgb (planes, image, scan_alpha);
+	if (unlikely (status))
+	    goto FAIL;
+    } else {
+	if (need_color) {
+	    if (image->format == COMAC_FORMAT_A1) {
+		planes->color = COMAC_IMAGE_IS_MONOCHROME;
+		planes->color_size =
+		    (unsigned long) (image->width + 7) / 8 * image->height;
+	    } else {
+		planes->color = COMAC_IMAGE_IS_GRAYSCALE;
+		planes->color_size =
+		    (unsigned long) image->width * image->height;
+	    }
+	    /* Only the alpha of A8 and A1 images is used. */
+	    planes->color_data = _comac_malloc (planes->color_size);
+	    if (unlikely (planes->color_data == NULL)) {
+		status = _comac_error (COMAC_STATUS_NO_MEMORY);
+		goto FAIL;
+	    }
+	    memset (planes->color_data, 0, planes->color_size);
+	}
+	if (scan_alpha) {
+	    status = _copy_alpha (planes, image);
+	    if (unlikely (status))
+		goto FAIL;
+	}
+    }
+
+    if (planes->color == COMAC_IMAGE_IS_COLOR)
+	planes->colorspace = COMAC_COLORSPACE_RGB;
+    if (need_alpha && ! scan_alpha)
+	planes->transparency = COMAC_IMAGE_IS_OPAQUE;
+
+    if (_comac_surface_is_snapshot (&image->base)) {
+	if (planes->color != COMAC_IMAGE_UNKNOWN_COLOR)
+	    image->color = planes->color;
+	if (planes->transparency != COMAC_IMAGE_UNKNOWN)
+	    image->transparency = planes->transparency;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+
+FAIL:
+    _comac_pdf_image_planes_fini (planes);
+    return status;
+}
+
+static comac_bool_t
+_uses_default_conversion (comac_surface_t *surface)
+{
+    if (surface->color_convert_batch != NULL)
+	return surface->color_convert_batch ==
+	       comac_default_color_convert_batch_func;
+
+    return surface->color_convert == NULL ||
+	   surface->color_convert == comac_default_color_convert_func;
+}
+
+comac_status_t
+_comac_pdf_image_planes_convert (comac_pdf_image_planes_t *planes,
+				 comac_surface_t *surface,
+				 int width,
+				 int height)
+{
+    comac_colorspace_t colorspace = surface->colorspace;
+    unsigned long num_pixels = (unsigned long) width * height;
+    int components, src_components, y;
+    const unsigned char *src;
+    unsigned char *data, *dst;
+
+    if (planes->colorspace == colorspace ||
+	planes->color == COMAC_IMAGE_IS_MONOCHROME ||
+	colorspace == COMAC_COLORSPACE_RGB)
+	return COMAC_STATUS_SUCCESS;
+
+    components = _comac_colorspace_num_components (colorspace);
+    src_components = _comac_colorspace_num_components (planes->colorspace);
+    data = _comac_malloc_abc (width, height, components);
+    if (unlikely (data == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    if (_uses_default_conversion (surface)) {
+	src = planes->color_data;
+	dst = data;
+	for (y = 0; y < height; y++) {
+	    if (colorspace == COMAC_COLORSPACE_GRAY)
+		_row_rgb_to_gray (src, width, dst);
+	    else if (src_components == 3)
+		_row_rgb_to_cmyk (src, width, dst);
+	    else
+		_row_gray_to_cmyk (src, width, dst);
+	    src += width * src_components;
+	    dst += width * components;
+	}
+    } else {
+	_convert_with_callbacks (surface,
+				 planes->color_data,
+				 src_components,
+				 colorspace,
+				 data,
+				 num_pixels);
+    }
+
+    free (planes->color_data);
+    planes->color_data = data;
+    planes->color_size = num_pixels * components;
+    planes->colorspace = colorspace;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+void
+_comac_pdf_image_planes_fini (comac_pdf_image_planes_t *planes)
+{
+    free (planes->color_data);
+    free (planes->alpha_data);
+    planes->color_data = NULL;
+    planes->alpha_data = NULL;
+}
+
+/* PNG predictors, as described in section 7.4.4.4 of the PDF
+ * specification and section 9 of the PNG specification. Each row is
+ * written with a filter type byte followed by the filtered bytes.
+ * The filter of each row is picked with the heuristic recommended by
+ * the PNG specification: the one whose output, taken as signed bytes,
+ * has the smallest sum of absolute values.
+ *
+ * Each filter is a separate loop over the row, without branches in
+ * the body, so that the compiler can vectorize it. The first @bpp
+ * bytes of a row have no left neighbour and are done separately.
+ */
+
+enum {
+    PNG_FILTER_NONE,
+    PNG_FILTER_SUB,
+    PNG_FILTER_UP,
+    PNG_FILTER_AVERAGE,
+    PNG_FILTER_PAETH,
+    PNG_FILTER_LAST
+};
+
+static inline uint32_t
+_filter_cost (uint8_t v)
+{
+    return v < 128 ? v : 256 - v;
+}
+
+static uint32_t
+_filter_none (const unsigned char *row,
+	      const unsigned char *prev,
+	      int row_size,
+	      int bpp,
+	      unsigned char *restrict dst)
+{
+    uint32_t cost = 0;
+    int i;
+
+    for (i = 0; i < row_size; i++) {
+	dst[i] = row[i];
+	cost += _filter_cost (dst[i]);
+    }
+
+    return cost;
+}
+
+static uint32_t
+_filter_sub (const unsigned char *row,
+	     const unsigned char *prev,
+	     int row_size,
+	     int bpp,
+	     unsigned char *restrict dst)
+{
+    uint32_t cost = 0;
+    int i;
+
+    for (i = 0; i < bpp; i++) {
+	dst[i] = row[i];
+	cost += _filter_cost (dst[i]);
+    }
+    for (; i < row_size; i++) {
+	dst[i] = row[i] - row[i - bpp];
+	cost += _filter_cost (dst[i]);
+    }
+
+    return cost;
+}
+
+static uint32_t
+_filter_up (const unsigned char *row,
+	    const unsigned char *prev,
+	    int row_size,
+	    int bpp,
+	    unsigned char *restrict dst)
+{
+    uint32_t cost = 0;
+    int i;
+
+    for (i = 0; i < row_size; i++) {
+	dst[i] = row[i] - prev[i];
+	cost += _filter_cost (dst[i]);
+    }
+
+    return cost;
+}
+
+static uint32_t
+_filter_average (const unsigned char *row,
+		 const unsigned char *prev,
+		 int row_size,
+		 int bpp,
+		 unsigned char *restrict dst)
+{
+    uint32_t cost = 0;
+    int i;
+
+    for (i = 0; i < bpp; i++) {
+	dst[i] = row[i] - (prev[i] >> 1);
+	cost += _filter_cost (dst[i]);
+    }
+    for (; i < row_size; i++) {
+	dst[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+	cost += _filter_cost (dst[i]);
+    }
+
+    return cost;
+}
+
+static uint32_t
+_filter_paeth (const unsigned char *row,
+	       const unsigned char *prev,
+	       int row_size,
+	       int bpp,
+	       unsigned char *restrict dst)
+{
+    uint32_t cost = 0;
+    int i;
+
+    /* Without a left neighbour the predictor is always the byte above. */
+    for (i = 0; i < bpp; i++) {
+	dst[i] = row[i] - prev[i];
+	cost += _filter_cost (dst[i]);
+    }
+    for (; i < row_size; i++) {
+	int a = row[i - bpp];
+	int b = prev[i];
+	int c = prev[i - bpp];
+	int pa = abs (b - c);
+	int pb = abs (a - c);
+	int pc = abs (a + b - 2 * c);
+	int pred;
+
+	pred = pb <= pc ? b : c;
+	pred = pa <= pb && pa <= pc ? a : pred;
+	dst[i] = row[i] - pred;
+	cost += _filter_cost (dst[i]);
+    }
+
+    return cost;
+}
+
+typedef uint32_t (*comac_pdf_png_filter_func_t) (const unsigned char *row,
+						 const unsigned char *prev,
+						 int row_size,
+						 int bpp,
+						 unsigned char *dst);
+
+static const comac_pdf_png_filter_func_t _png_filters[PNG_FILTER_LAST] = {
+    _filter_none,
+    _filter_sub,
+    _filter_up,
+    _filter_average,
+    _filter_paeth,
+};
+
+comac_status_t
+_comac_pdf_image_write_predicted (comac_output_stream_t *output,
+				  const unsigned char *data,
+				  int row_size,
+				  int height,
+				  int bpp)
+{
+    unsigned char *scratch, *zero_row, *filtered[PNG_FILTER_LAST];
+    const unsigned char *row, *prev;
+    uint32_t cost, best_cost;
+    int y, type, best;
+
+    /* One row per filter, each with room for the filter type byte,
+     * and a row of zeros standing in for the row above the first. */
+    scratch = _comac_malloc_ab (PNG_FILTER_LAST + 1, row_size + 1);
+    if (unlikely (scratch == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    for (type = 0; type < PNG_FILTER_LAST; type++) {
+	filtered[type] = scratch + type * (row_size + 1);
+	filtered[type][0] = type;
+    }
+    zero_row = scratch + PNG_FILTER_LAST * (row_size + 1);
+    memset (zero_row, 0, row_size);
+
+    prev = zero_row;
+    for (y = 0; y < height; y++) {
+	row = data + (unsigned long) y * row_size;
+
+	best = PNG_FILTER_NONE;
+	best_cost = UINT32_MAX;
+	for (type = 0; type < PNG_FILTER_LAST; type++) {
+	    cost = _png_filters[type] (row,
+				       prev,
+				       row_size,
+				       bpp,
+				       filtered[type] + 1);
+	    if (cost < best_cost) {
+		best = type;
+		best_cost = cost;
+	    }
+	}
+
+	_comac_output_stream_write (output, filtered[best], row_size + 1);
+	prev = row;
+    }
+
+    free (scratch);
+
+    return _comac_output_stream_get_status (output);
+}
@@ -753,6 +753,15 @@ comac_pdf_interchange_walk_struct_tree (
     return COMAC_STATUS_SUCCESS;
 }
 
+static comac_int_status_t
+comac_pdf_interchange_free_node_object (comac_pdf_surface_t *surface,
+					comac_pdf_struct_tree_node_t *node)
+{
+    _comac_pdf_surface_free_object (surface, node->res);
+
+    return COMAC_STATUS_SUCCESS;
+}
+
 static comac_int_status_t
 comac_pdf_interchange_write_struct_tree (comac_pdf_surface_t *surface)
 {
@@ -1758,6 +1767,19 @@ _comac_pdf_interchange_write_document_objects (comac_pdf_surface_t *surface)
     comac_int_status_t status = COMAC_STATUS_SUCCESS;
     comac_tag_stack_structure_type_t tag_type;
 
+    /* An update keeps the document objects of the file. Only the link
+     * destinations of the new pages that are still to be written
+     * remain, and the structure elements reserved while drawing are
+     * not written at all. */
+    if (surface->update) {
+	comac_pdf_interchange_walk_struct_tree (
+	    surface,
+	    ic->struct_root,
+	    comac_pdf_interchange_free_node_object);
+
+	return comac_pdf_interchange_write_forward_links (surface);
+    }
+
     tag_type = _comac_tag_stack_get_structure_type (&ic->analysis_tag_stack);
     if (tag_type == TAG_TREE_TYPE_TAGGED ||
 	tag_type == TAG_TREE_TYPE_STRUCTURE ||
@@ -0,0 +1,105 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#ifndef COMAC_PDF_LINEARIZE_PRIVATE_H
+#define COMAC_PDF_LINEARIZE_PRIVATE_H
+
+#include "comac-compiler-private.h"
+#include "comac-types-private.h"
+#include "comac-error-private.h"
+
+/* The lexer used to find the references in the objects being
+ * linearized. It is shared with the reader of comac-pdf-update.c. */
+typedef enum _comac_pdf_token_type {
+    PDF_TOKEN_END,
+    PDF_TOKEN_INTEGER,
+    PDF_TOKEN_KEYWORD,
+    PDF_TOKEN_OTHER
+} comac_pdf_token_type_t;
+
+typedef struct _comac_pdf_token {
+    comac_pdf_token_type_t type;
+    long long start;
+    long long end;
+    long long value;
+} comac_pdf_token_t;
+
+/* Reads the token of data[pos..end) starting at @pos and returns the
+ * position after it. Strings, names, numbers other than integers and
+ * delimiters such as "<<" or "[" are all PDF_TOKEN_OTHER. */
+comac_private_no_warn long long
+_comac_pdf_next_token (const unsigned char *data,
+		       long long pos,
+		       long long end,
+		       comac_pdf_token_t *token);
+
+/* Returns whether @token is the keyword @keyword, such as "obj". */
+comac_private comac_bool_t
+_comac_pdf_token_is (const unsigned char *data,
+		     const comac_pdf_token_t *token,
+		     const char *keyword);
+
+/**
+ * _comac_pdf_linearize:
+ * @output: the stream to write the linearized file to
+ * @data: a complete PDF file without its cross-reference table and
+ * trailer
+ * @length: the length of @data in bytes
+ * @offsets: the offset in @data of each object, indexed by object
+ * number minus one, or -1 for free objects
+ * @num_objects: the number of entries in @offsets
+ * @pages: the object numbers of the page objects, in page order
+ * @num_pages: the number of entries in @pages
+ * @pages_root: the object number of the page tree root
+ * @catalog: the object number of the document catalog
+ * @info: the object number of the document information dictionary
+ *
+ * Writes the objects of @data to @output as a linearized PDF file,
+ * renumbered and reordered so that the first page can be displayed
+ * before the rest of the file has been received. The hint stream,
+ * both cross-reference tables and trailers are added. All objects
+ * must be uncompressed, which means object streams must not be used.
+ *
+ * Return value: %COMAC_INT_STATUS_UNSUPPORTED without writing
+ * anything if @data cannot be linearized, otherwise the status of
+ * @output or %COMAC_STATUS_NO_MEMORY.
+ **/
+comac_private comac_int_status_t
+_comac_pdf_linearize (comac_output_stream_t *output,
+		      const unsigned char *data,
+		      unsigned long length,
+		      const long long *offsets,
+		      int num_objects,
+		      const int *pages,
+		      int num_pages,
+		      int pages_root,
+		      int catalog,
+		      int info);
+
+#endif /* COMAC_PDF_LINEARIZE_PRIVATE_H */
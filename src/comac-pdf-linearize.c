@@ -0,0 +1,1138 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-pdf-linearize-private.h"
+#include "comac-array-private.h"
+#include "comac-output-stream-private.h"
+
+#include <stdio.h>
+
+/* Linearized PDF files, as described in Annex F of the PDF
+ * specification.
+ *
+ * The PDF surface writes the file as usual, to memory, and hands it
+ * over together with the offset of every object. The objects are
+ * parsed only far enough to find the references in their dictionaries,
+ * then renumbered and written out again in this order:
+ *
+ *   header
+ *   linearization dictionary
+ *   first-page cross-reference table and trailer
+ *   catalog
+ *   hint stream
+ *   the first page and every object it uses
+ *   each other page, followed by the objects only that page uses
+ *   objects shared by several pages other than the first
+ *   everything else: the page tree, outlines, structure tree, ...
+ *   main cross-reference table and trailer
+ *
+ * The linearization dictionary, catalog, hint stream and first page
+ * objects take the highest object numbers and are the only entries of
+ * the first-page cross-reference table, so a viewer has all it needs
+ * to display the first page once the first /E bytes have arrived.
+ *
+ * The hint stream holds a page offset hint table and a shared object
+ * hint table. Every page lists the object groups it shares with other
+ * pages, where each object of the first page and each shared object
+ * is a group of its own. Content stream offsets are not tracked; as
+ * in most writers the whole page is given as its content stream.
+ */
+
+typedef enum _comac_pdf_part {
+    PDF_PART_OTHER,
+    PDF_PART_CATALOG,
+    PDF_PART_FIRST_PAGE,
+    PDF_PART_PAGE,
+    PDF_PART_SHARED
+} comac_pdf_part_t;
+
+typedef struct _comac_pdf_lin_ref {
+    long long start; /* of "n g R" in the input */
+    long long end;
+    int id;
+} comac_pdf_lin_ref_t;
+
+typedef struct _comac_pdf_lin_object {
+    long long offset; /* of "n 0 obj" in the input, -1 if free */
+    long long body;   /* just past "obj" */
+    long long end;
+    int first_ref;
+    int num_refs;
+
+    /* Not followed when collecting the objects used by a page */
+    comac_bool_t stop;
+
+    int page; /* the first page using the object, or -1 */
+    comac_bool_t shared;
+    comac_pdf_part_t part;
+    int index; /* within the first page or shared objects */
+
+    int new_id;
+    long long length;
+    long long new_offset; /* as if the hint stream was not there */
+} comac_pdf_lin_object_t;
+
+typedef struct _comac_pdf_linearizer {
+    const unsigned char *data;
+    unsigned long length;
+    comac_pdf_lin_object_t *objects; /* indexed by object number */
+    int num_objects;
+    comac_array_t refs;
+    const int *pages;
+    int num_pages;
+
+    /* The objects used by each page, page_start[i] being the first
+     * entry of page i. */
+    comac_array_t page_objects;
+    int *page_start;
+
+    /* Object numbers in output order */
+    int *first_page; /* the first page section */
+    int num_first_page;
+    int *main;	      /* other pages, shared and other objects */
+    int num_main;
+    int shared_start; /* first shared object in main */
+    int num_shared;
+
+    int linearization_id;
+    int catalog_id;
+    int hint_id;
+    int size;
+} comac_pdf_linearizer_t;
+
+static const char linearization_format[] =
+    "%d 0 obj\n"
+    "<< /Linearized 1 /L %10lld /H [ %10lld %10lld ]"
+    " /O %d /E %10lld /N %d /T %10lld >>\n"
+    "endobj\n";
+
+static const char first_trailer_format[] = "trailer\n"
+					   "<< /Size %d /Root %d 0 R%s"
+					   " /Prev %10lld >>\n"
+					   "startxref\n"
+					   "0\n"
+					   "%%%%EOF\n";
+
+static comac_bool_t
+_is_white (unsigned char c)
+{
+    return c == '\0' || c == '\t' || c == '\n' || c == '\f' || c == '\r' ||
+	   c == ' ';
+}
+
+static comac_bool_t
+_is_delimiter (unsigned char c)
+{
+    return c == '(' || c == ')' || c == '<' || c == '>' || c == '[' ||
+	   c == ']' || c == '{' || c == '}' || c == '/' || c == '%';
+}
+
+static comac_bool_t
+_is_regular (unsigned char c)
+{
+    return ! _is_white (c) && ! _is_delimiter (c);
+}
+
+long long
+_comac_pdf_next_token (const unsigned char *data,
+		       long long pos,
+		       long long end,
+		       comac_pdf_token_t *token)
+{
+    unsigned char c;
+    long long i;
+    int depth;
+
+    while (pos < end) {
+	if (_is_white (data[pos])) {
+	    pos++;
+	} else if (data[pos] == '%') {
+	    while (pos < end && data[pos] != '\r' && data[pos] != '\n')
+		pos++;
+	} else {
+	    break;
+	}
+    }
+
+    token->start = pos;
+    token->type = PDF_TOKEN_OTHER;
+    if (pos == end) {
+	token->type = PDF_TOKEN_END;
+    } else if (data[pos] == '(') {
+	depth = 0;
+	while (pos < end) {
+	    c = data[pos++];
+	    if (c == '\\')
+		pos++;
+	    else if (c == '(')
+		depth++;
+	    else if (c == ')' && --depth == 0)
+		break;
+	}
+    } else if (data[pos] == '<' || data[pos] == '>') {
+	c = data[pos++];
+	if (pos < end && data[pos] == c) {
+	    pos++;
+	} else if (c == '<') {
+	    while (pos < end && data[pos++] != '>')
+		;
+	}
+    } else if (data[pos] == '/') {
+	pos++;
+	while (pos < end && _is_regular (data[pos]))
+	    pos++;
+    } else if (_is_delimiter (data[pos])) {
+	pos++;
+    } else {
+	while (pos < end && _is_regular (data[pos]))
+	    pos++;
+
+	i = token->start;
+	if (data[i] == '+' || data[i] == '-')
+	    i++;
+	if (i < pos && pos - i < 19) {
+	    token->type = PDF_TOKEN_INTEGER;
+	    token->value = 0;
+	    for (; i < pos; i++) {
+		if (data[i] < '0' || data[i] > '9') {
+		    token->type = PDF_TOKEN_OTHER;
+		    break;
+		}
+		token->value = token->value * 10 + data[i] - '0';
+	    }
+	    if (data[token->start] == '-')
+		token->value = -token->value;
+	}
+	if (token->type == PDF_TOKEN_OTHER && data[token->start] != '.' &&
+	    data[token->start] != '+' && data[token->start] != '-' &&
+	    (data[token->start] < '0' || data[token->start] > '9'))
+	{
+	    token->type = PDF_TOKEN_KEYWORD;
+	}
+    }
+
+    if (pos > end)
+	pos = end;
+    token->end = pos;
+
+    return pos;
+}
+
+comac_bool_t
+_comac_pdf_token_is (const unsigned char *data,
+		     const comac_pdf_token_t *token,
+		     const char *keyword)
+{
+    size_t len = strlen (keyword);
+
+    return token->type == PDF_TOKEN_KEYWORD &&
+	   token->end - token->start == (long long) len &&
+	   memcmp (data + token->start, keyword, len) == 0;
+}
+
+static comac_pdf_lin_object_t *
+_lookup (comac_pdf_linearizer_t *lin, int id)
+{
+    if (id < 1 || id > lin->num_objects || lin->objects[id].offset < 0)
+	return NULL;
+
+    return &lin->objects[id];
+}
+
+/* Finds the references "n g R" in the dictionary of an object, which
+ * ends at the stream keyword if it is a stream. */
+static comac_int_status_t
+_comac_pdf_linearizer_scan_object (comac_pdf_linearizer_t *lin, int id)
+{
+    comac_pdf_lin_object_t *object = &lin->objects[id];
+    comac_pdf_token_t token, ints[2];
+    comac_pdf_lin_ref_t ref;
+    comac_int_status_t status;
+    long long pos;
+    int num_ints;
+
+    pos =
+	_comac_pdf_next_token (lin->data, object->offset, object->end, &token);
+    if (token.type != PDF_TOKEN_INTEGER || token.value != id ||
+	token.start != object->offset)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    pos = _comac_pdf_next_token (lin->data, pos, object->end, &token);
+    if (token.type != PDF_TOKEN_INTEGER)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    pos = _comac_pdf_next_token (lin->data, pos, object->end, &token);
+    if (! _comac_pdf_token_is (lin->data, &token, "obj"))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    object->body = pos;
+    object->first_ref = _comac_array_num_elements (&lin->refs);
+    num_ints = 0;
+    for (;;) {
+	pos = _comac_pdf_next_token (lin->data, pos, object->end, &token);
+	if (token.type == PDF_TOKEN_END)
+	    break;
+
+	if (token.type == PDF_TOKEN_INTEGER) {
+	    if (num_ints == 2) {
+		ints[0] = ints[1];
+		num_ints = 1;
+	    }
+	    ints[num_ints++] = token;
+	    continue;
+	}
+
+	if (token.type == PDF_TOKEN_KEYWORD) {
+	    if (num_ints == 2 && _comac_pdf_token_is (lin->data, &token, "R")) {
+		ref.start = ints[0].start;
+		ref.end = token.end;
+		ref.id = ints[0].value > 0 && ints[0].value <= INT_MAX
+			     ? ints[0].value
+			     : 0;
+		status = _comac_array_append (&lin->refs, &ref);
+		if (unlikely (status))
+		    return status;
+	    } else if (_comac_pdf_token_is (lin->data, &token, "stream") ||
+		       _comac_pdf_token_is (lin->data, &token, "endobj")) {
+		break;
+	    }
+	}
+	num_ints = 0;
+    }
+    object->num_refs =
+	_comac_array_num_elements (&lin->refs) - object->first_ref;
+
+    return COMAC_INT_STATUS_SUCCESS;
+}
+
+static int
+_comac_pdf_lin_offset_compare (const void *a, const void *b)
+{
+    const long long *offset_a = a;
+    const long long *offset_b = b;
+
+    if (*offset_a < *offset_b)
+	return -1;
+    if (*offset_a > *offset_b)
+	return 1;
+    return 0;
+}
+
+/* Sorts the objects by offset to find where each ends, and scans them.
+ * Returns the object numbers in input order in @order. */
+static comac_int_status_t
+_comac_pdf_linearizer_scan (comac_pdf_linearizer_t *lin,
+			    const long long *offsets,
+			    int *order,
+			    int *num_order)
+{
+    comac_int_status_t status;
+    long long *sorted;
+    int i, n;
+
+    /* Sort (offset, id) pairs packed into two long longs each. */
+    sorted = _comac_malloc_ab (lin->num_objects, 2 * sizeof (long long));
+    if (unlikely (sorted == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    n = 0;
+    for (i = 0; i < lin->num_objects; i++) {
+	lin->objects[i + 1].offset = offsets[i];
+	if (offsets[i] < 0)
+	    continue;
+	if (offsets[i] >= (long long) lin->length) {
+	    free (sorted);
+	    return COMAC_INT_STATUS_UNSUPPORTED;
+	}
+	sorted[2 * n] = offsets[i];
+	sorted[2 * n + 1] = i + 1;
+	n++;
+    }
+    qsort (sorted, n, 2 * sizeof (long long), _comac_pdf_lin_offset_compare);
+
+    for (i = 0; i < n; i++) {
+	order[i] = sorted[2 * i + 1];
+	lin->objects[order[i]].end =
+	    i + 1 < n ? sorted[2 * i + 2] : (long long) lin->length;
+    }
+    free (sorted);
+    *num_order = n;
+
+    if (n == 0)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    for (i = 0; i < n; i++) {
+	status = _comac_pdf_linearizer_scan_object (lin, order[i]);
+	if (unlikely (status))
+	    return status;
+    }
+
+    return COMAC_INT_STATUS_SUCCESS;
+}
+
+/* Collects the objects used by each page, following references from
+ * the page object but not into other pages or the page tree. */
+static comac_int_status_t
+_comac_pdf_linearizer_collect_pages (comac_pdf_linearizer_t *lin)
+{
+    comac_pdf_lin_object_t *object, *target;
+    comac_pdf_lin_ref_t *ref;
+    comac_array_t stack;
+    comac_int_status_t status = COMAC_INT_STATUS_SUCCESS;
+    int *stamp;
+    int i, j, id;
+
+    lin->page_start = _comac_malloc_ab (lin->num_pages + 1, sizeof (int));
+    stamp = calloc (lin->num_objects + 1, sizeof (int));
+    if (unlikely (lin->page_start == NULL || stamp == NULL)) {
+	free (stamp);
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    _comac_array_init (&stack, sizeof (int));
+    for (i = 0; i < lin->num_pages; i++) {
+	lin->page_start[i] = _comac_array_num_elements (&lin->page_objects);
+	status = _comac_array_append (&stack, &lin->pages[i]);
+	if (unlikely (status))
+	    goto BAIL;
+
+	while (_comac_array_num_elements (&stack) > 0) {
+	    _comac_array_copy_element (&stack,
+				       _comac_array_num_elements (&stack) - 1,
+				       &id);
+	    _comac_array_truncate (&stack,
+				   _comac_array_num_elements (&stack) - 1);
+	    if (stamp[id] == i + 1)
+		continue;
+
+	    stamp[id] = i + 1;
+	    object = &lin->objects[id];
+	    if (object->page < 0)
+		object->page = i;
+	    else
+		object->shared = TRUE;
+
+	    status = _comac_array_append (&lin->page_objects, &id);
+	    if (unlikely (status))
+		goto BAIL;
+
+	    for (j = 0; j < object->num_refs; j++) {
+		ref = _comac_array_index (&lin->refs, object->first_ref + j);
+		target = _lookup (lin, ref->id);
+		if (target == NULL || target->stop)
+		    continue;
+
+		status = _comac_array_append (&stack, &ref->id);
+		if (unlikely (status))
+		    goto BAIL;
+	    }
+	}
+    }
+    lin->page_start[lin->num_pages] =
+	_comac_array_num_elements (&lin->page_objects);
+
+BAIL:
+    _comac_array_fini (&stack);
+    free (stamp);
+
+    return status;
+}
+
+/* Puts the objects in output order and gives them their new numbers. */
+static comac_int_status_t
+_comac_pdf_linearizer_order (comac_pdf_linearizer_t *lin,
+			     const int *order,
+			     int num_order)
+{
+    comac_pdf_lin_object_t *object;
+    int *fill;
+    int i, n, id;
+
+    lin->first_page = _comac_malloc_ab (num_order, sizeof (int));
+    lin->main = _comac_malloc_ab (num_order, sizeof (int));
+    fill = calloc (lin->num_pages + 1, sizeof (int));
+    if (unlikely (lin->first_page == NULL || lin->main == NULL ||
+		  fill == NULL))
+    {
+	free (fill);
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    for (i = 0; i < num_order; i++) {
+	object = &lin->objects[order[i]];
+	if (object->part == PDF_PART_CATALOG)
+	    continue;
+
+	if (object->page == 0)
+	    object->part = PDF_PART_FIRST_PAGE;
+	else if (object->page > 0)
+	    object->part = object->shared ? PDF_PART_SHARED : PDF_PART_PAGE;
+    }
+
+    /* The first page object comes first. */
+    lin->first_page[0] = lin->pages[0];
+    n = 1;
+    for (i = 0; i < num_order; i++) {
+	id = order[i];
+	if (lin->objects[id].part == PDF_PART_FIRST_PAGE && id != lin->pages[0])
+	    lin->first_page[n++] = id;
+    }
+    lin->num_first_page = n;
+
+    /* Each other page is followed by the objects only it uses. */
+    for (i = 0; i < num_order; i++) {
+	object = &lin->objects[order[i]];
+	if (object->part == PDF_PART_PAGE)
+	    fill[object->page + 1]++;
+    }
+    for (i = 1; i <= lin->num_pages; i++)
+	fill[i] += fill[i - 1];
+    for (i = 1; i < lin->num_pages; i++)
+	lin->main[fill[i]++] = lin->pages[i];
+    for (i = 0; i < num_order; i++) {
+	id = order[i];
+	object = &lin->objects[id];
+	if (object->part == PDF_PART_PAGE && id != lin->pages[object->page])
+	    lin->main[fill[object->page]++] = id;
+    }
+    n = fill[lin->num_pages - 1];
+    free (fill);
+
+    lin->shared_start = n;
+    for (i = 0; i < num_order; i++) {
+	if (lin->objects[order[i]].part == PDF_PART_SHARED)
+	    lin->main[n++] = order[i];
+    }
+    lin->num_shared = n - lin->shared_start;
+
+    for (i = 0; i < num_order; i++) {
+	if (lin->objects[order[i]].part == PDF_PART_OTHER)
+	    lin->main[n++] = order[i];
+    }
+    lin->num_main = n;
+
+    for (i = 0; i < lin->num_main; i++) {
+	object = &lin->objects[lin->main[i]];
+	object->new_id = i + 1;
+	object->index = i - lin->shared_start;
+    }
+    lin->linearization_id = lin->num_main + 1;
+    lin->catalog_id = lin->linearization_id + 1;
+    lin->hint_id = lin->catalog_id + 1;
+    for (i = 0; i < lin->num_first_page; i++) {
+	object = &lin->objects[lin->first_page[i]];
+	object->new_id = lin->hint_id + 1 + i;
+	object->index = i;
+    }
+    lin->size = lin->hint_id + 1 + lin->num_first_page;
+
+    return COMAC_INT_STATUS_SUCCESS;
+}
+
+static int
+_num_digits (long long value)
+{
+    int n = 1;
+
+    while (value >= 10) {
+	value /= 10;
+	n++;
+    }
+
+    return n;
+}
+
+/* The length of an object once renumbered. */
+static long long
+_comac_pdf_linearizer_object_length (comac_pdf_linearizer_t *lin,
+				     comac_pdf_lin_object_t *object)
+{
+    comac_pdf_lin_object_t *target;
+    comac_pdf_lin_ref_t *ref;
+    long long length;
+    int i;
+
+    length = _num_digits (object->new_id) + strlen (" 0 obj");
+    length += object->end - object->body;
+    for (i = 0; i < object->num_refs; i++) {
+	ref = _comac_array_index (&lin->refs, object->first_ref + i);
+	target = _lookup (lin, ref->id);
+	length -= ref->end - ref->start;
+	if (target)
+	    length += _num_digits (target->new_id) + strlen (" 0 R");
+	else
+	    length += strlen ("null");
+    }
+
+    return length;
+}
+
+static void
+_comac_pdf_linearizer_write_object (comac_pdf_linearizer_t *lin,
+				    comac_output_stream_t *output,
+				    comac_pdf_lin_object_t *object)
+{
+    comac_pdf_lin_object_t *target;
+    comac_pdf_lin_ref_t *ref;
+    long long pos;
+    int i;
+
+    assert (_comac_output_stream_get_position (output) ==
+	    object->new_offset);
+
+    _comac_output_stream_printf (output, "%d 0 obj", object->new_id);
+    pos = object->body;
+    for (i = 0; i < object->num_refs; i++) {
+	ref = _comac_array_index (&lin->refs, object->first_ref + i);
+	_comac_output_stream_write (output, lin->data + pos, ref->start - pos);
+	target = _lookup (lin, ref->id);
+	if (target)
+	    _comac_output_stream_printf (output, "%d 0 R", target->new_id);
+	else
+	    _comac_output_stream_printf (output, "null");
+	pos = ref->end;
+    }
+    _comac_output_stream_write (output, lin->data + pos, object->end - pos);
+}
+
+typedef struct _comac_pdf_bit_writer {
+    comac_output_stream_t *stream;
+    unsigned int byte;
+    int num_bits;
+} comac_pdf_bit_writer_t;
+
+static void
+_bits_write (comac_pdf_bit_writer_t *writer, long long value, int num_bits)
+{
+    unsigned char c;
+
+    while (num_bits--) {
+	writer->byte = (writer->byte << 1) | ((value >> num_bits) & 1);
+	if (++writer->num_bits == 8) {
+	    c = writer->byte;
+	    _comac_output_stream_write (writer->stream, &c, 1);
+	    writer->byte = 0;
+	    writer->num_bits = 0;
+	}
+    }
+}
+
+static void
+_bits_flush (comac_pdf_bit_writer_t *writer)
+{
+    if (writer->num_bits)
+	_bits_write (writer, 0, 8 - writer->num_bits);
+}
+
+/* The number of bits needed to represent values up to @value. */
+static int
+_num_bits (long long value)
+{
+    int n = 0;
+
+    while (value > 0) {
+	value >>= 1;
+	n++;
+    }
+
+    return n;
+}
+
+/* Writes the page offset and shared object hint tables. Offsets are
+ * those of the file without the hint stream, as required. */
+static comac_int_status_t
+_comac_pdf_linearizer_write_hints (comac_pdf_linearizer_t *lin,
+				   unsigned char **data,
+				   unsigned long *length,
+				   int *shared_offset)
+{
+    comac_pdf_bit_writer_t writer;
+    comac_pdf_lin_object_t *object, *page;
+    long long *page_length;
+    int *page_num_objects, *page_num_shared;
+    long long min_length, max_length, min_group, max_group;
+    int min_objects, max_objects, max_shared, max_id;
+    int i, j, k, id, num_groups, bits, start, end;
+
+    *shared_offset = 0;
+
+    page_length = _comac_malloc_ab (lin->num_pages, sizeof (long long));
+    page_num_objects = _comac_malloc_ab (lin->num_pages, sizeof (int));
+    page_num_shared = calloc (lin->num_pages, sizeof (int));
+    if (unlikely (page_length == NULL || page_num_objects == NULL ||
+		  page_num_shared == NULL))
+    {
+	free (page_length);
+	free (page_num_objects);
+	free (page_num_shared);
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    /* Pages are contiguous: the first page section, then each other
+     * page object followed by its own objects. */
+    page_length[0] = 0;
+    for (i = 0; i < lin->num_first_page; i++)
+	page_length[0] += lin->objects[lin->first_page[i]].length;
+    page_num_objects[0] = lin->num_first_page;
+    for (i = 1; i < lin->num_pages; i++) {
+	start = lin->objects[lin->pages[i]].new_id - 1;
+	if (i + 1 < lin->num_pages)
+	    end = lin->objects[lin->pages[i + 1]].new_id - 1;
+	else
+	    end = lin->shared_start;
+
+	page_length[i] = 0;
+	for (k = start; k < end; k++)
+	    page_length[i] += lin->objects[lin->main[k]].length;
+	page_num_objects[i] = end - start;
+    }
+
+    max_shared = 0;
+    max_id = 0;
+    for (i = 1; i < lin->num_pages; i++) {
+	for (j = lin->page_start[i]; j < lin->page_start[i + 1]; j++) {
+	    _comac_array_copy_element (&lin->page_objects, j, &id);
+	    object = &lin->objects[id];
+	    if (object->part == PDF_PART_FIRST_PAGE) {
+		max_id = MAX (max_id, object->index);
+		page_num_shared[i]++;
+	    } else if (object->part == PDF_PART_SHARED) {
+		max_id = MAX (max_id, lin->num_first_page + object->index);
+		page_num_shared[i]++;
+	    }
+	}
+	max_shared = MAX (max_shared, page_num_shared[i]);
+    }
+
+    min_objects = max_objects = page_num_objects[0];
+    min_length = max_length = page_length[0];
+    for (i = 1; i < lin->num_pages; i++) {
+	min_objects = MIN (min_objects, page_num_objects[i]);
+	max_objects = MAX (max_objects, page_num_objects[i]);
+	min_length = MIN (min_length, page_length[i]);
+	max_length = MAX (max_length, page_length[i]);
+    }
+
+    writer.stream = _comac_memory_stream_create ();
+    writer.byte = 0;
+    writer.num_bits = 0;
+
+    /* Page offset hint table header */
+    page = &lin->objects[lin->pages[0]];
+    bits = _num_bits (max_length - min_length);
+    _bits_write (&writer, min_objects, 32);
+    _bits_write (&writer, page->new_offset, 32);
+    _bits_write (&writer, _num_bits (max_objects - min_objects), 16);
+    _bits_write (&writer, min_length, 32);
+    _bits_write (&writer, bits, 16);
+    _bits_write (&writer, 0, 32); /* content stream offset */
+    _bits_write (&writer, 0, 16);
+    _bits_write (&writer, min_length, 32); /* content stream length */
+    _bits_write (&writer, bits, 16);
+    _bits_write (&writer, _num_bits (max_shared), 16);
+    _bits_write (&writer, _num_bits (max_id), 16);
+    _bits_write (&writer, 0, 16); /* fractional position numerator */
+    _bits_write (&writer, 1, 16); /* and denominator */
+
+    /* Page offset hint table entries, item by item */
+    for (i = 0; i < lin->num_pages; i++)
+	_bits_write (&writer,
+		     page_num_objects[i] - min_objects,
+		     _num_bits (max_objects - min_objects));
+    _bits_flush (&writer);
+    for (i = 0; i < lin->num_pages; i++)
+	_bits_write (&writer, page_length[i] - min_length, bits);
+    _bits_flush (&writer);
+    for (i = 0; i < lin->num_pages; i++)
+	_bits_write (&writer, page_num_shared[i], _num_bits (max_shared));
+    _bits_flush (&writer);
+    for (i = 1; i < lin->num_pages; i++) {
+	for (j = lin->page_start[i]; j < lin->page_start[i + 1]; j++) {
+	    _comac_array_copy_element (&lin->page_objects, j, &id);
+	    object = &lin->objects[id];
+	    if (object->part == PDF_PART_FIRST_PAGE)
+		_bits_write (&writer, object->index, _num_bits (max_id));
+	    else if (object->part == PDF_PART_SHARED)
+		_bits_write (&writer,
+			     lin->num_first_page + object->index,
+			     _num_bits (max_id));
+	}
+    }
+    _bits_flush (&writer);
+    for (i = 0; i < lin->num_pages; i++)
+	_bits_write (&writer, page_length[i] - min_length, bits);
+    _bits_flush (&writer);
+
+    free (page_length);
+    free (page_num_objects);
+    free (page_num_shared);
+
+    /* Shared object hint table, one object per group */
+    *shared_offset = _comac_output_stream_get_position (writer.stream);
+    num_groups = lin->num_first_page + lin->num_shared;
+    min_group = max_group = lin->objects[lin->first_page[0]].length;
+    for (i = 0; i < num_groups; i++) {
+	if (i < lin->num_first_page)
+	    object = &lin->objects[lin->first_page[i]];
+	else
+	    object = &lin->objects[lin->main[lin->shared_start + i -
+					     lin->num_first_page]];
+	min_group = MIN (min_group, object->length);
+	max_group = MAX (max_group, object->length);
+    }
+    bits = _num_bits (max_group - min_group);
+
+    if (lin->num_shared) {
+	object = &lin->objects[lin->main[lin->shared_start]];
+	_bits_write (&writer, object->new_id, 32);
+	_bits_write (&writer, object->new_offset, 32);
+    } else {
+	_bits_write (&writer, 0, 32);
+	_bits_write (&writer, 0, 32);
+    }
+    _bits_write (&writer, lin->num_first_page, 32);
+    _bits_write (&writer, num_groups, 32);
+    _bits_write (&writer, 0, 16); /* objects per group, minus one */
+    _bits_write (&writer, min_group, 32);
+    _bits_write (&writer, bits, 16);
+
+    for (i = 0; i < num_groups; i++) {
+	if (i < lin->num_first_page)
+	    object = &lin->objects[lin->first_page[i]];
+	else
+	    object = &lin->objects[lin->main[lin->shared_start + i -
+					     lin->num_first_page]];
+	_bits_write (&writer, object->length - min_group, bits);
+    }
+    _bits_flush (&writer);
+    for (i = 0; i < num_groups; i++)
+	_bits_write (&writer, 0, 1); /* no MD5 signature */
+    _bits_flush (&writer);
+
+    return _comac_memory_stream_destroy (writer.stream, data, length);
+}
+
+static comac_int_status_t
+_comac_pdf_linearizer_write (comac_pdf_linearizer_t *lin,
+			     comac_output_stream_t *output,
+			     long long header_length,
+			     int catalog_id,
+			     int info_id)
+{
+    comac_pdf_lin_object_t *object, *catalog, *info;
+    unsigned char *hints;
+    unsigned long hints_length;
+    char info_ref[32];
+    char hint_dict[80];
+    long long pos, hint_offset, hint_length, first_xref, main_xref;
+    long long first_page_end, file_length, main_xref_header;
+    int shared_offset;
+    int i, num_first, first_page_id;
+    comac_int_status_t status;
+
+    catalog = &lin->objects[catalog_id];
+    catalog->new_id = lin->catalog_id;
+    catalog->length = _comac_pdf_linearizer_object_length (lin, catalog);
+    for (i = 0; i < lin->num_first_page; i++) {
+	object = &lin->objects[lin->first_page[i]];
+	object->length = _comac_pdf_linearizer_object_length (lin, object);
+    }
+    for (i = 0; i < lin->num_main; i++) {
+	object = &lin->objects[lin->main[i]];
+	object->length = _comac_pdf_linearizer_object_length (lin, object);
+    }
+
+    info = _lookup (lin, info_id);
+    if (info)
+	snprintf (info_ref, sizeof info_ref, " /Info %d 0 R", info->new_id);
+    else
+	info_ref[0] = '\0';
+
+    /* Lay out the file without the hint stream, as the offsets in the
+     * hint tables ignore it. */
+    first_page_id = lin->objects[lin->pages[0]].new_id;
+    num_first = lin->num_first_page + 3;
+    pos = header_length;
+    pos += snprintf (NULL,
+		     0,
+		     linearization_format,
+		     lin->linearization_id,
+		     0LL,
+		     0LL,
+		     0LL,
+		     first_page_id,
+		     0LL,
+		     lin->num_pages,
+		     0LL);
+    first_xref = pos;
+    pos += snprintf (NULL,
+		     0,
+		     "xref\n%d %d\n",
+		     lin->linearization_id,
+		     num_first);
+    pos += 20 * num_first;
+    pos += snprintf (NULL,
+		     0,
+		     first_trailer_format,
+		     lin->size,
+		     lin->catalog_id,
+		     info_ref,
+		     0LL);
+    catalog->new_offset = pos;
+    pos += catalog->length;
+    hint_offset = pos;
+    for (i = 0; i < lin->num_first_page; i++) {
+	object = &lin->objects[lin->first_page[i]];
+	object->new_offset = pos;
+	pos += object->length;
+    }
+    first_page_end = pos;
+    for (i = 0; i < lin->num_main; i++) {
+	object = &lin->objects[lin->main[i]];
+	object->new_offset = pos;
+	pos += object->length;
+    }
+    main_xref = pos;
+
+    status = _comac_pdf_linearizer_write_hints (lin,
+						&hints,
+						&hints_length,
+						&shared_offset);
+    if (unlikely (status))
+	return status;
+
+    snprintf (hint_dict,
+	      sizeof hint_dict,
+	      "%d 0 obj\n<< /Length %lu /S %d >>\nstream\n",
+	      lin->hint_id,
+	      hints_length,
+	      shared_offset);
+    hint_length =
+	strlen (hint_dict) + hints_length + strlen ("\nendstream\nendobj\n");
+
+    for (i = 0; i < lin->num_first_page; i++)
+	lin->objects[lin->first_page[i]].new_offset += hint_length;
+    for (i = 0; i < lin->num_main; i++)
+	lin->objects[lin->main[i]].new_offset += hint_length;
+    first_page_end += hint_length;
+    main_xref += hint_length;
+
+    main_xref_header =
+	snprintf (NULL, 0, "xref\n0 %d\n", lin->linearization_id);
+    file_length = main_xref + main_xref_header;
+    file_length += 20 * lin->linearization_id;
+    file_length += snprintf (NULL,
+			     0,
+			     "trailer\n<< /Size %d >>\n"
+			     "startxref\n%lld\n%%%%EOF\n",
+			     lin->linearization_id,
+			     first_xref);
+
+    /* The fixed width fields and xref entries hold 10 digits. */
+    if (file_length >= 10000000000LL) {
+	free (hints);
+	return COMAC_INT_STATUS_UNSUPPORTED;
+    }
+
+    _comac_output_stream_write (output, lin->data, header_length);
+    _comac_output_stream_printf (output,
+				 linearization_format,
+				 lin->linearization_id,
+				 file_length,
+				 hint_offset,
+				 hint_length,
+				 first_page_id,
+				 first_page_end,
+				 lin->num_pages,
+				 main_xref + main_xref_header - 1);
+
+    assert (_comac_output_stream_get_position (output) == first_xref);
+    _comac_output_stream_printf (output,
+				 "xref\n%d %d\n",
+				 lin->linearization_id,
+				 num_first);
+    _comac_output_stream_printf (output,
+				 "%010lld 00000 n \n",
+				 header_length);
+    _comac_output_stream_printf (output,
+				 "%010lld 00000 n \n",
+				 catalog->new_offset);
+    _comac_output_stream_printf (output, "%010lld 00000 n \n", hint_offset);
+    for (i = 0; i < lin->num_first_page; i++) {
+	_comac_output_stream_printf (
+	    output,
+	    "%010lld 00000 n \n",
+	    lin->objects[lin->first_page[i]].new_offset);
+    }
+    _comac_output_stream_printf (output,
+				 first_trailer_format,
+				 lin->size,
+				 lin->catalog_id,
+				 info_ref,
+				 main_xref);
+
+    _comac_pdf_linearizer_write_object (lin, output, catalog);
+
+    assert (_comac_output_stream_get_position (output) == hint_offset);
+    _comac_output_stream_printf (output, "%s", hint_dict);
+    _comac_output_stream_write (output, hints, hints_length);
+    _comac_output_stream_printf (output, "\nendstream\nendobj\n");
+    free (hints);
+
+    for (i = 0; i < lin->num_first_page; i++) {
+	_comac_pdf_linearizer_write_object (lin,
+					    output,
+					    &lin->objects[lin->first_page[i]]);
+    }
+    for (i = 0; i < lin->num_main; i++) {
+	_comac_pdf_linearizer_write_object (lin,
+					    output,
+					    &lin->objects[lin->main[i]]);
+    }
+
+    assert (_comac_output_stream_get_position (output) == main_xref);
+    _comac_output_stream_printf (output,
+				 "xref\n0 %d\n",
+				 lin->linearization_id);
+    _comac_output_stream_printf (output, "0000000000 65535 f \n");
+    for (i = 0; i < lin->num_main; i++) {
+	_comac_output_stream_printf (output,
+				     "%010lld 00000 n \n",
+				     lin->objects[lin->main[i]].new_offset);
+    }
+    _comac_output_stream_printf (output,
+				 "trailer\n"
+				 "<< /Size %d >>\n"
+				 "startxref\n"
+				 "%lld\n"
+				 "%%%%EOF\n",
+				 lin->linearization_id,
+				 first_xref);
+    assert (_comac_output_stream_get_position (output) == file_length);
+
+    return _comac_output_stream_get_status (output);
+}
+
+comac_int_status_t
+_comac_pdf_linearize (comac_output_stream_t *output,
+		      const unsigned char *data,
+		      unsigned long length,
+		      const long long *offsets,
+		      int num_objects,
+		      const int *pages,
+		      int num_pages,
+		      int pages_root,
+		      int catalog,
+		      int info)
+{
+    comac_pdf_linearizer_t lin;
+    comac_pdf_lin_object_t *object;
+    comac_int_status_t status;
+    int *order;
+    int i, num_order = 0;
+
+    if (num_pages < 1)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    memset (&lin, 0, sizeof (lin));
+    lin.data = data;
+    lin.length = length;
+    lin.num_objects = num_objects;
+    lin.pages = pages;
+    lin.num_pages = num_pages;
+    _comac_array_init (&lin.refs, sizeof (comac_pdf_lin_ref_t));
+    _comac_array_init (&lin.page_objects, sizeof (int));
+
+    lin.objects = calloc (num_objects + 1, sizeof (comac_pdf_lin_object_t));
+    order = _comac_malloc_ab (num_objects, sizeof (int));
+    if (unlikely (lin.objects == NULL || order == NULL)) {
+	status = _comac_error (COMAC_STATUS_NO_MEMORY);
+	goto BAIL;
+    }
+
+    for (i = 0; i <= num_objects; i++) {
+	lin.objects[i].offset = -1;
+	lin.objects[i].page = -1;
+    }
+
+    status = _comac_pdf_linearizer_scan (&lin, offsets, order, &num_order);
+    if (unlikely (status))
+	goto BAIL;
+
+    object = _lookup (&lin, catalog);
+    if (object == NULL) {
+	status = COMAC_INT_STATUS_UNSUPPORTED;
+	goto BAIL;
+    }
+    object->stop = TRUE;
+    object->part = PDF_PART_CATALOG;
+
+    for (i = 0; i < num_pages; i++) {
+	object = _lookup (&lin, pages[i]);
+	if (object == NULL || object->stop) {
+	    status = COMAC_INT_STATUS_UNSUPPORTED;
+	    goto BAIL;
+	}
+	object->stop = TRUE;
+    }
+
+    object = _lookup (&lin, pages_root);
+    if (object)
+	object->stop = TRUE;
+    object = _lookup (&lin, info);
+    if (object)
+	object->stop = TRUE;
+
+    status = _comac_pdf_linearizer_collect_pages (&lin);
+    if (unlikely (status))
+	goto BAIL;
+
+    status = _comac_pdf_linearizer_order (&lin, order, num_order);
+    if (unlikely (status))
+	goto BAIL;
+
+    status = _comac_pdf_linearizer_write (&lin,
+					  output,
+					  lin.objects[order[0]].offset,
+					  catalog,
+					  info);
+
+BAIL:
+    free (order);
+    free (lin.objects);
+    free (lin.page_start);
+    free (lin.first_page);
+    free (lin.main);
+    _comac_array_fini (&lin.refs);
+    _comac_array_fini (&lin.page_objects);
+
+    return status;
+}
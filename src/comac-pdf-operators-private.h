@@ -53,6 +53,14 @@
  */
 #define PDF_GLYPH_BUFFER_SIZE 200
 
+/* Dash arrays up to this length are remembered so that an unchanged
+ * dash pattern is not emitted again. */
+#define PDF_LINE_STYLE_MAX_DASHES 8
+
+/* Depth of nested 'q' operators for which the line style is restored
+ * on the matching 'Q'. Deeper levels forget the line style. */
+#define PDF_SAVE_STACK_SIZE 4
+
 typedef comac_int_status_t (*comac_pdf_operators_use_font_subset_t) (
     unsigned int font_id, unsigned int subset_id, void *closure);
 
@@ -62,6 +70,17 @@ typedef struct _comac_pdf_glyph {
     double x_advance;
 } comac_pdf_glyph_t;
 
+typedef struct _comac_pdf_line_style {
+    comac_bool_t is_set;
+    double line_width;
+    comac_line_cap_t line_cap;
+    comac_line_join_t line_join;
+    double miter_limit;
+    int num_dashes; /* -1 if the dash array is too long to remember */
+    double dash[PDF_LINE_STYLE_MAX_DASHES];
+    double dash_offset;
+} comac_pdf_line_style_t;
+
 typedef struct _comac_pdf_operators {
     comac_output_stream_t *stream;
     comac_matrix_t comac_to_pdf;
@@ -91,12 +110,19 @@ typedef struct _comac_pdf_operators {
     comac_pdf_glyph_t glyphs[PDF_GLYPH_BUFFER_SIZE];
 
     /* PDF line style */
-    comac_bool_t has_line_style;
-    double line_width;
-    comac_line_cap_t line_cap;
-    comac_line_join_t line_join;
-    double miter_limit;
-    comac_bool_t has_dashes;
+    comac_pdf_line_style_t line_style;
+
+    /* Fill with the fill operator not yet emitted. Subsequent fills
+     * that do not overlap are appended to the same path. */
+    comac_bool_t in_fill;
+    comac_fill_rule_t fill_rule;
+    comac_box_double_t fill_extents; /* in PDF coordinates */
+
+    /* 'q' operators not yet emitted. A 'Q' that immediately follows
+     * cancels the last one instead of emitting an empty pair. */
+    int num_pending_saves;
+    int save_depth;
+    comac_pdf_line_style_t saved_line_styles[PDF_SAVE_STACK_SIZE];
 } comac_pdf_operators_t;
 
 comac_private void
@@ -133,6 +159,12 @@ _comac_pdf_operators_flush (comac_pdf_operators_t *pdf_operators);
 comac_private void
 _comac_pdf_operators_reset (comac_pdf_operators_t *pdf_operators);
 
+comac_private comac_status_t
+_comac_pdf_operators_save (comac_pdf_operators_t *pdf_operators);
+
+comac_private comac_status_t
+_comac_pdf_operators_restore (comac_pdf_operators_t *pdf_operators);
+
 comac_private comac_int_status_t
 _comac_pdf_operators_clip (comac_pdf_operators_t *pdf_operators,
 			   const comac_path_fixed_t *path,
@@ -67,8 +67,11 @@ _comac_pdf_operators_init (comac_pdf_operators_t *pdf_operators,
     pdf_operators->use_font_subset_closure = NULL;
     pdf_operators->in_text_object = FALSE;
     pdf_operators->num_glyphs = 0;
-    pdf_operators->has_line_style = FALSE;
+    pdf_operators->line_style.is_set = FALSE;
     pdf_operators->use_actual_text = FALSE;
+    pdf_operators->in_fill = FALSE;
+    pdf_operators->num_pending_saves = 0;
+    pdf_operators->save_depth = 0;
 }
 
 comac_status_t
@@ -96,7 +99,7 @@ _comac_pdf_operators_set_stream (comac_pdf_operators_t *pdf_operators,
 				 comac_output_stream_t *stream)
 {
     pdf_operators->stream = stream;
-    pdf_operators->has_line_style = FALSE;
+    pdf_operators->line_style.is_set = FALSE;
 }
 
 void
@@ -104,7 +107,7 @@ _comac_pdf_operators_set_comac_to_pdf_matrix (
     comac_pdf_operators_t *pdf_operators, comac_matrix_t *comac_to_pdf)
 {
     pdf_operators->comac_to_pdf = *comac_to_pdf;
-    pdf_operators->has_line_style = FALSE;
+    pdf_operators->line_style.is_set = FALSE;
 }
 
 comac_private void
@@ -114,6 +117,45 @@ _comac_pdf_operators_enable_actual_text (comac_pdf_operators_t *pdf_operators,
     pdf_operators->use_actual_text = enable;
 }
 
+static comac_status_t
+_comac_pdf_operators_end_fill (comac_pdf_operators_t *pdf_operators)
+{
+    const char *pdf_operator;
+
+    switch (pdf_operators->fill_rule) {
+    default:
+	ASSERT_NOT_REACHED;
+    case COMAC_FILL_RULE_WINDING:
+	pdf_operator = "f";
+	break;
+    case COMAC_FILL_RULE_EVEN_ODD:
+	pdf_operator = "f*";
+	break;
+    }
+
+    _comac_output_stream_printf (pdf_operators->stream, "%s\n", pdf_operator);
+
+    pdf_operators->in_fill = FALSE;
+
+    return _comac_output_stream_get_status (pdf_operators->stream);
+}
+
+/* Finish the text object or fill that has been left open for
+ * merging with subsequent operations. */
+static comac_status_t
+_comac_pdf_operators_end_pending (comac_pdf_operators_t *pdf_operators)
+{
+    comac_status_t status = COMAC_STATUS_SUCCESS;
+
+    if (pdf_operators->in_text_object)
+	status = _comac_pdf_operators_end_text (pdf_operators);
+
+    if (status == COMAC_STATUS_SUCCESS && pdf_operators->in_fill)
+	status = _comac_pdf_operators_end_fill (pdf_operators);
+
+    return status;
+}
+
 /* Finish writing out any pending commands to the stream. This
  * function must be called by the surface before emitting anything
  * into the PDF stream.
@@ -128,12 +170,21 @@ _comac_pdf_operators_enable_actual_text (comac_pdf_operators_t *pdf_operators,
 comac_status_t
 _comac_pdf_operators_flush (comac_pdf_operators_t *pdf_operators)
 {
-    comac_status_t status = COMAC_STATUS_SUCCESS;
+    comac_status_t status;
 
-    if (pdf_operators->in_text_object)
-	status = _comac_pdf_operators_end_text (pdf_operators);
+    status = _comac_pdf_operators_end_pending (pdf_operators);
+    if (unlikely (status))
+	return status;
 
-    return status;
+    if (pdf_operators->num_pending_saves == 0)
+	return COMAC_STATUS_SUCCESS;
+
+    while (pdf_operators->num_pending_saves) {
+	_comac_output_stream_printf (pdf_operators->stream, "q\n");
+	pdf_operators->num_pending_saves--;
+    }
+
+    return _comac_output_stream_get_status (pdf_operators->stream);
 }
 
 /* Reset the known graphics state of the PDF consumer. ie no
@@ -149,7 +200,62 @@ _comac_pdf_operators_flush (comac_pdf_operators_t *pdf_operators)
 void
 _comac_pdf_operators_reset (comac_pdf_operators_t *pdf_operators)
 {
-    pdf_operators->has_line_style = FALSE;
+    pdf_operators->line_style.is_set = FALSE;
+}
+
+/* Save the graphics state with the 'q' operator. Emitting the 'q' is
+ * deferred until the next operation so that a save immediately
+ * followed by _comac_pdf_operators_restore() emits nothing.
+ *
+ * The line style is remembered and known again after the restore.
+ */
+comac_status_t
+_comac_pdf_operators_save (comac_pdf_operators_t *pdf_operators)
+{
+    comac_status_t status;
+
+    status = _comac_pdf_operators_end_pending (pdf_operators);
+    if (unlikely (status))
+	return status;
+
+    if (pdf_operators->save_depth < PDF_SAVE_STACK_SIZE) {
+	pdf_operators->saved_line_styles[pdf_operators->save_depth] =
+	    pdf_operators->line_style;
+    }
+    pdf_operators->save_depth++;
+    pdf_operators->num_pending_saves++;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Restore the graphics state saved by _comac_pdf_operators_save(). */
+comac_status_t
+_comac_pdf_operators_restore (comac_pdf_operators_t *pdf_operators)
+{
+    comac_status_t status;
+
+    status = _comac_pdf_operators_end_pending (pdf_operators);
+    if (unlikely (status))
+	return status;
+
+    if (pdf_operators->num_pending_saves) {
+	/* Nothing has been drawn since the save. Drop the q/Q pair. */
+	pdf_operators->num_pending_saves--;
+    } else {
+	_comac_output_stream_printf (pdf_operators->stream, "Q\n");
+	if (pdf_operators->save_depth > 0 &&
+	    pdf_operators->save_depth <= PDF_SAVE_STACK_SIZE) {
+	    pdf_operators->line_style =
+		pdf_operators->saved_line_styles[pdf_operators->save_depth - 1];
+	} else {
+	    pdf_operators->line_style.is_set = FALSE;
+	}
+    }
+
+    if (pdf_operators->save_depth > 0)
+	pdf_operators->save_depth--;
+
+    return _comac_output_stream_get_status (pdf_operators->stream);
 }
 
 /* A word wrap stream can be used as a filter to do word wrapping on
@@ -547,11 +653,9 @@ _comac_pdf_operators_clip (comac_pdf_operators_t *pdf_operators,
     const char *pdf_operator;
     comac_status_t status;
 
-    if (pdf_operators->in_text_object) {
-	status = _comac_pdf_operators_end_text (pdf_operators);
-	if (unlikely (status))
-	    return status;
-    }
+    status = _comac_pdf_operators_flush (pdf_operators);
+    if (unlikely (status))
+	return status;
 
     if (! path->has_current_point) {
 	/* construct an empty path */
@@ -613,6 +717,30 @@ _comac_pdf_line_join (comac_line_join_t join)
     }
 }
 
+/* Check if the dash pattern is the one that was emitted last. */
+static comac_bool_t
+_comac_pdf_line_style_has_dashes (const comac_pdf_line_style_t *line_style,
+				  const double *dash,
+				  int num_dashes,
+				  double dash_offset,
+				  double scale)
+{
+    int d;
+
+    if (! line_style->is_set || line_style->num_dashes != num_dashes)
+	return FALSE;
+
+    if (line_style->dash_offset != dash_offset * scale)
+	return FALSE;
+
+    for (d = 0; d < num_dashes; d++) {
+	if (line_style->dash[d] != dash[d] * scale)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
 comac_int_status_t
 _comac_pdf_operators_emit_stroke_style (comac_pdf_operators_t *pdf_operators,
 					const comac_stroke_style_t *style,
@@ -622,6 +750,7 @@ _comac_pdf_operators_emit_stroke_style (comac_pdf_operators_t *pdf_operators,
     int num_dashes = style->num_dashes;
     double dash_offset = style->dash_offset;
     double line_width = style->line_width * scale;
+    comac_pdf_line_style_t *line_style;
 
     /* PostScript has "special needs" when it comes to zero-length
      * dash segments with butt caps. It apparently (at least
@@ -702,58 +831,69 @@ _comac_pdf_operators_emit_stroke_style (comac_pdf_operators_t *pdf_operators,
 	}
     }
 
-    if (! pdf_operators->has_line_style ||
-	pdf_operators->line_width != line_width) {
+    line_style = &pdf_operators->line_style;
+    if (! line_style->is_set || line_style->line_width != line_width) {
 	_comac_output_stream_printf (pdf_operators->stream,
 				     "%f w\n",
 				     line_width);
-	pdf_operators->line_width = line_width;
+	line_style->line_width = line_width;
     }
 
-    if (! pdf_operators->has_line_style ||
-	pdf_operators->line_cap != style->line_cap) {
+    if (! line_style->is_set || line_style->line_cap != style->line_cap) {
 	_comac_output_stream_printf (pdf_operators->stream,
 				     "%d J\n",
 				     _comac_pdf_line_cap (style->line_cap));
-	pdf_operators->line_cap = style->line_cap;
+	line_style->line_cap = style->line_cap;
     }
 
-    if (! pdf_operators->has_line_style ||
-	pdf_operators->line_join != style->line_join) {
+    if (! line_style->is_set || line_style->line_join != style->line_join) {
 	_comac_output_stream_printf (pdf_operators->stream,
 				     "%d j\n",
 				     _comac_pdf_line_join (style->line_join));
-	pdf_operators->line_join = style->line_join;
+	line_style->line_join = style->line_join;
     }
 
     if (num_dashes) {
-	int d;
-
-	_comac_output_stream_printf (pdf_operators->stream, "[");
-	for (d = 0; d < num_dashes; d++)
+	if (! _comac_pdf_line_style_has_dashes (line_style,
+						dash,
+						num_dashes,
+						dash_offset,
+						scale)) {
+	    int d;
+
+	    _comac_output_stream_printf (pdf_operators->stream, "[");
+	    for (d = 0; d < num_dashes; d++)
+		_comac_output_stream_printf (pdf_operators->stream,
+					     " %f",
+					     dash[d] * scale);
 	    _comac_output_stream_printf (pdf_operators->stream,
-					 " %f",
-					 dash[d] * scale);
-	_comac_output_stream_printf (pdf_operators->stream,
-				     "] %f d\n",
-				     dash_offset * scale);
-	pdf_operators->has_dashes = TRUE;
-    } else if (! pdf_operators->has_line_style || pdf_operators->has_dashes) {
+					 "] %f d\n",
+					 dash_offset * scale);
+
+	    if (num_dashes <= PDF_LINE_STYLE_MAX_DASHES) {
+		for (d = 0; d < num_dashes; d++)
+		    line_style->dash[d] = dash[d] * scale;
+		line_style->num_dashes = num_dashes;
+		line_style->dash_offset = dash_offset * scale;
+	    } else {
+		line_style->num_dashes = -1;
+	    }
+	}
+    } else if (! line_style->is_set || line_style->num_dashes != 0) {
 	_comac_output_stream_printf (pdf_operators->stream, "[] 0.0 d\n");
-	pdf_operators->has_dashes = FALSE;
+	line_style->num_dashes = 0;
     }
     if (dash != style->dash)
 	free (dash);
 
-    if (! pdf_operators->has_line_style ||
-	pdf_operators->miter_limit != style->miter_limit) {
+    if (! line_style->is_set || line_style->miter_limit != style->miter_limit) {
 	_comac_output_stream_printf (
 	    pdf_operators->stream,
 	    "%f M ",
 	    style->miter_limit < 1.0 ? 1.0 : style->miter_limit);
-	pdf_operators->miter_limit = style->miter_limit;
+	line_style->miter_limit = style->miter_limit;
     }
-    pdf_operators->has_line_style = TRUE;
+    line_style->is_set = TRUE;
 
     return _comac_output_stream_get_status (pdf_operators->stream);
 }
@@ -797,11 +937,9 @@ _comac_pdf_operators_emit_stroke (comac_pdf_operators_t *pdf_operators,
     comac_bool_t has_ctm = TRUE;
     double scale = 1.0;
 
-    if (pdf_operators->in_text_object) {
-	status = _comac_pdf_operators_end_text (pdf_operators);
-	if (unlikely (status))
-	    return status;
-    }
+    status = _comac_pdf_operators_flush (pdf_operators);
+    if (unlikely (status))
+	return status;
 
     /* Optimize away the stroke ctm when it does not affect the
      * stroke. There are other ctm cases that could be optimized
@@ -894,36 +1032,59 @@ _comac_pdf_operators_fill (comac_pdf_operators_t *pdf_operators,
 			   const comac_path_fixed_t *path,
 			   comac_fill_rule_t fill_rule)
 {
-    const char *pdf_operator;
+    comac_box_double_t extents;
     comac_status_t status;
 
-    if (pdf_operators->in_text_object) {
-	status = _comac_pdf_operators_end_text (pdf_operators);
+    if (path->fill_is_empty)
+	return COMAC_STATUS_SUCCESS;
+
+    _comac_box_to_doubles (&path->extents,
+			   &extents.p1.x,
+			   &extents.p1.y,
+			   &extents.p2.x,
+			   &extents.p2.y);
+    _comac_matrix_transform_bounding_box (&pdf_operators->comac_to_pdf,
+					  &extents.p1.x,
+					  &extents.p1.y,
+					  &extents.p2.x,
+					  &extents.p2.y,
+					  NULL);
+
+    /* The fill operator of the previous fill has not been emitted
+     * yet. Nothing else has been emitted since so the graphics state
+     * is the same. When the two paths do not overlap, painting their
+     * union with one fill operator gives the same result as painting
+     * them one after the other. */
+    if (pdf_operators->in_fill && pdf_operators->fill_rule == fill_rule &&
+	(extents.p1.x > pdf_operators->fill_extents.p2.x ||
+	 extents.p2.x < pdf_operators->fill_extents.p1.x ||
+	 extents.p1.y > pdf_operators->fill_extents.p2.y ||
+	 extents.p2.y < pdf_operators->fill_extents.p1.y)) {
+	pdf_operators->fill_extents.p1.x =
+	    MIN (pdf_operators->fill_extents.p1.x, extents.p1.x);
+	pdf_operators->fill_extents.p1.y =
+	    MIN (pdf_operators->fill_extents.p1.y, extents.p1.y);
+	pdf_operators->fill_extents.p2.x =
+	    MAX (pdf_operators->fill_extents.p2.x, extents.p2.x);
+	pdf_operators->fill_extents.p2.y =
+	    MAX (pdf_operators->fill_extents.p2.y, extents.p2.y);
+
+	/* Each path is word wrapped separately. */
+	_comac_output_stream_printf (pdf_operators->stream, "\n");
+    } else {
+	status = _comac_pdf_operators_flush (pdf_operators);
 	if (unlikely (status))
 	    return status;
-    }
 
-    status = _comac_pdf_operators_emit_path (pdf_operators,
-					     path,
-					     &pdf_operators->comac_to_pdf,
-					     COMAC_LINE_CAP_ROUND);
-    if (unlikely (status))
-	return status;
-
-    switch (fill_rule) {
-    default:
-	ASSERT_NOT_REACHED;
-    case COMAC_FILL_RULE_WINDING:
-	pdf_operator = "f";
-	break;
-    case COMAC_FILL_RULE_EVEN_ODD:
-	pdf_operator = "f*";
-	break;
+	pdf_operators->in_fill = TRUE;
+	pdf_operators->fill_rule = fill_rule;
+	pdf_operators->fill_extents = extents;
     }
 
-    _comac_output_stream_printf (pdf_operators->stream, "%s\n", pdf_operator);
-
-    return _comac_output_stream_get_status (pdf_operators->stream);
+    return _comac_pdf_operators_emit_path (pdf_operators,
+					   path,
+					   &pdf_operators->comac_to_pdf,
+					   COMAC_LINE_CAP_ROUND);
 }
 
 comac_int_status_t
@@ -1251,6 +1412,12 @@ _comac_pdf_operators_set_font_subset (
 static comac_status_t
 _comac_pdf_operators_begin_text (comac_pdf_operators_t *pdf_operators)
 {
+    comac_status_t status;
+
+    status = _comac_pdf_operators_flush (pdf_operators);
+    if (unlikely (status))
+	return status;
+
     _comac_output_stream_printf (pdf_operators->stream, "BT\n");
 
     pdf_operators->in_text_object = TRUE;
@@ -1596,11 +1763,9 @@ _comac_pdf_operators_tag_begin (comac_pdf_operators_t *pdf_operators,
 {
     comac_status_t status;
 
-    if (pdf_operators->in_text_object) {
-	status = _comac_pdf_operators_end_text (pdf_operators);
-	if (unlikely (status))
-	    return status;
-    }
+    status = _comac_pdf_operators_flush (pdf_operators);
+    if (unlikely (status))
+	return status;
 
     _comac_output_stream_printf (pdf_operators->stream,
 				 "/%s << /MCID %d >> BDC\n",
@@ -1615,11 +1780,9 @@ _comac_pdf_operators_tag_end (comac_pdf_operators_t *pdf_operators)
 {
     comac_status_t status;
 
-    if (pdf_operators->in_text_object) {
-	status = _comac_pdf_operators_end_text (pdf_operators);
-	if (unlikely (status))
-	    return status;
-    }
+    status = _comac_pdf_operators_flush (pdf_operators);
+    if (unlikely (status))
+	return status;
 
     _comac_output_stream_printf (pdf_operators->stream, "EMC\n");
 
@@ -56,16 +56,20 @@ typedef struct _comac_pdf_shading {
  * _comac_pdf_shading_init_color:
  * @shading: a #comac_pdf_shading_t to initialize
  * @pattern: the #comac_mesh_pattern_t to initialize from
+ * @surface: the surface the shading is written for
  *
  * Generate the PDF shading dictionary data for the a PDF type 7
- * shading from RGB part of the specified mesh pattern.
+ * shading from the color part of the specified mesh pattern. The
+ * colors are converted to the colorspace of @surface with its color
+ * conversion callbacks.
  *
  * Return value: %COMAC_STATUS_SUCCESS if successful, possible errors
  * include %COMAC_STATUS_NO_MEMORY.
  **/
 comac_private comac_status_t
 _comac_pdf_shading_init_color (comac_pdf_shading_t *shading,
-			       const comac_mesh_pattern_t *pattern);
+			       const comac_mesh_pattern_t *pattern,
+			       comac_surface_t *surface);
 
 /**
  * _comac_pdf_shading_init_alpha:
@@ -80,12 +80,14 @@ encode_color_component (unsigned char *p, double color)
 }
 
 static unsigned char *
-encode_color (unsigned char *p, const comac_color_t *color)
+encode_color (unsigned char *p,
+	      const double *color,
+	      unsigned int num_color_components)
 {
-    assert (color->colorspace == COMAC_COLORSPACE_RGB);
-    p = encode_color_component (p, color->c.rgb.red);
-    p = encode_color_component (p, color->c.rgb.green);
-    p = encode_color_component (p, color->c.rgb.blue);
+    unsigned int i;
+
+    for (i = 0; i < num_color_components; i++)
+	p = encode_color_component (p, color[i]);
 
     return p;
 }
@@ -102,16 +104,11 @@ encode_alpha (unsigned char *p, const comac_color_t *color)
 static comac_status_t
 _comac_pdf_shading_generate_decode_array (comac_pdf_shading_t *shading,
 					  const comac_mesh_pattern_t *mesh,
-					  comac_bool_t is_alpha)
+					  unsigned int num_color_components)
 {
-    unsigned int num_color_components, i;
+    unsigned int i;
     comac_bool_t is_valid;
 
-    if (is_alpha)
-	num_color_components = 1;
-    else
-	num_color_components = 3;
-
     shading->decode_array_length = 4 + num_color_components * 2;
     shading->decode_array =
 	_comac_malloc_ab (shading->decode_array_length, sizeof (double));
@@ -143,26 +140,77 @@ static const int pdf_points_order_i[16] = {
 static const int pdf_points_order_j[16] = {
     0, 1, 2, 3, 3, 3, 3, 2, 1, 0, 0, 0, 1, 2, 2, 1};
 
+/* Returns the colors of the corners of all the patches of @mesh in
+ * the colorspace of @surface, converted in a single call. */
+static double *
+_comac_pdf_shading_convert_colors (const comac_mesh_pattern_t *mesh,
+				   comac_surface_t *surface)
+{
+    const comac_mesh_patch_t *patch;
+    unsigned int num_colors, i, j;
+    double *colors, *converted;
+
+    num_colors = 4 * _comac_array_num_elements (&mesh->patches);
+    patch = _comac_array_index_const (&mesh->patches, 0);
+
+    colors = _comac_malloc_ab (num_colors, sizeof (double) * 4);
+    if (unlikely (colors == NULL))
+	return NULL;
+
+    for (i = 0; i < num_colors / 4; i++) {
+	for (j = 0; j < 4; j++) {
+	    const comac_color_t *color = &patch[i].colors[j];
+
+	    assert (color->colorspace == COMAC_COLORSPACE_RGB);
+	    memcpy (&colors[4 * (4 * i + j)],
+		    &color->c.rgb.red,
+		    4 * sizeof (double));
+	}
+    }
+
+    if (surface->colorspace == COMAC_COLORSPACE_RGB)
+	return colors;
+
+    converted = _comac_malloc_abc (
+	num_colors,
+	_comac_colorspace_num_components (surface->colorspace) + 1,
+	sizeof (double));
+    if (likely (converted != NULL)) {
+	_comac_surface_convert_colors (surface,
+				       COMAC_COLORSPACE_RGB,
+				       colors,
+				       surface->colorspace,
+				       converted,
+				       COMAC_COLOR_LAYOUT_DOUBLE,
+				       num_colors);
+    }
+
+    free (colors);
+    return converted;
+}
+
 static comac_status_t
 _comac_pdf_shading_generate_data (comac_pdf_shading_t *shading,
 				  const comac_mesh_pattern_t *mesh,
-				  comac_bool_t is_alpha)
+				  comac_surface_t *surface,
+				  unsigned int num_color_components)
 {
     const comac_mesh_patch_t *patch;
     double x_off, y_off, x_scale, y_scale;
     unsigned int num_patches;
-    unsigned int num_color_components;
+    double *colors = NULL;
     unsigned char *p;
     unsigned int i, j;
 
-    if (is_alpha)
-	num_color_components = 1;
-    else
-	num_color_components = 3;
-
     num_patches = _comac_array_num_elements (&mesh->patches);
     patch = _comac_array_index_const (&mesh->patches, 0);
 
+    if (surface != NULL) {
+	colors = _comac_pdf_shading_convert_colors (mesh, surface);
+	if (unlikely (colors == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
     /* Each patch requires:
      *
      * 1 flag - 1 byte
@@ -174,8 +222,10 @@ _comac_pdf_shading_generate_data (comac_pdf_shading_t *shading,
     shading->data_length =
 	num_patches * (1 + 16 * 2 * 4 + 4 * 2 * num_color_components);
     shading->data = _comac_malloc (shading->data_length);
-    if (unlikely (shading->data == NULL))
+    if (unlikely (shading->data == NULL)) {
+	free (colors);
 	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
 
     x_off = shading->decode_array[0];
     y_off = shading->decode_array[2];
@@ -212,14 +262,19 @@ _comac_pdf_shading_generate_data (comac_pdf_shading_t *shading,
 
 	/* 4 colors */
 	for (j = 0; j < 4; j++) {
-	    if (is_alpha)
+	    if (colors == NULL) {
 		p = encode_alpha (p, &patch[i].colors[j]);
-	    else
-		p = encode_color (p, &patch[i].colors[j]);
+	    } else {
+		p = encode_color (
+		    p,
+		    &colors[(4 * i + j) * (num_color_components + 1)],
+		    num_color_components);
+	    }
 	}
     }
 
     assert (p == shading->data + shading->data_length);
+    free (colors);
 
     return COMAC_STATUS_SUCCESS;
 }
@@ -227,8 +282,9 @@ _comac_pdf_shading_generate_data (comac_pdf_shading_t *shading,
 static comac_status_t
 _comac_pdf_shading_init (comac_pdf_shading_t *shading,
 			 const comac_mesh_pattern_t *mesh,
-			 comac_bool_t is_alpha)
+			 comac_surface_t *surface)
 {
+    unsigned int num_color_components;
     comac_status_t status;
 
     assert (mesh->base.status == COMAC_STATUS_SUCCESS);
@@ -251,25 +307,38 @@ _comac_pdf_shading_init (comac_pdf_shading_t *shading,
     shading->decode_array = NULL;
     shading->data = NULL;
 
-    status = _comac_pdf_shading_generate_decode_array (shading, mesh, is_alpha);
+    /* Without a surface the shading is of the alpha of the mesh */
+    if (surface != NULL)
+	num_color_components =
+	    _comac_colorspace_num_components (surface->colorspace);
+    else
+	num_color_components = 1;
+
+    status = _comac_pdf_shading_generate_decode_array (shading,
+						       mesh,
+						       num_color_components);
     if (unlikely (status))
 	return status;
 
-    return _comac_pdf_shading_generate_data (shading, mesh, is_alpha);
+    return _comac_pdf_shading_generate_data (shading,
+					     mesh,
+					     surface,
+					     num_color_components);
 }
 
 comac_status_t
 _comac_pdf_shading_init_color (comac_pdf_shading_t *shading,
-			       const comac_mesh_pattern_t *pattern)
+			       const comac_mesh_pattern_t *pattern,
+			       comac_surface_t *surface)
 {
-    return _comac_pdf_shading_init (shading, pattern, FALSE);
+    return _comac_pdf_shading_init (shading, pattern, surface);
 }
 
 comac_status_t
 _comac_pdf_shading_init_alpha (comac_pdf_shading_t *shading,
 			       const comac_mesh_pattern_t *pattern)
 {
-    return _comac_pdf_shading_init (shading, pattern, TRUE);
+    return _comac_pdf_shading_init (shading, pattern, NULL);
 }
 
 void
@@ -47,6 +47,7 @@
 #include "comac-surface-private.h"
 #include "comac-surface-clipper-private.h"
 #include "comac-pdf-operators-private.h"
+#include "comac-pdf-update-private.h"
 #include "comac-path-fixed-private.h"
 #include "comac-tag-attributes-private.h"
 #include "comac-tag-stack-private.h"
@@ -56,6 +57,10 @@ typedef struct _comac_pdf_resource {
 } comac_pdf_resource_t;
 
 #define COMAC_NUM_OPERATORS (COMAC_OPERATOR_HSL_LUMINOSITY + 1)
+#define COMAC_PDF_STREAM_TYPE_LAST (COMAC_PDF_STREAM_TYPE_FONT + 1)
+
+/* 128-bit content hash, stencil_mask and smask flags and smask resource */
+#define COMAC_PDF_CONTENT_ID_LENGTH (16 + 2 + 4)
 
 typedef struct _comac_pdf_group_resources {
     comac_bool_t operators[COMAC_NUM_OPERATORS];
@@ -67,6 +72,18 @@ typedef struct _comac_pdf_group_resources {
     comac_array_t fonts;
 } comac_pdf_group_resources_t;
 
+/* The part of the PDF graphics state set by the surface that is known
+ * to the surface. Anything not known is emitted before use. */
+typedef struct _comac_pdf_gstate {
+    comac_operator_t operator;
+    comac_bool_t has_fill_color;
+    comac_bool_t has_stroke_color;
+    comac_bool_t has_alpha;
+    struct _comac_rgb_color fill_color;
+    struct _comac_rgb_color stroke_color;
+    double alpha;
+} comac_pdf_gstate_t;
+
 typedef struct _comac_pdf_source_surface_entry {
     comac_hash_entry_t base;
     unsigned int id;
@@ -257,6 +274,23 @@ typedef struct _comac_pdf_interchange {
 
 } comac_pdf_interchange_t;
 
+typedef struct _comac_pdf_buffer_object {
+    comac_pdf_resource_t resource;
+    long long offset;
+} comac_pdf_buffer_object_t;
+
+/* The output of a page surface, held by the document until the pages
+ * are appended. Offsets are relative to the start of the buffer. */
+typedef struct _comac_pdf_page_buffer {
+    comac_list_t link;
+    struct _comac_pdf_surface *surface; /* until the page surface finishes */
+    comac_output_stream_t *output;
+    comac_array_t objects; /* comac_pdf_buffer_object_t in id order */
+    comac_array_t pages;
+    comac_array_t page_heights;
+    comac_array_t page_labels;
+} comac_pdf_page_buffer_t;
+
 /* pdf surface data */
 
 typedef struct _comac_pdf_surface comac_pdf_surface_t;
@@ -277,8 +311,7 @@ struct _comac_pdf_surface {
 
     comac_array_t objects;
     comac_array_t pages;
-    comac_array_t rgb_linear_functions;
-    comac_array_t alpha_linear_functions;
+    comac_hash_table_t *gradient_objects;
     comac_array_t page_patterns;
     comac_array_t page_surfaces;
     comac_array_t doc_surfaces;
@@ -297,6 +330,25 @@ struct _comac_pdf_surface {
 
     comac_pdf_version_t pdf_version;
     comac_bool_t compress_streams;
+    int compression_threads;
+    struct {
+	int level;
+	int strategy;
+    } stream_compression[COMAC_PDF_STREAM_TYPE_LAST];
+    comac_bool_t deduplicate_images;
+    comac_bool_t image_predictor;
+    comac_bool_t streaming;
+    comac_bool_t linearize;
+    comac_bool_t font_subset_cache;
+    size_t memory_stream_limit;
+
+    /* The real output while the file is written to memory to be
+     * linearized when finished. */
+    comac_output_stream_t *linearized_output;
+
+    /* Set for surfaces created with comac_pdf_surface_create_for_update().
+     * Objects of the existing file are numbered below update->size. */
+    comac_pdf_update_t *update;
 
     comac_pdf_resource_t content;
     comac_pdf_resource_t content_resources;
@@ -308,9 +360,11 @@ struct _comac_pdf_surface {
 	comac_bool_t active;
 	comac_pdf_resource_t self;
 	comac_pdf_resource_t length;
-	long long start_offset;
 	comac_bool_t compressed;
 	comac_output_stream_t *old_output;
+	comac_output_stream_t *dict;
+	comac_output_stream_t *buffer;
+	comac_output_stream_t *data;
     } pdf_stream;
 
     struct {
@@ -328,6 +382,7 @@ struct _comac_pdf_surface {
 	comac_output_stream_t *stream;
 	comac_pdf_resource_t resource;
 	comac_array_t objects;
+	comac_array_t pending_lengths;
     } object_stream;
 
     comac_surface_clipper_t clipper;
@@ -338,13 +393,10 @@ struct _comac_pdf_surface {
 
     comac_bool_t force_fallbacks;
 
-    comac_operator_t current_operator;
-    comac_bool_t current_pattern_is_solid_color;
-    comac_bool_t current_color_is_stroke;
-    double current_color_red;
-    double current_color_green;
-    double current_color_blue;
-    double current_color_alpha;
+    /* Graphics state of the content stream, and the state to return
+     * to when the 'q' emitted by select_pattern is restored. */
+    comac_pdf_gstate_t gstate;
+    comac_pdf_gstate_t pattern_gstate;
 
     comac_pdf_interchange_t interchange;
     int page_parent_tree; /* -1 if not used */
@@ -363,6 +415,16 @@ struct _comac_pdf_surface {
     comac_image_surface_t *thumbnail_image;
 
     comac_surface_t *paginated_surface;
+
+    /* Protects the object numbers, fonts and images shared with page
+     * surfaces. */
+    comac_recursive_mutex_t mutex;
+    comac_list_t page_buffers;
+
+    /* Set for surfaces created with comac_pdf_surface_create_page(). */
+    comac_pdf_surface_t *document;
+    comac_surface_t *document_surface; /* the reference held on @document */
+    comac_pdf_page_buffer_t *page_buffer;
 };
 
 comac_private comac_pdf_resource_t
@@ -372,6 +434,18 @@ comac_private void
 _comac_pdf_surface_update_object (comac_pdf_surface_t *surface,
 				  comac_pdf_resource_t resource);
 
+/* Marks an object that was reserved but is not going to be written as
+ * free in the cross-reference table. */
+comac_private void
+_comac_pdf_surface_free_object (comac_pdf_surface_t *surface,
+				comac_pdf_resource_t resource);
+
+/* Sets the size beyond which the memory streams of groups and page
+ * surfaces are moved to a temporary file, for the test suite. */
+comac_private void
+_comac_pdf_surface_set_memory_stream_limit (comac_surface_t *surface,
+					    size_t limit);
+
 comac_private comac_int_status_t
 _comac_utf8_to_pdf_string (const char *utf8, char **str_out);
 
@@ -46,6 +46,9 @@
 #include "comac-pdf-surface-private.h"
 #include "comac-pdf-operators-private.h"
 #include "comac-pdf-shading-private.h"
+#include "comac-pdf-image-private.h"
+#include "comac-pdf-linearize-private.h"
+#include "comac-pdf-font-cache-private.h"
 
 #include "comac-array-private.h"
 #include "comac-analysis-surface-private.h"
@@ -54,6 +57,7 @@
 #include "comac-error-private.h"
 #include "comac-image-surface-inline.h"
 #include "comac-image-info-private.h"
+#include "comac-list-inline.h"
 #include "comac-recording-surface-private.h"
 #include "comac-output-stream-private.h"
 #include "comac-paginated-private.h"
@@ -65,6 +69,10 @@
 
 #include <zlib.h>
 
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 /*
  * Page Structure of the Generated PDF:
  *
@@ -100,6 +108,10 @@
  *     _comac_pdf_surface_close_content_stream ()
  *
  *   The Content Stream contains the text and graphics operators.
+ *   surface->pdf_operators holds back text objects, fills and 'q'
+ *   operators so that they can be merged or dropped. Call
+ *   _comac_pdf_operators_flush() before writing anything else to
+ *   the stream.
  *
  * Group Stream:
  *   A Group Stream may be opened and closed with the following functions:
@@ -133,7 +145,7 @@
  * PDF files and is a multi-page vector surface backend.
  *
  * The following mime types are supported: %COMAC_MIME_TYPE_JPEG,
- * %COMAC_MIME_TYPE_JP2, %COMAC_MIME_TYPE_UNIQUE_ID,
+ * %COMAC_MIME_TYPE_JP2, %COMAC_MIME_TYPE_PNG, %COMAC_MIME_TYPE_UNIQUE_ID,
  * %COMAC_MIME_TYPE_JBIG2, %COMAC_MIME_TYPE_JBIG2_GLOBAL,
  * %COMAC_MIME_TYPE_JBIG2_GLOBAL_ID,
  * %COMAC_MIME_TYPE_CCITT_FAX, %COMAC_MIME_TYPE_CCITT_FAX_PARAMS.
@@ -234,6 +246,7 @@ typedef struct {
 static const char *_comac_pdf_supported_mime_types[] = {
     COMAC_MIME_TYPE_JPEG,
     COMAC_MIME_TYPE_JP2,
+    COMAC_MIME_TYPE_PNG,
     COMAC_MIME_TYPE_UNIQUE_ID,
     COMAC_MIME_TYPE_JBIG2,
     COMAC_MIME_TYPE_JBIG2_GLOBAL,
@@ -265,23 +278,49 @@ typedef struct _comac_xref_stream_object {
     long long offset;
 } comac_xref_stream_object_t;
 
+typedef struct _comac_pdf_stream_length {
+    comac_pdf_resource_t resource;
+    long long length;
+} comac_pdf_stream_length_t;
+
+/* Streams shorter than this are buffered so that their /Length can be
+ * written directly in the stream dictionary. Longer ones are written
+ * as they are produced and refer to a separate length object. */
+#define PDF_STREAM_BUFFER_SIZE (64 * 1024)
+
+/* Groups and the output of page surfaces are built in memory streams
+ * before being copied to the file. Beyond this size they are moved to
+ * a temporary file. */
+#define PDF_MEMORY_STREAM_LIMIT (16 * 1024 * 1024)
+
+typedef struct _comac_pdf_stream_buffer {
+    comac_output_stream_t base;
+    comac_pdf_surface_t *surface;
+} comac_pdf_stream_buffer_t;
+
 typedef struct _comac_pdf_font {
     unsigned int font_id;
     unsigned int subset_id;
     comac_pdf_resource_t subset_resource;
 } comac_pdf_font_t;
 
-typedef struct _comac_pdf_rgb_linear_function {
+typedef enum _comac_pdf_gradient_object_type {
+    PDF_GRADIENT_COLOR_LINEAR_FUNCTION,
+    PDF_GRADIENT_ALPHA_LINEAR_FUNCTION,
+    PDF_GRADIENT_STITCHED_FUNCTION,
+    PDF_GRADIENT_REPEATING_FUNCTION,
+    PDF_GRADIENT_SHADING
+} comac_pdf_gradient_object_type_t;
+
+/* A function or shading object written for a gradient. The key holds
+ * the type and every value that goes into the object, so that
+ * identical objects are written only once. */
+typedef struct _comac_pdf_gradient_object {
+    comac_hash_entry_t base;
     comac_pdf_resource_t resource;
-    double color1[3];
-    double color2[3];
-} comac_pdf_rgb_linear_function_t;
-
-typedef struct _comac_pdf_alpha_linear_function {
-    comac_pdf_resource_t resource;
-    double alpha1;
-    double alpha2;
-} comac_pdf_alpha_linear_function_t;
+    unsigned int key_length;
+    double *key;
+} comac_pdf_gradient_object_t;
 
 static void
 _comac_pdf_surface_clear (comac_pdf_surface_t *surface);
@@ -289,6 +328,15 @@ _comac_pdf_surface_clear (comac_pdf_surface_t *surface);
 static void
 _comac_pdf_smask_group_destroy (comac_pdf_smask_group_t *group);
 
+static void
+_comac_pdf_source_surface_entry_pluck (void *entry, void *closure);
+
+static comac_bool_t
+_comac_pdf_gradient_object_equal (const void *key_a, const void *key_b);
+
+static void
+_comac_pdf_gradient_object_pluck (void *entry, void *closure);
+
 static comac_int_status_t
 _comac_pdf_surface_add_font (unsigned int font_id,
 			     unsigned int subset_id,
@@ -301,8 +349,9 @@ static comac_int_status_t
 _comac_pdf_surface_open_stream (comac_pdf_surface_t *surface,
 				comac_pdf_resource_t *resource,
 				comac_bool_t compressed,
+				comac_pdf_stream_type_t type,
 				const char *fmt,
-				...) COMAC_PRINTF_FORMAT (4, 5);
+				...) COMAC_PRINTF_FORMAT (5, 6);
 static comac_int_status_t
 _comac_pdf_surface_close_stream (comac_pdf_surface_t *surface);
 
@@ -339,6 +388,9 @@ _comac_pdf_surface_write_patterns_and_smask_groups (
 static comac_int_status_t
 _comac_pdf_surface_emit_font_subsets (comac_pdf_surface_t *surface);
 
+static void
+_comac_pdf_surface_emit_header (comac_pdf_surface_t *surface);
+
 static comac_bool_t
 _comac_pdf_source_surface_equal (const void *key_a, const void *key_b);
 
@@ -346,39 +398,183 @@ static const comac_surface_backend_t comac_pdf_surface_backend;
 static const comac_paginated_surface_backend_t
     comac_pdf_surface_paginated_backend;
 
+/* Takes the next object number of the document. Page surfaces draw
+ * from their document so that the numbers are unique across all
+ * pages. */
+static comac_pdf_resource_t
+_comac_pdf_surface_reserve_object (comac_pdf_surface_t *surface)
+{
+    comac_pdf_resource_t resource;
+
+    if (surface->document)
+	surface = surface->document;
+
+    COMAC_MUTEX_LOCK (surface->mutex);
+    resource = surface->next_available_resource;
+    surface->next_available_resource.id++;
+    COMAC_MUTEX_UNLOCK (surface->mutex);
+
+    return resource;
+}
+
+/* Extends the xref table up to @id. Objects reserved by page surfaces
+ * are not entered until their page is appended, so the gaps are
+ * filled with free entries. */
+static comac_int_status_t
+_comac_pdf_surface_grow_objects (comac_pdf_surface_t *surface,
+				 unsigned int id)
+{
+    comac_pdf_object_t *objects;
+    unsigned int num_objects, i;
+    comac_int_status_t status;
+
+    num_objects = _comac_array_num_elements (&surface->objects);
+    if (num_objects >= id)
+	return COMAC_STATUS_SUCCESS;
+
+    status = _comac_array_allocate (&surface->objects,
+				    id - num_objects,
+				    (void **) &objects);
+    if (unlikely (status))
+	return status;
+
+    for (i = 0; i < id - num_objects; i++) {
+	objects[i].type = PDF_OBJECT_FREE;
+	objects[i].u.offset = 0;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static comac_int_status_t
+_comac_pdf_surface_sync_objects (comac_pdf_surface_t *surface)
+{
+    unsigned int id;
+
+    COMAC_MUTEX_LOCK (surface->mutex);
+    id = surface->next_available_resource.id - 1;
+    COMAC_MUTEX_UNLOCK (surface->mutex);
+
+    return _comac_pdf_surface_grow_objects (surface, id);
+}
+
 comac_pdf_resource_t
 _comac_pdf_surface_new_object (comac_pdf_surface_t *surface)
 {
     comac_pdf_resource_t resource;
     comac_int_status_t status;
-    comac_pdf_object_t object;
+    comac_pdf_object_t *object;
+    comac_pdf_buffer_object_t buffer_object;
 
-    /* Default to Uncompressed. If this object is used with
-     * _comac_pdf_surface_object_begin() and Object Streams are
-     * enabled it will be changed to Compressed. */
-    object.type = PDF_OBJECT_UNCOMPRESSED;
-    object.u.offset = _comac_output_stream_get_position (surface->output);
+    resource = _comac_pdf_surface_reserve_object (surface);
+
+    if (surface->page_buffer) {
+	buffer_object.resource = resource;
+	buffer_object.offset =
+	    _comac_output_stream_get_position (surface->output);
+	status = _comac_array_append (&surface->page_buffer->objects,
+				      &buffer_object);
+	if (unlikely (status))
+	    resource.id = 0;
 
-    status = _comac_array_append (&surface->objects, &object);
+	return resource;
+    }
+
+    status = _comac_pdf_surface_grow_objects (surface, resource.id);
     if (unlikely (status)) {
 	resource.id = 0;
 	return resource;
     }
 
-    resource = surface->next_available_resource;
-    surface->next_available_resource.id++;
+    /* Default to Uncompressed. If this object is used with
+     * _comac_pdf_surface_object_begin() and Object Streams are
+     * enabled it will be changed to Compressed. */
+    object = _comac_array_index (&surface->objects, resource.id - 1);
+    object->type = PDF_OBJECT_UNCOMPRESSED;
+    object->u.offset = _comac_output_stream_get_position (surface->output);
 
     return resource;
 }
 
+static void
+_comac_pdf_surface_set_object_offset (comac_pdf_surface_t *surface,
+				      comac_pdf_resource_t resource,
+				      long long offset)
+{
+    comac_pdf_object_t *object;
+    comac_pdf_buffer_object_t *buffer_object;
+    int lo, hi, mid;
+
+    if (surface->page_buffer) {
+	lo = 0;
+	hi = _comac_array_num_elements (&surface->page_buffer->objects) - 1;
+	while (lo <= hi) {
+	    mid = (lo + hi) / 2;
+	    buffer_object =
+		_comac_array_index (&surface->page_buffer->objects, mid);
+	    if (buffer_object->resource.id == resource.id) {
+		buffer_object->offset = offset;
+		return;
+	    }
+
+	    if (buffer_object->resource.id < resource.id)
+		lo = mid + 1;
+	    else
+		hi = mid - 1;
+	}
+	ASSERT_NOT_REACHED;
+	return;
+    }
+
+    object = _comac_array_index (&surface->objects, resource.id - 1);
+    object->type = PDF_OBJECT_UNCOMPRESSED;
+    object->u.offset = offset;
+}
+
 void
 _comac_pdf_surface_update_object (comac_pdf_surface_t *surface,
 				  comac_pdf_resource_t resource)
+{
+    _comac_pdf_surface_set_object_offset (
+	surface,
+	resource,
+	_comac_output_stream_get_position (surface->output));
+}
+
+void
+_comac_pdf_surface_free_object (comac_pdf_surface_t *surface,
+				comac_pdf_resource_t resource)
 {
     comac_pdf_object_t *object;
 
+    if (resource.id > _comac_array_num_elements (&surface->objects))
+	return;
+
     object = _comac_array_index (&surface->objects, resource.id - 1);
-    object->u.offset = _comac_output_stream_get_position (surface->output);
+    object->type = PDF_OBJECT_FREE;
+}
+
+static void
+_comac_pdf_page_buffer_destroy (comac_pdf_page_buffer_t *buffer)
+{
+    comac_status_t status_ignored;
+    char *label;
+    int size, i;
+
+    if (buffer->output)
+	status_ignored = _comac_output_stream_destroy (buffer->output);
+
+    size = _comac_array_num_elements (&buffer->page_labels);
+    for (i = 0; i < size; i++) {
+	_comac_array_copy_element (&buffer->page_labels, i, &label);
+	free (label);
+    }
+    _comac_array_fini (&buffer->page_labels);
+    _comac_array_fini (&buffer->page_heights);
+    _comac_array_fini (&buffer->pages);
+    _comac_array_fini (&buffer->objects);
+    comac_list_del (&buffer->link);
+    free (buffer);
 }
 
 static void
@@ -394,6 +590,17 @@ _comac_pdf_surface_set_size_internal (comac_pdf_surface_t *surface,
     surface->surface_extents.height = ceil (surface->height);
 }
 
+/* Forget the graphics state. Used after the state has been reset to the
+ * state at the start of the content stream. */
+static void
+_comac_pdf_surface_reset_gstate (comac_pdf_surface_t *surface)
+{
+    surface->gstate.operator = COMAC_OPERATOR_OVER;
+    surface->gstate.has_fill_color = FALSE;
+    surface->gstate.has_stroke_color = FALSE;
+    surface->gstate.has_alpha = FALSE;
+}
+
 static comac_bool_t
 _path_covers_bbox (comac_pdf_surface_t *surface, comac_path_fixed_t *path)
 {
@@ -417,18 +624,14 @@ _comac_pdf_surface_clipper_intersect_clip_path (
 	comac_container_of (clipper, comac_pdf_surface_t, clipper);
     comac_int_status_t status;
 
-    status = _comac_pdf_operators_flush (&surface->pdf_operators);
-    if (unlikely (status))
-	return status;
-
     if (path == NULL) {
-	_comac_output_stream_printf (surface->output, "Q q\n");
+	status = _comac_pdf_operators_restore (&surface->pdf_operators);
+	if (unlikely (status))
+	    return status;
 
-	surface->current_pattern_is_solid_color = FALSE;
-	surface->current_operator = COMAC_OPERATOR_OVER;
-	_comac_pdf_operators_reset (&surface->pdf_operators);
+	_comac_pdf_surface_reset_gstate (surface);
 
-	return COMAC_STATUS_SUCCESS;
+	return _comac_pdf_operators_save (&surface->pdf_operators);
     }
 
     if (_path_covers_bbox (surface, path))
@@ -440,6 +643,8 @@ _comac_pdf_surface_clipper_intersect_clip_path (
 static comac_surface_t *
 _comac_pdf_surface_create_for_stream_internal (
     comac_output_stream_t *output,
+    comac_pdf_surface_t *document,
+    comac_pdf_update_t *update,
     comac_colorspace_t colorspace,
     comac_rendering_intent_t intent,
     comac_color_convert_cb color_convert,
@@ -449,11 +654,16 @@ _comac_pdf_surface_create_for_stream_internal (
 {
     comac_pdf_surface_t *surface;
     comac_status_t status, status_ignored;
+    int i;
 
     surface = _comac_malloc (sizeof (comac_pdf_surface_t));
     if (unlikely (surface == NULL)) {
-	/* destroy stream on behalf of caller */
+	/* destroy stream and update on behalf of caller */
 	status = _comac_output_stream_destroy (output);
+	if (update) {
+	    _comac_pdf_update_fini (update);
+	    free (update);
+	}
 	return _comac_surface_create_in_error (
 	    _comac_error (COMAC_STATUS_NO_MEMORY));
     }
@@ -481,10 +691,6 @@ _comac_pdf_surface_create_for_stream_internal (
 
     _comac_array_init (&surface->objects, sizeof (comac_pdf_object_t));
     _comac_array_init (&surface->pages, sizeof (comac_pdf_resource_t));
-    _comac_array_init (&surface->rgb_linear_functions,
-		       sizeof (comac_pdf_rgb_linear_function_t));
-    _comac_array_init (&surface->alpha_linear_functions,
-		       sizeof (comac_pdf_alpha_linear_function_t));
     _comac_array_init (&surface->fonts, sizeof (comac_pdf_font_t));
     _comac_array_init (&surface->smask_groups,
 		       sizeof (comac_pdf_smask_group_t *));
@@ -498,6 +704,31 @@ _comac_pdf_surface_create_for_stream_internal (
     _comac_array_init (&surface->jbig2_global,
 		       sizeof (comac_pdf_jbig2_global_t));
     _comac_array_init (&surface->page_heights, sizeof (double));
+    comac_list_init (&surface->page_buffers);
+    COMAC_RECURSIVE_MUTEX_INIT (surface->mutex);
+    surface->document = document;
+    surface->document_surface = NULL;
+    surface->update = update;
+    surface->page_buffer = NULL;
+    if (document) {
+	surface->page_buffer = _comac_malloc (sizeof (comac_pdf_page_buffer_t));
+	if (unlikely (surface->page_buffer == NULL)) {
+	    status = _comac_error (COMAC_STATUS_NO_MEMORY);
+	    goto BAIL0;
+	}
+
+	comac_list_init (&surface->page_buffer->link);
+	surface->page_buffer->surface = surface;
+	surface->page_buffer->output = NULL;
+	_comac_array_init (&surface->page_buffer->objects,
+			   sizeof (comac_pdf_buffer_object_t));
+	_comac_array_init (&surface->page_buffer->pages,
+			   sizeof (comac_pdf_resource_t));
+	_comac_array_init (&surface->page_buffer->page_heights,
+			   sizeof (double));
+	_comac_array_init (&surface->page_buffer->page_labels, sizeof (char *));
+    }
+
     surface->all_surfaces =
 	_comac_hash_table_create (_comac_pdf_source_surface_equal);
     if (unlikely (surface->all_surfaces == NULL)) {
@@ -505,32 +736,73 @@ _comac_pdf_surface_create_for_stream_internal (
 	goto BAIL0;
     }
 
-    _comac_pdf_group_resources_init (&surface->resources);
-
-    surface->font_subsets = _comac_scaled_font_subsets_create_composite ();
-    if (! surface->font_subsets) {
+    surface->gradient_objects =
+	_comac_hash_table_create (_comac_pdf_gradient_object_equal);
+    if (unlikely (surface->gradient_objects == NULL)) {
 	status = _comac_error (COMAC_STATUS_NO_MEMORY);
 	goto BAIL1;
     }
 
-    _comac_scaled_font_subsets_enable_latin_subset (surface->font_subsets,
-						    TRUE);
+    _comac_pdf_group_resources_init (&surface->resources);
 
     surface->next_available_resource.id = 1;
-    surface->pages_resource = _comac_pdf_surface_new_object (surface);
-    if (surface->pages_resource.id == 0) {
-	status = _comac_error (COMAC_STATUS_NO_MEMORY);
-	goto BAIL2;
+    if (document) {
+	/* Glyphs are mapped into the document's subsets and pages
+	 * are added to its page tree. */
+	surface->font_subsets = document->font_subsets;
+	surface->pages_resource = document->pages_resource;
+	surface->header_emitted = TRUE;
+    } else {
+	surface->font_subsets = _comac_scaled_font_subsets_create_composite ();
+	if (! surface->font_subsets) {
+	    status = _comac_error (COMAC_STATUS_NO_MEMORY);
+	    goto BAIL2;
+	}
+
+	_comac_scaled_font_subsets_enable_latin_subset (surface->font_subsets,
+							TRUE);
+
+	if (update) {
+	    /* New objects follow those of the file, whose page tree
+	     * is written again with the new pages added. */
+	    surface->next_available_resource.id = update->size;
+	    surface->pages_resource.id = update->pages;
+	    surface->header_emitted = TRUE;
+	} else {
+	    surface->pages_resource = _comac_pdf_surface_new_object (surface);
+	    if (surface->pages_resource.id == 0) {
+		status = _comac_error (COMAC_STATUS_NO_MEMORY);
+		goto BAIL3;
+	    }
+	    surface->header_emitted = FALSE;
+	}
     }
 
     surface->struct_tree_root.id = 0;
     surface->pdf_version = COMAC_PDF_VERSION_1_7;
+    if (update)
+	surface->pdf_version = update->version;
     if (getenv ("COMAC_DEBUG_PDF") != NULL)
 	surface->compress_streams = FALSE;
     else
 	surface->compress_streams = TRUE;
+    surface->compression_threads = 1;
+    surface->deduplicate_images = FALSE;
+    surface->image_predictor = FALSE;
+    surface->streaming = FALSE;
+    surface->linearize = FALSE;
+    surface->font_subset_cache = FALSE;
+    surface->memory_stream_limit = PDF_MEMORY_STREAM_LIMIT;
+    surface->linearized_output = NULL;
+    for (i = 0; i < COMAC_PDF_STREAM_TYPE_LAST; i++) {
+	surface->stream_compression[i].level = Z_DEFAULT_COMPRESSION;
+	surface->stream_compression[i].strategy = Z_DEFAULT_STRATEGY;
+    }
     surface->pdf_stream.active = FALSE;
     surface->pdf_stream.old_output = NULL;
+    surface->pdf_stream.dict = NULL;
+    surface->pdf_stream.buffer = NULL;
+    surface->pdf_stream.data = NULL;
     surface->group_stream.active = FALSE;
     surface->group_stream.stream = NULL;
     surface->group_stream.mem_stream = NULL;
@@ -538,14 +810,14 @@ _comac_pdf_surface_create_for_stream_internal (
     surface->object_stream.stream = NULL;
     _comac_array_init (&surface->object_stream.objects,
 		       sizeof (comac_xref_stream_object_t));
+    _comac_array_init (&surface->object_stream.pending_lengths,
+		       sizeof (comac_pdf_stream_length_t));
 
     surface->paginated_mode = COMAC_PAGINATED_MODE_ANALYZE;
 
     surface->force_fallbacks = FALSE;
     surface->select_pattern_gstate_saved = FALSE;
-    surface->current_pattern_is_solid_color = FALSE;
-    surface->current_operator = COMAC_OPERATOR_OVER;
-    surface->header_emitted = FALSE;
+    _comac_pdf_surface_reset_gstate (surface);
 
     _comac_surface_clipper_init (
 	&surface->clipper,
@@ -563,7 +835,7 @@ _comac_pdf_surface_create_for_stream_internal (
 
     status = _comac_pdf_interchange_init (surface);
     if (unlikely (status))
-	goto BAIL2;
+	goto BAIL3;
 
     surface->page_parent_tree = -1;
     _comac_array_init (&surface->page_annots, sizeof (comac_pdf_resource_t));
@@ -592,16 +864,26 @@ _comac_pdf_surface_create_for_stream_internal (
 	return surface->paginated_surface;
     }
 
+BAIL3:
+    if (! document)
+	_comac_scaled_font_subsets_destroy (surface->font_subsets);
 BAIL2:
-    _comac_scaled_font_subsets_destroy (surface->font_subsets);
+    _comac_hash_table_destroy (surface->gradient_objects);
 BAIL1:
     _comac_hash_table_destroy (surface->all_surfaces);
 BAIL0:
+    if (surface->page_buffer)
+	_comac_pdf_page_buffer_destroy (surface->page_buffer);
     _comac_array_fini (&surface->objects);
+    COMAC_MUTEX_FINI (surface->mutex);
     free (surface);
 
-    /* destroy stream on behalf of caller */
+    /* destroy stream and update on behalf of caller */
     status_ignored = _comac_output_stream_destroy (output);
+    if (update) {
+	_comac_pdf_update_fini (update);
+	free (update);
+    }
 
     return _comac_surface_create_in_error (status);
 }
@@ -664,6 +946,8 @@ comac_pdf_surface_create_for_stream2 (comac_write_func_t write_func,
 	    _comac_output_stream_destroy (output));
 
     return _comac_pdf_surface_create_for_stream_internal (output,
+							  NULL,
+							  NULL,
 							  colorspace,
 							  intent,
 							  color_convert,
@@ -726,6 +1010,8 @@ comac_pdf_surface_create2 (const char *filename,
 	    _comac_output_stream_destroy (output));
 
     return _comac_pdf_surface_create_for_stream_internal (output,
+							  NULL,
+							  NULL,
 							  colorspace,
 							  intent,
 							  color_convert,
@@ -734,6 +1020,85 @@ comac_pdf_surface_create2 (const char *filename,
 							  height_in_points);
 }
 
+/**
+ * comac_pdf_surface_create_for_update:
+ * @filename: a PDF file previously written by a PDF surface, which must
+ *            be readable and writable
+ * @width_in_points: width of the surface, in points (1 point == 1/72.0 inch)
+ * @height_in_points: height of the surface, in points (1 point == 1/72.0 inch)
+ *
+ * Creates a PDF surface of the specified size in points that adds its
+ * pages after those of the existing file @filename. The new pages are
+ * appended to the file as an incremental update: their objects, a new
+ * version of the page tree and a cross-reference section for these
+ * objects only. Object numbers continue from those of the file, and
+ * the rest of the file is neither read nor written again, so the time
+ * taken depends on the new pages only.
+ *
+ * The document catalog and information dictionary of the file are
+ * kept, together with its outlines, page labels, named destinations
+ * and structure tree. The corresponding data of the new pages, set
+ * with comac_pdf_surface_add_outline(), comac_pdf_surface_set_metadata(),
+ * comac_pdf_surface_set_page_label() or tags, is not written. The
+ * surface uses the PDF version of the file.
+ *
+ * The page tree of the file must be a single /Pages object with every
+ * page in its /Kids, as written by the PDF surface, and the file must
+ * not be encrypted. Otherwise a "nil" surface with the status
+ * %COMAC_STATUS_READ_ERROR is returned and the file is left unchanged.
+ * Files which have already been updated, or were linearized, are
+ * supported.
+ *
+ * Return value: a pointer to the newly created surface. The caller
+ * owns the surface and should call comac_surface_destroy() when done
+ * with it.
+ *
+ * This function always returns a valid pointer, but it will return a
+ * pointer to a "nil" surface if an error such as out of memory
+ * occurs. You can use comac_surface_status() to check for this.
+ *
+ * Since: TBD
+ **/
+comac_surface_t *
+comac_pdf_surface_create_for_update (const char *filename,
+				     double width_in_points,
+				     double height_in_points)
+{
+    comac_pdf_update_t *update;
+    comac_output_stream_t *output;
+    comac_status_t status;
+
+    update = _comac_malloc (sizeof (comac_pdf_update_t));
+    if (unlikely (update == NULL))
+	return _comac_surface_create_in_error (
+	    _comac_error (COMAC_STATUS_NO_MEMORY));
+
+    status = _comac_pdf_update_init (update, filename);
+    if (unlikely (status)) {
+	free (update);
+	return _comac_surface_create_in_error (status);
+    }
+
+    output = _comac_output_stream_create_for_append (filename);
+    if (_comac_output_stream_get_status (output)) {
+	_comac_pdf_update_fini (update);
+	free (update);
+	return _comac_surface_create_in_error (
+	    _comac_output_stream_destroy (output));
+    }
+
+    return _comac_pdf_surface_create_for_stream_internal (
+	output,
+	NULL,
+	update,
+	COMAC_COLORSPACE_RGB,
+	COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
+	comac_default_color_convert_func,
+	NULL,
+	width_in_points,
+	height_in_points);
+}
+
 static comac_bool_t
 _comac_surface_is_pdf (comac_surface_t *surface)
 {
@@ -821,6 +1186,542 @@ comac_pdf_surface_restrict_to_version (comac_surface_t *abstract_surface,
 					     version >= COMAC_PDF_VERSION_1_5);
 }
 
+/**
+ * comac_pdf_surface_set_compression:
+ * @surface: a PDF #comac_surface_t
+ * @compression: the compression trade-off to use
+ *
+ * Selects between faster and smaller output for all streams in the
+ * document. This overrides any levels previously set with
+ * comac_pdf_surface_set_stream_compression(). The default is
+ * %COMAC_PDF_COMPRESSION_DEFAULT.
+ *
+ * This function should only be called before any drawing operations
+ * have been performed on the given surface. The simplest way to do
+ * this is to call this function immediately after creating the
+ * surface.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_compression (comac_surface_t *abstract_surface,
+				   comac_pdf_compression_t compression)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+    int level, i;
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    switch (compression) {
+    case COMAC_PDF_COMPRESSION_FAST:
+	level = Z_BEST_SPEED;
+	break;
+    case COMAC_PDF_COMPRESSION_SMALL:
+	level = Z_BEST_COMPRESSION;
+	break;
+    case COMAC_PDF_COMPRESSION_DEFAULT:
+    default:
+	level = Z_DEFAULT_COMPRESSION;
+	break;
+    }
+
+    for (i = 0; i < COMAC_PDF_STREAM_TYPE_LAST; i++) {
+	surface->stream_compression[i].level = level;
+	surface->stream_compression[i].strategy = Z_DEFAULT_STRATEGY;
+    }
+}
+
+/**
+ * comac_pdf_surface_set_stream_compression:
+ * @surface: a PDF #comac_surface_t
+ * @type: the kind of stream the setting applies to
+ * @level: the compression level, from 0 (fastest, no compression) to
+ * 9 (smallest output), or -1 for the default level
+ * @strategy: the compression strategy
+ *
+ * Sets the compression level and strategy used for streams of
+ * @type. Images that are embedded in their original encoding, such as
+ * JPEG data, are not recompressed and are not affected. Invalid levels
+ * are ignored.
+ *
+ * This function should only be called before any drawing operations
+ * have been performed on the given surface. The simplest way to do
+ * this is to call this function immediately after creating the
+ * surface.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_stream_compression (
+    comac_surface_t *abstract_surface,
+    comac_pdf_stream_type_t type,
+    int level,
+    comac_pdf_compression_strategy_t strategy)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    if ((unsigned) type >= COMAC_PDF_STREAM_TYPE_LAST)
+	return;
+
+    if (level < Z_DEFAULT_COMPRESSION || level > Z_BEST_COMPRESSION)
+	return;
+
+    surface->stream_compression[type].level = level;
+    switch (strategy) {
+    case COMAC_PDF_COMPRESSION_STRATEGY_FILTERED:
+	surface->stream_compression[type].strategy = Z_FILTERED;
+	break;
+    case COMAC_PDF_COMPRESSION_STRATEGY_HUFFMAN_ONLY:
+	surface->stream_compression[type].strategy = Z_HUFFMAN_ONLY;
+	break;
+    case COMAC_PDF_COMPRESSION_STRATEGY_RLE:
+	surface->stream_compression[type].strategy = Z_RLE;
+	break;
+    case COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT:
+    default:
+	surface->stream_compression[type].strategy = Z_DEFAULT_STRATEGY;
+	break;
+    }
+}
+
+/**
+ * comac_pdf_surface_set_deduplicate_images:
+ * @surface: a PDF #comac_surface_t
+ * @deduplicate: %TRUE to write identical images only once
+ *
+ * Enables detection of identical images by their contents. Normally
+ * an image is written once per #comac_surface_t it was drawn from, or
+ * once per %COMAC_MIME_TYPE_UNIQUE_ID. With deduplication enabled, images
+ * without a unique id that have the same format, size and pixel data
+ * share a single image object, even if they come from separate
+ * surfaces. This costs one hash of the pixel data per image surface.
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_deduplicate_images (comac_surface_t *abstract_surface,
+					  comac_bool_t deduplicate)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->deduplicate_images = deduplicate;
+}
+
+/**
+ * comac_pdf_surface_set_image_predictor:
+ * @surface: a PDF #comac_surface_t
+ * @predictor: %TRUE to encode images with PNG predictors
+ *
+ * Enables PNG predictors for images with 8 bits per component. Each
+ * row of the image is filtered with whichever PNG filter suits it
+ * best before it is compressed. Screenshots, charts and other
+ * synthetic images usually compress several times better, and faster,
+ * this way. Photographs and noise gain little, and filtering takes
+ * some time of its own.
+ *
+ * Images embedded from their original data, such as JPEG, are not
+ * affected.
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_image_predictor (comac_surface_t *abstract_surface,
+				       comac_bool_t predictor)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->image_predictor = predictor;
+}
+
+/**
+ * comac_pdf_surface_set_streaming:
+ * @surface: a PDF #comac_surface_t
+ * @streaming: %TRUE to write out and release page resources page by page
+ *
+ * Enables streaming output for very long documents. Normally the
+ * surface keeps unbounded source surfaces, such as recording surfaces
+ * created without extents, alive until it is finished, and remembers
+ * every image, surface and gradient it has written so that later
+ * pages can refer to them again.
+ *
+ * In streaming mode everything used by a page is written out and
+ * released by comac_show_page(). From one page to the next the surface
+ * then retains only the file offset of each object written, a few
+ * words per page for the page tree and the font subsets, which grow
+ * with the number of distinct glyphs used rather than with the number
+ * of pages. Peak memory is bounded by the largest single page: its
+ * recorded drawing operations, the source surfaces and patterns it
+ * uses, and the page's small objects while they are being compressed.
+ * Tagged PDF structure, links and destinations are still kept for the
+ * whole document when they are used.
+ *
+ * The cost is that an image or pattern drawn on several pages is
+ * written once for each page, so the output may be larger.
+ *
+ * This function may be called at any time and takes effect from the
+ * next call to comac_show_page().
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_streaming (comac_surface_t *abstract_surface,
+				 comac_bool_t streaming)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->streaming = streaming;
+}
+
+/**
+ * comac_pdf_surface_set_linearize:
+ * @surface: a PDF #comac_surface_t
+ * @linearize: %TRUE to write a linearized file
+ *
+ * Enables linearized output, also known as "fast web view". The
+ * objects of a linearized file are ordered page by page, with the
+ * first page and everything it uses at the start of the file and
+ * hint tables locating the other pages. A viewer reading the file
+ * over a slow connection can then display the first page before the
+ * rest of the file has arrived.
+ *
+ * The file is written to memory and linearized when the surface is
+ * finished, so the whole file is held in memory until then and
+ * nothing is written to the output before. Object streams are not
+ * used, which makes the file somewhat larger. Streaming mode, see
+ * comac_pdf_surface_set_streaming(), has no effect on memory use
+ * in this case. Surfaces created with
+ * comac_pdf_surface_create_for_update() are never linearized.
+ *
+ * This function must be called before any drawing operations are
+ * performed on the surface.
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_linearize (comac_surface_t *abstract_surface,
+				 comac_bool_t linearize)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->linearize = linearize;
+}
+
+void
+_comac_pdf_surface_set_memory_stream_limit (comac_surface_t *abstract_surface,
+					    size_t limit)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->memory_stream_limit = limit;
+}
+
+/**
+ * comac_pdf_surface_set_write_thread:
+ * @surface: a PDF #comac_surface_t
+ * @write_thread: %TRUE to write the file from a separate thread
+ *
+ * Writes the output file from a separate thread, so that generating
+ * the PDF overlaps with writing it to disk. This only has an effect
+ * on surfaces created with comac_pdf_surface_create() for a file
+ * name, on platforms with thread support.
+ *
+ * This function must be called before any drawing operations are
+ * performed on the surface.
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_write_thread (comac_surface_t *abstract_surface,
+				    comac_bool_t write_thread)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    _comac_output_stream_set_write_thread (surface->output, write_thread);
+}
+
+/**
+ * comac_pdf_surface_set_font_subset_cache:
+ * @surface: a PDF #comac_surface_t
+ * @cache: %TRUE to use the font subset cache
+ *
+ * Makes the surface use a cache of embedded font subsets that is
+ * shared by every PDF surface of the process that enables it. When a
+ * document embeds the same glyphs of the same font face as an earlier
+ * document, which is typical when many similar documents are
+ * generated, the earlier subset is reused instead of parsing and
+ * subsetting the font again.
+ *
+ * The cache holds up to 16 megabytes of subsets and keeps a reference
+ * to the font face of each, until the subset is evicted or
+ * comac_debug_reset_static_data() is called.
+ *
+ * This function may be called at any time before the surface is
+ * finished.
+ *
+ * The default is %FALSE.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_font_subset_cache (comac_surface_t *abstract_surface,
+					 comac_bool_t cache)
+{
+    comac_pdf_surface_t *surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (abstract_surface, &surface))
+	return;
+
+    surface->font_subset_cache = cache;
+}
+
+/**
+ * comac_pdf_surface_create_page:
+ * @document: a PDF #comac_surface_t
+ * @width_in_points: width of the page surface, in points (1 point == 1/72.0 inch)
+ * @height_in_points: height of the page surface, in points (1 point == 1/72.0 inch)
+ *
+ * Creates a page surface for @document. Drawing to a page surface
+ * does not touch @document, so several page surfaces may be drawn
+ * from different threads at the same time, for instance one per page
+ * of a long report. Each page surface may hold any number of pages,
+ * ended with comac_show_page() as usual, which are written to memory.
+ * The pages are added to @document, in the order chosen by the
+ * caller, with comac_pdf_surface_append_page().
+ *
+ * Object numbers, fonts and images are shared with @document: glyphs
+ * are subset into the fonts of the document, and an image drawn on
+ * several pages is written only once, unless @document is in
+ * streaming mode. Every page surface of a document must therefore be
+ * appended before the document is finished; a page surface that is
+ * still being drawn then is set in the %COMAC_STATUS_SURFACE_FINISHED
+ * error state. The PDF version and
+ * compression settings of @document at the time of the call are
+ * used. Tags, links and metadata set on a page surface are ignored;
+ * page labels are kept.
+ *
+ * The page surface keeps a reference to @document until it is
+ * finished.
+ *
+ * Return value: a pointer to the newly created surface. The caller
+ * owns the surface and should call comac_surface_destroy() when done
+ * with it.
+ *
+ * This function always returns a valid pointer, but it will return a
+ * pointer to a "nil" surface if an error such as out of memory
+ * occurs. You can use comac_surface_status() to check for this.
+ *
+ * Since: TBD
+ **/
+comac_surface_t *
+comac_pdf_surface_create_page (comac_surface_t *document,
+			       double width_in_points,
+			       double height_in_points)
+{
+    comac_pdf_surface_t *doc = NULL; /* hide compiler warning */
+    comac_pdf_surface_t *surface;
+    comac_surface_t *page;
+    int i;
+
+    if (! _extract_pdf_surface (document, &doc))
+	return _comac_surface_create_in_error (document->status);
+
+    if (doc->document)
+	return _comac_surface_create_in_error (
+	    _comac_error (COMAC_STATUS_SURFACE_TYPE_MISMATCH));
+
+    page = _comac_pdf_surface_create_for_stream_internal (
+	_comac_memory_stream_create_with_limit (doc->memory_stream_limit),
+	doc,
+	NULL,
+	doc->base.colorspace,
+	doc->base.intent,
+	doc->base.color_convert,
+	doc->base.color_convert_ctx,
+	width_in_points,
+	height_in_points);
+    if (page->status)
+	return page;
+
+    surface =
+	(comac_pdf_surface_t *) _comac_paginated_surface_get_target (page);
+    surface->pdf_version = doc->pdf_version;
+    surface->compress_streams = doc->compress_streams;
+    surface->compression_threads = doc->compression_threads;
+    for (i = 0; i < COMAC_PDF_STREAM_TYPE_LAST; i++)
+	surface->stream_compression[i] = doc->stream_compression[i];
+    surface->deduplicate_images = doc->deduplicate_images;
+    surface->image_predictor = doc->image_predictor;
+    surface->thumbnail_width = doc->thumbnail_width;
+    surface->thumbnail_height = doc->thumbnail_height;
+    surface->memory_stream_limit = doc->memory_stream_limit;
+
+    COMAC_MUTEX_LOCK (doc->mutex);
+    comac_list_add_tail (&surface->page_buffer->link, &doc->page_buffers);
+    COMAC_MUTEX_UNLOCK (doc->mutex);
+
+    surface->document_surface =
+	comac_surface_reference (doc->paginated_surface);
+
+    return page;
+}
+
+/**
+ * comac_pdf_surface_append_page:
+ * @document: a PDF #comac_surface_t
+ * @page: a page surface created for @document with
+ *   comac_pdf_surface_create_page()
+ *
+ * Finishes @page and adds its pages to the end of @document. The pages
+ * are copied into the output of @document as they were written,
+ * without being drawn again. Pages drawn on @document itself are added
+ * when comac_show_page() is called on it, so the two can be mixed.
+ *
+ * This function must not be called while @document or @page is being
+ * drawn to from another thread. @page must not have been finished
+ * already; otherwise, or if @page is in an error state, an error is
+ * set on @document.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_append_page (comac_surface_t *document,
+			       comac_surface_t *page)
+{
+    comac_pdf_surface_t *doc = NULL; /* hide compiler warning */
+    comac_pdf_surface_t *surface;
+    comac_pdf_page_buffer_t *buffer;
+    comac_pdf_buffer_object_t *buffer_object;
+    comac_pdf_object_t *object;
+    comac_surface_t *target;
+    comac_status_t status;
+    long long base;
+    int num_objects, i;
+
+    if (! _extract_pdf_surface (document, &doc))
+	return;
+
+    if (page->status) {
+	status = _comac_surface_set_error (document, page->status);
+	return;
+    }
+
+    if (page->finished) {
+	status = _comac_surface_set_error (
+	    document,
+	    _comac_error (COMAC_STATUS_SURFACE_FINISHED));
+	return;
+    }
+
+    if (! _comac_surface_is_paginated (page)) {
+	status = _comac_surface_set_error (
+	    document,
+	    _comac_error (COMAC_STATUS_SURFACE_TYPE_MISMATCH));
+	return;
+    }
+
+    target = _comac_paginated_surface_get_target (page);
+    if (! _comac_surface_is_pdf (target) ||
+	((comac_pdf_surface_t *) target)->document != doc) {
+	status = _comac_surface_set_error (
+	    document,
+	    _comac_error (COMAC_STATUS_SURFACE_TYPE_MISMATCH));
+	return;
+    }
+    surface = (comac_pdf_surface_t *) target;
+
+    /* Keep the page surface alive past the paginated wrapper, which
+     * drops its reference when finished. */
+    comac_surface_reference (target);
+    comac_surface_finish (page);
+    comac_surface_finish (target);
+    status = target->status ? target->status : page->status;
+    if (unlikely (status))
+	goto BAIL;
+
+    buffer = surface->page_buffer;
+    _comac_pdf_surface_emit_header (doc);
+    status = _comac_pdf_surface_sync_objects (doc);
+    if (unlikely (status))
+	goto BAIL;
+
+    base = _comac_output_stream_get_position (doc->output);
+    _comac_memory_stream_copy (buffer->output, doc->output);
+
+    num_objects = _comac_array_num_elements (&buffer->objects);
+    for (i = 0; i < num_objects; i++) {
+	buffer_object = _comac_array_index (&buffer->objects, i);
+	object = _comac_array_index (&doc->objects,
+				     buffer_object->resource.id - 1);
+	object->type = PDF_OBJECT_UNCOMPRESSED;
+	object->u.offset = base + buffer_object->offset;
+    }
+
+    status = _comac_array_append_multiple (
+	&doc->pages,
+	_comac_array_index (&buffer->pages, 0),
+	_comac_array_num_elements (&buffer->pages));
+    if (likely (status == COMAC_STATUS_SUCCESS))
+	status = _comac_array_append_multiple (
+	    &doc->page_heights,
+	    _comac_array_index (&buffer->page_heights, 0),
+	    _comac_array_num_elements (&buffer->page_heights));
+    if (likely (status == COMAC_STATUS_SUCCESS)) {
+	status = _comac_array_append_multiple (
+	    &doc->page_labels,
+	    _comac_array_index (&buffer->page_labels, 0),
+	    _comac_array_num_elements (&buffer->page_labels));
+	/* The labels now belong to the document. */
+	if (likely (status == COMAC_STATUS_SUCCESS))
+	    _comac_array_truncate (&buffer->page_labels, 0);
+    }
+
+    _comac_paginated_surface_count_pages (
+	doc->paginated_surface,
+	_comac_array_num_elements (&buffer->pages));
+
+    COMAC_MUTEX_LOCK (doc->mutex);
+    _comac_pdf_page_buffer_destroy (buffer);
+    COMAC_MUTEX_UNLOCK (doc->mutex);
+    surface->page_buffer = NULL;
+
+BAIL:
+    comac_surface_destroy (target);
+    if (unlikely (status))
+	status = _comac_surface_set_error (document, status);
+}
+
 /**
  * comac_pdf_get_versions:
  * @versions: supported version list
@@ -1073,6 +1974,46 @@ comac_pdf_surface_set_thumbnail_size (comac_surface_t *surface,
     pdf_surface->thumbnail_height = height;
 }
 
+/**
+ * comac_pdf_surface_set_compression_threads:
+ * @surface: a PDF #comac_surface_t
+ * @num_threads: the number of threads to use, or 0 to use one thread
+ * per online processor
+ *
+ * Sets the number of threads used to compress content, image and
+ * group streams. Large streams are split into blocks that are
+ * compressed concurrently. The output remains a standard FlateDecode
+ * stream but is slightly larger than that of single threaded
+ * compression. The default is 1, which compresses each stream on the
+ * calling thread.
+ *
+ * This function should only be called before any drawing operations
+ * have been performed on the given surface. The simplest way to do
+ * this is to call this function immediately after creating the
+ * surface.
+ *
+ * Since: TBD
+ **/
+void
+comac_pdf_surface_set_compression_threads (comac_surface_t *surface,
+					   int num_threads)
+{
+    comac_pdf_surface_t *pdf_surface = NULL; /* hide compiler warning */
+
+    if (! _extract_pdf_surface (surface, &pdf_surface))
+	return;
+
+    if (num_threads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	num_threads = sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+	if (num_threads <= 0)
+	    num_threads = 1;
+    }
+
+    pdf_surface->compression_threads = num_threads;
+}
+
 static void
 _comac_pdf_surface_clear (comac_pdf_surface_t *surface)
 {
@@ -1113,6 +2054,33 @@ _comac_pdf_surface_clear (comac_pdf_surface_t *surface)
     surface->thumbnail_image = NULL;
 }
 
+/* In streaming mode the unbounded surfaces have been written along
+ * with the page. Release them and forget every surface and gradient
+ * written so far so that nothing accumulates from page to page. */
+static void
+_comac_pdf_surface_clear_doc_resources (comac_pdf_surface_t *surface)
+{
+    int i, size;
+    comac_pdf_source_surface_t *src_surface;
+
+    size = _comac_array_num_elements (&surface->doc_surfaces);
+    for (i = 0; i < size; i++) {
+	src_surface = (comac_pdf_source_surface_t *) _comac_array_index (
+	    &surface->doc_surfaces,
+	    i);
+	comac_surface_destroy (src_surface->surface);
+    }
+    _comac_array_truncate (&surface->doc_surfaces, 0);
+
+    _comac_hash_table_foreach (surface->all_surfaces,
+			       _comac_pdf_source_surface_entry_pluck,
+			       surface->all_surfaces);
+
+    _comac_hash_table_foreach (surface->gradient_objects,
+			       _comac_pdf_gradient_object_pluck,
+			       surface->gradient_objects);
+}
+
 static void
 _comac_pdf_group_resources_init (comac_pdf_group_resources_t *res)
 {
@@ -1227,6 +2195,7 @@ _comac_pdf_surface_add_font (unsigned int font_id,
 			     void *closure)
 {
     comac_pdf_surface_t *surface = closure;
+    comac_pdf_surface_t *document;
     comac_pdf_font_t font;
     int num_fonts, i;
     comac_int_status_t status;
@@ -1239,20 +2208,25 @@ _comac_pdf_surface_add_font (unsigned int font_id,
 	    return COMAC_STATUS_SUCCESS;
     }
 
-    num_fonts = _comac_array_num_elements (&surface->fonts);
+    /* The font subsets are written by the document, so page surfaces
+     * take the font objects from there. */
+    document = surface->document ? surface->document : surface;
+    COMAC_MUTEX_LOCK (document->mutex);
+    status = COMAC_STATUS_SUCCESS;
+    num_fonts = _comac_array_num_elements (&document->fonts);
     for (i = 0; i < num_fonts; i++) {
-	_comac_array_copy_element (&surface->fonts, i, &font);
+	_comac_array_copy_element (&document->fonts, i, &font);
 	if (font.font_id == font_id && font.subset_id == subset_id)
-	    return _comac_array_append (&res->fonts, &font);
+	    break;
     }
 
-    font.font_id = font_id;
-    font.subset_id = subset_id;
-    font.subset_resource = _comac_pdf_surface_new_object (surface);
-    if (font.subset_resource.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
-
-    status = _comac_array_append (&surface->fonts, &font);
+    if (i == num_fonts) {
+	font.font_id = font_id;
+	font.subset_id = subset_id;
+	font.subset_resource = _comac_pdf_surface_reserve_object (document);
+	status = _comac_array_append (&document->fonts, &font);
+    }
+    COMAC_MUTEX_UNLOCK (document->mutex);
     if (unlikely (status))
 	return status;
 
@@ -1509,7 +2483,8 @@ _comac_pdf_source_surface_equal (const void *key_a, const void *key_b)
     const comac_pdf_source_surface_entry_t *a = key_a;
     const comac_pdf_source_surface_entry_t *b = key_b;
 
-    if (a->interpolate != b->interpolate)
+    if (a->interpolate != b->interpolate ||
+	a->need_transp_group != b->need_transp_group)
 	return FALSE;
 
     if (a->unique_id && b->unique_id &&
@@ -1527,8 +2502,56 @@ _comac_pdf_source_surface_init_key (comac_pdf_source_surface_entry_t *key)
 					    key->unique_id,
 					    key->unique_id_length);
     } else {
-	key->base.hash = key->id;
+	key->base.hash = key->id;
+    }
+}
+
+/* Builds a key identifying an image by its contents. The flags that
+ * change how the image is written are included so that the same pixels
+ * used as e.g. both an image and a stencil mask are kept apart. */
+static comac_int_status_t
+_comac_pdf_surface_get_content_id (comac_pdf_surface_t *surface,
+				   comac_surface_t *source,
+				   comac_bool_t stencil_mask,
+				   comac_bool_t smask,
+				   const comac_pdf_resource_t *smask_res,
+				   unsigned char *content_id)
+{
+    comac_image_surface_t *image;
+    void *image_extra;
+    uint64_t hash[2];
+    uint32_t smask_id;
+    comac_int_status_t status;
+
+    if (source->type != COMAC_SURFACE_TYPE_IMAGE)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    if (_comac_surface_is_snapshot (source)) {
+	status = _comac_surface_snapshot_get_content_hash (source, hash);
+	if (unlikely (status))
+	    return status;
+    } else if (source->backend->type == COMAC_SURFACE_TYPE_IMAGE) {
+	status =
+	    _comac_surface_acquire_source_image (source, &image, &image_extra);
+	if (unlikely (status))
+	    return status;
+	_comac_image_compute_content_hash (image, hash);
+	_comac_surface_release_source_image (source, image, image_extra);
+    } else {
+	return COMAC_INT_STATUS_UNSUPPORTED;
     }
+
+    _comac_hash128_bytes (hash,
+			  &source->device_transform,
+			  sizeof (source->device_transform));
+
+    smask_id = smask_res ? smask_res->id : 0;
+    memcpy (content_id, hash, 16);
+    content_id[16] = stencil_mask;
+    content_id[17] = smask;
+    memcpy (content_id + 18, &smask_id, 4);
+
+    return COMAC_STATUS_SUCCESS;
 }
 
 static comac_int_status_t
@@ -1599,6 +2622,36 @@ _comac_pdf_surface_release_source_image_from_pattern (
     }
 }
 
+/* Recording surfaces are written as a Form XObject unless they carry
+ * mime data that is embedded as an image instead. */
+static comac_bool_t
+_comac_pdf_surface_source_is_form (comac_surface_t *source)
+{
+    static const char *image_mime_types[] = {COMAC_MIME_TYPE_JBIG2,
+					     COMAC_MIME_TYPE_JP2,
+					     COMAC_MIME_TYPE_JPEG,
+					     COMAC_MIME_TYPE_PNG,
+					     COMAC_MIME_TYPE_CCITT_FAX,
+					     NULL};
+    const unsigned char *data;
+    unsigned long length;
+    int i;
+
+    if (source->type != COMAC_SURFACE_TYPE_RECORDING)
+	return FALSE;
+
+    for (i = 0; image_mime_types[i]; i++) {
+	comac_surface_get_mime_data (source,
+				     image_mime_types[i],
+				     &data,
+				     &length);
+	if (data)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
 static comac_int_status_t
 _get_source_surface_extents (comac_surface_t *source,
 			     comac_rectangle_int_t *extents,
@@ -1668,7 +2721,12 @@ _get_source_surface_extents (comac_surface_t *source,
  * a PDF resource to reference the surface. A hash table of all
  * surfaces in the PDF file (keyed by COMAC_MIME_TYPE_UNIQUE_ID or
  * surface unique_id) is used to ensure surfaces with the same id are
- * only written once to the PDF file.
+ * only written once to the PDF file. Recording surfaces are written
+ * once per snapshot as a Form XObject, with a second form only if
+ * some uses need a transparency group and others do not. If image
+ * deduplication is enabled, images without a COMAC_MIME_TYPE_UNIQUE_ID
+ * are keyed by a hash of their contents instead, so that identical
+ * images are written once even if they are separate surfaces.
  *
  * Only one of @source_pattern or @source_surface is to be
  * specified. Set the other to NULL.
@@ -1690,9 +2748,11 @@ _comac_pdf_surface_add_source_surface (
     double *y_offset,
     comac_rectangle_int_t *source_extents)
 {
+    comac_pdf_surface_t *document;
     comac_pdf_source_surface_t src_surface;
     comac_pdf_source_surface_entry_t surface_key;
     comac_pdf_source_surface_entry_t *surface_entry;
+    comac_hash_table_t *shared_surfaces;
     comac_int_status_t status = COMAC_STATUS_SUCCESS;
     comac_bool_t interpolate;
     unsigned char *unique_id = NULL;
@@ -1703,6 +2763,7 @@ _comac_pdf_surface_add_source_surface (
     comac_rectangle_int_t op_extents;
     double x, y;
     comac_bool_t subsurface;
+    unsigned char content_id[COMAC_PDF_CONTENT_ID_LENGTH];
 
     switch (filter) {
     default:
@@ -1754,16 +2815,61 @@ _comac_pdf_surface_add_source_surface (
     if (source_extents)
 	*source_extents = op_extents;
 
+    /* A Form XObject is not filtered, so the filter must not keep
+     * uses of the same recording apart. What does matter is whether
+     * the form is written as a transparency group, which is decided
+     * by the operator and alpha it is painted with. */
+    if (_comac_pdf_surface_source_is_form (source_surface)) {
+	interpolate = FALSE;
+	need_transp_group = need_transp_group || op != COMAC_OPERATOR_OVER;
+    } else {
+	need_transp_group = FALSE;
+    }
+
     surface_key.id = source_surface->unique_id;
     surface_key.interpolate = interpolate;
+    surface_key.need_transp_group = need_transp_group;
     comac_surface_get_mime_data (
 	source_surface,
 	COMAC_MIME_TYPE_UNIQUE_ID,
 	(const unsigned char **) &surface_key.unique_id,
 	&surface_key.unique_id_length);
+    if (surface_key.unique_id == NULL && surface->deduplicate_images) {
+	status = _comac_pdf_surface_get_content_id (surface,
+						    source_surface,
+						    stencil_mask,
+						    smask,
+						    smask_res,
+						    content_id);
+	if (status == COMAC_INT_STATUS_SUCCESS) {
+	    surface_key.unique_id = content_id;
+	    surface_key.unique_id_length = sizeof (content_id);
+	} else if (status == COMAC_INT_STATUS_UNSUPPORTED) {
+	    status = COMAC_STATUS_SUCCESS;
+	}
+    }
     _comac_pdf_source_surface_init_key (&surface_key);
-    surface_entry =
-	_comac_hash_table_lookup (surface->all_surfaces, &surface_key.base);
+
+    /* Page surfaces share their bounded sources with the document and
+     * the other pages. Unbounded ones are written when the page
+     * surface finishes and are kept to itself. */
+    document = surface->document ? surface->document : surface;
+    shared_surfaces = NULL;
+    if (surface->document && ! surface->document->streaming)
+	shared_surfaces = surface->document->all_surfaces;
+
+    COMAC_MUTEX_LOCK (document->mutex);
+    surface_entry = NULL;
+    if (likely (status == COMAC_INT_STATUS_SUCCESS)) {
+	surface_entry =
+	    _comac_hash_table_lookup (surface->all_surfaces, &surface_key.base);
+	if (surface_entry == NULL && shared_surfaces) {
+	    surface_entry =
+		_comac_hash_table_lookup (shared_surfaces, &surface_key.base);
+	    if (surface_entry && ! surface_entry->bounded)
+		surface_entry = NULL;
+	}
+    }
     if (surface_entry) {
 	if (pdf_source)
 	    *pdf_source = surface_entry;
@@ -1777,6 +2883,7 @@ _comac_pdf_surface_add_source_surface (
     }
 
     if (status || surface_entry) {
+	COMAC_MUTEX_UNLOCK (document->mutex);
 	if (source_pattern &&
 	    source_pattern->type == COMAC_PATTERN_TYPE_RASTER_SOURCE)
 	    _comac_pdf_surface_release_source_image_from_pattern (
@@ -1882,11 +2989,18 @@ _comac_pdf_surface_add_source_surface (
 	    goto fail3;
     }
 
-    status =
-	_comac_hash_table_insert (surface->all_surfaces, &surface_entry->base);
+    if (surface_entry->bounded && shared_surfaces) {
+	status =
+	    _comac_hash_table_insert (shared_surfaces, &surface_entry->base);
+    } else {
+	status = _comac_hash_table_insert (surface->all_surfaces,
+					   &surface_entry->base);
+    }
     if (unlikely (status))
 	goto fail3;
 
+    COMAC_MUTEX_UNLOCK (document->mutex);
+
     if (source_pattern &&
 	source_pattern->type == COMAC_PATTERN_TYPE_RASTER_SOURCE)
 	_comac_pdf_surface_release_source_image_from_pattern (surface,
@@ -1907,6 +3021,7 @@ fail2:
     free (surface_entry);
 
 fail1:
+    COMAC_MUTEX_UNLOCK (document->mutex);
     if (unique_id)
 	free (unique_id);
 
@@ -2044,82 +3159,228 @@ _comac_pdf_surface_add_pdf_pattern (comac_pdf_surface_t *surface,
 							  gstate_res);
 }
 
+static comac_output_stream_t *
+_comac_pdf_surface_create_deflate_stream (comac_pdf_surface_t *surface,
+					  comac_output_stream_t *output,
+					  comac_pdf_stream_type_t type)
+{
+    return _comac_deflate_stream_create_full (
+	output,
+	surface->stream_compression[type].level,
+	surface->stream_compression[type].strategy,
+	surface->compression_threads);
+}
+
+/* Writes the dictionary of the current stream to @output, with a
+ * direct /Length if @length is known or a reference to the stream's
+ * length object otherwise. */
+static void
+_comac_pdf_surface_write_stream_header (comac_pdf_surface_t *surface,
+					comac_output_stream_t *output,
+					long long length)
+{
+    _comac_pdf_surface_set_object_offset (
+	surface,
+	surface->pdf_stream.self,
+	_comac_output_stream_get_position (output));
+
+    _comac_output_stream_printf (output,
+				 "%d 0 obj\n",
+				 surface->pdf_stream.self.id);
+    if (surface->pdf_stream.length.id) {
+	_comac_output_stream_printf (output,
+				     "<< /Length %d 0 R\n",
+				     surface->pdf_stream.length.id);
+    } else {
+	_comac_output_stream_printf (output, "<< /Length %lld\n", length);
+    }
+    if (surface->pdf_stream.compressed)
+	_comac_output_stream_printf (output, "   /Filter /FlateDecode\n");
+
+    _comac_memory_stream_copy (surface->pdf_stream.dict, output);
+    _comac_output_stream_printf (output,
+				 ">>\n"
+				 "stream\n");
+}
+
+/* The stream has outgrown PDF_STREAM_BUFFER_SIZE. Write out what has
+ * been buffered behind a dictionary that refers to a length object,
+ * and pass everything that follows straight through. */
+static comac_status_t
+_comac_pdf_surface_spill_stream (comac_pdf_surface_t *surface)
+{
+    comac_output_stream_t *output = surface->pdf_stream.old_output;
+    comac_status_t status;
+
+    surface->pdf_stream.length = _comac_pdf_surface_new_object (surface);
+    if (surface->pdf_stream.length.id == 0)
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    _comac_pdf_surface_write_stream_header (surface, output, -1);
+    _comac_memory_stream_copy (surface->pdf_stream.data, output);
+
+    status = _comac_output_stream_destroy (surface->pdf_stream.data);
+    surface->pdf_stream.data = NULL;
+    if (unlikely (status))
+	return status;
+
+    return _comac_output_stream_get_status (output);
+}
+
+static comac_status_t
+_comac_pdf_stream_buffer_write (comac_output_stream_t *base,
+				const unsigned char *data,
+				unsigned int length)
+{
+    comac_pdf_stream_buffer_t *stream = (comac_pdf_stream_buffer_t *) base;
+    comac_pdf_surface_t *surface = stream->surface;
+    comac_status_t status;
+
+    if (surface->pdf_stream.data) {
+	if (_comac_memory_stream_length (surface->pdf_stream.data) + length <=
+	    PDF_STREAM_BUFFER_SIZE) {
+	    _comac_output_stream_write (surface->pdf_stream.data, data, length);
+	    return _comac_output_stream_get_status (surface->pdf_stream.data);
+	}
+
+	status = _comac_pdf_surface_spill_stream (surface);
+	if (unlikely (status))
+	    return status;
+    }
+
+    _comac_output_stream_write (surface->pdf_stream.old_output, data, length);
+
+    return _comac_output_stream_get_status (surface->pdf_stream.old_output);
+}
+
+static comac_output_stream_t *
+_comac_pdf_stream_buffer_create (comac_pdf_surface_t *surface)
+{
+    comac_pdf_stream_buffer_t *stream;
+
+    stream = _comac_malloc (sizeof (comac_pdf_stream_buffer_t));
+    if (unlikely (stream == NULL)) {
+	_comac_error_throw (COMAC_STATUS_NO_MEMORY);
+	return (comac_output_stream_t *) &_comac_output_stream_nil;
+    }
+
+    _comac_output_stream_init (&stream->base,
+			       _comac_pdf_stream_buffer_write,
+			       NULL,
+			       NULL);
+    stream->surface = surface;
+
+    return &stream->base;
+}
+
 static comac_int_status_t
 _comac_pdf_surface_open_stream (comac_pdf_surface_t *surface,
 				comac_pdf_resource_t *resource,
 				comac_bool_t compressed,
+				comac_pdf_stream_type_t type,
 				const char *fmt,
 				...)
 {
     va_list ap;
-    comac_pdf_resource_t self, length;
-    comac_output_stream_t *output = NULL;
+    comac_pdf_resource_t self;
+    comac_output_stream_t *output;
+    comac_int_status_t status;
 
     if (resource) {
 	self = *resource;
-	_comac_pdf_surface_update_object (surface, self);
     } else {
 	self = _comac_pdf_surface_new_object (surface);
 	if (self.id == 0)
 	    return _comac_error (COMAC_STATUS_NO_MEMORY);
     }
 
-    length = _comac_pdf_surface_new_object (surface);
-    if (length.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
-
-    if (compressed) {
-	output = _comac_deflate_stream_create (surface->output);
-	if (_comac_output_stream_get_status (output))
-	    return _comac_output_stream_destroy (output);
-    }
-
     surface->pdf_stream.active = TRUE;
     surface->pdf_stream.self = self;
-    surface->pdf_stream.length = length;
+    surface->pdf_stream.length.id = 0;
     surface->pdf_stream.compressed = compressed;
-    surface->current_pattern_is_solid_color = FALSE;
-    surface->current_operator = COMAC_OPERATOR_OVER;
-    _comac_pdf_operators_reset (&surface->pdf_operators);
-
-    _comac_output_stream_printf (surface->output,
-				 "%d 0 obj\n"
-				 "<< /Length %d 0 R\n",
-				 surface->pdf_stream.self.id,
-				 surface->pdf_stream.length.id);
-    if (compressed)
-	_comac_output_stream_printf (surface->output,
-				     "   /Filter /FlateDecode\n");
+    _comac_pdf_surface_reset_gstate (surface);
 
+    /* The dictionary and the start of the data are kept until either
+     * the stream is closed or it grows too large to be buffered. */
+    surface->pdf_stream.dict = _comac_memory_stream_create ();
     if (fmt != NULL) {
 	va_start (ap, fmt);
-	_comac_output_stream_vprintf (surface->output, fmt, ap);
+	_comac_output_stream_vprintf (surface->pdf_stream.dict, fmt, ap);
 	va_end (ap);
     }
+    surface->pdf_stream.data = _comac_memory_stream_create ();
+    surface->pdf_stream.buffer = _comac_pdf_stream_buffer_create (surface);
 
-    _comac_output_stream_printf (surface->output,
-				 ">>\n"
-				 "stream\n");
-
-    surface->pdf_stream.start_offset =
-	_comac_output_stream_get_position (surface->output);
-
+    output = surface->pdf_stream.buffer;
     if (compressed) {
-	assert (surface->pdf_stream.old_output == NULL);
-	surface->pdf_stream.old_output = surface->output;
-	surface->output = output;
-	_comac_pdf_operators_set_stream (&surface->pdf_operators,
-					 surface->output);
+	output = _comac_pdf_surface_create_deflate_stream (surface,
+							  output,
+							  type);
     }
+
+    assert (surface->pdf_stream.old_output == NULL);
+    surface->pdf_stream.old_output = surface->output;
+    surface->output = output;
+    _comac_pdf_operators_set_stream (&surface->pdf_operators, surface->output);
     _comac_pdf_operators_reset (&surface->pdf_operators);
 
-    return _comac_output_stream_get_status (surface->output);
+    status = _comac_output_stream_get_status (surface->pdf_stream.dict);
+    if (status == COMAC_INT_STATUS_SUCCESS)
+	status = _comac_output_stream_get_status (surface->pdf_stream.data);
+    if (status == COMAC_INT_STATUS_SUCCESS)
+	status = _comac_output_stream_get_status (surface->output);
+
+    return status;
 }
 
+/* Writes the value of a stream's indirect /Length. Inside an object
+ * stream it is packed with the other objects. When object streams are
+ * in use but none is open, it waits for the next one. Page surfaces
+ * and linearized files have no object streams, so it is written at
+ * once. */
 static comac_int_status_t
-_comac_pdf_surface_close_stream (comac_pdf_surface_t *surface)
+_comac_pdf_surface_write_stream_length (comac_pdf_surface_t *surface,
+					comac_pdf_resource_t resource,
+					long long length)
 {
+    comac_pdf_stream_length_t pending;
     comac_int_status_t status;
+
+    if (surface->object_stream.active) {
+	status = _comac_pdf_surface_object_begin (surface, resource);
+	if (unlikely (status))
+	    return status;
+
+	_comac_output_stream_printf (surface->object_stream.stream,
+				     "%lld\n",
+				     length);
+	_comac_pdf_surface_object_end (surface);
+    } else if (surface->pdf_version >= COMAC_PDF_VERSION_1_5 &&
+	       ! surface->page_buffer && ! surface->linearized_output)
+    {
+	pending.resource = resource;
+	pending.length = length;
+	status = _comac_array_append (&surface->object_stream.pending_lengths,
+				      &pending);
+	if (unlikely (status))
+	    return status;
+    } else {
+	_comac_pdf_surface_update_object (surface, resource);
+	_comac_output_stream_printf (surface->output,
+				     "%d 0 obj\n"
+				     "   %lld\n"
+				     "endobj\n",
+				     resource.id,
+				     length);
+    }
+
+    return COMAC_INT_STATUS_SUCCESS;
+}
+
+static comac_int_status_t
+_comac_pdf_surface_close_stream (comac_pdf_surface_t *surface)
+{
+    comac_int_status_t status, status2;
     long long length;
 
     if (! surface->pdf_stream.active)
@@ -2128,32 +3389,52 @@ _comac_pdf_surface_close_stream (comac_pdf_surface_t *surface)
     status = _comac_pdf_operators_flush (&surface->pdf_operators);
 
     if (surface->pdf_stream.compressed) {
-	comac_int_status_t status2;
-
 	status2 = _comac_output_stream_destroy (surface->output);
 	if (likely (status == COMAC_INT_STATUS_SUCCESS))
 	    status = status2;
-
-	surface->output = surface->pdf_stream.old_output;
-	_comac_pdf_operators_set_stream (&surface->pdf_operators,
-					 surface->output);
-	surface->pdf_stream.old_output = NULL;
     }
 
-    length = _comac_output_stream_get_position (surface->output) -
-	     surface->pdf_stream.start_offset;
+    surface->output = surface->pdf_stream.old_output;
+    _comac_pdf_operators_set_stream (&surface->pdf_operators, surface->output);
+    surface->pdf_stream.old_output = NULL;
+
+    length = _comac_output_stream_get_position (surface->pdf_stream.buffer);
+    if (surface->pdf_stream.data) {
+	_comac_pdf_surface_write_stream_header (surface,
+						surface->output,
+						length);
+	_comac_memory_stream_copy (surface->pdf_stream.data, surface->output);
+    }
     _comac_output_stream_printf (surface->output,
 				 "\n"
 				 "endstream\n"
 				 "endobj\n");
 
-    _comac_pdf_surface_update_object (surface, surface->pdf_stream.length);
-    _comac_output_stream_printf (surface->output,
-				 "%d 0 obj\n"
-				 "   %lld\n"
-				 "endobj\n",
-				 surface->pdf_stream.length.id,
-				 length);
+    if (surface->pdf_stream.length.id) {
+	status2 = _comac_pdf_surface_write_stream_length (
+	    surface,
+	    surface->pdf_stream.length,
+	    length);
+	if (likely (status == COMAC_INT_STATUS_SUCCESS))
+	    status = status2;
+    }
+
+    status2 = _comac_output_stream_destroy (surface->pdf_stream.buffer);
+    if (likely (status == COMAC_INT_STATUS_SUCCESS))
+	status = status2;
+    surface->pdf_stream.buffer = NULL;
+
+    if (surface->pdf_stream.data) {
+	status2 = _comac_output_stream_destroy (surface->pdf_stream.data);
+	if (likely (status == COMAC_INT_STATUS_SUCCESS))
+	    status = status2;
+	surface->pdf_stream.data = NULL;
+    }
+
+    status2 = _comac_output_stream_destroy (surface->pdf_stream.dict);
+    if (likely (status == COMAC_INT_STATUS_SUCCESS))
+	status = status2;
+    surface->pdf_stream.dict = NULL;
 
     surface->pdf_stream.active = FALSE;
 
@@ -2176,7 +3457,7 @@ _comac_pdf_surface_write_memory_stream (comac_pdf_surface_t *surface,
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
 				 "<< /Type /XObject\n"
-				 "   /Length %d\n",
+				 "   /Length %lld\n",
 				 resource.id,
 				 _comac_memory_stream_length (mem_stream));
 
@@ -2228,11 +3509,15 @@ _comac_pdf_surface_open_group (comac_pdf_surface_t *surface,
 
     surface->group_stream.active = TRUE;
 
-    surface->group_stream.mem_stream = _comac_memory_stream_create ();
+    surface->group_stream.mem_stream =
+	_comac_memory_stream_create_with_limit (surface->memory_stream_limit);
 
     if (surface->compress_streams) {
 	surface->group_stream.stream =
-	    _comac_deflate_stream_create (surface->group_stream.mem_stream);
+	    _comac_pdf_surface_create_deflate_stream (
+		surface,
+		surface->group_stream.mem_stream,
+		COMAC_PDF_STREAM_TYPE_CONTENT);
     } else {
 	surface->group_stream.stream = surface->group_stream.mem_stream;
     }
@@ -2256,8 +3541,7 @@ _comac_pdf_surface_open_group (comac_pdf_surface_t *surface,
 
     /* Reset gstate */
     _comac_output_stream_printf (surface->output, "/gs0 gs\n");
-    surface->current_pattern_is_solid_color = FALSE;
-    surface->current_operator = COMAC_OPERATOR_OVER;
+    _comac_pdf_surface_reset_gstate (surface);
     _comac_pdf_operators_reset (&surface->pdf_operators);
 
     return status;
@@ -2322,9 +3606,17 @@ _comac_pdf_surface_close_group (comac_pdf_surface_t *surface,
 static comac_int_status_t
 _comac_pdf_surface_open_object_stream (comac_pdf_surface_t *surface)
 {
-    if (surface->pdf_version < COMAC_PDF_VERSION_1_5) {
+    comac_pdf_stream_length_t *pending;
+    comac_int_status_t status;
+    int i, num_pending;
+
+    if (surface->pdf_version < COMAC_PDF_VERSION_1_5 || surface->page_buffer ||
+	surface->linearized_output)
+    {
 	/* Object streams not supported. All objects will be written
-	 * directly to the file. */
+	 * directly to the file. Page surfaces do the same as their
+	 * objects are copied verbatim into the document, and so do
+	 * linearized files as their objects are moved around. */
 	assert (surface->pdf_stream.active == FALSE);
 	assert (surface->group_stream.active == FALSE);
 	surface->object_stream.stream = surface->output;
@@ -2337,6 +3629,19 @@ _comac_pdf_surface_open_object_stream (comac_pdf_surface_t *surface)
 	_comac_array_truncate (&surface->object_stream.objects, 0);
 	surface->object_stream.stream = _comac_memory_stream_create ();
 	surface->object_stream.active = TRUE;
+
+	num_pending =
+	    _comac_array_num_elements (&surface->object_stream.pending_lengths);
+	for (i = 0; i < num_pending; i++) {
+	    pending =
+		_comac_array_index (&surface->object_stream.pending_lengths, i);
+	    status = _comac_pdf_surface_write_stream_length (surface,
+							     pending->resource,
+							     pending->length);
+	    if (unlikely (status))
+		return status;
+	}
+	_comac_array_truncate (&surface->object_stream.pending_lengths, 0);
     }
     return _comac_output_stream_get_status (surface->object_stream.stream);
 }
@@ -2400,10 +3705,9 @@ _comac_pdf_surface_close_object_stream (comac_pdf_surface_t *surface)
 {
     int i, num_objects;
     comac_xref_stream_object_t *xref_obj;
-    long long start_pos, length;
     comac_output_stream_t *index_stream;
+    comac_output_stream_t *data_stream;
     comac_output_stream_t *deflate_stream;
-    comac_pdf_resource_t length_res;
     comac_int_status_t status;
     comac_pdf_object_t *object;
 
@@ -2432,19 +3736,35 @@ _comac_pdf_surface_close_object_stream (comac_pdf_surface_t *surface)
 				     xref_obj->offset);
     }
 
-    length_res = _comac_pdf_surface_new_object (surface);
-    if (length_res.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    /* The objects are all in memory already, so compress them there
+     * too and write the length directly. */
+    data_stream = _comac_memory_stream_create ();
+    if (surface->compress_streams) {
+	deflate_stream = _comac_pdf_surface_create_deflate_stream (
+	    surface,
+	    data_stream,
+	    COMAC_PDF_STREAM_TYPE_CONTENT);
+	_comac_memory_stream_copy (index_stream, deflate_stream);
+	_comac_memory_stream_copy (surface->object_stream.stream,
+				   deflate_stream);
+	status = _comac_output_stream_destroy (deflate_stream);
+	if (unlikely (status))
+	    return status;
+    } else {
+	_comac_memory_stream_copy (index_stream, data_stream);
+	_comac_memory_stream_copy (surface->object_stream.stream,
+				   data_stream);
+    }
 
     _comac_pdf_surface_update_object (surface, surface->object_stream.resource);
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
 				 "<< /Type /ObjStm\n"
-				 "   /Length %d 0 R\n"
+				 "   /Length %lld\n"
 				 "   /N %d\n"
-				 "   /First %d\n",
+				 "   /First %lld\n",
 				 surface->object_stream.resource.id,
-				 length_res.id,
+				 _comac_memory_stream_length (data_stream),
 				 num_objects,
 				 _comac_memory_stream_length (index_stream));
 
@@ -2456,39 +3776,15 @@ _comac_pdf_surface_close_object_stream (comac_pdf_surface_t *surface)
     _comac_output_stream_printf (surface->output,
 				 ">>\n"
 				 "stream\n");
-
-    start_pos = _comac_output_stream_get_position (surface->output);
-    if (surface->compress_streams) {
-	deflate_stream = _comac_deflate_stream_create (surface->output);
-	_comac_memory_stream_copy (index_stream, deflate_stream);
-	_comac_memory_stream_copy (surface->object_stream.stream,
-				   deflate_stream);
-	status = _comac_output_stream_destroy (deflate_stream);
-	if (unlikely (status))
-	    return status;
-
-	length =
-	    _comac_output_stream_get_position (surface->output) - start_pos;
-    } else {
-	_comac_memory_stream_copy (index_stream, surface->output);
-	_comac_memory_stream_copy (surface->object_stream.stream,
-				   surface->output);
-	length =
-	    _comac_output_stream_get_position (surface->output) - start_pos;
-    }
-
+    _comac_memory_stream_copy (data_stream, surface->output);
     _comac_output_stream_printf (surface->output,
 				 "\n"
 				 "endstream\n"
 				 "endobj\n");
 
-    _comac_pdf_surface_update_object (surface, length_res);
-    _comac_output_stream_printf (surface->output,
-				 "%d 0 obj\n"
-				 "   %lld\n"
-				 "endobj\n",
-				 length_res.id,
-				 length);
+    status = _comac_output_stream_destroy (data_stream);
+    if (unlikely (status))
+	return status;
 
     status = _comac_output_stream_destroy (index_stream);
     if (unlikely (status))
@@ -2528,6 +3824,7 @@ _comac_pdf_surface_open_content_stream (comac_pdf_surface_t *surface,
 		surface,
 		resource,
 		surface->compress_streams,
+		COMAC_PDF_STREAM_TYPE_CONTENT,
 		"   /Type /XObject\n"
 		"   /Subtype /Form\n"
 		"   /BBox [ %f %f %f %f ]\n"
@@ -2549,6 +3846,7 @@ _comac_pdf_surface_open_content_stream (comac_pdf_surface_t *surface,
 		_comac_pdf_surface_open_stream (surface,
 						resource,
 						surface->compress_streams,
+						COMAC_PDF_STREAM_TYPE_CONTENT,
 						"   /Type /XObject\n"
 						"   /Subtype /Form\n"
 						"   /BBox [ %f %f %f %f ]\n"
@@ -2563,6 +3861,7 @@ _comac_pdf_surface_open_content_stream (comac_pdf_surface_t *surface,
 	status = _comac_pdf_surface_open_stream (surface,
 						 resource,
 						 surface->compress_streams,
+						 COMAC_PDF_STREAM_TYPE_CONTENT,
 						 NULL);
 	_comac_output_stream_printf (surface->output,
 				     "1 0 0 -1 0 %f cm\n",
@@ -2573,8 +3872,10 @@ _comac_pdf_surface_open_content_stream (comac_pdf_surface_t *surface,
 
     surface->content = surface->pdf_stream.self;
 
-    _comac_output_stream_printf (surface->output, "q\n");
     _comac_pdf_operators_reset (&surface->pdf_operators);
+    status = _comac_pdf_operators_save (&surface->pdf_operators);
+    if (unlikely (status))
+	return status;
 
     return _comac_output_stream_get_status (surface->output);
 }
@@ -2588,11 +3889,10 @@ _comac_pdf_surface_close_content_stream (comac_pdf_surface_t *surface,
     assert (surface->pdf_stream.active == TRUE);
     assert (surface->group_stream.active == FALSE);
 
-    status = _comac_pdf_operators_flush (&surface->pdf_operators);
+    status = _comac_pdf_operators_restore (&surface->pdf_operators);
     if (unlikely (status))
 	return status;
 
-    _comac_output_stream_printf (surface->output, "Q\n");
     status = _comac_pdf_surface_close_stream (surface);
     if (unlikely (status))
 	return status;
@@ -2615,10 +3915,134 @@ _comac_pdf_source_surface_entry_pluck (void *entry, void *closure)
     comac_pdf_source_surface_entry_t *surface_entry = entry;
     comac_hash_table_t *patterns = closure;
 
-    _comac_hash_table_remove (patterns, &surface_entry->base);
-    free (surface_entry->unique_id);
+    _comac_hash_table_remove (patterns, &surface_entry->base);
+    free (surface_entry->unique_id);
+
+    free (surface_entry);
+}
+
+/* Hands the output and the pages of a finished page surface over to
+ * its buffer, where they wait for comac_pdf_surface_append_page(). */
+static comac_status_t
+_comac_pdf_surface_close_page_buffer (comac_pdf_surface_t *surface)
+{
+    comac_pdf_page_buffer_t *buffer = surface->page_buffer;
+    comac_status_t status;
+
+    status = _comac_output_stream_get_status (surface->output);
+
+    COMAC_MUTEX_LOCK (surface->document->mutex);
+    buffer->surface = NULL;
+    buffer->output = surface->output;
+    buffer->pages = surface->pages;
+    buffer->page_heights = surface->page_heights;
+    buffer->page_labels = surface->page_labels;
+    COMAC_MUTEX_UNLOCK (surface->document->mutex);
+
+    surface->output = NULL;
+    _comac_array_init (&surface->pages, sizeof (comac_pdf_resource_t));
+    _comac_array_init (&surface->page_heights, sizeof (double));
+    _comac_array_init (&surface->page_labels, sizeof (char *));
+    surface->font_subsets = NULL;
+
+    return status;
+}
+
+/* Cuts off a page surface that is still being drawn from its document,
+ * which is being finished and is about to free everything the page
+ * surface shares with it. The page surface is set in error as its
+ * pages can no longer be appended. */
+static void
+_comac_pdf_surface_detach_page (comac_pdf_surface_t *surface)
+{
+    comac_status_t status_ignored;
+
+    surface->document = NULL;
+    surface->page_buffer = NULL;
+    surface->font_subsets = NULL;
+
+    status_ignored =
+	_comac_surface_set_error (&surface->base,
+				  _comac_error (COMAC_STATUS_SURFACE_FINISHED));
+    status_ignored =
+	_comac_surface_set_error (surface->paginated_surface,
+				  _comac_error (COMAC_STATUS_SURFACE_FINISHED));
+}
+
+/* Writes the file held in memory to the real output as a linearized
+ * file. If it cannot be linearized the file is copied as it is and
+ * @linearized is set to %FALSE for the cross-reference table and
+ * trailer to be written as usual. */
+static comac_status_t
+_comac_pdf_surface_write_linearized (comac_pdf_surface_t *surface,
+				     comac_pdf_resource_t catalog,
+				     comac_bool_t *linearized)
+{
+    comac_pdf_object_t *object;
+    comac_pdf_resource_t *page;
+    unsigned char *data;
+    unsigned long length;
+    long long *offsets;
+    int *pages;
+    int num_objects, num_pages, i;
+    comac_int_status_t status;
+
+    /* Every object must have been written for the offsets to be valid,
+     * whether the file is linearized or copied as it is. */
+    assert (_comac_array_num_elements (
+		&surface->object_stream.pending_lengths) == 0);
+
+    *linearized = FALSE;
+    status = _comac_memory_stream_destroy (surface->output, &data, &length);
+    surface->output = surface->linearized_output;
+    surface->linearized_output = NULL;
+    _comac_pdf_operators_set_stream (&surface->pdf_operators, surface->output);
+    if (unlikely (status))
+	return status;
+
+    num_objects = _comac_array_num_elements (&surface->objects);
+    num_pages = _comac_array_num_elements (&surface->pages);
+    offsets = _comac_malloc_ab (num_objects, sizeof (long long));
+    pages = _comac_malloc_ab (num_pages, sizeof (int));
+    if (unlikely (offsets == NULL || (num_pages && pages == NULL))) {
+	status = _comac_error (COMAC_STATUS_NO_MEMORY);
+	goto BAIL;
+    }
+
+    for (i = 0; i < num_objects; i++) {
+	object = _comac_array_index (&surface->objects, i);
+	if (object->type == PDF_OBJECT_UNCOMPRESSED)
+	    offsets[i] = object->u.offset;
+	else
+	    offsets[i] = -1;
+    }
+    for (i = 0; i < num_pages; i++) {
+	page = _comac_array_index (&surface->pages, i);
+	pages[i] = page->id;
+    }
+
+    status = _comac_pdf_linearize (surface->output,
+				   data,
+				   length,
+				   offsets,
+				   num_objects,
+				   pages,
+				   num_pages,
+				   surface->pages_resource.id,
+				   catalog.id,
+				   surface->docinfo_res.id);
+    *linearized = status != COMAC_INT_STATUS_UNSUPPORTED;
+    if (! *linearized) {
+	_comac_output_stream_write (surface->output, data, length);
+	status = _comac_output_stream_get_status (surface->output);
+    }
+
+BAIL:
+    free (offsets);
+    free (pages);
+    free (data);
 
-    free (surface_entry);
+    return status;
 }
 
 static comac_status_t
@@ -2633,6 +4057,17 @@ _comac_pdf_surface_finish (void *abstract_surface)
     comac_pdf_jbig2_global_t *global;
     char *label;
     comac_pdf_resource_t xref_res;
+    comac_pdf_page_buffer_t *buffer, *next_buffer;
+    comac_bool_t linearized;
+
+    comac_list_foreach_entry (buffer,
+			      comac_pdf_page_buffer_t,
+			      &surface->page_buffers,
+			      link)
+    {
+	if (buffer->surface)
+	    _comac_pdf_surface_detach_page (buffer->surface);
+    }
 
     /* Some of the data may be in an inconistent state if there is an error status. */
     if (surface->base.status != COMAC_STATUS_SUCCESS)
@@ -2640,6 +4075,22 @@ _comac_pdf_surface_finish (void *abstract_surface)
 
     _comac_pdf_surface_clear (surface);
 
+    if (surface->page_buffer) {
+	/* Only the unbounded surfaces remain to be written. The rest of
+	 * the document is written when the document is finished. */
+	status = _comac_pdf_surface_open_object_stream (surface);
+	if (status == COMAC_STATUS_SUCCESS)
+	    status = _comac_pdf_surface_write_patterns_and_smask_groups (surface,
+									 TRUE);
+	if (status == COMAC_STATUS_SUCCESS)
+	    status = _comac_pdf_surface_close_object_stream (surface);
+	goto CLEANUP;
+    }
+
+    status = _comac_pdf_surface_sync_objects (surface);
+    if (unlikely (status))
+	return status;
+
     status = _comac_pdf_surface_open_object_stream (surface);
     if (unlikely (status))
 	return status;
@@ -2659,18 +4110,31 @@ _comac_pdf_surface_finish (void *abstract_surface)
     if (unlikely (status))
 	return status;
 
-    catalog = _comac_pdf_surface_new_object (surface);
-    if (catalog.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    if (surface->update) {
+	/* The catalog of the file refers to the same page tree */
+	catalog.id = surface->update->catalog;
+	surface->docinfo_res.id = surface->update->info;
+    } else {
+	catalog = _comac_pdf_surface_new_object (surface);
+	if (catalog.id == 0)
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
 
-    status = _comac_pdf_surface_write_catalog (surface, catalog);
-    if (unlikely (status))
-	return status;
+	status = _comac_pdf_surface_write_catalog (surface, catalog);
+	if (unlikely (status))
+	    return status;
+    }
 
     status = _comac_pdf_surface_close_object_stream (surface);
     if (unlikely (status))
 	return status;
 
+    if (surface->linearized_output) {
+	status =
+	    _comac_pdf_surface_write_linearized (surface, catalog, &linearized);
+	if (unlikely (status) || linearized)
+	    goto CLEANUP;
+    }
+
     if (surface->pdf_version >= COMAC_PDF_VERSION_1_5) {
 	xref_res = _comac_pdf_surface_new_object (surface);
 	status = _comac_pdf_surface_write_xref_stream (surface,
@@ -2683,12 +4147,20 @@ _comac_pdf_surface_finish (void *abstract_surface)
 	_comac_output_stream_printf (surface->output,
 				     "trailer\n"
 				     "<< /Size %d\n"
-				     "   /Root %d 0 R\n"
-				     "   /Info %d 0 R\n"
-				     ">>\n",
+				     "   /Root %d 0 R\n",
 				     surface->next_available_resource.id,
-				     catalog.id,
-				     surface->docinfo_res.id);
+				     catalog.id);
+	if (surface->docinfo_res.id) {
+	    _comac_output_stream_printf (surface->output,
+					 "   /Info %d 0 R\n",
+					 surface->docinfo_res.id);
+	}
+	if (surface->update) {
+	    _comac_output_stream_printf (surface->output,
+					 "   /Prev %lld\n",
+					 surface->update->xref_offset);
+	}
+	_comac_output_stream_printf (surface->output, ">>\n");
     }
     _comac_output_stream_printf (surface->output,
 				 "startxref\n"
@@ -2725,9 +4197,19 @@ CLEANUP:
 	surface->output = surface->pdf_stream.old_output;
     if (surface->group_stream.active)
 	surface->output = surface->group_stream.old_output;
+    if (surface->linearized_output) {
+	/* The file was not completed, discard it */
+	status2 = _comac_output_stream_destroy (surface->output);
+	surface->output = surface->linearized_output;
+	surface->linearized_output = NULL;
+    }
 
     /* and finish the pdf surface */
-    status2 = _comac_output_stream_destroy (surface->output);
+    if (surface->page_buffer) {
+	status2 = _comac_pdf_surface_close_page_buffer (surface);
+    } else {
+	status2 = _comac_output_stream_destroy (surface->output);
+    }
     if (status == COMAC_STATUS_SUCCESS)
 	status = status2;
 
@@ -2735,11 +4217,14 @@ CLEANUP:
 
     _comac_array_fini (&surface->objects);
     _comac_array_fini (&surface->pages);
-    _comac_array_fini (&surface->rgb_linear_functions);
-    _comac_array_fini (&surface->alpha_linear_functions);
+    _comac_hash_table_foreach (surface->gradient_objects,
+			       _comac_pdf_gradient_object_pluck,
+			       surface->gradient_objects);
+    _comac_hash_table_destroy (surface->gradient_objects);
     _comac_array_fini (&surface->page_patterns);
     _comac_array_fini (&surface->page_surfaces);
     _comac_array_fini (&surface->object_stream.objects);
+    _comac_array_fini (&surface->object_stream.pending_lengths);
 
     size = _comac_array_num_elements (&surface->doc_surfaces);
     for (i = 0; i < size; i++) {
@@ -2757,11 +4242,21 @@ CLEANUP:
     _comac_array_fini (&surface->page_annots);
     _comac_array_fini (&surface->forward_links);
 
-    if (surface->font_subsets) {
+    if (surface->font_subsets && ! surface->document) {
 	_comac_scaled_font_subsets_destroy (surface->font_subsets);
 	surface->font_subsets = NULL;
     }
 
+    comac_list_foreach_entry_safe (buffer,
+				   next_buffer,
+				   comac_pdf_page_buffer_t,
+				   &surface->page_buffers,
+				   link)
+    {
+	_comac_pdf_page_buffer_destroy (buffer);
+    }
+    COMAC_MUTEX_FINI (surface->mutex);
+
     size = _comac_array_num_elements (&surface->jbig2_global);
     for (i = 0; i < size; i++) {
 	global = (comac_pdf_jbig2_global_t *) _comac_array_index (
@@ -2785,9 +4280,58 @@ CLEANUP:
 
     _comac_pdf_interchange_fini (surface);
 
+    if (surface->update) {
+	_comac_pdf_update_fini (surface->update);
+	free (surface->update);
+    }
+
+    /* Drop the reference taken by comac_pdf_surface_create_page(). */
+    comac_surface_destroy (surface->document_surface);
+
     return status;
 }
 
+static void
+_comac_pdf_surface_emit_header (comac_pdf_surface_t *surface)
+{
+    const char *version;
+
+    if (surface->header_emitted)
+	return;
+
+    switch (surface->pdf_version) {
+    case COMAC_PDF_VERSION_1_4:
+	version = "1.4";
+	break;
+    case COMAC_PDF_VERSION_1_5:
+	version = "1.5";
+	break;
+    case COMAC_PDF_VERSION_1_6:
+	version = "1.6";
+	break;
+    default:
+    case COMAC_PDF_VERSION_1_7:
+	version = "1.7";
+	break;
+    }
+
+    if (surface->linearize && ! surface->page_buffer) {
+	surface->linearized_output = surface->output;
+	surface->output = _comac_memory_stream_create ();
+	_comac_pdf_operators_set_stream (&surface->pdf_operators,
+					 surface->output);
+    }
+
+    _comac_output_stream_printf (surface->output, "%%PDF-%s\n", version);
+    _comac_output_stream_printf (surface->output,
+				 "%%%c%c%c%c\n",
+				 181,
+				 237,
+				 174,
+				 251);
+    surface->header_emitted = TRUE;
+}
+
 static comac_int_status_t
 _comac_pdf_surface_start_page (void *abstract_surface)
 {
@@ -2795,35 +4339,7 @@ _comac_pdf_surface_start_page (void *abstract_surface)
     comac_pdf_resource_t page;
     comac_int_status_t status;
 
-    /* Document header */
-    if (! surface->header_emitted) {
-	const char *version;
-
-	switch (surface->pdf_version) {
-	case COMAC_PDF_VERSION_1_4:
-	    version = "1.4";
-	    break;
-	case COMAC_PDF_VERSION_1_5:
-	    version = "1.5";
-	    break;
-	case COMAC_PDF_VERSION_1_6:
-	    version = "1.6";
-	    break;
-	default:
-	case COMAC_PDF_VERSION_1_7:
-	    version = "1.7";
-	    break;
-	}
-
-	_comac_output_stream_printf (surface->output, "%%PDF-%s\n", version);
-	_comac_output_stream_printf (surface->output,
-				     "%%%c%c%c%c\n",
-				     181,
-				     237,
-				     174,
-				     251);
-	surface->header_emitted = TRUE;
-    }
+    _comac_pdf_surface_emit_header (surface);
 
     _comac_pdf_group_resources_clear (&surface->resources);
     surface->in_xobject = FALSE;
@@ -3002,101 +4518,106 @@ BAIL:
     return status;
 }
 
-/* Emit alpha channel from the image into stream_res.
+static comac_bool_t
+_comac_pdf_surface_use_predictor (comac_pdf_surface_t *surface,
+				  int bits_per_component)
+{
+    return surface->image_predictor && bits_per_component == 8;
+}
+
+/* Formats the /DecodeParms entry of an image stream into buf, or an
+ * empty string if the image data is written without predictors.
+ */
+static void
+_comac_pdf_surface_format_decode_parms (comac_pdf_surface_t *surface,
+					int colors,
+					int bits_per_component,
+					int width,
+					char *buf,
+					size_t size)
+{
+    if (_comac_pdf_surface_use_predictor (surface, bits_per_component)) {
+	snprintf (buf,
+		  size,
+		  "   /DecodeParms << /Predictor 15 /Colors %d "
+		  "/BitsPerComponent %d /Columns %d >>\n",
+		  colors,
+		  bits_per_component,
+		  width);
+    } else {
+	buf[0] = 0;
+    }
+}
+
+/* Writes image data to the current stream, filtered with PNG
+ * predictors if _comac_pdf_surface_format_decode_parms() said so.
+ */
+static comac_int_status_t
+_comac_pdf_surface_write_image_data (comac_pdf_surface_t *surface,
+				     const unsigned char *data,
+				     unsigned long size,
+				     int colors,
+				     int bits_per_component,
+				     int width,
+				     int height)
+{
+    if (_comac_pdf_surface_use_predictor (surface, bits_per_component)) {
+	return _comac_pdf_image_write_predicted (surface->output,
+						 data,
+						 width * colors,
+						 height,
+						 colors);
+    }
+
+    _comac_output_stream_write (surface->output, data, size);
+    return _comac_output_stream_get_status (surface->output);
+}
+
+/* Emit the alpha plane of an image into stream_res.
  */
 static comac_int_status_t
 _comac_pdf_surface_emit_smask (comac_pdf_surface_t *surface,
 			       comac_image_surface_t *image,
+			       const comac_pdf_image_planes_t *planes,
 			       comac_bool_t stencil_mask,
 			       comac_bool_t interpolate,
 			       comac_pdf_resource_t *stream_res)
 {
     comac_int_status_t status = COMAC_STATUS_SUCCESS;
-    char *alpha;
+    comac_int_status_t status2;
+    unsigned char *alpha;
     unsigned long alpha_size;
-    uint32_t *pixel32;
-    uint8_t *pixel8;
-    int i, x, y, bit, a;
-    comac_image_transparency_t transparency;
-
-    /* This is the only image format we support, which simplifies things. */
-    assert (image->format == COMAC_FORMAT_ARGB32 ||
-	    image->format == COMAC_FORMAT_RGB24 ||
-	    image->format == COMAC_FORMAT_A8 ||
-	    image->format == COMAC_FORMAT_A1);
+    int bits_per_component;
+    char decode_parms[100];
 
-    transparency = _comac_image_analyze_transparency (image);
     if (stencil_mask) {
-	assert (transparency == COMAC_IMAGE_IS_OPAQUE ||
-		transparency == COMAC_IMAGE_HAS_BILEVEL_ALPHA);
+	assert (planes->transparency == COMAC_IMAGE_IS_OPAQUE ||
+		planes->transparency == COMAC_IMAGE_HAS_BILEVEL_ALPHA);
     } else {
-	assert (transparency != COMAC_IMAGE_IS_OPAQUE);
+	assert (planes->transparency != COMAC_IMAGE_IS_OPAQUE);
     }
 
-    if (transparency == COMAC_IMAGE_HAS_BILEVEL_ALPHA ||
-	transparency == COMAC_IMAGE_IS_OPAQUE) {
+    if (planes->transparency == COMAC_IMAGE_IS_OPAQUE) {
 	alpha_size = (image->width + 7) / 8 * image->height;
 	alpha = _comac_malloc_ab ((image->width + 7) / 8, image->height);
-    } else {
-	alpha_size = image->height * image->width;
-	alpha = _comac_malloc_ab (image->height, image->width);
-    }
+	if (unlikely (alpha == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
 
-    if (unlikely (alpha == NULL)) {
-	status = _comac_error (COMAC_STATUS_NO_MEMORY);
-	goto CLEANUP;
+	memset (alpha, 0xff, alpha_size);
+    } else {
+	alpha_size = planes->alpha_size;
+	alpha = planes->alpha_data;
     }
 
-    i = 0;
-    for (y = 0; y < image->height; y++) {
-	if (transparency == COMAC_IMAGE_IS_OPAQUE) {
-	    for (x = 0; x < (image->width + 7) / 8; x++)
-		alpha[i++] = 0xff;
-	} else if (image->format == COMAC_FORMAT_A1) {
-	    pixel8 = (uint8_t *) (image->data + y * image->stride);
-
-	    for (x = 0; x < (image->width + 7) / 8; x++, pixel8++) {
-		a = *pixel8;
-		a = COMAC_BITSWAP8_IF_LITTLE_ENDIAN (a);
-		alpha[i++] = a;
-	    }
-	} else {
-	    pixel8 = (uint8_t *) (image->data + y * image->stride);
-	    pixel32 = (uint32_t *) (image->data + y * image->stride);
-	    bit = 7;
-	    for (x = 0; x < image->width; x++) {
-		if (image->format == COMAC_FORMAT_ARGB32) {
-		    a = (*pixel32 & 0xff000000) >> 24;
-		    pixel32++;
-		} else {
-		    a = *pixel8;
-		    pixel8++;
-		}
-
-		if (transparency == COMAC_IMAGE_HAS_ALPHA) {
-		    alpha[i++] = a;
-		} else { /* transparency == COMAC_IMAGE_HAS_BILEVEL_ALPHA or COMAC_IMAGE_IS_OPAQUE */
-		    if (bit == 7)
-			alpha[i] = 0;
-		    if (a != 0)
-			alpha[i] |= (1 << bit);
-		    bit--;
-		    if (bit < 0) {
-			bit = 7;
-			i++;
-		    }
-		}
-	    }
-	    if (bit != 7)
-		i++;
-	}
-    }
+    bits_per_component =
+	planes->transparency == COMAC_IMAGE_HAS_ALPHA ? 8 : 1;
 
     if (stencil_mask) {
 	status =
 	    _comac_pdf_surface_open_stream (surface,
 					    stream_res,
 					    TRUE,
+					    COMAC_PDF_STREAM_TYPE_IMAGE,
 					    "   /Type /XObject\n"
 					    "   /Subtype /Image\n"
 					    "   /ImageMask true\n"
@@ -3109,31 +4630,48 @@ _comac_pdf_surface_emit_smask (comac_pdf_surface_t *surface,
 					    image->height,
 					    interpolate ? "true" : "false");
     } else {
+	_comac_pdf_surface_format_decode_parms (surface,
+						1,
+						bits_per_component,
+						image->width,
+						decode_parms,
+						sizeof (decode_parms));
 	status = _comac_pdf_surface_open_stream (
 	    surface,
 	    stream_res,
 	    TRUE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /Width %d\n"
 	    "   /Height %d\n"
 	    "   /ColorSpace /DeviceGray\n"
 	    "   /Interpolate %s\n"
-	    "   /BitsPerComponent %d\n",
+	    "   /BitsPerComponent %d\n"
+	    "%s",
 	    image->width,
 	    image->height,
 	    interpolate ? "true" : "false",
-	    transparency == COMAC_IMAGE_HAS_ALPHA ? 8 : 1);
+	    bits_per_component,
+	    decode_parms);
     }
     if (unlikely (status))
 	goto CLEANUP_ALPHA;
 
-    _comac_output_stream_write (surface->output, alpha, alpha_size);
-    status = _comac_pdf_surface_close_stream (surface);
+    status = _comac_pdf_surface_write_image_data (surface,
+						  alpha,
+						  alpha_size,
+						  1,
+						  bits_per_component,
+						  image->width,
+						  image->height);
+    status2 = _comac_pdf_surface_close_stream (surface);
+    if (status == COMAC_INT_STATUS_SUCCESS)
+	status = status2;
 
 CLEANUP_ALPHA:
-    free (alpha);
-CLEANUP:
+    if (alpha != planes->alpha_data)
+	free (alpha);
     return status;
 }
 
@@ -3154,16 +4692,14 @@ _comac_pdf_surface_emit_image (comac_pdf_surface_t *surface,
 			       comac_pdf_source_surface_entry_t *surface_entry)
 {
     comac_int_status_t status = COMAC_STATUS_SUCCESS;
-    char *data;
-    unsigned long data_size;
-    uint32_t *pixel;
-    int i, x, y, bit;
+    comac_int_status_t status2;
+    comac_pdf_image_planes_t planes;
     comac_pdf_resource_t smask = {0}; /* squelch bogus compiler warning */
     comac_bool_t need_smask;
-    comac_image_color_t color;
     comac_image_surface_t *image;
-    comac_image_transparency_t transparency;
+    int colors, bits_per_component;
     char smask_buf[30];
+    char decode_parms[100];
 
     image = image_surf;
     if (image->format != COMAC_FORMAT_RGB24 &&
@@ -3193,123 +4729,56 @@ _comac_pdf_surface_emit_image (comac_pdf_surface_t *surface,
     }
 
     if (surface_entry->smask || surface_entry->stencil_mask) {
-	return _comac_pdf_surface_emit_smask (surface,
-					      image,
-					      surface_entry->stencil_mask,
-					      surface_entry->interpolate,
-					      &surface_entry->surface_res);
-    }
-
-    color = _comac_image_analyze_color (image);
-    switch (color) {
-    default:
-    case COMAC_IMAGE_UNKNOWN_COLOR:
-	ASSERT_NOT_REACHED;
-    case COMAC_IMAGE_IS_COLOR:
-	data_size = image->height * image->width * 3;
-	data = _comac_malloc_abc (image->width, image->height, 3);
-	break;
+	status = _comac_pdf_image_planes_init (&planes, image, FALSE, TRUE);
+	if (unlikely (status))
+	    goto CLEANUP;
 
-    case COMAC_IMAGE_IS_GRAYSCALE:
-	data_size = image->height * image->width;
-	data = _comac_malloc_ab (image->width, image->height);
-	break;
-    case COMAC_IMAGE_IS_MONOCHROME:
-	data_size = (image->width + 7) / 8 * image->height;
-	data = _comac_malloc_ab ((image->width + 7) / 8, image->height);
-	break;
-    }
-    if (unlikely (data == NULL)) {
-	status = _comac_error (COMAC_STATUS_NO_MEMORY);
-	goto CLEANUP;
+	status = _comac_pdf_surface_emit_smask (surface,
+						image,
+						&planes,
+						surface_entry->stencil_mask,
+						surface_entry->interpolate,
+						&surface_entry->surface_res);
+	goto CLEANUP_PLANES;
     }
 
-    i = 0;
-    for (y = 0; y < image->height; y++) {
-	pixel = (uint32_t *) (image->data + y * image->stride);
-
-	bit = 7;
-	for (x = 0; x < image->width; x++, pixel++) {
-	    int r, g, b;
-
-	    /* XXX: We're un-premultiplying alpha here. My reading of the PDF
-	     * specification suggests that we should be able to avoid having
-	     * to do this by filling in the SMask's Matte dictionary
-	     * appropriately, but my attempts to do that so far have
-	     * failed. */
-	    if (image->format == COMAC_FORMAT_ARGB32) {
-		uint8_t a;
-		a = (*pixel & 0xff000000) >> 24;
-		if (a == 0) {
-		    r = g = b = 0;
-		} else {
-		    r = (((*pixel & 0xff0000) >> 16) * 255 + a / 2) / a;
-		    g = (((*pixel & 0x00ff00) >> 8) * 255 + a / 2) / a;
-		    b = (((*pixel & 0x0000ff) >> 0) * 255 + a / 2) / a;
-		}
-	    } else if (image->format == COMAC_FORMAT_RGB24) {
-		r = (*pixel & 0x00ff0000) >> 16;
-		g = (*pixel & 0x0000ff00) >> 8;
-		b = (*pixel & 0x000000ff) >> 0;
-	    } else {
-		r = g = b = 0;
-	    }
-
-	    switch (color) {
-	    case COMAC_IMAGE_IS_COLOR:
-	    case COMAC_IMAGE_UNKNOWN_COLOR:
-		data[i++] = r;
-		data[i++] = g;
-		data[i++] = b;
-		break;
-
-	    case COMAC_IMAGE_IS_GRAYSCALE:
-		data[i++] = r;
-		break;
-
-	    case COMAC_IMAGE_IS_MONOCHROME:
-		if (bit == 7)
-		    data[i] = 0;
-		if (r != 0)
-		    data[i] |= (1 << bit);
-		bit--;
-		if (bit < 0) {
-		    bit = 7;
-		    i++;
-		}
-		break;
-	    }
-	}
-	if (bit != 7)
-	    i++;
-    }
+    /* Classify the image and convert both its color and its alpha in
+     * one pass. The alpha is not needed if an smask was supplied.
+     *
+     * XXX: We're un-premultiplying alpha here. My reading of the PDF
+     * specification suggests that we should be able to avoid having
+     * to do this by filling in the SMask's Matte dictionary
+     * appropriately, but my attempts to do that so far have
+     * failed. */
+    status =
+	_comac_pdf_image_planes_init (&planes,
+				      image,
+				      TRUE,
+				      surface_entry->smask_res.id == 0);
+    if (unlikely (status))
+	goto CLEANUP;
 
     if (surface_entry->smask_res.id != 0) {
 	need_smask = TRUE;
 	smask = surface_entry->smask_res;
     } else {
 	need_smask = FALSE;
-	if (image->format == COMAC_FORMAT_ARGB32 ||
-	    image->format == COMAC_FORMAT_A8 ||
-	    image->format == COMAC_FORMAT_A1) {
-	    transparency = _comac_image_analyze_transparency (image);
-	    if (transparency != COMAC_IMAGE_IS_OPAQUE) {
-		need_smask = TRUE;
-		smask = _comac_pdf_surface_new_object (surface);
-		if (smask.id == 0) {
-		    status = _comac_error (COMAC_STATUS_NO_MEMORY);
-		    goto CLEANUP_RGB;
-		}
-
-		status =
-		    _comac_pdf_surface_emit_smask (surface,
-						   image,
-						   FALSE,
-						   surface_entry->interpolate,
-						   &smask);
-		if (unlikely (status))
-		    goto CLEANUP_RGB;
+	if (planes.transparency != COMAC_IMAGE_IS_OPAQUE) {
+	    need_smask = TRUE;
+	    smask = _comac_pdf_surface_new_object (surface);
+	    if (smask.id == 0) {
+		status = _comac_error (COMAC_STATUS_NO_MEMORY);
+		goto CLEANUP_PLANES;
 	    }
+
+	    status = _comac_pdf_surface_emit_smask (surface,
+						    image,
+						    &planes,
+						    FALSE,
+						    surface_entry->interpolate,
+						    &smask);
+	    if (unlikely (status))
+		goto CLEANUP_PLANES;
 	}
     }
 
@@ -3321,34 +4790,61 @@ _comac_pdf_surface_emit_image (comac_pdf_surface_t *surface,
     else
 	smask_buf[0] = 0;
 
+    status = _comac_pdf_image_planes_convert (&planes,
+					      &surface->base,
+					      image->width,
+					      image->height);
+    if (unlikely (status))
+	goto CLEANUP_PLANES;
+
+    colors = _comac_colorspace_num_components (planes.colorspace);
+    bits_per_component = planes.color == COMAC_IMAGE_IS_MONOCHROME ? 1 : 8;
+    _comac_pdf_surface_format_decode_parms (surface,
+					    colors,
+					    bits_per_component,
+					    image->width,
+					    decode_parms,
+					    sizeof (decode_parms));
+
     status = _comac_pdf_surface_open_stream (
 	surface,
 	&surface_entry->surface_res,
 	TRUE,
+	COMAC_PDF_STREAM_TYPE_IMAGE,
 	"   /Type /XObject\n"
 	"   /Subtype /Image\n"
 	"   /Width %d\n"
 	"   /Height %d\n"
-	"   /ColorSpace %s\n"
+	"   /ColorSpace /%s\n"
 	"   /Interpolate %s\n"
 	"   /BitsPerComponent %d\n"
+	"%s"
 	"%s",
 	image->width,
 	image->height,
-	color == COMAC_IMAGE_IS_COLOR ? "/DeviceRGB" : "/DeviceGray",
+	_comac_pdf_colorspace_strings[planes.colorspace],
 	surface_entry->interpolate ? "true" : "false",
-	color == COMAC_IMAGE_IS_MONOCHROME ? 1 : 8,
+	bits_per_component,
+	decode_parms,
 	smask_buf);
     if (unlikely (status))
-	goto CLEANUP_RGB;
+	goto CLEANUP_PLANES;
 
 #undef IMAGE_DICTIONARY
 
-    _comac_output_stream_write (surface->output, data, data_size);
-    status = _comac_pdf_surface_close_stream (surface);
+    status = _comac_pdf_surface_write_image_data (surface,
+						  planes.color_data,
+						  planes.color_size,
+						  colors,
+						  bits_per_component,
+						  image->width,
+						  image->height);
+    status2 = _comac_pdf_surface_close_stream (surface);
+    if (status == COMAC_INT_STATUS_SUCCESS)
+	status = status2;
 
-CLEANUP_RGB:
-    free (data);
+CLEANUP_PLANES:
+    _comac_pdf_image_planes_fini (&planes);
 CLEANUP:
     if (image != image_surf)
 	comac_surface_destroy (&image->base);
@@ -3456,10 +4952,12 @@ _comac_pdf_surface_emit_jbig2_image (
 					 &global_data,
 					 &global_data_length);
 	    if (global_data) {
-		status = _comac_pdf_surface_open_stream (surface,
-							 &global_entry->res,
-							 FALSE,
-							 NULL);
+		status = _comac_pdf_surface_open_stream (
+		    surface,
+		    &global_entry->res,
+		    FALSE,
+		    COMAC_PDF_STREAM_TYPE_IMAGE,
+		    NULL);
 		if (unlikely (status))
 		    return status;
 
@@ -3495,6 +4993,7 @@ _comac_pdf_surface_emit_jbig2_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /ImageMask true\n"
@@ -3514,6 +5013,7 @@ _comac_pdf_surface_emit_jbig2_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /Width %d\n"
@@ -3591,6 +5091,7 @@ _comac_pdf_surface_emit_jpx_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /ImageMask true\n"
@@ -3608,6 +5109,7 @@ _comac_pdf_surface_emit_jpx_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /Width %d\n"
@@ -3695,6 +5197,7 @@ _comac_pdf_surface_emit_jpeg_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /ImageMask true\n"
@@ -3712,6 +5215,7 @@ _comac_pdf_surface_emit_jpeg_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /Width %d\n"
@@ -3737,6 +5241,123 @@ _comac_pdf_surface_emit_jpeg_image (
     return status;
 }
 
+static comac_int_status_t
+_comac_pdf_surface_write_png_idat (void *closure,
+				   const unsigned char *data,
+				   unsigned long length)
+{
+    comac_pdf_surface_t *surface = closure;
+
+    _comac_output_stream_write (surface->output, data, length);
+
+    return _comac_output_stream_get_status (surface->output);
+}
+
+/* PNG image data is a zlib stream of rows filtered the same way as
+ * the PNG predictors of the FlateDecode filter, so the IDAT chunks
+ * can be copied to the image stream as they are. Only 8-bit gray and
+ * RGB images are handled. Those are always opaque, as images with a
+ * tRNS chunk are left to the image fallback.
+ */
+static comac_int_status_t
+_comac_pdf_surface_emit_png_image (
+    comac_pdf_surface_t *surface,
+    comac_surface_t *source,
+    comac_pdf_source_surface_entry_t *surface_entry,
+    comac_bool_t test)
+{
+    comac_int_status_t status;
+    const unsigned char *mime_data;
+    unsigned long mime_data_length;
+    comac_int_status_t status2;
+    comac_image_info_t info;
+    char smask_buf[30];
+
+    comac_surface_get_mime_data (source,
+				 COMAC_MIME_TYPE_PNG,
+				 &mime_data,
+				 &mime_data_length);
+    if (unlikely (source->status))
+	return source->status;
+    if (mime_data == NULL)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    status =
+	_comac_image_info_get_png_info (&info, mime_data, mime_data_length);
+    if (unlikely (status))
+	return status;
+
+    if (info.bits_per_component != 8 || surface_entry->stencil_mask)
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    if (info.num_components != 1 &&
+	(info.num_components != 3 || surface_entry->smask))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    /* Images that need converting to the colorspace of the surface are
+     * left to _comac_pdf_surface_emit_image(). */
+    if (surface->base.colorspace != COMAC_COLORSPACE_RGB &&
+	(info.num_components == 3 ||
+	 surface->base.colorspace == COMAC_COLORSPACE_CMYK))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    status = _comac_image_info_png_foreach_idat (mime_data,
+						 mime_data_length,
+						 NULL,
+						 NULL);
+    if (unlikely (status))
+	return status;
+
+    /* At this point we know emitting png will succeed. */
+    if (test)
+	return COMAC_STATUS_SUCCESS;
+
+    if (surface_entry->smask_res.id)
+	snprintf (smask_buf,
+		  sizeof (smask_buf),
+		  "   /SMask %d 0 R\n",
+		  surface_entry->smask_res.id);
+    else
+	smask_buf[0] = 0;
+
+    status = _comac_pdf_surface_open_stream (
+	surface,
+	&surface_entry->surface_res,
+	FALSE,
+	COMAC_PDF_STREAM_TYPE_IMAGE,
+	"   /Type /XObject\n"
+	"   /Subtype /Image\n"
+	"   /Width %d\n"
+	"   /Height %d\n"
+	"   /ColorSpace %s\n"
+	"   /Interpolate %s\n"
+	"   /BitsPerComponent 8\n"
+	"%s"
+	"   /Filter /FlateDecode\n"
+	"   /DecodeParms << /Predictor 15 /Colors %d "
+	"/BitsPerComponent 8 /Columns %d >>\n",
+	info.width,
+	info.height,
+	info.num_components == 1 ? "/DeviceGray" : "/DeviceRGB",
+	surface_entry->interpolate ? "true" : "false",
+	smask_buf,
+	info.num_components,
+	info.width);
+    if (unlikely (status))
+	return status;
+
+    status = _comac_image_info_png_foreach_idat (
+	mime_data,
+	mime_data_length,
+	_comac_pdf_surface_write_png_idat,
+	surface);
+    status2 = _comac_pdf_surface_close_stream (surface);
+    if (status == COMAC_INT_STATUS_SUCCESS)
+	status = status2;
+
+    return status;
+}
+
 static comac_int_status_t
 _comac_pdf_surface_emit_ccitt_image (
     comac_pdf_surface_t *surface,
@@ -3818,6 +5439,7 @@ _comac_pdf_surface_emit_ccitt_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /ImageMask true\n"
@@ -3837,6 +5459,7 @@ _comac_pdf_surface_emit_ccitt_image (
 	    surface,
 	    &surface_entry->surface_res,
 	    FALSE,
+	    COMAC_PDF_STREAM_TYPE_IMAGE,
 	    "   /Type /XObject\n"
 	    "   /Subtype /Image\n"
 	    "   /Width %d\n"
@@ -3947,6 +5570,10 @@ _comac_pdf_surface_emit_recording_surface (
     if (unlikely (status))
 	goto err;
 
+    status = _comac_pdf_operators_flush (&surface->pdf_operators);
+    if (unlikely (status))
+	goto err;
+
     /* Reset gstate */
     _comac_output_stream_printf (surface->output, "/gs0 gs\n");
 
@@ -4039,6 +5666,15 @@ _comac_pdf_surface_emit_surface (comac_pdf_surface_t *surface,
 	    return status;
 	}
 
+	status = _comac_pdf_surface_emit_png_image (surface,
+						    source->surface,
+						    source->hash_entry,
+						    test);
+	if (status != COMAC_INT_STATUS_UNSUPPORTED) {
+	    *is_image = TRUE;
+	    return status;
+	}
+
 	status = _comac_pdf_surface_emit_ccitt_image (surface,
 						      source->surface,
 						      source->hash_entry,
@@ -4254,6 +5890,7 @@ _comac_pdf_surface_emit_surface_pattern (comac_pdf_surface_t *surface,
 	surface,
 	&pdf_pattern->pattern_res,
 	FALSE,
+	COMAC_PDF_STREAM_TYPE_CONTENT,
 	"   /PatternType 1\n"
 	"   /BBox [ %f %f %f %f ]\n"
 	"   /XStep %f\n"
@@ -4350,65 +5987,146 @@ _comac_pdf_surface_emit_surface_pattern (comac_pdf_surface_t *surface,
     return _comac_output_stream_get_status (surface->output);
 }
 
+/* The color of a stop is in the colorspace of the surface, with the
+ * components it does not use set to zero. */
 typedef struct _comac_pdf_color_stop {
     double offset;
     double color[4];
+    double alpha;
     comac_pdf_resource_t resource;
 } comac_pdf_color_stop_t;
 
+static comac_bool_t
+_comac_pdf_gradient_object_equal (const void *key_a, const void *key_b)
+{
+    const comac_pdf_gradient_object_t *a = key_a;
+    const comac_pdf_gradient_object_t *b = key_b;
+
+    if (a->key_length != b->key_length)
+	return FALSE;
+
+    return memcmp (a->key, b->key, a->key_length * sizeof (double)) == 0;
+}
+
+static void
+_comac_pdf_gradient_object_pluck (void *entry, void *closure)
+{
+    comac_pdf_gradient_object_t *object = entry;
+    comac_hash_table_t *table = closure;
+
+    _comac_hash_table_remove (table, &object->base);
+    free (object);
+}
+
+/* Looks up the object previously written for @key. If there is none a
+ * new object number is reserved and @emit is set, in which case the
+ * caller must write the object. */
 static comac_int_status_t
-comac_pdf_surface_emit_rgb_linear_function (comac_pdf_surface_t *surface,
-					    comac_pdf_color_stop_t *stop1,
-					    comac_pdf_color_stop_t *stop2,
-					    comac_pdf_resource_t *function)
+_comac_pdf_surface_get_gradient_object (comac_pdf_surface_t *surface,
+					const double *key,
+					unsigned int key_length,
+					comac_pdf_resource_t *resource,
+					comac_bool_t *emit)
 {
-    int num_elems, i;
-    comac_pdf_rgb_linear_function_t elem;
-    comac_pdf_resource_t res;
+    comac_pdf_gradient_object_t object_key;
+    comac_pdf_gradient_object_t *object;
     comac_int_status_t status;
 
-    num_elems = _comac_array_num_elements (&surface->rgb_linear_functions);
-    for (i = 0; i < num_elems; i++) {
-	_comac_array_copy_element (&surface->rgb_linear_functions, i, &elem);
-	if (memcmp (&elem.color1[0], &stop1->color[0], sizeof (double) * 3) !=
-	    0)
-	    continue;
-	if (memcmp (&elem.color2[0], &stop2->color[0], sizeof (double) * 3) !=
-	    0)
-	    continue;
-	*function = elem.resource;
+    object_key.key = (double *) key;
+    object_key.key_length = key_length;
+    object_key.base.hash = _comac_hash_bytes (_COMAC_HASH_INIT_VALUE,
+					      key,
+					      key_length * sizeof (double));
+
+    object = _comac_hash_table_lookup (surface->gradient_objects,
+				       &object_key.base);
+    if (object) {
+	*resource = object->resource;
+	*emit = FALSE;
 	return COMAC_STATUS_SUCCESS;
     }
 
-    res = _comac_pdf_surface_new_object (surface);
-    if (res.id == 0)
+    object = _comac_malloc_ab_plus_c (key_length,
+				      sizeof (double),
+				      sizeof (comac_pdf_gradient_object_t));
+    if (unlikely (object == NULL))
 	return _comac_error (COMAC_STATUS_NO_MEMORY);
 
+    object->base.hash = object_key.base.hash;
+    object->key = (double *) (object + 1);
+    object->key_length = key_length;
+    memcpy (object->key, key, key_length * sizeof (double));
+
+    object->resource = _comac_pdf_surface_new_object (surface);
+    if (object->resource.id == 0) {
+	free (object);
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    }
+
+    status = _comac_hash_table_insert (surface->gradient_objects,
+				       &object->base);
+    if (unlikely (status)) {
+	free (object);
+	return status;
+    }
+
+    *resource = object->resource;
+    *emit = TRUE;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+_comac_pdf_surface_emit_color_components (comac_pdf_surface_t *surface,
+					  const double *color)
+{
+    int num_components, i;
+
+    num_components =
+	_comac_colorspace_num_components (surface->base.colorspace);
+    for (i = 0; i < num_components; i++)
+	_comac_output_stream_printf (surface->output, "%f ", color[i]);
+}
+
+static comac_int_status_t
+comac_pdf_surface_emit_color_linear_function (comac_pdf_surface_t *surface,
+					      comac_pdf_color_stop_t *stop1,
+					      comac_pdf_color_stop_t *stop2,
+					      comac_pdf_resource_t *function)
+{
+    double key[10];
+    comac_bool_t emit;
+    comac_int_status_t status;
+
+    key[0] = PDF_GRADIENT_COLOR_LINEAR_FUNCTION;
+    key[1] = surface->base.colorspace;
+    memcpy (&key[2], &stop1->color[0], sizeof (double) * 4);
+    memcpy (&key[6], &stop2->color[0], sizeof (double) * 4);
+
+    status = _comac_pdf_surface_get_gradient_object (surface,
+						     key,
+						     ARRAY_LENGTH (key),
+						     function,
+						     &emit);
+    if (unlikely (status) || ! emit)
+	return status;
+
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
 				 "<< /FunctionType 2\n"
 				 "   /Domain [ 0 1 ]\n"
-				 "   /C0 [ %f %f %f ]\n"
-				 "   /C1 [ %f %f %f ]\n"
+				 "   /C0 [ ",
+				 function->id);
+    _comac_pdf_surface_emit_color_components (surface, stop1->color);
+    _comac_output_stream_printf (surface->output, "]\n   /C1 [ ");
+    _comac_pdf_surface_emit_color_components (surface, stop2->color);
+    _comac_output_stream_printf (surface->output,
+				 "]\n"
 				 "   /N 1\n"
 				 ">>\n"
-				 "endobj\n",
-				 res.id,
-				 stop1->color[0],
-				 stop1->color[1],
-				 stop1->color[2],
-				 stop2->color[0],
-				 stop2->color[1],
-				 stop2->color[2]);
-
-    elem.resource = res;
-    memcpy (&elem.color1[0], &stop1->color[0], sizeof (double) * 3);
-    memcpy (&elem.color2[0], &stop2->color[0], sizeof (double) * 3);
-
-    status = _comac_array_append (&surface->rgb_linear_functions, &elem);
-    *function = res;
+				 "endobj\n");
 
-    return status;
+    return _comac_output_stream_get_status (surface->output);
 }
 
 static comac_int_status_t
@@ -4417,25 +6135,21 @@ comac_pdf_surface_emit_alpha_linear_function (comac_pdf_surface_t *surface,
 					      comac_pdf_color_stop_t *stop2,
 					      comac_pdf_resource_t *function)
 {
-    int num_elems, i;
-    comac_pdf_alpha_linear_function_t elem;
-    comac_pdf_resource_t res;
+    double key[3];
+    comac_bool_t emit;
     comac_int_status_t status;
 
-    num_elems = _comac_array_num_elements (&surface->alpha_linear_functions);
-    for (i = 0; i < num_elems; i++) {
-	_comac_array_copy_element (&surface->alpha_linear_functions, i, &elem);
-	if (elem.alpha1 != stop1->color[3])
-	    continue;
-	if (elem.alpha2 != stop2->color[3])
-	    continue;
-	*function = elem.resource;
-	return COMAC_STATUS_SUCCESS;
-    }
+    key[0] = PDF_GRADIENT_ALPHA_LINEAR_FUNCTION;
+    key[1] = stop1->alpha;
+    key[2] = stop2->alpha;
 
-    res = _comac_pdf_surface_new_object (surface);
-    if (res.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    status = _comac_pdf_surface_get_gradient_object (surface,
+						     key,
+						     ARRAY_LENGTH (key),
+						     function,
+						     &emit);
+    if (unlikely (status) || ! emit)
+	return status;
 
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
@@ -4446,18 +6160,11 @@ comac_pdf_surface_emit_alpha_linear_function (comac_pdf_surface_t *surface,
 				 "   /N 1\n"
 				 ">>\n"
 				 "endobj\n",
-				 res.id,
-				 stop1->color[3],
-				 stop2->color[3]);
-
-    elem.resource = res;
-    elem.alpha1 = stop1->color[3];
-    elem.alpha2 = stop2->color[3];
+				 function->id,
+				 stop1->alpha,
+				 stop2->alpha);
 
-    status = _comac_array_append (&surface->alpha_linear_functions, &elem);
-    *function = res;
-
-    return status;
+    return _comac_output_stream_get_status (surface->output);
 }
 
 static comac_int_status_t
@@ -4467,7 +6174,9 @@ _comac_pdf_surface_emit_stitched_colorgradient (comac_pdf_surface_t *surface,
 						comac_bool_t is_alpha,
 						comac_pdf_resource_t *function)
 {
-    comac_pdf_resource_t res;
+    double *key;
+    unsigned int key_length;
+    comac_bool_t emit;
     unsigned int i;
     comac_int_status_t status;
 
@@ -4482,26 +6191,45 @@ _comac_pdf_surface_emit_stitched_colorgradient (comac_pdf_surface_t *surface,
 	    if (unlikely (status))
 		return status;
 	} else {
-	    status =
-		comac_pdf_surface_emit_rgb_linear_function (surface,
-							    &stops[i],
-							    &stops[i + 1],
-							    &stops[i].resource);
+	    status = comac_pdf_surface_emit_color_linear_function (
+		surface,
+		&stops[i],
+		&stops[i + 1],
+		&stops[i].resource);
 	    if (unlikely (status))
 		return status;
 	}
     }
 
-    /* ... and stitch them together */
-    res = _comac_pdf_surface_new_object (surface);
-    if (res.id == 0)
+    /* ... and stitch them together. The key is the domain followed by
+     * the function and the bound of each stop. */
+    key_length = 2 * n_stops + 1;
+    key = _comac_malloc_ab (key_length, sizeof (double));
+    if (unlikely (key == NULL))
 	return _comac_error (COMAC_STATUS_NO_MEMORY);
 
+    key[0] = PDF_GRADIENT_STITCHED_FUNCTION;
+    key[1] = stops[0].offset;
+    key[2] = stops[n_stops - 1].offset;
+    for (i = 0; i < n_stops - 1; i++) {
+	key[2 * i + 3] = stops[i].resource.id;
+	key[2 * i + 4] = stops[i + 1].offset;
+    }
+
+    status = _comac_pdf_surface_get_gradient_object (surface,
+						     key,
+						     key_length,
+						     function,
+						     &emit);
+    free (key);
+    if (unlikely (status) || ! emit)
+	return status;
+
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
 				 "<< /FunctionType 3\n"
 				 "   /Domain [ %f %f ]\n",
-				 res.id,
+				 function->id,
 				 stops[0].offset,
 				 stops[n_stops - 1].offset);
 
@@ -4526,8 +6254,6 @@ _comac_pdf_surface_emit_stitched_colorgradient (comac_pdf_surface_t *surface,
 				 ">>\n"
 				 "endobj\n");
 
-    *function = res;
-
     return _comac_output_stream_get_status (surface->output);
 }
 
@@ -4542,10 +6268,59 @@ calc_gradient_color (comac_pdf_color_stop_t *new_stop,
     for (i = 0; i < 4; i++)
 	new_stop->color[i] =
 	    stop1->color[i] + offset * (stop2->color[i] - stop1->color[i]);
+    new_stop->alpha = stop1->alpha + offset * (stop2->alpha - stop1->alpha);
 }
 
 #define COLOR_STOP_EPSILON 1e-6
 
+/* Converts the colors of all the stops of @pattern to the colorspace
+ * of @surface in one go. */
+static comac_int_status_t
+_comac_pdf_surface_convert_stop_colors (comac_pdf_surface_t *surface,
+					comac_gradient_pattern_t *pattern,
+					comac_pdf_color_stop_t *stops)
+{
+    comac_colorspace_t colorspace = surface->base.colorspace;
+    unsigned int n_stops = pattern->n_stops;
+    int num_components, i, j;
+    double *colors, *converted;
+
+    num_components = _comac_colorspace_num_components (colorspace);
+    colors = _comac_malloc_ab (n_stops, sizeof (double) * 9);
+    if (unlikely (colors == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    for (i = 0; i < (int) n_stops; i++) {
+	colors[4 * i + 0] = pattern->stops[i].color.red;
+	colors[4 * i + 1] = pattern->stops[i].color.green;
+	colors[4 * i + 2] = pattern->stops[i].color.blue;
+	colors[4 * i + 3] = pattern->stops[i].color.alpha;
+    }
+
+    /* As with solid colors, RGB is written without converting it */
+    converted = colors;
+    if (colorspace != COMAC_COLORSPACE_RGB) {
+	converted = colors + 4 * n_stops;
+	_comac_surface_convert_colors (&surface->base,
+				       COMAC_COLORSPACE_RGB,
+				       colors,
+				       colorspace,
+				       converted,
+				       COMAC_COLOR_LAYOUT_DOUBLE,
+				       n_stops);
+    }
+
+    for (i = 0; i < (int) n_stops; i++) {
+	const double *color = converted + (num_components + 1) * i;
+
+	for (j = 0; j < 4; j++)
+	    stops[i].color[j] = j < num_components ? color[j] : 0.;
+    }
+
+    free (colors);
+    return COMAC_STATUS_SUCCESS;
+}
+
 static comac_int_status_t
 _comac_pdf_surface_emit_pattern_stops (comac_pdf_surface_t *surface,
 				       comac_gradient_pattern_t *pattern,
@@ -4569,12 +6344,13 @@ _comac_pdf_surface_emit_pattern_stops (comac_pdf_surface_t *surface,
     stops = &allstops[1];
     n_stops = pattern->n_stops;
 
+    status = _comac_pdf_surface_convert_stop_colors (surface, pattern, stops);
+    if (unlikely (status))
+	goto BAIL;
+
     for (i = 0; i < n_stops; i++) {
-	stops[i].color[0] = pattern->stops[i].color.red;
-	stops[i].color[1] = pattern->stops[i].color.green;
-	stops[i].color[2] = pattern->stops[i].color.blue;
-	stops[i].color[3] = pattern->stops[i].color.alpha;
-	if (! COMAC_ALPHA_IS_OPAQUE (stops[i].color[3]))
+	stops[i].alpha = pattern->stops[i].color.alpha;
+	if (! COMAC_ALPHA_IS_OPAQUE (stops[i].alpha))
 	    emit_alpha = TRUE;
 	stops[i].offset = pattern->stops[i].offset;
     }
@@ -4655,11 +6431,11 @@ _comac_pdf_surface_emit_pattern_stops (comac_pdf_surface_t *surface,
 	}
     } else if (n_stops == 2) {
 	/* no need for stitched function */
-	status =
-	    comac_pdf_surface_emit_rgb_linear_function (surface,
-							&stops[0],
-							&stops[n_stops - 1],
-							color_function);
+	status = comac_pdf_surface_emit_color_linear_function (
+	    surface,
+	    &stops[0],
+	    &stops[n_stops - 1],
+	    color_function);
 	if (unlikely (status))
 	    goto BAIL;
 
@@ -4709,11 +6485,29 @@ _comac_pdf_surface_emit_repeating_function (comac_pdf_surface_t *surface,
 					    int end)
 {
     comac_pdf_resource_t res;
+    double key[5];
+    comac_bool_t emit;
+    comac_int_status_t status;
     int i;
 
-    res = _comac_pdf_surface_new_object (surface);
-    if (res.id == 0)
-	return _comac_error (COMAC_STATUS_NO_MEMORY);
+    key[0] = PDF_GRADIENT_REPEATING_FUNCTION;
+    key[1] = function->id;
+    key[2] = begin;
+    key[3] = end;
+    key[4] = pattern->base.extend == COMAC_EXTEND_REFLECT;
+
+    status = _comac_pdf_surface_get_gradient_object (surface,
+						     key,
+						     ARRAY_LENGTH (key),
+						     &res,
+						     &emit);
+    if (unlikely (status))
+	return status;
+
+    if (! emit) {
+	*function = res;
+	return COMAC_STATUS_SUCCESS;
+    }
 
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
@@ -4811,6 +6605,7 @@ comac_pdf_surface_emit_transparency_group (comac_pdf_surface_t *surface,
 	_comac_pdf_surface_open_stream (surface,
 					NULL,
 					surface->compress_streams,
+					COMAC_PDF_STREAM_TYPE_CONTENT,
 					"   /Type /XObject\n"
 					"   /Subtype /Form\n"
 					"   /FormType 1\n"
@@ -4889,47 +6684,36 @@ comac_pdf_surface_emit_transparency_group (comac_pdf_surface_t *surface,
 }
 
 static void
-_comac_pdf_surface_output_gradient (comac_pdf_surface_t *surface,
-				    const comac_pdf_pattern_t *pdf_pattern,
-				    comac_pdf_resource_t pattern_resource,
-				    const comac_matrix_t *pat_to_pdf,
-				    const comac_circle_double_t *start,
-				    const comac_circle_double_t *end,
-				    const double *domain,
-				    const char *colorspace,
-				    comac_pdf_resource_t color_function)
-{
+_comac_pdf_surface_output_shading (comac_pdf_surface_t *surface,
+				   const comac_pdf_pattern_t *pdf_pattern,
+				   comac_pdf_resource_t shading_resource,
+				   const comac_circle_double_t *start,
+				   const comac_circle_double_t *end,
+				   const double *domain,
+				   comac_colorspace_t colorspace,
+				   comac_pdf_resource_t color_function)
+{
+    _comac_pdf_surface_update_object (surface, shading_resource);
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n",
-				 pattern_resource.id);
-
-    if (! pdf_pattern->is_shading) {
-	_comac_output_stream_printf (surface->output,
-				     "<< /Type /Pattern\n"
-				     "   /PatternType 2\n"
-				     "   /Matrix [ ");
-	_comac_output_stream_print_matrix (surface->output, pat_to_pdf);
-	_comac_output_stream_printf (surface->output,
-				     " ]\n"
-				     "   /Shading\n");
-    }
+				 shading_resource.id);
 
     if (pdf_pattern->pattern->type == COMAC_PATTERN_TYPE_LINEAR) {
 	_comac_output_stream_printf (surface->output,
-				     "      << /ShadingType 2\n"
-				     "         /ColorSpace %s\n"
-				     "         /Coords [ %f %f %f %f ]\n",
-				     colorspace,
+				     "<< /ShadingType 2\n"
+				     "   /ColorSpace /%s\n"
+				     "   /Coords [ %f %f %f %f ]\n",
+				     _comac_pdf_colorspace_strings[colorspace],
 				     start->center.x,
 				     start->center.y,
 				     end->center.x,
 				     end->center.y);
     } else {
 	_comac_output_stream_printf (surface->output,
-				     "      << /ShadingType 3\n"
-				     "         /ColorSpace %s\n"
-				     "         /Coords [ %f %f %f %f %f %f ]\n",
-				     colorspace,
+				     "<< /ShadingType 3\n"
+				     "   /ColorSpace /%s\n"
+				     "   /Coords [ %f %f %f %f %f %f ]\n",
+				     _comac_pdf_colorspace_strings[colorspace],
 				     start->center.x,
 				     start->center.y,
 				     MAX (start->radius, 0),
@@ -4939,28 +6723,106 @@ _comac_pdf_surface_output_gradient (comac_pdf_surface_t *surface,
     }
 
     _comac_output_stream_printf (surface->output,
-				 "         /Domain [ %f %f ]\n",
+				 "   /Domain [ %f %f ]\n",
 				 domain[0],
 				 domain[1]);
 
     if (pdf_pattern->pattern->extend != COMAC_EXTEND_NONE) {
 	_comac_output_stream_printf (surface->output,
-				     "         /Extend [ true true ]\n");
+				     "   /Extend [ true true ]\n");
     } else {
 	_comac_output_stream_printf (surface->output,
-				     "         /Extend [ false false ]\n");
+				     "   /Extend [ false false ]\n");
     }
 
     _comac_output_stream_printf (surface->output,
-				 "         /Function %d 0 R\n"
-				 "      >>\n",
+				 "   /Function %d 0 R\n"
+				 ">>\n"
+				 "endobj\n",
 				 color_function.id);
+}
 
-    if (! pdf_pattern->is_shading) {
-	_comac_output_stream_printf (surface->output, ">>\n");
+/* Shading patterns are written as a pattern object referring to a
+ * shading object. The pattern carries the matrix so that the shading
+ * can be shared between patterns that differ only in their
+ * transformation. */
+static comac_int_status_t
+_comac_pdf_surface_output_gradient (comac_pdf_surface_t *surface,
+				    const comac_pdf_pattern_t *pdf_pattern,
+				    comac_pdf_resource_t pattern_resource,
+				    const comac_matrix_t *pat_to_pdf,
+				    const comac_circle_double_t *start,
+				    const comac_circle_double_t *end,
+				    const double *domain,
+				    comac_colorspace_t colorspace,
+				    comac_pdf_resource_t color_function)
+{
+    comac_pdf_resource_t shading;
+    double key[13];
+    comac_bool_t emit;
+    comac_int_status_t status;
+
+    if (pdf_pattern->is_shading) {
+	_comac_pdf_surface_output_shading (surface,
+					   pdf_pattern,
+					   pattern_resource,
+					   start,
+					   end,
+					   domain,
+					   colorspace,
+					   color_function);
+	return _comac_output_stream_get_status (surface->output);
     }
 
-    _comac_output_stream_printf (surface->output, "endobj\n");
+    key[0] = PDF_GRADIENT_SHADING;
+    key[1] = pdf_pattern->pattern->type;
+    key[2] = colorspace;
+    key[3] = start->center.x;
+    key[4] = start->center.y;
+    key[5] = start->radius;
+    key[6] = end->center.x;
+    key[7] = end->center.y;
+    key[8] = end->radius;
+    key[9] = domain[0];
+    key[10] = domain[1];
+    key[11] = pdf_pattern->pattern->extend != COMAC_EXTEND_NONE;
+    key[12] = color_function.id;
+
+    status = _comac_pdf_surface_get_gradient_object (surface,
+						     key,
+						     ARRAY_LENGTH (key),
+						     &shading,
+						     &emit);
+    if (unlikely (status))
+	return status;
+
+    if (emit) {
+	_comac_pdf_surface_output_shading (surface,
+					   pdf_pattern,
+					   shading,
+					   start,
+					   end,
+					   domain,
+					   colorspace,
+					   color_function);
+    }
+
+    _comac_pdf_surface_update_object (surface, pattern_resource);
+    _comac_output_stream_printf (surface->output,
+				 "%d 0 obj\n"
+				 "<< /Type /Pattern\n"
+				 "   /PatternType 2\n"
+				 "   /Matrix [ ",
+				 pattern_resource.id);
+    _comac_output_stream_print_matrix (surface->output, pat_to_pdf);
+    _comac_output_stream_printf (surface->output,
+				 " ]\n"
+				 "   /Shading %d 0 R\n"
+				 ">>\n"
+				 "endobj\n",
+				 shading.id);
+
+    return _comac_output_stream_get_status (surface->output);
 }
 
 static comac_int_status_t
@@ -5095,17 +6957,17 @@ _comac_pdf_surface_emit_gradient (comac_pdf_surface_t *surface,
 	domain[1] = 1.0;
     }
 
-    _comac_pdf_surface_update_object (surface, pdf_pattern->pattern_res);
-    _comac_pdf_surface_output_gradient (
-	surface,
-	pdf_pattern,
-	pdf_pattern->pattern_res,
-	&pat_to_pdf,
-	&start,
-	&end,
-	domain,
-	_comac_pdf_colorspace_strings[surface->base.colorspace],
-	color_function);
+    status = _comac_pdf_surface_output_gradient (surface,
+						 pdf_pattern,
+						 pdf_pattern->pattern_res,
+						 &pat_to_pdf,
+						 &start,
+						 &end,
+						 domain,
+						 surface->base.colorspace,
+						 color_function);
+    if (unlikely (status))
+	return status;
 
     if (alpha_function.id != 0) {
 	comac_pdf_resource_t mask_resource;
@@ -5117,15 +6979,17 @@ _comac_pdf_surface_emit_gradient (comac_pdf_surface_t *surface,
 	if (mask_resource.id == 0)
 	    return _comac_error (COMAC_STATUS_NO_MEMORY);
 
-	_comac_pdf_surface_output_gradient (surface,
-					    pdf_pattern,
-					    mask_resource,
-					    &pat_to_pdf,
-					    &start,
-					    &end,
-					    domain,
-					    "/DeviceGray",
-					    alpha_function);
+	status = _comac_pdf_surface_output_gradient (surface,
+						     pdf_pattern,
+						     mask_resource,
+						     &pat_to_pdf,
+						     &start,
+						     &end,
+						     domain,
+						     COMAC_COLORSPACE_GRAY,
+						     alpha_function);
+	if (unlikely (status))
+	    return status;
 
 	status =
 	    comac_pdf_surface_emit_transparency_group (surface,
@@ -5164,7 +7028,8 @@ _comac_pdf_surface_emit_mesh_pattern (comac_pdf_surface_t *surface,
     comac_matrix_multiply (&pat_to_pdf, &pat_to_pdf, &mat);
 
     status = _comac_pdf_shading_init_color (&shading,
-					    (comac_mesh_pattern_t *) pattern);
+					    (comac_mesh_pattern_t *) pattern,
+					    &surface->base);
     if (unlikely (status))
 	return status;
 
@@ -5568,7 +7433,7 @@ _comac_pdf_surface_select_operator (comac_pdf_surface_t *surface,
 {
     comac_int_status_t status;
 
-    if (op == surface->current_operator)
+    if (op == surface->gstate.operator)
 	return COMAC_STATUS_SUCCESS;
 
     status = _comac_pdf_operators_flush (&surface->pdf_operators);
@@ -5576,7 +7441,7 @@ _comac_pdf_surface_select_operator (comac_pdf_surface_t *surface,
 	return status;
 
     _comac_output_stream_printf (surface->output, "/b%d gs\n", op);
-    surface->current_operator = op;
+    surface->gstate.operator = op;
     _comac_pdf_surface_add_operator (surface, op);
 
     return COMAC_STATUS_SUCCESS;
@@ -5591,6 +7456,8 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
     comac_int_status_t status;
     int alpha;
     const comac_color_t *solid_color = NULL;
+    comac_bool_t *has_color;
+    struct _comac_rgb_color *color;
 
     if (pattern->type == COMAC_PATTERN_TYPE_SOLID) {
 	const comac_solid_pattern_t *solid =
@@ -5601,12 +7468,19 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 
     // HACK, update do handle non-rgb colors.
     assert (solid_color->colorspace == COMAC_COLORSPACE_RGB);
+
+    if (is_stroke) {
+	has_color = &surface->gstate.has_stroke_color;
+	color = &surface->gstate.stroke_color;
+    } else {
+	has_color = &surface->gstate.has_fill_color;
+	color = &surface->gstate.fill_color;
+    }
+
     if (solid_color != NULL) {
-	if (surface->current_pattern_is_solid_color == FALSE ||
-	    surface->current_color_red != solid_color->c.rgb.red ||
-	    surface->current_color_green != solid_color->c.rgb.green ||
-	    surface->current_color_blue != solid_color->c.rgb.blue ||
-	    surface->current_color_is_stroke != is_stroke) {
+	if (! *has_color || color->red != solid_color->c.rgb.red ||
+	    color->green != solid_color->c.rgb.green ||
+	    color->blue != solid_color->c.rgb.blue) {
 	    status = _comac_pdf_operators_flush (&surface->pdf_operators);
 	    if (unlikely (status))
 		return status;
@@ -5619,23 +7493,19 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 					     solid_color->c.rgb.blue);
 	    } else if (surface->base.colorspace == COMAC_COLORSPACE_GRAY) {
 		double gray[2];
-		surface->base.color_convert (
-		    COMAC_COLORSPACE_RGB,
-		    (double *) &solid_color->c.rgb,
-		    COMAC_COLORSPACE_GRAY,
-		    gray,
-		    COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
-		    surface->base.color_convert_ctx);
+		_comac_surface_convert_color (&surface->base,
+					      COMAC_COLORSPACE_RGB,
+					      &solid_color->c.rgb.red,
+					      COMAC_COLORSPACE_GRAY,
+					      gray);
 		_comac_output_stream_printf (surface->output, "%f ", gray[0]);
 	    } else if (surface->base.colorspace == COMAC_COLORSPACE_CMYK) {
 		double cmyk[5];
-		surface->base.color_convert (
-		    COMAC_COLORSPACE_RGB,
-		    (double *) &solid_color->c.rgb,
-		    COMAC_COLORSPACE_CMYK,
-		    cmyk,
-		    COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
-		    surface->base.color_convert_ctx);
+		_comac_surface_convert_color (&surface->base,
+					      COMAC_COLORSPACE_RGB,
+					      &solid_color->c.rgb.red,
+					      COMAC_COLORSPACE_CMYK,
+					      cmyk);
 		_comac_output_stream_printf (surface->output,
 					     "%f %f %f %f ",
 					     cmyk[0],
@@ -5658,14 +7528,14 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 		    "%s ",
 		    _comac_pdf_set_nonstroke_color[surface->base.colorspace]);
 
-	    surface->current_color_red = solid_color->c.rgb.red;
-	    surface->current_color_green = solid_color->c.rgb.green;
-	    surface->current_color_blue = solid_color->c.rgb.blue;
-	    surface->current_color_is_stroke = is_stroke;
+	    *has_color = TRUE;
+	    color->red = solid_color->c.rgb.red;
+	    color->green = solid_color->c.rgb.green;
+	    color->blue = solid_color->c.rgb.blue;
 	}
 
-	if (surface->current_pattern_is_solid_color == FALSE ||
-	    surface->current_color_alpha != solid_color->c.rgb.alpha) {
+	if (! surface->gstate.has_alpha ||
+	    surface->gstate.alpha != solid_color->c.rgb.alpha) {
 	    status = _comac_pdf_surface_add_alpha (surface,
 						   solid_color->c.rgb.alpha,
 						   &alpha);
@@ -5677,10 +7547,9 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 		return status;
 
 	    _comac_output_stream_printf (surface->output, "/a%d gs\n", alpha);
-	    surface->current_color_alpha = solid_color->c.rgb.alpha;
+	    surface->gstate.has_alpha = TRUE;
+	    surface->gstate.alpha = solid_color->c.rgb.alpha;
 	}
-
-	surface->current_pattern_is_solid_color = TRUE;
     } else {
 	status = _comac_pdf_surface_add_alpha (surface, 1.0, &alpha);
 	if (unlikely (status))
@@ -5690,15 +7559,20 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 	if (unlikely (status))
 	    return status;
 
+	/* fill-stroke calls select_pattern twice. Don't save if the
+	 * gstate is already saved. */
+	if (! surface->select_pattern_gstate_saved) {
+	    status = _comac_pdf_operators_save (&surface->pdf_operators);
+	    if (unlikely (status))
+		return status;
+
+	    surface->pattern_gstate = surface->gstate;
+	}
+
 	status = _comac_pdf_operators_flush (&surface->pdf_operators);
 	if (unlikely (status))
 	    return status;
 
-	/* fill-stroke calls select_pattern twice. Don't save if the
-	 * gstate is already saved. */
-	if (! surface->select_pattern_gstate_saved)
-	    _comac_output_stream_printf (surface->output, "q ");
-
 	if (is_stroke) {
 	    _comac_output_stream_printf (surface->output,
 					 "/Pattern CS /p%d SCN ",
@@ -5710,7 +7584,9 @@ _comac_pdf_surface_select_pattern (comac_pdf_surface_t *surface,
 	}
 	_comac_output_stream_printf (surface->output, "/a%d gs\n", alpha);
 	surface->select_pattern_gstate_saved = TRUE;
-	surface->current_pattern_is_solid_color = FALSE;
+	*has_color = FALSE;
+	surface->gstate.has_alpha = TRUE;
+	surface->gstate.alpha = 1.0;
     }
 
     return _comac_output_stream_get_status (surface->output);
@@ -5722,13 +7598,11 @@ _comac_pdf_surface_unselect_pattern (comac_pdf_surface_t *surface)
     comac_int_status_t status;
 
     if (surface->select_pattern_gstate_saved) {
-	status = _comac_pdf_operators_flush (&surface->pdf_operators);
+	status = _comac_pdf_operators_restore (&surface->pdf_operators);
 	if (unlikely (status))
 	    return status;
 
-	_comac_output_stream_printf (surface->output, "Q\n");
-	_comac_pdf_operators_reset (&surface->pdf_operators);
-	surface->current_pattern_is_solid_color = FALSE;
+	surface->gstate = surface->pattern_gstate;
     }
     surface->select_pattern_gstate_saved = FALSE;
 
@@ -5767,6 +7641,8 @@ _comac_pdf_surface_show_page (void *abstract_surface)
 	return status;
 
     _comac_pdf_surface_clear (surface);
+    if (surface->streaming)
+	_comac_pdf_surface_clear_doc_resources (surface);
 
     return COMAC_STATUS_SUCCESS;
 }
@@ -5800,7 +7676,7 @@ static comac_int_status_t
 _comac_pdf_surface_write_pages (comac_pdf_surface_t *surface)
 {
     comac_pdf_resource_t page;
-    int num_pages, i;
+    int num_kids, num_pages, i;
     comac_int_status_t status;
 
     status = _comac_pdf_surface_object_begin (surface, surface->pages_resource);
@@ -5811,6 +7687,18 @@ _comac_pdf_surface_write_pages (comac_pdf_surface_t *surface)
 				 "<< /Type /Pages\n"
 				 "   /Kids [ ");
 
+    num_kids = 0;
+    if (surface->update) {
+	/* The pages of the file come first */
+	num_kids = _comac_array_num_elements (&surface->update->kids);
+	for (i = 0; i < num_kids; i++) {
+	    _comac_output_stream_printf (
+		surface->object_stream.stream,
+		"%d 0 R ",
+		*(int *) _comac_array_index (&surface->update->kids, i));
+	}
+    }
+
     num_pages = _comac_array_num_elements (&surface->pages);
     for (i = 0; i < num_pages; i++) {
 	_comac_array_copy_element (&surface->pages, i, &page);
@@ -5822,7 +7710,7 @@ _comac_pdf_surface_write_pages (comac_pdf_surface_t *surface)
     _comac_output_stream_printf (surface->object_stream.stream, "]\n");
     _comac_output_stream_printf (surface->object_stream.stream,
 				 "   /Count %d\n",
-				 num_pages);
+				 num_kids + num_pages);
 
     /* TODO: Figure out which other defaults to be inherited by /Page
      * objects. */
@@ -6062,6 +7950,7 @@ _comac_pdf_surface_emit_to_unicode_stream (
     status = _comac_pdf_surface_open_stream (surface,
 					     NULL,
 					     surface->compress_streams,
+					     COMAC_PDF_STREAM_TYPE_FONT,
 					     NULL);
     if (unlikely (status))
 	return status;
@@ -6189,6 +8078,7 @@ _comac_pdf_surface_emit_cff_font (comac_pdf_surface_t *surface,
 	surface,
 	NULL,
 	TRUE,
+	COMAC_PDF_STREAM_TYPE_FONT,
 	font_subset->is_latin ? "   /Subtype /Type1C\n"
 			      : "   /Subtype /CIDFontType0C\n");
     if (unlikely (status))
@@ -6378,7 +8268,14 @@ _comac_pdf_surface_emit_cff_font_subset (
 	      "ComacFont-%d-%d",
 	      font_subset->font_id,
 	      font_subset->subset_id);
-    status = _comac_cff_subset_init (&subset, name, font_subset);
+    if (surface->font_subset_cache) {
+	status = _comac_pdf_font_cache_cff_subset_init (&subset,
+							name,
+							font_subset,
+							FALSE);
+    } else {
+	status = _comac_cff_subset_init (&subset, name, font_subset);
+    }
     if (unlikely (status))
 	return status;
 
@@ -6407,7 +8304,14 @@ _comac_pdf_surface_emit_cff_fallback_font (
 	      "ComacFont-%d-%d",
 	      font_subset->font_id,
 	      font_subset->subset_id);
-    status = _comac_cff_fallback_init (&subset, name, font_subset);
+    if (surface->font_subset_cache) {
+	status = _comac_pdf_font_cache_cff_subset_init (&subset,
+							name,
+							font_subset,
+							TRUE);
+    } else {
+	status = _comac_cff_fallback_init (&subset, name, font_subset);
+    }
     if (unlikely (status))
 	return status;
 
@@ -6444,6 +8348,7 @@ _comac_pdf_surface_emit_type1_font (comac_pdf_surface_t *surface,
     status = _comac_pdf_surface_open_stream (surface,
 					     NULL,
 					     TRUE,
+					     COMAC_PDF_STREAM_TYPE_FONT,
 					     "   /Length1 %lu\n"
 					     "   /Length2 %lu\n"
 					     "   /Length3 %lu\n",
@@ -6637,7 +8542,12 @@ _comac_pdf_surface_emit_truetype_font_subset (
     if (subset_resource.id == 0)
 	return COMAC_STATUS_SUCCESS;
 
-    status = _comac_truetype_subset_init_pdf (&subset, font_subset);
+    if (surface->font_subset_cache) {
+	status =
+	    _comac_pdf_font_cache_truetype_subset_init (&subset, font_subset);
+    } else {
+	status = _comac_truetype_subset_init_pdf (&subset, font_subset);
+    }
     if (unlikely (status))
 	return status;
 
@@ -6646,6 +8556,7 @@ _comac_pdf_surface_emit_truetype_font_subset (
     status = _comac_pdf_surface_open_stream (surface,
 					     NULL,
 					     TRUE,
+					     COMAC_PDF_STREAM_TYPE_FONT,
 					     "   /Length1 %lu\n",
 					     subset.data_length);
     if (unlikely (status)) {
@@ -6973,6 +8884,7 @@ _comac_pdf_surface_emit_type3_font_subset (
 	status = _comac_pdf_surface_open_stream (surface,
 						 NULL,
 						 surface->compress_streams,
+						 COMAC_PDF_STREAM_TYPE_FONT,
 						 NULL);
 	if (unlikely (status))
 	    break;
@@ -7242,28 +9154,76 @@ _comac_pdf_surface_write_catalog (comac_pdf_surface_t *surface,
     return status;
 }
 
+/* Returns whether object @id is listed in the cross-reference section.
+ * An update lists the objects it writes and the free object 0 only. */
+static comac_bool_t
+_comac_pdf_surface_object_in_xref (comac_pdf_surface_t *surface, int id)
+{
+    comac_pdf_object_t *object;
+
+    if (surface->update == NULL || id == 0 || id >= surface->update->size)
+	return TRUE;
+
+    object = _comac_array_index (&surface->objects, id - 1);
+    return object->type != PDF_OBJECT_FREE;
+}
+
+/* Finds the next run of objects listed in the cross-reference section,
+ * from object @first on, and returns its length, or 0 if there is none.
+ * Without an update, this is every object at once. */
+static int
+_comac_pdf_surface_next_xref_run (comac_pdf_surface_t *surface, int *first)
+{
+    int num_objects, end;
+
+    num_objects = _comac_array_num_elements (&surface->objects);
+    while (*first <= num_objects &&
+	   ! _comac_pdf_surface_object_in_xref (surface, *first))
+	(*first)++;
+
+    end = *first;
+    while (end <= num_objects &&
+	   _comac_pdf_surface_object_in_xref (surface, end))
+	end++;
+
+    return end - *first;
+}
+
 static long long
 _comac_pdf_surface_write_xref (comac_pdf_surface_t *surface)
 {
     comac_pdf_object_t *object;
-    int num_objects, i;
+    int first, count, i;
     long long offset;
 
-    num_objects = _comac_array_num_elements (&surface->objects);
-
     offset = _comac_output_stream_get_position (surface->output);
-    _comac_output_stream_printf (surface->output,
-				 "xref\n"
-				 "%d %d\n",
-				 0,
-				 num_objects + 1);
+    _comac_output_stream_printf (surface->output, "xref\n");
 
-    _comac_output_stream_printf (surface->output, "0000000000 65535 f \n");
-    for (i = 0; i < num_objects; i++) {
-	object = _comac_array_index (&surface->objects, i);
+    for (first = 0; (count = _comac_pdf_surface_next_xref_run (surface,
+							       &first));
+	 first += count)
+    {
 	_comac_output_stream_printf (surface->output,
-				     "%010lld 00000 n \n",
-				     object->u.offset);
+				     "%d %d\n",
+				     first,
+				     count);
+	for (i = first; i < first + count; i++) {
+	    if (i == 0) {
+		_comac_output_stream_printf (surface->output,
+					     "0000000000 65535 f \n");
+		continue;
+	    }
+
+	    object = _comac_array_index (&surface->objects, i - 1);
+	    if (object->type == PDF_OBJECT_FREE) {
+		_comac_output_stream_printf (surface->output,
+					     "0000000000 65535 f \n");
+	    } else {
+		_comac_output_stream_printf (surface->output,
+					     "%010lld 00000 n \n",
+					     object->u.offset);
+	    }
+	}
     }
 
     return offset;
@@ -7321,6 +9281,9 @@ _comac_write_xref_stream_entries (comac_pdf_surface_t *surface,
 
     num_objects = _comac_array_num_elements (&surface->objects);
     for (i = 0; i < num_objects; i++) {
+	if (! _comac_pdf_surface_object_in_xref (surface, i + 1))
+	    continue;
+
 	object = _comac_array_index (&surface->objects, i);
 	if (object->type == PDF_OBJECT_UNCOMPRESSED) {
 	    _comac_write_xref_stream_entry (stream,
@@ -7361,7 +9324,7 @@ _comac_pdf_surface_write_xref_stream (comac_pdf_surface_t *surface,
     comac_output_stream_t *mem_stream;
     comac_output_stream_t *xref_stream;
     long long offset;
-    int offset_bytes;
+    int offset_bytes, first, count;
     comac_status_t status;
 
     *xref_offset = _comac_output_stream_get_position (surface->output);
@@ -7389,13 +9352,12 @@ _comac_pdf_surface_write_xref_stream (comac_pdf_surface_t *surface,
     _comac_output_stream_printf (surface->output,
 				 "%d 0 obj\n"
 				 "<< /Type /XRef\n"
-				 "   /Length %d\n"
+				 "   /Length %lld\n"
 				 "   /Filter /FlateDecode\n"
 				 "   /Size %d\n"
 				 "   /W [1 %d 2]\n"
 				 "   /Root %d 0 R\n"
-				 "   /Info %d 0 R\n"
-				 ">>\n",
+				 "   /Info %d 0 R\n",
 				 xref_res.id,
 				 _comac_memory_stream_length (mem_stream),
 				 surface->next_available_resource.id,
@@ -7403,6 +9365,24 @@ _comac_pdf_surface_write_xref_stream (comac_pdf_surface_t *surface,
 				 root_res.id,
 				 info_res.id);
 
+    if (surface->update) {
+	_comac_output_stream_printf (surface->output, "   /Index [");
+	for (first = 0; (count = _comac_pdf_surface_next_xref_run (surface,
+								   &first));
+	     first += count)
+	{
+	    _comac_output_stream_printf (surface->output,
+					 " %d %d",
+					 first,
+					 count);
+	}
+	_comac_output_stream_printf (surface->output,
+				     " ]\n"
+				     "   /Prev %lld\n",
+				     surface->update->xref_offset);
+    }
+    _comac_output_stream_printf (surface->output, ">>\n");
+
     if (! surface->compress_streams) {
 	/* Adobe Reader requires xref streams to be flate encoded (PDF
 	 * Reference 1.7, implementation note 20). This means
@@ -7873,6 +9853,10 @@ _comac_pdf_surface_write_page (comac_pdf_surface_t *surface)
 	if (unlikely (status))
 	    return status;
 
+	status = _comac_pdf_operators_flush (&surface->pdf_operators);
+	if (unlikely (status))
+	    return status;
+
 	_comac_output_stream_printf (surface->output, "/x%d Do\n", knockout.id);
 	status = _comac_pdf_surface_add_xobject (surface, knockout);
 	if (unlikely (status))
@@ -7952,7 +9936,8 @@ _comac_pdf_surface_write_page (comac_pdf_surface_t *surface)
     _comac_pdf_surface_object_end (surface);
 
     status =
-	_comac_pdf_surface_write_patterns_and_smask_groups (surface, FALSE);
+	_comac_pdf_surface_write_patterns_and_smask_groups (surface,
+							    surface->streaming);
     if (unlikely (status))
 	return status;
 
@@ -9566,6 +11551,11 @@ _comac_pdf_surface_tag (void *abstract_surface,
     comac_pdf_surface_t *surface = abstract_surface;
     comac_int_status_t status = 0;
 
+    /* The structure tree spans the whole document and cannot be
+     * built from pages generated independently. */
+    if (surface->page_buffer)
+	return COMAC_STATUS_SUCCESS;
+
     if (begin)
 	status =
 	    _comac_pdf_interchange_tag_begin (surface, tag_name, attributes);
@@ -0,0 +1,74 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#ifndef COMAC_PDF_UPDATE_PRIVATE_H
+#define COMAC_PDF_UPDATE_PRIVATE_H
+
+#include "comac-pdf.h"
+
+#include "comac-compiler-private.h"
+#include "comac-types-private.h"
+#include "comac-error-private.h"
+#include "comac-array-private.h"
+
+/* What the PDF surface needs to know about an existing file to add
+ * pages to it with an incremental update. */
+typedef struct _comac_pdf_update {
+    long long length;	   /* of the file */
+    long long xref_offset; /* of its last cross-reference section */
+    comac_pdf_version_t version;
+    int size;	 /* the first unused object number */
+    int catalog; /* object numbers from the trailer and the catalog */
+    int info;	 /* 0 if the file has no information dictionary */
+    int pages;
+    comac_array_t kids; /* int, the object numbers of the pages */
+} comac_pdf_update_t;
+
+/**
+ * _comac_pdf_update_init:
+ * @update: the #comac_pdf_update_t to initialize
+ * @filename: the PDF file to read
+ *
+ * Reads the trailers, the catalog and the page tree of @filename
+ * into @update. Only the cross-reference sections and these objects
+ * are read, not the rest of the file. The page tree must be a single
+ * /Pages object with every page in its /Kids, as written by the PDF
+ * surface, and the file must not be encrypted.
+ *
+ * Return value: %COMAC_STATUS_SUCCESS, %COMAC_STATUS_FILE_NOT_FOUND,
+ * %COMAC_STATUS_NO_MEMORY, or %COMAC_STATUS_READ_ERROR if the file
+ * cannot be read or is not supported.
+ **/
+comac_private comac_status_t
+_comac_pdf_update_init (comac_pdf_update_t *update, const char *filename);
+
+comac_private void
+_comac_pdf_update_fini (comac_pdf_update_t *update);
+
+#endif /* COMAC_PDF_UPDATE_PRIVATE_H */
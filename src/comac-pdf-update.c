@@ -0,0 +1,1198 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it either under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation
+ * (the "LGPL") or, at your option, under the terms of the Mozilla
+ * Public License Version 1.1 (the "MPL"). If you do not alter this
+ * notice, a recipient may use your version of this file under either
+ * the MPL or the LGPL.
+ *
+ * You should have received a copy of the LGPL along with this library
+ * in the file COPYING-LGPL-2.1; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA
+ * You should have received a copy of the MPL along with this library
+ * in the file COPYING-MPL-1.1
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.1 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY
+ * OF ANY KIND, either express or implied. See the LGPL or the MPL for
+ * the specific language governing rights and limitations.
+ *
+ * The Original Code is the comac graphics library.
+ */
+
+#include "comacint.h"
+
+#include "comac-pdf-update-private.h"
+#include "comac-pdf-linearize-private.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <zlib.h>
+
+/* Incremental updates, as described in section 7.5.6 of the PDF
+ * specification.
+ *
+ * To add pages to an existing file the PDF surface writes the new
+ * objects after the end of the file, followed by a new version of the
+ * page tree object and a cross-reference section that lists only
+ * these objects. Its trailer points back to the last section of the
+ * file with /Prev. This file reads what the surface needs for that:
+ * the object count, catalog and information dictionary from the
+ * trailers, the page tree from the catalog and the pages already in
+ * the page tree.
+ *
+ * The chain of cross-reference sections is followed from the last
+ * startxref through /Prev. Both tables and streams are supported, and
+ * objects are looked up in the sections newest first, so files which
+ * have been updated before or linearized are read correctly. Objects
+ * are read into a buffer that grows until they are complete, which
+ * keeps the rest of the file, the pages and their content, unread.
+ */
+
+#define READ_SIZE 4096
+#define TAIL_SIZE 1024
+#define XREF_ENTRY_SIZE 20
+
+typedef struct _comac_pdf_xref_subsection {
+    int first;
+    int count;
+    long long offset; /* of the first entry, in the file for a table */
+} comac_pdf_xref_subsection_t;
+
+typedef struct _comac_pdf_xref_section {
+    long long offset;
+    unsigned char *data; /* the decoded stream, NULL for a table */
+    int w[3];
+    comac_array_t subsections;
+} comac_pdf_xref_section_t;
+
+typedef struct _comac_pdf_reader {
+    FILE *file;
+    long long length;
+
+    /* The bytes last read, at offset in the file */
+    unsigned char *buffer;
+    long long buffer_size;
+    long long offset;
+    long long end;
+    comac_bool_t eof;
+
+    comac_array_t sections; /* newest first */
+} comac_pdf_reader_t;
+
+typedef struct _comac_pdf_reader_object {
+    int id; /* 0 for a trailer */
+    const unsigned char *data;
+    long long dict; /* the dictionary is data[dict..dict_end) */
+    long long dict_end;
+    long long stream;	    /* offset of the stream data, or -1 */
+    unsigned char *decoded; /* the object stream holding the object */
+} comac_pdf_reader_object_t;
+
+static comac_bool_t
+_token_equals (const unsigned char *data,
+	       const comac_pdf_token_t *token,
+	       const char *text)
+{
+    size_t len = strlen (text);
+
+    return token->end - token->start == (long long) len &&
+	   memcmp (data + token->start, text, len) == 0;
+}
+
+/* Like _comac_pdf_next_token(), but when data[0..end) is only part of
+ * the object being read, a token which may continue past @end is
+ * PDF_TOKEN_END. */
+static long long
+_next_token (const unsigned char *data,
+	     long long pos,
+	     long long end,
+	     comac_bool_t partial,
+	     comac_pdf_token_t *token)
+{
+    pos = _comac_pdf_next_token (data, pos, end, token);
+    if (partial && token->end == end)
+	token->type = PDF_TOKEN_END;
+
+    return pos;
+}
+
+/* Returns the position after the object starting at @pos, where a
+ * reference "n g R" is a single object, or -1 if it does not end
+ * before @end. */
+static long long
+_skip_object (const unsigned char *data,
+	      long long pos,
+	      long long end,
+	      comac_bool_t partial)
+{
+    comac_pdf_token_t token, gen, r;
+    long long next;
+    int depth = 0;
+
+    do {
+	pos = _next_token (data, pos, end, partial, &token);
+	if (token.type == PDF_TOKEN_END)
+	    return -1;
+
+	if (_token_equals (data, &token, "<<") ||
+	    _token_equals (data, &token, "["))
+	    depth++;
+	else if (_token_equals (data, &token, ">>") ||
+		 _token_equals (data, &token, "]"))
+	    depth--;
+	if (depth < 0)
+	    return -1;
+    } while (depth > 0);
+
+    if (token.type == PDF_TOKEN_INTEGER) {
+	next = _next_token (data, pos, end, partial, &gen);
+	if (gen.type == PDF_TOKEN_INTEGER) {
+	    next = _next_token (data, next, end, partial, &r);
+	    if (_comac_pdf_token_is (data, &r, "R"))
+		pos = next;
+	}
+    }
+
+    return pos;
+}
+
+/* Steps over the next entry of the dictionary whose key is at @pos and
+ * returns the position of its value, or -1 at the end. */
+static long long
+_dict_next_key (const comac_pdf_reader_object_t *object,
+		long long pos,
+		comac_pdf_token_t *key)
+{
+    pos = _comac_pdf_next_token (object->data, pos, object->dict_end, key);
+    if (key->type == PDF_TOKEN_END || object->data[key->start] != '/')
+	return -1;
+
+    return pos;
+}
+
+/* Returns the position of the value of @key, which includes the
+ * slash, or -1 if the dictionary has no such key. */
+static long long
+_dict_lookup (const comac_pdf_reader_object_t *object, const char *key)
+{
+    comac_pdf_token_t token;
+    long long pos;
+
+    /* Skip "<<" */
+    pos = object->dict + 2;
+    for (;;) {
+	pos = _dict_next_key (object, pos, &token);
+	if (pos < 0)
+	    return -1;
+
+	if (_token_equals (object->data, &token, key))
+	    return pos;
+
+	pos = _skip_object (object->data, pos, object->dict_end, FALSE);
+	if (pos < 0)
+	    return -1;
+    }
+}
+
+static comac_bool_t
+_dict_get_int (const comac_pdf_reader_object_t *object,
+	       const char *key,
+	       long long *value)
+{
+    comac_pdf_token_t token;
+    long long pos;
+
+    pos = _dict_lookup (object, key);
+    if (pos < 0)
+	return FALSE;
+
+    _comac_pdf_next_token (object->data, pos, object->dict_end, &token);
+    if (token.type != PDF_TOKEN_INTEGER)
+	return FALSE;
+
+    *value = token.value;
+    return TRUE;
+}
+
+/* Reads the reference at @pos, returning the position after it or -1. */
+static long long
+_read_ref (const comac_pdf_reader_object_t *object, long long pos, int *id)
+{
+    comac_pdf_token_t token, gen, r;
+
+    pos = _comac_pdf_next_token (object->data, pos, object->dict_end, &token);
+    pos = _comac_pdf_next_token (object->data, pos, object->dict_end, &gen);
+    pos = _comac_pdf_next_token (object->data, pos, object->dict_end, &r);
+    if (token.type != PDF_TOKEN_INTEGER || gen.type != PDF_TOKEN_INTEGER ||
+	! _comac_pdf_token_is (object->data, &r, "R") || token.value < 1 ||
+	token.value > INT_MAX)
+	return -1;
+
+    *id = token.value;
+    return pos;
+}
+
+static comac_bool_t
+_dict_get_ref (const comac_pdf_reader_object_t *object,
+	       const char *key,
+	       int *id)
+{
+    long long pos;
+
+    pos = _dict_lookup (object, key);
+    return pos >= 0 && _read_ref (object, pos, id) >= 0;
+}
+
+static comac_bool_t
+_dict_has_name (const comac_pdf_reader_object_t *object,
+		const char *key,
+		const char *name)
+{
+    comac_pdf_token_t token;
+    long long pos;
+
+    pos = _dict_lookup (object, key);
+    if (pos < 0)
+	return FALSE;
+
+    _comac_pdf_next_token (object->data, pos, object->dict_end, &token);
+    return _token_equals (object->data, &token, name);
+}
+
+/* Appends the elements of the array of integers, or of references if
+ * @refs is set, to @array of int. */
+static comac_status_t
+_dict_get_array (const comac_pdf_reader_object_t *object,
+		 const char *key,
+		 comac_bool_t refs,
+		 comac_array_t *array)
+{
+    comac_pdf_token_t token;
+    comac_status_t status;
+    long long pos, next;
+    int value;
+
+    pos = _dict_lookup (object, key);
+    if (pos < 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    pos = _comac_pdf_next_token (object->data, pos, object->dict_end, &token);
+    if (! _token_equals (object->data, &token, "["))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    for (;;) {
+	next =
+	    _comac_pdf_next_token (object->data, pos, object->dict_end, &token);
+	if (_token_equals (object->data, &token, "]"))
+	    return COMAC_STATUS_SUCCESS;
+
+	if (refs) {
+	    next = _read_ref (object, pos, &value);
+	} else if (token.type == PDF_TOKEN_INTEGER && token.value >= 0 &&
+		   token.value <= INT_MAX) {
+	    value = token.value;
+	} else {
+	    next = -1;
+	}
+	if (next < 0)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	status = _comac_array_append (array, &value);
+	if (unlikely (status))
+	    return status;
+
+	pos = next;
+    }
+}
+
+static comac_status_t
+_comac_pdf_reader_init (comac_pdf_reader_t *reader, const char *filename)
+{
+    comac_status_t status;
+
+    status = _comac_fopen (filename, "rb", &reader->file);
+    if (unlikely (status))
+	return status;
+
+    if (reader->file == NULL) {
+	switch (errno) {
+	case ENOMEM:
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+	case ENOENT:
+	    return _comac_error (COMAC_STATUS_FILE_NOT_FOUND);
+	default:
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+	}
+    }
+
+    if (fseek (reader->file, 0, SEEK_END) != 0 ||
+	(reader->length = ftell (reader->file)) < 0)
+    {
+	fclose (reader->file);
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+    }
+
+    reader->buffer = NULL;
+    reader->buffer_size = 0;
+    reader->offset = 0;
+    reader->end = 0;
+    reader->eof = FALSE;
+    _comac_array_init (&reader->sections, sizeof (comac_pdf_xref_section_t));
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+_comac_pdf_xref_section_fini (comac_pdf_xref_section_t *section)
+{
+    free (section->data);
+    _comac_array_fini (&section->subsections);
+}
+
+static void
+_comac_pdf_reader_fini (comac_pdf_reader_t *reader)
+{
+    int i, num_sections;
+
+    num_sections = _comac_array_num_elements (&reader->sections);
+    for (i = 0; i < num_sections; i++)
+	_comac_pdf_xref_section_fini (
+	    _comac_array_index (&reader->sections, i));
+    _comac_array_fini (&reader->sections);
+    free (reader->buffer);
+    fclose (reader->file);
+}
+
+/* Reads @size bytes at @offset, fewer at the end of the file, into the
+ * buffer. */
+static comac_status_t
+_comac_pdf_reader_read (comac_pdf_reader_t *reader,
+			long long offset,
+			long long size)
+{
+    unsigned char *buffer;
+
+    if (offset < 0 || offset > reader->length)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    if (size > reader->length - offset)
+	size = reader->length - offset;
+
+    if (size >= reader->buffer_size) {
+	buffer = realloc (reader->buffer, size + 1);
+	if (unlikely (buffer == NULL))
+	    return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+	reader->buffer = buffer;
+	reader->buffer_size = size + 1;
+    }
+
+    if (fseek (reader->file, offset, SEEK_SET) != 0 ||
+	fread (reader->buffer, 1, size, reader->file) != (size_t) size)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    reader->buffer[size] = '\0';
+    reader->offset = offset;
+    reader->end = size;
+    reader->eof = offset + size == reader->length;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Parses "n g obj" followed by a dictionary, and the stream keyword if
+ * there is one, or "trailer" followed by a dictionary, at the start of
+ * the buffer. Returns %FALSE if they are not all in the buffer. */
+static comac_bool_t
+_comac_pdf_reader_parse_object (comac_pdf_reader_t *reader,
+				comac_pdf_reader_object_t *object)
+{
+    const unsigned char *data = reader->buffer;
+    long long end = reader->end;
+    comac_bool_t partial = ! reader->eof;
+    comac_pdf_token_t token;
+    long long pos;
+
+    pos = _next_token (data, 0, end, partial, &token);
+    if (token.type == PDF_TOKEN_INTEGER && token.value > 0 &&
+	token.value <= INT_MAX)
+    {
+	object->id = token.value;
+	pos = _next_token (data, pos, end, partial, &token);
+	if (token.type != PDF_TOKEN_INTEGER)
+	    return FALSE;
+
+	pos = _next_token (data, pos, end, partial, &token);
+	if (! _comac_pdf_token_is (data, &token, "obj"))
+	    return FALSE;
+    } else if (! _comac_pdf_token_is (data, &token, "trailer")) {
+	return FALSE;
+    }
+
+    _next_token (data, pos, end, partial, &token);
+    if (! _token_equals (data, &token, "<<"))
+	return FALSE;
+
+    object->data = data;
+    object->dict = token.start;
+    object->dict_end = _skip_object (data, token.start, end, partial);
+    if (object->dict_end < 0)
+	return FALSE;
+
+    if (object->id) {
+	pos = _next_token (data, object->dict_end, end, partial, &token);
+	if (token.type == PDF_TOKEN_END)
+	    return FALSE;
+
+	if (_comac_pdf_token_is (data, &token, "stream")) {
+	    if (pos < end && data[pos] == '\r')
+		pos++;
+	    if (pos < end && data[pos] == '\n')
+		pos++;
+	    if (pos == end && partial)
+		return FALSE;
+
+	    object->stream = reader->offset + pos;
+	}
+    }
+
+    return TRUE;
+}
+
+/* Reads the object or trailer at @offset. Its dictionary is in the
+ * buffer until the next read. */
+static comac_status_t
+_comac_pdf_reader_read_object (comac_pdf_reader_t *reader,
+			       long long offset,
+			       comac_pdf_reader_object_t *object)
+{
+    comac_status_t status;
+    long long size;
+
+    object->id = 0;
+    object->stream = -1;
+    object->decoded = NULL;
+    for (size = READ_SIZE;; size *= 2) {
+	status = _comac_pdf_reader_read (reader, offset, size);
+	if (unlikely (status))
+	    return status;
+
+	if (_comac_pdf_reader_parse_object (reader, object))
+	    return COMAC_STATUS_SUCCESS;
+
+	if (reader->eof)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+    }
+}
+
+static comac_status_t
+_inflate (const unsigned char *data,
+	  long long length,
+	  unsigned char **decoded_out,
+	  long long *decoded_length)
+{
+    z_stream zs;
+    unsigned char *decoded, *tmp;
+    long long size;
+    int ret;
+
+    memset (&zs, 0, sizeof (zs));
+    if (inflateInit (&zs) != Z_OK)
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    size = 4 * length + READ_SIZE;
+    decoded = _comac_malloc (size);
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = length;
+    ret = Z_OK;
+    while (decoded) {
+	zs.next_out = decoded + zs.total_out;
+	zs.avail_out = size - zs.total_out;
+	ret = inflate (&zs, Z_NO_FLUSH);
+	if (ret != Z_OK)
+	    break;
+
+	if (zs.avail_out == 0) {
+	    size *= 2;
+	    tmp = realloc (decoded, size);
+	    if (unlikely (tmp == NULL))
+		free (decoded);
+	    decoded = tmp;
+	} else if (zs.avail_in == 0) {
+	    /* Truncated */
+	    ret = Z_DATA_ERROR;
+	    break;
+	}
+    }
+    inflateEnd (&zs);
+
+    if (unlikely (decoded == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    if (ret != Z_STREAM_END) {
+	free (decoded);
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+    }
+
+    *decoded_out = decoded;
+    *decoded_length = zs.total_out;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Reads the data of the stream @object, which must be unfiltered or
+ * use /FlateDecode without parameters. @object is no longer valid
+ * afterwards. */
+static comac_status_t
+_comac_pdf_reader_read_stream (comac_pdf_reader_t *reader,
+			       comac_pdf_reader_object_t *object,
+			       unsigned char **data_out,
+			       long long *length_out)
+{
+    comac_status_t status;
+    long long length;
+    comac_bool_t flate;
+
+    if (object->stream < 0 || ! _dict_get_int (object, "/Length", &length) ||
+	length < 0 || length > reader->length - object->stream ||
+	_dict_lookup (object, "/DecodeParms") >= 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    flate = _dict_has_name (object, "/Filter", "/FlateDecode");
+    if (! flate && _dict_lookup (object, "/Filter") >= 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    status = _comac_pdf_reader_read (reader, object->stream, length);
+    if (unlikely (status))
+	return status;
+
+    if (reader->end != length)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    if (flate)
+	return _inflate (reader->buffer, length, data_out, length_out);
+
+    *data_out = _comac_malloc (length + 1);
+    if (unlikely (*data_out == NULL))
+	return _comac_error (COMAC_STATUS_NO_MEMORY);
+
+    memcpy (*data_out, reader->buffer, length);
+    *length_out = length;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Takes the entries of the trailer that are not already known from a
+ * newer one. */
+static comac_status_t
+_comac_pdf_reader_read_trailer (comac_pdf_reader_t *reader,
+				comac_pdf_reader_object_t *trailer,
+				comac_pdf_update_t *update,
+				long long *prev)
+{
+    long long size;
+
+    if (_dict_lookup (trailer, "/Encrypt") >= 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    if (update->size == 0) {
+	if (! _dict_get_int (trailer, "/Size", &size) || size < 1 ||
+	    size > INT_MAX)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	update->size = size;
+    }
+
+    if (update->catalog == 0)
+	_dict_get_ref (trailer, "/Root", &update->catalog);
+
+    if (update->info == 0)
+	_dict_get_ref (trailer, "/Info", &update->info);
+
+    if (! _dict_get_int (trailer, "/Prev", prev))
+	*prev = -1;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Reads the subsection headers of the table whose first subsection
+ * starts at @offset, just after the xref keyword, and its trailer. */
+static comac_status_t
+_comac_pdf_reader_read_xref_table (comac_pdf_reader_t *reader,
+				   long long offset,
+				   comac_pdf_xref_section_t *section,
+				   comac_pdf_update_t *update,
+				   long long *prev)
+{
+    comac_pdf_xref_subsection_t subsection;
+    comac_pdf_reader_object_t trailer;
+    comac_pdf_token_t first, count, entry;
+    comac_status_t status;
+    long long pos;
+
+    for (;;) {
+	status = _comac_pdf_reader_read (reader, offset, READ_SIZE);
+	if (unlikely (status))
+	    return status;
+
+	pos = _next_token (reader->buffer,
+			   0,
+			   reader->end,
+			   ! reader->eof,
+			   &first);
+	if (_comac_pdf_token_is (reader->buffer, &first, "trailer")) {
+	    status = _comac_pdf_reader_read_object (reader,
+						    offset + first.start,
+						    &trailer);
+	    if (unlikely (status))
+		return status;
+
+	    return _comac_pdf_reader_read_trailer (reader,
+						   &trailer,
+						   update,
+						   prev);
+	}
+
+	pos = _next_token (reader->buffer,
+			   pos,
+			   reader->end,
+			   ! reader->eof,
+			   &count);
+	if (first.type != PDF_TOKEN_INTEGER ||
+	    count.type != PDF_TOKEN_INTEGER || first.value < 0 ||
+	    count.value < 0 || first.value + count.value > INT_MAX)
+	    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	/* The entries start right after the end of line */
+	_next_token (reader->buffer, pos, reader->end, ! reader->eof, &entry);
+	subsection.first = first.value;
+	subsection.count = count.value;
+	subsection.offset = offset + (count.value ? entry.start : pos);
+	status = _comac_array_append (&section->subsections, &subsection);
+	if (unlikely (status))
+	    return status;
+
+	offset = subsection.offset + XREF_ENTRY_SIZE * count.value;
+    }
+}
+
+/* Reads the cross-reference stream at @offset. The entries are
+ * decoded into the section. */
+static comac_status_t
+_comac_pdf_reader_read_xref_stream (comac_pdf_reader_t *reader,
+				    long long offset,
+				    comac_pdf_xref_section_t *section,
+				    comac_pdf_update_t *update,
+				    long long *prev)
+{
+    comac_pdf_xref_subsection_t subsection;
+    comac_pdf_reader_object_t object;
+    comac_array_t w, index;
+    comac_status_t status;
+    long long size, length, row;
+    int i, row_size, num_index;
+
+    _comac_array_init (&w, sizeof (int));
+    _comac_array_init (&index, sizeof (int));
+
+    status = _comac_pdf_reader_read_object (reader, offset, &object);
+    if (unlikely (status))
+	goto BAIL;
+
+    if (! _dict_has_name (&object, "/Type", "/XRef") ||
+	! _dict_get_int (&object, "/Size", &size) || size < 0 ||
+	size > INT_MAX)
+    {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+	goto BAIL;
+    }
+
+    status = _dict_get_array (&object, "/W", FALSE, &w);
+    if (unlikely (status))
+	goto BAIL;
+
+    if (_dict_lookup (&object, "/Index") >= 0) {
+	status = _dict_get_array (&object, "/Index", FALSE, &index);
+    } else {
+	i = 0;
+	status = _comac_array_append (&index, &i);
+	if (status == COMAC_STATUS_SUCCESS) {
+	    i = size;
+	    status = _comac_array_append (&index, &i);
+	}
+    }
+    if (unlikely (status))
+	goto BAIL;
+
+    status = _comac_pdf_reader_read_trailer (reader, &object, update, prev);
+    if (unlikely (status))
+	goto BAIL;
+
+    if (_comac_array_num_elements (&w) != 3) {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+	goto BAIL;
+    }
+    row_size = 0;
+    for (i = 0; i < 3; i++) {
+	_comac_array_copy_element (&w, i, &section->w[i]);
+	if (section->w[i] > 8) {
+	    status = _comac_error (COMAC_STATUS_READ_ERROR);
+	    goto BAIL;
+	}
+	row_size += section->w[i];
+    }
+
+    status = _comac_pdf_reader_read_stream (reader,
+					    &object,
+					    &section->data,
+					    &length);
+    if (unlikely (status))
+	goto BAIL;
+
+    num_index = _comac_array_num_elements (&index);
+    if (num_index % 2) {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+	goto BAIL;
+    }
+    row = 0;
+    for (i = 0; i < num_index; i += 2) {
+	_comac_array_copy_element (&index, i, &subsection.first);
+	_comac_array_copy_element (&index, i + 1, &subsection.count);
+	subsection.offset = row * row_size;
+	row += subsection.count;
+	status = _comac_array_append (&section->subsections, &subsection);
+	if (unlikely (status))
+	    goto BAIL;
+    }
+    if (row * row_size > length)
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+
+BAIL:
+    _comac_array_fini (&w);
+    _comac_array_fini (&index);
+
+    return status;
+}
+
+/* Adds the cross-reference section at @offset to the sections of
+ * @reader and returns the offset of the previous one in @prev, or -1
+ * if it is the first. */
+static comac_status_t
+_comac_pdf_reader_read_xref (comac_pdf_reader_t *reader,
+			     long long offset,
+			     comac_pdf_update_t *update,
+			     long long *prev)
+{
+    comac_pdf_xref_section_t section;
+    comac_pdf_token_t token;
+    comac_status_t status;
+    long long pos;
+
+    section.offset = offset;
+    section.data = NULL;
+    _comac_array_init (&section.subsections,
+		       sizeof (comac_pdf_xref_subsection_t));
+
+    status = _comac_pdf_reader_read (reader, offset, READ_SIZE);
+    if (unlikely (status))
+	return status;
+
+    pos = _next_token (reader->buffer, 0, reader->end, FALSE, &token);
+    if (token.start == 0 &&
+	_comac_pdf_token_is (reader->buffer, &token, "xref"))
+    {
+	status = _comac_pdf_reader_read_xref_table (reader,
+						    offset + pos,
+						    &section,
+						    update,
+						    prev);
+    } else {
+	status = _comac_pdf_reader_read_xref_stream (reader,
+						     offset,
+						     &section,
+						     update,
+						     prev);
+    }
+    if (status == COMAC_STATUS_SUCCESS)
+	status = _comac_array_append (&reader->sections, &section);
+    if (unlikely (status))
+	_comac_pdf_xref_section_fini (&section);
+
+    return status;
+}
+
+/* Finds the newest cross-reference entry of object @id. @type is 1
+ * for an object at offset @field2, and 2 for the object with index
+ * @field3 in object stream @field2. */
+static comac_status_t
+_comac_pdf_reader_find (comac_pdf_reader_t *reader,
+			int id,
+			int *type,
+			long long *field2,
+			int *field3)
+{
+    comac_pdf_xref_section_t *section;
+    comac_pdf_xref_subsection_t *subsection;
+    comac_pdf_token_t offset, gen, keyword;
+    comac_status_t status;
+    const unsigned char *row;
+    long long pos, fields[3];
+    int i, j, k, n, num_sections, num_subsections;
+
+    num_sections = _comac_array_num_elements (&reader->sections);
+    for (i = 0; i < num_sections; i++) {
+	section = _comac_array_index (&reader->sections, i);
+	num_subsections = _comac_array_num_elements (&section->subsections);
+	for (j = 0; j < num_subsections; j++) {
+	    subsection = _comac_array_index (&section->subsections, j);
+	    if (id < subsection->first ||
+		id - subsection->first >= subsection->count)
+		continue;
+
+	    if (section->data == NULL) {
+		status = _comac_pdf_reader_read (
+		    reader,
+		    subsection->offset +
+			XREF_ENTRY_SIZE * (id - subsection->first),
+		    XREF_ENTRY_SIZE);
+		if (unlikely (status))
+		    return status;
+
+		pos = _comac_pdf_next_token (reader->buffer,
+					     0,
+					     reader->end,
+					     &offset);
+		pos = _comac_pdf_next_token (reader->buffer,
+					     pos,
+					     reader->end,
+					     &gen);
+		_comac_pdf_next_token (reader->buffer,
+				       pos,
+				       reader->end,
+				       &keyword);
+		if (offset.type != PDF_TOKEN_INTEGER ||
+		    gen.type != PDF_TOKEN_INTEGER)
+		    return _comac_error (COMAC_STATUS_READ_ERROR);
+
+		if (_comac_pdf_token_is (reader->buffer, &keyword, "n"))
+		    *type = 1;
+		else
+		    *type = 0;
+		*field2 = offset.value;
+		*field3 = 0;
+	    } else {
+		row = section->data + subsection->offset +
+		      (section->w[0] + section->w[1] + section->w[2]) *
+			  (long long) (id - subsection->first);
+		for (k = 0; k < 3; k++) {
+		    fields[k] = 0;
+		    for (n = 0; n < section->w[k]; n++)
+			fields[k] = fields[k] << 8 | *row++;
+		}
+		*type = section->w[0] ? fields[0] : 1;
+		*field2 = fields[1];
+		*field3 = fields[2];
+	    }
+
+	    if (*type != 1 && *type != 2)
+		return _comac_error (COMAC_STATUS_READ_ERROR);
+
+	    return COMAC_STATUS_SUCCESS;
+	}
+    }
+
+    return _comac_error (COMAC_STATUS_READ_ERROR);
+}
+
+static void
+_comac_pdf_reader_object_fini (comac_pdf_reader_object_t *object)
+{
+    free (object->decoded);
+}
+
+/* Reads object @id, which must be a dictionary. */
+static comac_status_t
+_comac_pdf_reader_get_object (comac_pdf_reader_t *reader,
+			      int id,
+			      comac_pdf_reader_object_t *object)
+{
+    comac_pdf_reader_object_t stream;
+    comac_pdf_token_t token;
+    comac_status_t status;
+    long long offset = 0, n, first, length, pos;
+    int type, index, i;
+
+    status = _comac_pdf_reader_find (reader, id, &type, &offset, &index);
+    if (unlikely (status))
+	return status;
+
+    if (type == 1) {
+	status = _comac_pdf_reader_read_object (reader, offset, object);
+	if (status == COMAC_STATUS_SUCCESS && object->id != id)
+	    status = _comac_error (COMAC_STATUS_READ_ERROR);
+
+	return status;
+    }
+
+    /* Compressed, index in object stream offset */
+    if (offset > INT_MAX)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    status = _comac_pdf_reader_get_object (reader, offset, &stream);
+    if (unlikely (status))
+	return status;
+
+    if (stream.decoded != NULL ||
+	! _dict_has_name (&stream, "/Type", "/ObjStm") ||
+	! _dict_get_int (&stream, "/N", &n) ||
+	! _dict_get_int (&stream, "/First", &first) || index >= n)
+    {
+	_comac_pdf_reader_object_fini (&stream);
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+    }
+
+    object->id = id;
+    object->stream = -1;
+    status = _comac_pdf_reader_read_stream (reader,
+					    &stream,
+					    &object->decoded,
+					    &length);
+    if (unlikely (status))
+	return status;
+
+    object->data = object->decoded;
+    if (first < 0 || first > length)
+	goto READ_ERROR;
+
+    /* The stream starts with pairs of object number and offset */
+    pos = 0;
+    for (i = 0; i <= index; i++) {
+	pos = _comac_pdf_next_token (object->data, pos, first, &token);
+	if (token.type != PDF_TOKEN_INTEGER)
+	    goto READ_ERROR;
+
+	if (i == index && token.value != id)
+	    goto READ_ERROR;
+
+	pos = _comac_pdf_next_token (object->data, pos, first, &token);
+	if (token.type != PDF_TOKEN_INTEGER || token.value < 0 ||
+	    token.value > length - first)
+	    goto READ_ERROR;
+    }
+
+    _comac_pdf_next_token (object->data,
+			   first + token.value,
+			   length,
+			   &token);
+    if (! _token_equals (object->data, &token, "<<"))
+	goto READ_ERROR;
+
+    object->dict = token.start;
+    object->dict_end = _skip_object (object->data, token.start, length, FALSE);
+    if (object->dict_end < 0)
+	goto READ_ERROR;
+
+    return COMAC_STATUS_SUCCESS;
+
+READ_ERROR:
+    _comac_pdf_reader_object_fini (object);
+    return _comac_error (COMAC_STATUS_READ_ERROR);
+}
+
+static comac_status_t
+_comac_pdf_reader_read_header (comac_pdf_reader_t *reader,
+			       comac_pdf_update_t *update)
+{
+    comac_status_t status;
+    int minor;
+
+    status = _comac_pdf_reader_read (reader, 0, 8);
+    if (unlikely (status))
+	return status;
+
+    if (reader->end < 8 || memcmp (reader->buffer, "%PDF-", 5) != 0 ||
+	! _comac_isdigit (reader->buffer[5]) || reader->buffer[6] != '.' ||
+	! _comac_isdigit (reader->buffer[7]))
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    minor = reader->buffer[7] - '0';
+    if (reader->buffer[5] > '1' || minor >= 7)
+	update->version = COMAC_PDF_VERSION_1_7;
+    else if (minor == 6)
+	update->version = COMAC_PDF_VERSION_1_6;
+    else if (minor == 5)
+	update->version = COMAC_PDF_VERSION_1_5;
+    else
+	update->version = COMAC_PDF_VERSION_1_4;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Finds the offset given by the last startxref of the file. */
+static comac_status_t
+_comac_pdf_reader_read_startxref (comac_pdf_reader_t *reader,
+				  comac_pdf_update_t *update)
+{
+    comac_pdf_token_t token;
+    comac_status_t status;
+    long long pos;
+
+    status = _comac_pdf_reader_read (reader,
+				     MAX (reader->length - TAIL_SIZE, 0),
+				     TAIL_SIZE);
+    if (unlikely (status))
+	return status;
+
+    for (pos = reader->end - 9; pos >= 0; pos--) {
+	if (memcmp (reader->buffer + pos, "startxref", 9) == 0)
+	    break;
+    }
+    if (pos < 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    _comac_pdf_next_token (reader->buffer, pos + 9, reader->end, &token);
+    if (token.type != PDF_TOKEN_INTEGER || token.value < 0)
+	return _comac_error (COMAC_STATUS_READ_ERROR);
+
+    update->xref_offset = token.value;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Reads the cross-reference sections from the newest to the oldest. */
+static comac_status_t
+_comac_pdf_reader_read_xrefs (comac_pdf_reader_t *reader,
+			      comac_pdf_update_t *update)
+{
+    comac_pdf_xref_section_t *section;
+    comac_status_t status;
+    long long offset, prev;
+    int i, num_sections;
+
+    for (offset = update->xref_offset; offset >= 0; offset = prev) {
+	/* Do not loop forever on a broken /Prev chain */
+	num_sections = _comac_array_num_elements (&reader->sections);
+	for (i = 0; i < num_sections; i++) {
+	    section = _comac_array_index (&reader->sections, i);
+	    if (section->offset == offset)
+		return _comac_error (COMAC_STATUS_READ_ERROR);
+	}
+
+	status = _comac_pdf_reader_read_xref (reader, offset, update, &prev);
+	if (unlikely (status))
+	    return status;
+    }
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+/* Reads the pages from the page tree, which must not have any other
+ * entries, such as inherited attributes, that would have to be kept
+ * when it is written again. */
+static comac_status_t
+_comac_pdf_reader_read_pages (comac_pdf_reader_t *reader,
+			      comac_pdf_update_t *update)
+{
+    comac_pdf_reader_object_t object;
+    comac_pdf_token_t key;
+    comac_status_t status;
+    long long count, pos;
+
+    status = _comac_pdf_reader_get_object (reader, update->catalog, &object);
+    if (unlikely (status))
+	return status;
+
+    if (! _dict_get_ref (&object, "/Pages", &update->pages))
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+    _comac_pdf_reader_object_fini (&object);
+    if (unlikely (status))
+	return status;
+
+    status = _comac_pdf_reader_get_object (reader, update->pages, &object);
+    if (unlikely (status))
+	return status;
+
+    for (pos = object.dict + 2; pos >= 0;) {
+	pos = _dict_next_key (&object, pos, &key);
+	if (pos < 0)
+	    break;
+
+	if (! _token_equals (object.data, &key, "/Type") &&
+	    ! _token_equals (object.data, &key, "/Kids") &&
+	    ! _token_equals (object.data, &key, "/Count"))
+	{
+	    status = _comac_error (COMAC_STATUS_READ_ERROR);
+	    goto BAIL;
+	}
+
+	pos = _skip_object (object.data, pos, object.dict_end, FALSE);
+    }
+
+    if (! _dict_has_name (&object, "/Type", "/Pages") ||
+	! _dict_get_int (&object, "/Count", &count))
+    {
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+	goto BAIL;
+    }
+
+    status = _dict_get_array (&object, "/Kids", TRUE, &update->kids);
+    if (unlikely (status))
+	goto BAIL;
+
+    /* Every page must be a kid of the root */
+    if (count != _comac_array_num_elements (&update->kids))
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+
+BAIL:
+    _comac_pdf_reader_object_fini (&object);
+
+    return status;
+}
+
+comac_status_t
+_comac_pdf_update_init (comac_pdf_update_t *update, const char *filename)
+{
+    comac_pdf_reader_t reader;
+    comac_status_t status;
+
+    update->xref_offset = -1;
+    update->size = 0;
+    update->catalog = 0;
+    update->info = 0;
+    update->pages = 0;
+    _comac_array_init (&update->kids, sizeof (int));
+
+    status = _comac_pdf_reader_init (&reader, filename);
+    if (unlikely (status))
+	return status;
+
+    update->length = reader.length;
+    status = _comac_pdf_reader_read_header (&reader, update);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = _comac_pdf_reader_read_startxref (&reader, update);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = _comac_pdf_reader_read_xrefs (&reader, update);
+    if (status == COMAC_STATUS_SUCCESS && update->catalog == 0)
+	status = _comac_error (COMAC_STATUS_READ_ERROR);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = _comac_pdf_reader_read_pages (&reader, update);
+
+    _comac_pdf_reader_fini (&reader);
+    if (unlikely (status))
+	_comac_array_fini (&update->kids);
+
+    return status;
+}
+
+void
+_comac_pdf_update_fini (comac_pdf_update_t *update)
+{
+    _comac_array_fini (&update->kids);
+}
@@ -92,10 +92,121 @@ comac_pdf_surface_create_for_stream2 (comac_write_func_t write_func,
 				      double width_in_points,
 				      double height_in_points);
 
+comac_public comac_surface_t *
+comac_pdf_surface_create_for_update (const char *filename,
+				     double width_in_points,
+				     double height_in_points);
+
 comac_public void
 comac_pdf_surface_restrict_to_version (comac_surface_t *surface,
 				       comac_pdf_version_t version);
 
+/**
+ * comac_pdf_compression_t:
+ * @COMAC_PDF_COMPRESSION_DEFAULT: Balance output size and speed. (Since TBD)
+ * @COMAC_PDF_COMPRESSION_FAST: Compress as fast as possible. (Since TBD)
+ * @COMAC_PDF_COMPRESSION_SMALL: Produce the smallest output. (Since TBD)
+ *
+ * #comac_pdf_compression_t is used by
+ * comac_pdf_surface_set_compression() to select the trade-off between
+ * compression speed and output size for the whole document.
+ *
+ * Since: TBD
+ **/
+typedef enum _comac_pdf_compression {
+    COMAC_PDF_COMPRESSION_DEFAULT,
+    COMAC_PDF_COMPRESSION_FAST,
+    COMAC_PDF_COMPRESSION_SMALL
+} comac_pdf_compression_t;
+
+/**
+ * comac_pdf_stream_type_t:
+ * @COMAC_PDF_STREAM_TYPE_CONTENT: Page content, pattern and form
+ * streams. (Since TBD)
+ * @COMAC_PDF_STREAM_TYPE_IMAGE: Image and soft mask streams. (Since TBD)
+ * @COMAC_PDF_STREAM_TYPE_FONT: Embedded font subsets and their
+ * associated streams. (Since TBD)
+ *
+ * #comac_pdf_stream_type_t is used by
+ * comac_pdf_surface_set_stream_compression() to select which streams a
+ * compression setting applies to.
+ *
+ * Since: TBD
+ **/
+typedef enum _comac_pdf_stream_type {
+    COMAC_PDF_STREAM_TYPE_CONTENT,
+    COMAC_PDF_STREAM_TYPE_IMAGE,
+    COMAC_PDF_STREAM_TYPE_FONT
+} comac_pdf_stream_type_t;
+
+/**
+ * comac_pdf_compression_strategy_t:
+ * @COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT: The default strategy, suitable
+ * for most data. (Since TBD)
+ * @COMAC_PDF_COMPRESSION_STRATEGY_FILTERED: Favour Huffman coding over
+ * string matching, for data with many small distinct values. (Since TBD)
+ * @COMAC_PDF_COMPRESSION_STRATEGY_HUFFMAN_ONLY: Use Huffman coding
+ * only. (Since TBD)
+ * @COMAC_PDF_COMPRESSION_STRATEGY_RLE: Limit string matching to runs of
+ * identical bytes. This is fast and works well for flat images. (Since TBD)
+ *
+ * #comac_pdf_compression_strategy_t is used by
+ * comac_pdf_surface_set_stream_compression() to tune the compressor to
+ * the kind of data in a stream.
+ *
+ * Since: TBD
+ **/
+typedef enum _comac_pdf_compression_strategy {
+    COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT,
+    COMAC_PDF_COMPRESSION_STRATEGY_FILTERED,
+    COMAC_PDF_COMPRESSION_STRATEGY_HUFFMAN_ONLY,
+    COMAC_PDF_COMPRESSION_STRATEGY_RLE
+} comac_pdf_compression_strategy_t;
+
+comac_public void
+comac_pdf_surface_set_compression (comac_surface_t *surface,
+				   comac_pdf_compression_t compression);
+
+comac_public void
+comac_pdf_surface_set_stream_compression (
+    comac_surface_t *surface,
+    comac_pdf_stream_type_t type,
+    int level,
+    comac_pdf_compression_strategy_t strategy);
+
+comac_public void
+comac_pdf_surface_set_deduplicate_images (comac_surface_t *surface,
+					  comac_bool_t deduplicate);
+
+comac_public void
+comac_pdf_surface_set_image_predictor (comac_surface_t *surface,
+				       comac_bool_t predictor);
+
+comac_public void
+comac_pdf_surface_set_streaming (comac_surface_t *surface,
+				 comac_bool_t streaming);
+
+comac_public void
+comac_pdf_surface_set_linearize (comac_surface_t *surface,
+				 comac_bool_t linearize);
+
+comac_public void
+comac_pdf_surface_set_write_thread (comac_surface_t *surface,
+				    comac_bool_t write_thread);
+
+comac_public void
+comac_pdf_surface_set_font_subset_cache (comac_surface_t *surface,
+					 comac_bool_t cache);
+
+comac_public comac_surface_t *
+comac_pdf_surface_create_page (comac_surface_t *document,
+			       double width_in_points,
+			       double height_in_points);
+
+comac_public void
+comac_pdf_surface_append_page (comac_surface_t *document,
+			       comac_surface_t *page);
+
 comac_public void
 comac_pdf_get_versions (comac_pdf_version_t const **versions,
 			int *num_versions);
@@ -179,6 +290,10 @@ comac_pdf_surface_set_thumbnail_size (comac_surface_t *surface,
 				      int width,
 				      int height);
 
+comac_public void
+comac_pdf_surface_set_compression_threads (comac_surface_t *surface,
+					   int num_threads);
+
 COMAC_END_DECLS
 
 #else /* COMAC_HAS_PDF_SURFACE */
@@ -374,6 +374,7 @@ write_png (comac_surface_t *surface, png_rw_ptr write_func, void *closure)
 	break;
     case COMAC_FORMAT_INVALID:
     case COMAC_FORMAT_RGB16_565:
+    case COMAC_FORMAT_CMYKA:
     default:
 	status = _comac_error (COMAC_STATUS_INVALID_FORMAT);
 	goto BAIL4;
@@ -189,6 +189,11 @@ _comac_recording_surface_replay_and_create_regions (
     const comac_matrix_t *surface_transform,
     comac_surface_t *target,
     comac_bool_t surface_is_unbounded);
+comac_private comac_int_status_t
+_comac_recording_surface_analyze_native (comac_surface_t *surface,
+					 comac_surface_t *target,
+					 comac_bool_t *is_native);
+
 comac_private comac_status_t
 _comac_recording_surface_replay_region (
     comac_surface_t *surface,
@@ -81,6 +81,7 @@
 #include "comac-array-private.h"
 #include "comac-analysis-surface-private.h"
 #include "comac-clip-private.h"
+#include "comac-clip-inline.h"
 #include "comac-combsort-inline.h"
 #include "comac-composite-rectangles-private.h"
 #include "comac-default-context-private.h"
@@ -2316,6 +2317,156 @@ _comac_recording_surface_replay_and_create_regions (
 	&params);
 }
 
+/* A shortcut for _comac_recording_surface_replay_and_create_regions()
+ * on the common page that needs no fallback images. Each command that
+ * is visible on @target is handed straight to its backend, which must
+ * be analysing, without an analysis surface in between to compute the
+ * extents and regions of the operations. If the backend supports every
+ * command natively, all of them are marked for the native region and
+ * @is_native is set to %TRUE.
+ *
+ * Otherwise @is_native is set to %FALSE and the regions are left as
+ * they were, and the caller has to run the full analysis. This is also
+ * the case for commands which need more than a yes or no from the
+ * backend: tags, recording surface patterns and operations that are
+ * only supported without transparency.
+ */
+comac_int_status_t
+_comac_recording_surface_analyze_native (comac_surface_t *abstract_surface,
+					 comac_surface_t *target,
+					 comac_bool_t *is_native)
+{
+    comac_recording_surface_t *surface =
+	(comac_recording_surface_t *) abstract_surface;
+    const comac_surface_backend_t *backend = target->backend;
+    comac_command_t **elements, *command;
+    comac_rectangle_int_t extents;
+    comac_int_status_t status;
+    unsigned int i, num_elements;
+
+    *is_native = FALSE;
+
+    if (unlikely (surface->base.status))
+	return surface->base.status;
+
+    if (unlikely (target->status))
+	return target->status;
+
+    if (unlikely (surface->base.finished))
+	return _comac_error (COMAC_STATUS_SURFACE_FINISHED);
+
+    /* An empty page is quickest to analyse the usual way. */
+    if (surface->base.is_clear)
+	return COMAC_STATUS_SUCCESS;
+
+    if (! _comac_surface_get_extents (target, &extents))
+	return COMAC_STATUS_SUCCESS;
+
+    if (! surface->unbounded)
+	_comac_rectangle_intersect (&extents, &surface->extents);
+
+    num_elements = surface->commands.num_elements;
+    elements = _comac_array_index (&surface->commands, 0);
+    for (i = 0; i < num_elements; i++) {
+	command = elements[i];
+
+	if (command->header.type != COMAC_COMMAND_TAG &&
+	    (! _comac_rectangle_intersects (&extents,
+					    &command->header.extents) ||
+	     _comac_clip_is_all_clipped (command->header.clip)))
+	    continue;
+
+	status = COMAC_INT_STATUS_UNSUPPORTED;
+	switch (command->header.type) {
+	case COMAC_COMMAND_PAINT:
+	    if (backend->paint != NULL)
+		status = backend->paint (target,
+					 command->header.op,
+					 &command->paint.source.base,
+					 command->header.clip);
+	    break;
+
+	case COMAC_COMMAND_MASK:
+	    if (backend->mask != NULL)
+		status = backend->mask (target,
+					command->header.op,
+					&command->mask.source.base,
+					&command->mask.mask.base,
+					command->header.clip);
+	    break;
+
+	case COMAC_COMMAND_STROKE:
+	    if (backend->stroke != NULL)
+		status = backend->stroke (target,
+					  command->header.op,
+					  &command->stroke.source.base,
+					  &command->stroke.path,
+					  &command->stroke.style,
+					  &command->stroke.ctm,
+					  &command->stroke.ctm_inverse,
+					  command->stroke.tolerance,
+					  command->stroke.antialias,
+					  command->header.clip);
+	    break;
+
+	case COMAC_COMMAND_FILL:
+	    if (backend->fill != NULL)
+		status = backend->fill (target,
+					command->header.op,
+					&command->fill.source.base,
+					&command->fill.path,
+					command->fill.fill_rule,
+					command->fill.tolerance,
+					command->fill.antialias,
+					command->header.clip);
+	    break;
+
+	case COMAC_COMMAND_SHOW_TEXT_GLYPHS:
+	    if (backend->show_text_glyphs != NULL)
+		status = backend->show_text_glyphs (
+		    target,
+		    command->header.op,
+		    &command->show_text_glyphs.source.base,
+		    command->show_text_glyphs.utf8,
+		    command->show_text_glyphs.utf8_len,
+		    command->show_text_glyphs.glyphs,
+		    command->show_text_glyphs.num_glyphs,
+		    command->show_text_glyphs.clusters,
+		    command->show_text_glyphs.num_clusters,
+		    command->show_text_glyphs.cluster_flags,
+		    command->show_text_glyphs.scaled_font,
+		    command->header.clip);
+	    if (status == COMAC_INT_STATUS_UNSUPPORTED &&
+		backend->show_glyphs != NULL)
+		status = backend->show_glyphs (
+		    target,
+		    command->header.op,
+		    &command->show_text_glyphs.source.base,
+		    command->show_text_glyphs.glyphs,
+		    command->show_text_glyphs.num_glyphs,
+		    command->show_text_glyphs.scaled_font,
+		    command->header.clip);
+	    break;
+
+	case COMAC_COMMAND_TAG:
+	default:
+	    break;
+	}
+
+	if (_comac_int_status_is_error (status))
+	    return status;
+
+	if (status != COMAC_INT_STATUS_SUCCESS)
+	    return COMAC_STATUS_SUCCESS;
+    }
+
+    for (i = 0; i < num_elements; i++)
+	elements[i]->header.region = COMAC_RECORDING_REGION_NATIVE;
+
+    *is_native = TRUE;
+    return COMAC_STATUS_SUCCESS;
+}
+
 comac_status_t
 _comac_recording_surface_replay_region (
     comac_surface_t *surface,
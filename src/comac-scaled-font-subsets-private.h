@@ -210,6 +210,9 @@ _comac_scaled_font_subsets_enable_latin_subset (
  * mapped to a different utf8 string.
  * @unicode: the unicode character mapped to this glyph by the font backend.
  *
+ * This function may be called concurrently from several threads
+ * sharing @font_subsets.
+ *
  * Return value: %COMAC_STATUS_SUCCESS if successful, or a non-zero
  * value indicating an error. Possible errors include
  * %COMAC_STATUS_NO_MEMORY.
@@ -90,6 +90,9 @@ struct _comac_scaled_font_subsets {
     comac_subsets_type_t type;
     comac_bool_t use_latin_subset;
 
+    /* Serialises glyph mapping for surfaces that share the subsets. */
+    comac_mutex_t mutex;
+
     int max_glyphs_per_unscaled_subset_used;
     comac_hash_table_t *unscaled_sub_fonts;
     comac_sub_font_t *unscaled_sub_fonts_list;
@@ -802,6 +805,8 @@ _comac_scaled_font_subsets_create_internal (comac_subsets_type_t type)
     subsets->scaled_sub_fonts_list = NULL;
     subsets->scaled_sub_fonts_list_end = NULL;
 
+    COMAC_MUTEX_INIT (subsets->mutex);
+
     return subsets;
 }
 
@@ -836,6 +841,8 @@ _comac_scaled_font_subsets_destroy (comac_scaled_font_subsets_t *subsets)
 			       subsets->unscaled_sub_fonts);
     _comac_hash_table_destroy (subsets->unscaled_sub_fonts);
 
+    COMAC_MUTEX_FINI (subsets->mutex);
+
     free (subsets);
 }
 
@@ -846,8 +853,8 @@ _comac_scaled_font_subsets_enable_latin_subset (
     font_subsets->use_latin_subset = use_latin;
 }
 
-comac_status_t
-_comac_scaled_font_subsets_map_glyph (
+static comac_status_t
+_comac_scaled_font_subsets_map_glyph_internal (
     comac_scaled_font_subsets_t *subsets,
     comac_scaled_font_t *scaled_font,
     unsigned long scaled_font_glyph_index,
@@ -1028,6 +1035,30 @@ _comac_scaled_font_subsets_map_glyph (
 				      subset_glyph);
 }
 
+comac_status_t
+_comac_scaled_font_subsets_map_glyph (
+    comac_scaled_font_subsets_t *subsets,
+    comac_scaled_font_t *scaled_font,
+    unsigned long scaled_font_glyph_index,
+    const char *utf8,
+    int utf8_len,
+    comac_scaled_font_subsets_glyph_t *subset_glyph)
+{
+    comac_status_t status;
+
+    COMAC_MUTEX_LOCK (subsets->mutex);
+    status = _comac_scaled_font_subsets_map_glyph_internal (
+	subsets,
+	scaled_font,
+	scaled_font_glyph_index,
+	utf8,
+	utf8_len,
+	subset_glyph);
+    COMAC_MUTEX_UNLOCK (subsets->mutex);
+
+    return status;
+}
+
 static comac_status_t
 _comac_scaled_font_subsets_foreach_internal (
     comac_scaled_font_subsets_t *font_subsets,
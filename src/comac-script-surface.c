@@ -880,6 +880,8 @@ static const char *
 _format_to_string (comac_format_t format)
 {
     switch (format) {
+    case COMAC_FORMAT_CMYKA:
+	return "CMYKA";
     case COMAC_FORMAT_RGBA128F:
 	return "RGBA128F";
     case COMAC_FORMAT_RGB96F:
@@ -1290,6 +1292,12 @@ _write_image_surface (comac_output_stream_t *output,
 	    data += stride;
 	}
 	break;
+    case COMAC_FORMAT_CMYKA:
+	for (row = image->height; row--;) {
+	    _comac_output_stream_write (output, data, 5 * width);
+	    data += stride;
+	}
+	break;
     case COMAC_FORMAT_INVALID:
     default:
 	ASSERT_NOT_REACHED;
@@ -1368,6 +1376,12 @@ _write_image_surface (comac_output_stream_t *output,
 	    data += stride;
 	}
 	break;
+    case COMAC_FORMAT_CMYKA:
+	for (row = image->height; row--;) {
+	    _comac_output_stream_write (output, data, 5 * width);
+	    data += stride;
+	}
+	break;
     case COMAC_FORMAT_INVALID:
     default:
 	ASSERT_NOT_REACHED;
@@ -1484,6 +1498,9 @@ _emit_image_surface (comac_script_surface_t *surface,
 	case COMAC_FORMAT_RGBA128F:
 	    len = clone->width * 16;
 	    break;
+	case COMAC_FORMAT_CMYKA:
+	    len = clone->width * 5;
+	    break;
 	case COMAC_FORMAT_INVALID:
 	default:
 	    ASSERT_NOT_REACHED;
@@ -103,6 +103,13 @@ struct _comac_observation {
 
     /* XXX put interesting stats here! */
 
+    /* conversions of solid colors found in the color cache of the
+     * target, or converted with its callback */
+    struct color_cache {
+	unsigned int hits;
+	unsigned int misses;
+    } color_cache;
+
     struct paint {
 	comac_time_t elapsed;
 	unsigned int count;
@@ -675,6 +675,12 @@ _comac_surface_sync (comac_surface_t *target, int x, int y)
 {
     comac_rectangle_int_t extents;
 
+    /* Vector surfaces only record the operations. Mapping a pixel of
+     * one to an image would paint it back into the page, which then
+     * needs a fallback image. */
+    if (target->is_vector)
+	return;
+
     extents.x = x;
     extents.y = y;
     extents.width = 1;
@@ -1208,13 +1214,19 @@ add_record_glyphs (comac_observation_t *log,
 }
 
 static comac_int_status_t
-_comac_surface_observer_glyphs (void *abstract_surface,
-				comac_operator_t op,
-				const comac_pattern_t *source,
-				comac_glyph_t *glyphs,
-				int num_glyphs,
-				comac_scaled_font_t *scaled_font,
-				const comac_clip_t *clip)
+_comac_surface_observer_show_text_glyphs (
+    void *abstract_surface,
+    comac_operator_t op,
+    const comac_pattern_t *source,
+    const char *utf8,
+    int utf8_len,
+    comac_glyph_t *glyphs,
+    int num_glyphs,
+    const comac_text_cluster_t *clusters,
+    int num_clusters,
+    comac_text_cluster_flags_t cluster_flags,
+    comac_scaled_font_t *scaled_font,
+    const comac_clip_t *clip)
 {
     comac_surface_observer_t *surface = abstract_surface;
     comac_device_observer_t *device = to_device (surface);
@@ -1266,13 +1278,13 @@ _comac_surface_observer_glyphs (void *abstract_surface,
     status = _comac_surface_show_text_glyphs (surface->target,
 					      op,
 					      source,
-					      NULL,
-					      0,
+					      utf8,
+					      utf8_len,
 					      dev_glyphs,
 					      num_glyphs,
-					      NULL,
-					      0,
-					      0,
+					      clusters,
+					      num_clusters,
+					      cluster_flags,
 					      scaled_font,
 					      clip);
     free (dev_glyphs);
@@ -1307,6 +1319,38 @@ _comac_surface_observer_glyphs (void *abstract_surface,
     return COMAC_STATUS_SUCCESS;
 }
 
+static comac_int_status_t
+_comac_surface_observer_glyphs (void *abstract_surface,
+				comac_operator_t op,
+				const comac_pattern_t *source,
+				comac_glyph_t *glyphs,
+				int num_glyphs,
+				comac_scaled_font_t *scaled_font,
+				const comac_clip_t *clip)
+{
+    return _comac_surface_observer_show_text_glyphs (abstract_surface,
+						     op,
+						     source,
+						     NULL,
+						     0,
+						     glyphs,
+						     num_glyphs,
+						     NULL,
+						     0,
+						     0,
+						     scaled_font,
+						     clip);
+}
+
+/* Text is passed on for targets such as PDF to keep it searchable */
+static comac_bool_t
+_comac_surface_observer_has_show_text_glyphs (void *abstract_surface)
+{
+    comac_surface_observer_t *surface = abstract_surface;
+
+    return comac_surface_has_show_text_glyphs (surface->target);
+}
+
 static comac_status_t
 _comac_surface_observer_flush (void *abstract_surface, unsigned flags)
 {
@@ -1472,6 +1516,8 @@ static const comac_surface_backend_t _comac_surface_observer_backend = {
     _comac_surface_observer_fill,
     NULL, /* fill-stroke */
     _comac_surface_observer_glyphs,
+    _comac_surface_observer_has_show_text_glyphs,
+    _comac_surface_observer_show_text_glyphs,
 };
 
 /**
@@ -1979,6 +2025,12 @@ _comac_observation_print (comac_output_stream_t *stream,
     _comac_output_stream_printf (stream,
 				 "sources acquired: %d\n",
 				 log->num_sources_acquired);
+    if (log->color_cache.hits || log->color_cache.misses) {
+	_comac_output_stream_printf (stream,
+				     "color cache: hits %u, misses %u\n",
+				     log->color_cache.hits,
+				     log->color_cache.misses);
+    }
 
     _comac_output_stream_printf (
 	stream,
@@ -2126,12 +2178,39 @@ comac_surface_observer_print (comac_surface_t *abstract_surface,
 	return _comac_error (COMAC_STATUS_SURFACE_TYPE_MISMATCH);
 
     surface = (comac_surface_observer_t *) abstract_surface;
+    _comac_surface_get_color_cache_stats (surface->target,
+					  &surface->log.color_cache.hits,
+					  &surface->log.color_cache.misses);
 
     stream = _comac_output_stream_create (write_func, NULL, closure);
     _comac_observation_print (stream, &surface->log);
     return _comac_output_stream_destroy (stream);
 }
 
+comac_status_t
+comac_surface_observer_get_color_cache_stats (
+    comac_surface_t *abstract_surface,
+    unsigned int *hits,
+    unsigned int *misses)
+{
+    comac_surface_observer_t *surface;
+
+    if (unlikely (abstract_surface->status))
+	return abstract_surface->status;
+
+    if (unlikely (! _comac_surface_is_observer (abstract_surface)))
+	return _comac_error (COMAC_STATUS_SURFACE_TYPE_MISMATCH);
+
+    surface = (comac_surface_observer_t *) abstract_surface;
+    _comac_surface_get_color_cache_stats (surface->target,
+					  &surface->log.color_cache.hits,
+					  &surface->log.color_cache.misses);
+    *hits = surface->log.color_cache.hits;
+    *misses = surface->log.color_cache.misses;
+
+    return COMAC_STATUS_SUCCESS;
+}
+
 double
 comac_surface_observer_elapsed (comac_surface_t *abstract_surface)
 {
@@ -108,6 +108,9 @@ struct _comac_surface {
     comac_rendering_intent_t intent;
     comac_color_convert_cb color_convert;
     void *color_convert_ctx;
+    comac_color_convert_batch_cb color_convert_batch;
+    void *color_convert_batch_ctx;
+    comac_color_cache_t *color_cache;
 };
 
 comac_private comac_surface_t *
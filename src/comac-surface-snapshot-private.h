@@ -46,6 +46,9 @@ struct _comac_surface_snapshot {
     comac_mutex_t mutex;
     comac_surface_t *target;
     comac_surface_t *clone;
+
+    comac_bool_t has_content_hash;
+    uint64_t content_hash[2];
 };
 
 #endif /* COMAC_SURFACE_SNAPSHOT_PRIVATE_H */
@@ -287,6 +287,7 @@ _comac_surface_snapshot (comac_surface_t *surface)
     COMAC_MUTEX_INIT (snapshot->mutex);
     snapshot->target = surface;
     snapshot->clone = NULL;
+    snapshot->has_content_hash = FALSE;
 
     status = _comac_surface_copy_mime_data (&snapshot->base, surface);
     if (unlikely (status)) {
@@ -303,3 +304,60 @@ _comac_surface_snapshot (comac_surface_t *surface)
 
     return &snapshot->base;
 }
+
+/**
+ * _comac_surface_snapshot_get_content_hash:
+ * @surface: a snapshot surface
+ * @hash: return location for the hash
+ *
+ * Computes the hash of the pixel contents of the image @surface is a
+ * snapshot of, see _comac_image_compute_content_hash(). As the contents
+ * of a snapshot never change, the hash is only computed once.
+ *
+ * Return value: %COMAC_INT_STATUS_UNSUPPORTED if @surface is not a
+ * snapshot of an image surface, or an error if the image could not be
+ * acquired.
+ **/
+comac_int_status_t
+_comac_surface_snapshot_get_content_hash (comac_surface_t *surface,
+					  uint64_t hash[2])
+{
+    comac_surface_snapshot_t *snapshot = (comac_surface_snapshot_t *) surface;
+    comac_surface_t *target;
+    comac_image_surface_t *image;
+    void *extra;
+    comac_int_status_t status;
+
+    if (! _comac_surface_is_snapshot (surface))
+	return COMAC_INT_STATUS_UNSUPPORTED;
+
+    COMAC_MUTEX_LOCK (snapshot->mutex);
+    if (snapshot->has_content_hash) {
+	hash[0] = snapshot->content_hash[0];
+	hash[1] = snapshot->content_hash[1];
+	COMAC_MUTEX_UNLOCK (snapshot->mutex);
+	return COMAC_STATUS_SUCCESS;
+    }
+    COMAC_MUTEX_UNLOCK (snapshot->mutex);
+
+    target = _comac_surface_snapshot_get_target (surface);
+    if (target->backend->type != COMAC_SURFACE_TYPE_IMAGE) {
+	comac_surface_destroy (target);
+	return COMAC_INT_STATUS_UNSUPPORTED;
+    }
+
+    status = _comac_surface_acquire_source_image (target, &image, &extra);
+    if (likely (status == COMAC_INT_STATUS_SUCCESS)) {
+	_comac_image_compute_content_hash (image, hash);
+	_comac_surface_release_source_image (target, image, extra);
+
+	COMAC_MUTEX_LOCK (snapshot->mutex);
+	snapshot->content_hash[0] = hash[0];
+	snapshot->content_hash[1] = hash[1];
+	snapshot->has_content_hash = TRUE;
+	COMAC_MUTEX_UNLOCK (snapshot->mutex);
+    }
+    comac_surface_destroy (target);
+
+    return status;
+}
@@ -45,6 +45,7 @@
 #include "comac-device-private.h"
 #include "comac-error-private.h"
 #include "comac-list-inline.h"
+#include "comac-paginated-private.h"
 #include "comac-image-surface-inline.h"
 #include "comac-recording-surface-private.h"
 #include "comac-region-private.h"
@@ -150,6 +151,9 @@
 	COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,                          \
 	comac_default_color_convert_func,                                      \
 	NULL,                                                                  \
+	NULL,                                                                  \
+	NULL,                                                                  \
+	NULL,                                                                  \
     }
 
 /* XXX error object! */
@@ -334,6 +338,164 @@ comac_surface_set_color_conversion_callback (comac_surface_t *surface,
 {
     surface->color_convert = callback;
     surface->color_convert_ctx = ctx;
+    if (surface->color_cache != NULL)
+	_comac_color_cache_clear (surface->color_cache);
+
+    /* The backend of a paginated surface converts its colors */
+    if (_comac_surface_is_paginated (surface) && ! surface->finished) {
+	comac_surface_set_color_conversion_callback (
+	    _comac_paginated_surface_get_target (surface),
+	    callback,
+	    ctx);
+    }
+}
+
+/**
+ * comac_surface_set_color_conversion_batch_callback:
+ * @surface: a #comac_surface_t
+ * @callback: the function converting many colors at once, or %NULL
+ * @ctx: the last argument passed to @callback
+ *
+ * Sets the function used where @surface converts a number of colors
+ * together, such as the stops of a gradient or the colors of a mesh
+ * pattern, so that they are converted in one call instead of calling
+ * the callback set with comac_surface_set_color_conversion_callback()
+ * for each of them.
+ *
+ * If @callback is %NULL the colors are converted one at a time. The
+ * default is %NULL.
+ *
+ * Since: TBD
+ **/
+comac_public void
+comac_surface_set_color_conversion_batch_callback (
+    comac_surface_t *surface,
+    comac_color_convert_batch_cb callback,
+    void *ctx)
+{
+    if (unlikely (surface->status))
+	return;
+
+    surface->color_convert_batch = callback;
+    surface->color_convert_batch_ctx = ctx;
+    if (surface->color_cache != NULL)
+	_comac_color_cache_clear (surface->color_cache);
+
+    if (_comac_surface_is_paginated (surface) && ! surface->finished) {
+	comac_surface_set_color_conversion_batch_callback (
+	    _comac_paginated_surface_get_target (surface),
+	    callback,
+	    ctx);
+    }
+}
+
+/* Converts a single color, as for a solid pattern. The conversions
+ * are remembered for the life of @surface as the callback may be
+ * expensive and documents tend to use the same few colors. */
+void
+_comac_surface_convert_color (comac_surface_t *surface,
+			      comac_colorspace_t from_colorspace,
+			      const double *from_data,
+			      comac_colorspace_t to_colorspace,
+			      double *to_data)
+{
+    if (surface->color_cache == NULL) {
+	surface->color_cache = _comac_color_cache_create ();
+	if (unlikely (surface->color_cache == NULL)) {
+	    _comac_surface_convert_colors (surface,
+					   from_colorspace,
+					   from_data,
+					   to_colorspace,
+					   to_data,
+					   COMAC_COLOR_LAYOUT_DOUBLE,
+					   1);
+	    return;
+	}
+    }
+
+    if (_comac_color_cache_lookup (surface->color_cache,
+				   from_colorspace,
+				   from_data,
+				   to_colorspace,
+				   surface->intent,
+				   to_data))
+	return;
+
+    _comac_surface_convert_colors (surface,
+				   from_colorspace,
+				   from_data,
+				   to_colorspace,
+				   to_data,
+				   COMAC_COLOR_LAYOUT_DOUBLE,
+				   1);
+    _comac_color_cache_insert (surface->color_cache,
+			       from_colorspace,
+			       from_data,
+			       to_colorspace,
+			       surface->intent,
+			       to_data);
+}
+
+/* Returns the number of conversions of _comac_surface_convert_color()
+ * found in the cache of @surface and the number that were not, for the
+ * backend of a paginated surface. The paginated surface takes over the
+ * cache of its backend when it is finished. */
+void
+_comac_surface_get_color_cache_stats (comac_surface_t *surface,
+				      unsigned int *hits,
+				      unsigned int *misses)
+{
+    if (_comac_surface_is_paginated (surface) && ! surface->finished)
+	surface = _comac_paginated_surface_get_target (surface);
+
+    *hits = *misses = 0;
+    if (surface->color_cache != NULL)
+	_comac_color_cache_get_stats (surface->color_cache, hits, misses);
+}
+
+/* Converts @num_colors packed colors with the conversion callbacks of
+ * @surface, in a single call if it has a batch callback. */
+void
+_comac_surface_convert_colors (comac_surface_t *surface,
+			       comac_colorspace_t from_colorspace,
+			       const void *from_data,
+			       comac_colorspace_t to_colorspace,
+			       void *to_data,
+			       comac_color_layout_t layout,
+			       unsigned int num_colors)
+{
+    if (num_colors == 0)
+	return;
+
+    if (surface->color_convert_batch != NULL) {
+	surface->color_convert_batch (from_colorspace,
+				      from_data,
+				      to_colorspace,
+				      to_data,
+				      layout,
+				      num_colors,
+				      surface->intent,
+				      surface->color_convert_batch_ctx);
+    } else if (surface->color_convert != NULL) {
+	_comac_color_convert_batch (surface->color_convert,
+				    surface->color_convert_ctx,
+				    from_colorspace,
+				    from_data,
+				    to_colorspace,
+				    to_data,
+				    layout,
+				    num_colors,
+				    surface->intent);
+    } else {
+	comac_default_color_convert_batch_func (from_colorspace,
+						from_data,
+						to_colorspace,
+						to_data,
+						layout,
+						num_colors,
+						surface->intent,
+						NULL);
+    }
 }
 
 /**
@@ -477,6 +639,9 @@ _comac_surface_init (comac_surface_t *surface,
     surface->intent = intent;
     surface->color_convert = color_convert;
     surface->color_convert_ctx = color_convert_ctx;
+    surface->color_convert_batch = NULL;
+    surface->color_convert_batch_ctx = NULL;
+    surface->color_cache = NULL;
 
     COMAC_REFERENCE_COUNT_INIT (&surface->ref_count, 1);
     surface->status = COMAC_STATUS_SUCCESS;
@@ -1048,6 +1213,8 @@ comac_surface_destroy (comac_surface_t *surface)
     if (surface->damage)
 	_comac_damage_destroy (surface->damage);
 
+    free (surface->color_cache);
+
     _comac_user_data_array_fini (&surface->user_data);
     _comac_user_data_array_fini (&surface->mime_data);
 
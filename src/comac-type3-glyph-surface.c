@@ -59,8 +59,13 @@ _comac_type3_glyph_surface_clipper_intersect_clip_path (
 {
     comac_type3_glyph_surface_t *surface =
 	comac_container_of (clipper, comac_type3_glyph_surface_t, clipper);
+    comac_status_t status;
 
     if (path == NULL) {
+	status = _comac_pdf_operators_flush (&surface->pdf_operators);
+	if (unlikely (status))
+	    return status;
+
 	_comac_output_stream_printf (surface->stream, "Q q\n");
 	return COMAC_STATUS_SUCCESS;
     }
@@ -126,6 +131,10 @@ _comac_type3_glyph_surface_emit_image (comac_type3_glyph_surface_t *surface,
 {
     comac_status_t status;
 
+    status = _comac_pdf_operators_flush (&surface->pdf_operators);
+    if (unlikely (status))
+	return status;
+
     /* The only image type supported by Type 3 fonts are 1-bit masks */
     image = _comac_image_surface_coerce_to_format (image, COMAC_FORMAT_A1);
     status = image->base.status;
@@ -62,6 +62,7 @@ typedef struct _comac_composite_rectangles comac_composite_rectangles_t;
 typedef struct _comac_clip comac_clip_t;
 typedef struct _comac_clip_path comac_clip_path_t;
 typedef struct _comac_color comac_color_t;
+typedef struct _comac_color_cache comac_color_cache_t;
 typedef struct _comac_color_stop comac_color_stop_t;
 typedef struct _comac_contour comac_contour_t;
 typedef struct _comac_contour_chain comac_contour_chain_t;
@@ -222,6 +222,8 @@ _format_to_string (comac_format_t format)
 	return "RGB96F";
     case COMAC_FORMAT_RGBA128F:
 	return "RGBA128F";
+    case COMAC_FORMAT_CMYKA:
+	return "CMYKA";
     case COMAC_FORMAT_A8:
 	return "A8";
     case COMAC_FORMAT_A1:
@@ -409,6 +409,10 @@ typedef enum _comac_content {
  * @COMAC_FORMAT_RGB30: like RGB24 but with 10bpc. (Since 1.12)
  * @COMAC_FORMAT_RGB96F: 3 floats, R, G, B. (Since 1.17.2)
  * @COMAC_FORMAT_RGBA128F: 4 floats, R, G, B, A. (Since 1.17.2)
+ * @COMAC_FORMAT_CMYKA: each pixel is 5 bytes, cyan, magenta, yellow,
+ *   black and alpha in that order. Pre-multiplied alpha is used, as
+ *   with %COMAC_FORMAT_ARGB32. Colors drawn to such a surface are
+ *   converted to CMYK with its color conversion callbacks. (Since TBD)
  *
  * #comac_format_t is used to identify the memory format of
  * image data.
@@ -426,7 +430,8 @@ typedef enum _comac_format {
     COMAC_FORMAT_RGB16_565 = 4,
     COMAC_FORMAT_RGB30 = 5,
     COMAC_FORMAT_RGB96F = 6,
-    COMAC_FORMAT_RGBA128F = 7
+    COMAC_FORMAT_RGBA128F = 7,
+    COMAC_FORMAT_CMYKA = 8
 } comac_format_t;
 
 /**
@@ -2390,6 +2395,11 @@ comac_surface_observer_print (comac_surface_t *surface,
 comac_public double
 comac_surface_observer_elapsed (comac_surface_t *surface);
 
+comac_public comac_status_t
+comac_surface_observer_get_color_cache_stats (comac_surface_t *surface,
+					      unsigned int *hits,
+					      unsigned int *misses);
+
 comac_public comac_status_t
 comac_device_observer_print (comac_device_t *device,
 			     comac_write_func_t write_func,
@@ -2442,6 +2452,44 @@ comac_surface_set_color_conversion_callback (comac_surface_t *surface,
 					     comac_color_convert_cb callback,
 					     void *ctx);
 
+comac_public void
+comac_surface_set_color_conversion_batch_callback (
+    comac_surface_t *surface,
+    comac_color_convert_batch_cb callback,
+    void *ctx);
+
+typedef struct _comac_color_engine comac_color_engine_t;
+
+comac_public comac_color_engine_t *
+comac_color_engine_create (void);
+
+comac_public void
+comac_color_engine_destroy (comac_color_engine_t *engine);
+
+comac_public comac_status_t
+comac_color_engine_set_profile (comac_color_engine_t *engine,
+				comac_colorspace_t colorspace,
+				const unsigned char *data,
+				unsigned long length);
+
+comac_public void
+comac_color_engine_convert_func (comac_colorspace_t from_colorspace,
+				 const double *from_data,
+				 comac_colorspace_t to_colorspace,
+				 double *to_data,
+				 comac_rendering_intent_t intent,
+				 void *ctx);
+
+comac_public void
+comac_color_engine_convert_batch_func (comac_colorspace_t from_colorspace,
+				       const void *from_data,
+				       comac_colorspace_t to_colorspace,
+				       void *to_data,
+				       comac_color_layout_t layout,
+				       unsigned int num_colors,
+				       comac_rendering_intent_t intent,
+				       void *ctx);
+
 /**
  * comac_surface_type_t:
  * @COMAC_SURFACE_TYPE_IMAGE: The surface is of type image, since 1.2
@@ -406,6 +406,9 @@ _comac_hash_string (const char *c);
 comac_private uintptr_t
 _comac_hash_bytes (uintptr_t hash, const void *bytes, unsigned int length);
 
+comac_private void
+_comac_hash128_bytes (uint64_t hash[2], const void *bytes, size_t length);
+
 /* We use bits 24-27 to store phases for subpixel positions */
 #define _comac_scaled_glyph_index(g)                                           \
     ((unsigned long) ((g)->hash_entry.hash & 0xffffff))
@@ -436,6 +439,9 @@ _comac_ft_font_reset_static_data (void);
 comac_private void
 _comac_win32_font_reset_static_data (void);
 
+comac_private void
+_comac_pdf_font_cache_reset_static_data (void);
+
 /* the font backend interface */
 
 struct _comac_unscaled_font_backend {
@@ -840,6 +846,48 @@ _comac_color_stop_equal (const comac_color_stop_t *color_a,
 comac_private comac_content_t
 _comac_color_get_content (const comac_color_t *color) comac_pure;
 
+/* comac-colormanagement.c */
+comac_private int
+_comac_colorspace_num_components (comac_colorspace_t colorspace) comac_const;
+
+comac_private comac_color_cache_t *
+_comac_color_cache_create (void);
+
+comac_private void
+_comac_color_cache_clear (comac_color_cache_t *cache);
+
+comac_private comac_bool_t
+_comac_color_cache_lookup (comac_color_cache_t *cache,
+			   comac_colorspace_t from_colorspace,
+			   const double *from_data,
+			   comac_colorspace_t to_colorspace,
+			   comac_rendering_intent_t intent,
+			   double *to_data);
+
+comac_private void
+_comac_color_cache_insert (comac_color_cache_t *cache,
+			   comac_colorspace_t from_colorspace,
+			   const double *from_data,
+			   comac_colorspace_t to_colorspace,
+			   comac_rendering_intent_t intent,
+			   const double *to_data);
+
+comac_private void
+_comac_color_cache_get_stats (const comac_color_cache_t *cache,
+			      unsigned int *hits,
+			      unsigned int *misses);
+
+comac_private void
+_comac_color_convert_batch (comac_color_convert_cb convert,
+			    void *ctx,
+			    comac_colorspace_t from_colorspace,
+			    const void *from_data,
+			    comac_colorspace_t to_colorspace,
+			    void *to_data,
+			    comac_color_layout_t layout,
+			    unsigned int num_colors,
+			    comac_rendering_intent_t intent);
+
 /* comac-font-face.c */
 
 extern const comac_private comac_font_face_t _comac_font_face_nil;
@@ -1401,6 +1449,27 @@ _comac_surface_init (comac_surface_t *surface,
 		     comac_color_convert_cb color_cb,
 		     void *color_callback_context);
 
+comac_private void
+_comac_surface_convert_color (comac_surface_t *surface,
+			      comac_colorspace_t from_colorspace,
+			      const double *from_data,
+			      comac_colorspace_t to_colorspace,
+			      double *to_data);
+
+comac_private void
+_comac_surface_get_color_cache_stats (comac_surface_t *surface,
+				      unsigned int *hits,
+				      unsigned int *misses);
+
+comac_private void
+_comac_surface_convert_colors (comac_surface_t *surface,
+			       comac_colorspace_t from_colorspace,
+			       const void *from_data,
+			       comac_colorspace_t to_colorspace,
+			       void *to_data,
+			       comac_color_layout_t layout,
+			       unsigned int num_colors);
+
 comac_private void
 _comac_surface_set_font_options (comac_surface_t *surface,
 				 comac_font_options_t *options);
@@ -1498,6 +1567,10 @@ _comac_surface_release_source_image (comac_surface_t *surface,
 comac_private comac_surface_t *
 _comac_surface_snapshot (comac_surface_t *surface);
 
+comac_private comac_int_status_t
+_comac_surface_snapshot_get_content_hash (comac_surface_t *surface,
+					  uint64_t hash[2]);
+
 comac_private void
 _comac_surface_attach_snapshot (comac_surface_t *surface,
 				comac_surface_t *snapshot,
@@ -1556,7 +1629,7 @@ _comac_surface_release_device_reference (comac_surface_t *surface);
  * in comac-xlib-surface.c--again see -Wswitch-enum).
  */
 #define COMAC_FORMAT_VALID(format)                                             \
-    ((format) >= COMAC_FORMAT_ARGB32 && (format) <= COMAC_FORMAT_RGBA128F)
+    ((format) >= COMAC_FORMAT_ARGB32 && (format) <= COMAC_FORMAT_CMYKA)
 
 /* pixman-required stride alignment in bytes. */
 #define COMAC_STRIDE_ALIGNMENT (sizeof (uint32_t))
@@ -1637,6 +1710,10 @@ _comac_image_analyze_transparency (comac_image_surface_t *image);
 comac_private comac_image_color_t
 _comac_image_analyze_color (comac_image_surface_t *image);
 
+comac_private void
+_comac_image_compute_content_hash (comac_image_surface_t *image,
+				   uint64_t hash[2]);
+
 /* comac-pen.c */
 comac_private int
 _comac_pen_vertices_needed (double tolerance,
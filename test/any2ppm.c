@@ -215,6 +215,7 @@ write_ppm (comac_surface_t *surface, int fd)
     case COMAC_FORMAT_RGB30:
     case COMAC_FORMAT_RGB96F:
     case COMAC_FORMAT_RGBA128F:
+    case COMAC_FORMAT_CMYKA:
     case COMAC_FORMAT_INVALID:
     default:
 	return "unhandled image format";
@@ -0,0 +1,393 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <comac.h>
+
+/* Draw to COMAC_FORMAT_CMYKA image surfaces and check the pixels
+ * against the default RGB to CMYK conversion: solid fills with OVER,
+ * SOURCE and CLEAR, other operators, partial coverage, clipping and
+ * image sources, and that reading such a surface back converts it to
+ * RGB.
+ */
+
+#define WIDTH 64
+#define HEIGHT 8
+
+static const uint8_t *
+pixel_at (comac_surface_t *surface, int x, int y)
+{
+    comac_surface_flush (surface);
+    return comac_image_surface_get_data (surface) +
+	   y * comac_image_surface_get_stride (surface) + 5 * x;
+}
+
+static comac_bool_t
+check_pixel (const comac_test_context_t *ctx,
+	     const char *what,
+	     comac_surface_t *surface,
+	     int x,
+	     int y,
+	     const uint8_t expected[5])
+{
+    const uint8_t *p = pixel_at (surface, x, y);
+    int i;
+
+    for (i = 0; i < 5; i++) {
+	if (abs (p[i] - expected[i]) > 1) {
+	    comac_test_log (ctx,
+			    "%s: pixel (%d, %d) is %d %d %d %d %d, "
+			    "expected %d %d %d %d %d\n",
+			    what,
+			    x,
+			    y,
+			    p[0],
+			    p[1],
+			    p[2],
+			    p[3],
+			    p[4],
+			    expected[0],
+			    expected[1],
+			    expected[2],
+			    expected[3],
+			    expected[4]);
+	    return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+static comac_bool_t
+check_row (const comac_test_context_t *ctx,
+	   const char *what,
+	   comac_surface_t *surface,
+	   int y,
+	   const uint8_t expected[5])
+{
+    int x;
+
+    for (x = 0; x < WIDTH; x++) {
+	if (! check_pixel (ctx, what, surface, x, y, expected))
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+static comac_surface_t *
+create_white (void)
+{
+    comac_surface_t *surface;
+    comac_t *cr;
+
+    surface = comac_image_surface_create (COMAC_FORMAT_CMYKA, WIDTH, HEIGHT);
+    cr = comac_create (surface);
+    comac_set_source_rgb (cr, 1, 1, 1);
+    comac_paint (cr);
+    comac_destroy (cr);
+
+    return surface;
+}
+
+static comac_test_status_t
+check_solid (const comac_test_context_t *ctx)
+{
+    static const uint8_t white[5] = {0, 0, 0, 0, 255};
+    static const uint8_t red[5] = {0, 255, 255, 0, 255};
+    static const uint8_t pink[5] = {0, 128, 128, 0, 255};
+    static const uint8_t half_red[5] = {0, 128, 128, 0, 128};
+    static const uint8_t half_black[5] = {0, 0, 0, 128, 128};
+    static const uint8_t clear[5] = {0, 0, 0, 0, 0};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface;
+    comac_t *cr;
+
+    surface = create_white ();
+    if (! check_row (ctx, "white", surface, 0, white))
+	result = COMAC_TEST_FAILURE;
+
+    cr = comac_create (surface);
+
+    /* Whole rows, long enough for the repeated blocks */
+    comac_rectangle (cr, 0, 1, WIDTH, 1);
+    comac_set_source_rgb (cr, 1, 0, 0);
+    comac_fill (cr);
+    if (! check_row (ctx, "opaque red", surface, 1, red))
+	result = COMAC_TEST_FAILURE;
+
+    comac_rectangle (cr, 0, 2, WIDTH, 1);
+    comac_set_source_rgba (cr, 1, 0, 0, .5);
+    comac_fill (cr);
+    if (! check_row (ctx, "red over white", surface, 2, pink))
+	result = COMAC_TEST_FAILURE;
+
+    comac_set_operator (cr, COMAC_OPERATOR_SOURCE);
+    comac_rectangle (cr, 0, 3, WIDTH, 1);
+    comac_fill (cr);
+    if (! check_row (ctx, "red source", surface, 3, half_red))
+	result = COMAC_TEST_FAILURE;
+
+    comac_set_operator (cr, COMAC_OPERATOR_CLEAR);
+    comac_rectangle (cr, 0, 4, WIDTH, 2);
+    comac_fill (cr);
+    if (! check_row (ctx, "clear", surface, 4, clear))
+	result = COMAC_TEST_FAILURE;
+
+    /* A column half covered by an unaligned rectangle */
+    comac_set_operator (cr, COMAC_OPERATOR_OVER);
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_rectangle (cr, 2.5, 5, 1.5, 1);
+    comac_fill (cr);
+    if (! check_pixel (ctx, "coverage", surface, 2, 5, half_black) ||
+	! check_pixel (ctx, "coverage", surface, 1, 5, clear))
+	result = COMAC_TEST_FAILURE;
+
+    comac_destroy (cr);
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+check_operators (const comac_test_context_t *ctx)
+{
+    static const uint8_t rich[5] = {50, 60, 70, 80, 255};
+    static const uint8_t red[5] = {0, 255, 255, 0, 255};
+    static const uint8_t black[5] = {0, 0, 0, 255, 255};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface;
+    unsigned char *data;
+    int stride, x, y, changed;
+    comac_t *cr;
+
+    /* A color that RGB cannot hold */
+    surface = comac_image_surface_create (COMAC_FORMAT_CMYKA, WIDTH, HEIGHT);
+    data = comac_image_surface_get_data (surface);
+    stride = comac_image_surface_get_stride (surface);
+    for (y = 0; y < HEIGHT; y++) {
+	for (x = 0; x < WIDTH; x++)
+	    memcpy (data + y * stride + 5 * x, rich, 5);
+    }
+    comac_surface_mark_dirty (surface);
+
+    cr = comac_create (surface);
+    comac_set_operator (cr, COMAC_OPERATOR_CLEAR);
+    comac_rectangle (cr, 0, 1, WIDTH, 1);
+    comac_fill (cr);
+
+    /* Other operators are applied as in RGB */
+    comac_set_operator (cr, COMAC_OPERATOR_ADD);
+    comac_set_source_rgba (cr, 1, 0, 0, .5);
+    comac_rectangle (cr, 0, 1, WIDTH, 1);
+    comac_fill_preserve (cr);
+    comac_fill (cr);
+    if (comac_status (cr) != COMAC_STATUS_SUCCESS) {
+	comac_test_log (ctx,
+			"ADD failed: %s\n",
+			comac_status_to_string (comac_status (cr)));
+	result = COMAC_TEST_FAILURE;
+    }
+    if (! check_row (ctx, "red added", surface, 1, red))
+	result = COMAC_TEST_FAILURE;
+
+    /* The pixels that they leave alone keep their exact values */
+    changed = 0;
+    for (y = 0; y < HEIGHT; y++) {
+	for (x = 0; x < WIDTH; x++) {
+	    if (y != 1 && memcmp (pixel_at (surface, x, y), rich, 5))
+		changed++;
+	}
+    }
+    if (changed) {
+	comac_test_log (ctx, "ADD changed %d other pixels\n", changed);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    /* The surface can still be drawn to */
+    comac_set_operator (cr, COMAC_OPERATOR_OVER);
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_rectangle (cr, 0, 2, WIDTH, 1);
+    comac_fill (cr);
+    if (comac_status (cr) || ! check_row (ctx, "black", surface, 2, black))
+	result = COMAC_TEST_FAILURE;
+
+    comac_destroy (cr);
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+check_clip (const comac_test_context_t *ctx)
+{
+    static const uint8_t white[5] = {0, 0, 0, 0, 255};
+    static const uint8_t black[5] = {0, 0, 0, 255, 255};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface;
+    comac_t *cr;
+
+    surface = create_white ();
+    cr = comac_create (surface);
+
+    comac_arc (cr, 4, 4, 3, 0, 2 * M_PI);
+    comac_clip (cr);
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_arc (cr, 6, 4, 4, 0, 2 * M_PI);
+    comac_fill (cr);
+
+    if (comac_status (cr) ||
+	! check_pixel (ctx, "clipped", surface, 4, 4, black) ||
+	! check_pixel (ctx, "clipped", surface, 9, 4, white) ||
+	! check_pixel (ctx, "clipped", surface, 0, 0, white))
+	result = COMAC_TEST_FAILURE;
+
+    comac_destroy (cr);
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+check_sources (const comac_test_context_t *ctx)
+{
+    static const uint8_t green[5] = {255, 0, 255, 0, 255};
+    static const uint8_t white[5] = {0, 0, 0, 0, 255};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface, *rgb, *copy;
+    comac_pattern_t *gradient;
+    const uint8_t *p;
+    uint32_t *data;
+    comac_t *cr;
+
+    /* An RGB image is converted with the colors of the destination */
+    rgb = comac_image_surface_create (COMAC_FORMAT_ARGB32, WIDTH, HEIGHT);
+    cr = comac_create (rgb);
+    comac_set_source_rgb (cr, 0, 1, 0);
+    comac_paint (cr);
+    comac_destroy (cr);
+
+    surface = create_white ();
+    cr = comac_create (surface);
+    comac_set_source_surface (cr, rgb, 0, 0);
+    comac_rectangle (cr, 0, 0, WIDTH, 2);
+    comac_fill (cr);
+    if (! check_row (ctx, "rgb image", surface, 0, green))
+	result = COMAC_TEST_FAILURE;
+
+    /* A gradient goes from white to black over the width */
+    gradient = comac_pattern_create_linear (0, 0, WIDTH, 0);
+    comac_pattern_add_color_stop_rgb (gradient, 0, 1, 1, 1);
+    comac_pattern_add_color_stop_rgb (gradient, 1, 0, 0, 0);
+    comac_set_source (cr, gradient);
+    comac_pattern_destroy (gradient);
+    comac_rectangle (cr, 0, 2, WIDTH, 1);
+    comac_fill (cr);
+    p = pixel_at (surface, 0, 2);
+    if (p[3] > 8 || p[4] != 255 || pixel_at (surface, WIDTH - 1, 2)[3] < 247) {
+	comac_test_log (ctx, "gradient is not a black ramp\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    comac_destroy (cr);
+
+    /* A CMYKA image is copied as it is, including its offset */
+    copy = create_white ();
+    cr = comac_create (copy);
+    comac_set_source_surface (cr, surface, 0, -1);
+    comac_paint (cr);
+    comac_destroy (cr);
+    if (! check_row (ctx, "cmyka image", copy, 0, green) ||
+	! check_row (ctx, "cmyka image", copy, HEIGHT - 1, white) ||
+	memcmp (pixel_at (copy, 0, 1), pixel_at (surface, 0, 2), 5 * WIDTH)) {
+	result = COMAC_TEST_FAILURE;
+    }
+
+    /* Reading it back as a source gives RGB */
+    cr = comac_create (rgb);
+    comac_set_source_surface (cr, copy, 0, 0);
+    comac_set_operator (cr, COMAC_OPERATOR_SOURCE);
+    comac_paint (cr);
+    comac_destroy (cr);
+    comac_surface_flush (rgb);
+    data = (uint32_t *) comac_image_surface_get_data (rgb);
+    if (data[0] != 0xff00ff00 ||
+	data[(HEIGHT - 1) * WIDTH] != 0xffffffff) {
+	comac_test_log (ctx,
+			"read back as %08x and %08x\n",
+			data[0],
+			data[(HEIGHT - 1) * WIDTH]);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    comac_surface_destroy (copy);
+    comac_surface_destroy (surface);
+    comac_surface_destroy (rgb);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface;
+
+    if (comac_format_stride_for_width (COMAC_FORMAT_CMYKA, 3) != 16) {
+	comac_test_log (ctx, "Wrong stride for CMYKA\n");
+	return COMAC_TEST_FAILURE;
+    }
+
+    surface = comac_image_surface_create (COMAC_FORMAT_CMYKA, WIDTH, HEIGHT);
+    if (comac_surface_status (surface) ||
+	comac_image_surface_get_format (surface) != COMAC_FORMAT_CMYKA ||
+	comac_surface_get_content (surface) != COMAC_CONTENT_COLOR_ALPHA) {
+	comac_test_log (ctx, "Failed to create a CMYKA surface\n");
+	comac_surface_destroy (surface);
+	return COMAC_TEST_FAILURE;
+    }
+    comac_surface_destroy (surface);
+
+    if (check_solid (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_operators (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_clip (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_sources (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+
+    return result;
+}
+
+COMAC_TEST (cmyka_format,
+	    "Check drawing to CMYKA image surfaces",
+	    "image, color", /* keywords */
+	    NULL,	    /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
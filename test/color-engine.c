@@ -0,0 +1,551 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <comac.h>
+
+/* Check the ICC color engine against profiles built here: an sRGB
+ * profile with a matrix and curves must convert like the built-in
+ * sRGB, and colors converted with a CMYK profile with lut16 tables
+ * must stay close to what the profile gives without interpolation.
+ */
+
+#define HEADER_SIZE 128
+
+/* The sRGB primaries adapted to D50 and their inverse */
+static const double srgb_to_xyz[9] = {0.4361,
+				      0.3851,
+				      0.1431,
+				      0.2225,
+				      0.7169,
+				      0.0606,
+				      0.0139,
+				      0.0971,
+				      0.7141};
+static const double xyz_to_srgb[9] = {3.1339,
+				      -1.6170,
+				      -0.4906,
+				      -0.9785,
+				      1.9160,
+				      0.0334,
+				      0.0720,
+				      -0.2290,
+				      1.4057};
+
+static void
+put_u16 (unsigned char *p, unsigned int v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+put_u32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void
+put_sig (unsigned char *p, const char *sig)
+{
+    memcpy (p, sig, 4);
+}
+
+static void
+put_s15fixed16 (unsigned char *p, double v)
+{
+    put_u32 (p, (uint32_t) (int32_t) floor (v * 65536 + .5));
+}
+
+static double
+clamp (double v)
+{
+    return v < 0 ? 0 : v > 1 ? 1 : v;
+}
+
+/* A printer whose inks absorb the sRGB primaries in linear light. Its
+ * tables are multilinear in their inputs, so interpolating them is
+ * exact and any difference from the expected colors comes from the
+ * tables of the engine. */
+static void
+cmyk_to_pcs (const double *cmyk, double *pcs)
+{
+    double rgb[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+	rgb[i] = (1 - cmyk[i]) * (1 - cmyk[3]);
+    for (i = 0; i < 3; i++) {
+	pcs[i] = (srgb_to_xyz[3 * i] * rgb[0] +
+		  srgb_to_xyz[3 * i + 1] * rgb[1] +
+		  srgb_to_xyz[3 * i + 2] * rgb[2]) *
+		 32768 / 65535;
+    }
+}
+
+/* Colors outside of sRGB give inks outside of 0 to 1, which the output
+ * tables clamp, so that the color table itself stays linear */
+static void
+pcs_to_cmyk (const double *pcs, double *cmyk)
+{
+    int i;
+
+    for (i = 0; i < 3; i++) {
+	cmyk[i] = 1 - (xyz_to_srgb[3 * i] * pcs[0] +
+		       xyz_to_srgb[3 * i + 1] * pcs[1] +
+		       xyz_to_srgb[3 * i + 2] * pcs[2]) *
+			  65535 / 32768;
+    }
+    cmyk[3] = 0;
+}
+
+/* Writes a lut16Type with identity input tables. The color table holds
+ * the outputs of @eval mapped from @min to @max onto 0 to 1, and the
+ * output tables map them back, clamping to 0 to 1. */
+static size_t
+put_lut16 (unsigned char *p,
+	   int num_inputs,
+	   int num_outputs,
+	   int grid,
+	   double min,
+	   double max,
+	   void (*eval) (const double *in, double *out))
+{
+    int num_points = 1, i, j;
+    unsigned char *q;
+
+    for (i = 0; i < num_inputs; i++)
+	num_points *= grid;
+
+    put_sig (p, "mft2");
+    put_u32 (p + 4, 0);
+    p[8] = num_inputs;
+    p[9] = num_outputs;
+    p[10] = grid;
+    p[11] = 0;
+    for (i = 0; i < 9; i++)
+	put_s15fixed16 (p + 12 + 4 * i, i % 4 == 0 ? 1 : 0);
+    put_u16 (p + 48, 2);
+    put_u16 (p + 50, 256);
+
+    q = p + 52;
+    for (i = 0; i < num_inputs; i++) {
+	put_u16 (q, 0);
+	put_u16 (q + 2, 65535);
+	q += 4;
+    }
+
+    /* The first input varies slowest */
+    for (i = 0; i < num_points; i++) {
+	double in[4], out[4];
+	int index = i;
+
+	for (j = num_inputs - 1; j >= 0; j--) {
+	    in[j] = (index % grid) / (double) (grid - 1);
+	    index /= grid;
+	}
+	eval (in, out);
+	for (j = 0; j < num_outputs; j++) {
+	    double v = clamp ((out[j] - min) / (max - min));
+
+	    put_u16 (q, floor (v * 65535 + .5));
+	    q += 2;
+	}
+    }
+
+    for (i = 0; i < num_outputs; i++) {
+	for (j = 0; j < 256; j++) {
+	    double v = clamp (min + j / 255. * (max - min));
+
+	    put_u16 (q, floor (v * 65535 + .5));
+	    q += 2;
+	}
+    }
+
+    return q - p;
+}
+
+static void
+put_header (unsigned char *data,
+	    size_t length,
+	    const char *colorspace,
+	    int num_tags)
+{
+    memset (data, 0, HEADER_SIZE);
+    put_u32 (data, length);
+    put_u32 (data + 8, 0x04300000);
+    put_sig (data + 12, "prtr");
+    put_sig (data + 16, colorspace);
+    put_sig (data + 20, "XYZ ");
+    put_sig (data + 36, "acsp");
+    put_u32 (data + HEADER_SIZE, num_tags);
+}
+
+static void
+put_tag_entry (unsigned char *data,
+	       int index,
+	       const char *sig,
+	       size_t offset,
+	       size_t length)
+{
+    unsigned char *entry = data + HEADER_SIZE + 4 + 12 * index;
+
+    put_sig (entry, sig);
+    put_u32 (entry + 4, offset);
+    put_u32 (entry + 8, length);
+}
+
+static unsigned char *
+create_cmyk_profile (size_t *length)
+{
+    unsigned char *data;
+    size_t offset, size;
+
+    data = calloc (1, 32 * 1024);
+    if (data == NULL)
+	return NULL;
+
+    offset = HEADER_SIZE + 4 + 2 * 12;
+    size = put_lut16 (data + offset, 4, 3, 5, 0, 1, cmyk_to_pcs);
+    put_tag_entry (data, 0, "A2B0", offset, size);
+    offset += (size + 3) & ~3;
+
+    size = put_lut16 (data + offset,
+		      3,
+		      4,
+		      9,
+		      /* 0 and 1 fall on entries of the output tables */
+		      -5,
+		      10,
+		      pcs_to_cmyk);
+    put_tag_entry (data, 1, "B2A0", offset, size);
+    offset += (size + 3) & ~3;
+
+    put_header (data, offset, "CMYK", 2);
+    *length = offset;
+    return data;
+}
+
+/* The sRGB profile with a matrix and parametric curves */
+static unsigned char *
+create_srgb_profile (size_t *length)
+{
+    static const char *xyz_sigs[] = {"rXYZ", "gXYZ", "bXYZ"};
+    static const char *trc_sigs[] = {"rTRC", "gTRC", "bTRC"};
+    static const double params[] =
+	{2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045};
+    unsigned char *data, *p;
+    size_t offset;
+    int i, j;
+
+    data = calloc (1, 1024);
+    if (data == NULL)
+	return NULL;
+
+    offset = HEADER_SIZE + 4 + 7 * 12;
+    for (i = 0; i < 3; i++) {
+	p = data + offset;
+	put_sig (p, "XYZ ");
+	for (j = 0; j < 3; j++)
+	    put_s15fixed16 (p + 8 + 4 * j, srgb_to_xyz[3 * j + i]);
+	put_tag_entry (data, i, xyz_sigs[i], offset, 20);
+	offset += 20;
+    }
+
+    /* All three curves share one tag */
+    p = data + offset;
+    put_sig (p, "para");
+    put_u16 (p + 8, 3);
+    for (j = 0; j < 5; j++)
+	put_s15fixed16 (p + 12 + 4 * j, params[j]);
+    for (i = 0; i < 3; i++)
+	put_tag_entry (data, 3 + i, trc_sigs[i], offset, 32);
+    offset += 32;
+
+    p = data + offset;
+    put_sig (p, "XYZ ");
+    put_s15fixed16 (p + 8, 0.9642);
+    put_s15fixed16 (p + 12, 1.0);
+    put_s15fixed16 (p + 16, 0.8249);
+    put_tag_entry (data, 6, "wtpt", offset, 20);
+    offset += 20;
+
+    put_header (data, offset, "RGB ", 7);
+    put_sig (data + 12, "mntr");
+    *length = offset;
+    return data;
+}
+
+static double
+srgb_to_linear (double v)
+{
+    return v <= 0.04045 ? v / 12.92 : pow ((v + 0.055) / 1.055, 2.4);
+}
+
+static double
+max_difference (const double *a, const double *b, int n)
+{
+    double max = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+	max = MAX (max, fabs (a[i] - b[i]));
+
+    return max;
+}
+
+static void
+convert (comac_color_engine_t *engine,
+	 comac_colorspace_t from_colorspace,
+	 const double *from,
+	 comac_colorspace_t to_colorspace,
+	 double *to)
+{
+    comac_color_engine_convert_func (from_colorspace,
+				     from,
+				     to_colorspace,
+				     to,
+				     COMAC_RENDERING_INTENT_PERCEPTUAL,
+				     engine);
+}
+
+static comac_test_status_t
+check_conversions (comac_test_context_t *ctx,
+		   comac_color_engine_t *builtin,
+		   comac_color_engine_t *parsed)
+{
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    double max_parsed = 0, max_cmyk = 0, max_round_trip = 0, max_gray = 0;
+    unsigned char rgb8[4 * 27], cmyk8[5 * 27], batch8[5 * 27];
+    int r, g, b, i, n = 0;
+
+    for (r = 0; r <= 4; r++) {
+	for (g = 0; g <= 4; g++) {
+	    for (b = 0; b <= 4; b++) {
+		double rgb[4] = {r / 4., g / 4., b / 4., 1};
+		double cmyk[5], cmyk2[5], expected[5], back[4];
+
+		convert (builtin,
+			 COMAC_COLORSPACE_RGB,
+			 rgb,
+			 COMAC_COLORSPACE_CMYK,
+			 cmyk);
+		convert (parsed,
+			 COMAC_COLORSPACE_RGB,
+			 rgb,
+			 COMAC_COLORSPACE_CMYK,
+			 cmyk2);
+		max_parsed = MAX (max_parsed, max_difference (cmyk, cmyk2, 5));
+
+		for (i = 0; i < 3; i++)
+		    expected[i] = 1 - srgb_to_linear (rgb[i]);
+		expected[3] = 0;
+		expected[4] = 1;
+		max_cmyk = MAX (max_cmyk, max_difference (cmyk, expected, 5));
+
+		convert (builtin,
+			 COMAC_COLORSPACE_CMYK,
+			 cmyk,
+			 COMAC_COLORSPACE_RGB,
+			 back);
+		/* Compare in linear light, as the steep start of the sRGB
+		 * curve magnifies small differences in dark channels */
+		for (i = 0; i < 3; i++) {
+		    rgb[i] = srgb_to_linear (rgb[i]);
+		    back[i] = srgb_to_linear (back[i]);
+		}
+		max_round_trip =
+		    MAX (max_round_trip, max_difference (rgb, back, 4));
+	    }
+	}
+    }
+
+    for (i = 0; i <= 16; i++) {
+	double gray[2] = {i / 16., 0.5};
+	double rgb[4], expected[4] = {i / 16., i / 16., i / 16., 0.5};
+
+	convert (builtin,
+		 COMAC_COLORSPACE_GRAY,
+		 gray,
+		 COMAC_COLORSPACE_RGB,
+		 rgb);
+	max_gray = MAX (max_gray, max_difference (rgb, expected, 4));
+    }
+
+    comac_test_log (ctx,
+		    "max difference: parsed sRGB %g, CMYK %g, round trip %g, "
+		    "gray %g\n",
+		    max_parsed,
+		    max_cmyk,
+		    max_round_trip,
+		    max_gray);
+
+    if (max_parsed > 0.005) {
+	comac_test_log (ctx, "The parsed sRGB profile differs from sRGB\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    if (max_cmyk > 0.005) {
+	comac_test_log (ctx, "RGB to CMYK is not accurate\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    if (max_round_trip > 0.02) {
+	comac_test_log (ctx, "RGB to CMYK and back is not accurate\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    if (max_gray > 0.01) {
+	comac_test_log (ctx, "Gray to RGB is not neutral\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+    /* Converting in a batch gives the same colors */
+    for (r = 0; r < 3; r++) {
+	for (g = 0; g < 3; g++) {
+	    for (b = 0; b < 3; b++, n++) {
+		rgb8[4 * n] = r * 127;
+		rgb8[4 * n + 1] = g * 127;
+		rgb8[4 * n + 2] = b * 127;
+		rgb8[4 * n + 3] = n;
+	    }
+	}
+    }
+    comac_color_engine_convert_batch_func (COMAC_COLORSPACE_RGB,
+					   rgb8,
+					   COMAC_COLORSPACE_CMYK,
+					   batch8,
+					   COMAC_COLOR_LAYOUT_U8,
+					   n,
+					   COMAC_RENDERING_INTENT_PERCEPTUAL,
+					   builtin);
+    for (i = 0; i < n; i++) {
+	double rgb[4], cmyk[5];
+	int j;
+
+	for (j = 0; j < 4; j++)
+	    rgb[j] = rgb8[4 * i + j] / 255.;
+	convert (builtin,
+		 COMAC_COLORSPACE_RGB,
+		 rgb,
+		 COMAC_COLORSPACE_CMYK,
+		 cmyk);
+	for (j = 0; j < 4; j++)
+	    cmyk8[5 * i + j] = cmyk[j] * 255 + .5;
+	cmyk8[5 * i + 4] = rgb8[4 * i + 3];
+    }
+    for (i = 0; i < 5 * n; i++) {
+	if (abs (cmyk8[i] - batch8[i]) > 1) {
+	    comac_test_log (ctx, "Batch and single conversions differ\n");
+	    result = COMAC_TEST_FAILURE;
+	    break;
+	}
+    }
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_color_engine_t *builtin, *parsed;
+    unsigned char *cmyk_profile, *srgb_profile;
+    size_t cmyk_length, srgb_length;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+
+    cmyk_profile = create_cmyk_profile (&cmyk_length);
+    srgb_profile = create_srgb_profile (&srgb_length);
+    builtin = comac_color_engine_create ();
+    parsed = comac_color_engine_create ();
+    if (cmyk_profile == NULL || srgb_profile == NULL || builtin == NULL ||
+	parsed == NULL) {
+	result = COMAC_TEST_NO_MEMORY;
+	goto CLEANUP;
+    }
+
+    status = comac_color_engine_set_profile (builtin,
+					     COMAC_COLORSPACE_CMYK,
+					     cmyk_profile,
+					     cmyk_length);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_color_engine_set_profile (parsed,
+						 COMAC_COLORSPACE_CMYK,
+						 cmyk_profile,
+						 cmyk_length);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_color_engine_set_profile (parsed,
+						 COMAC_COLORSPACE_RGB,
+						 srgb_profile,
+						 srgb_length);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to set a profile: %s\n",
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    /* A profile of another colorspace or a truncated one is refused */
+    status = comac_color_engine_set_profile (parsed,
+					     COMAC_COLORSPACE_GRAY,
+					     srgb_profile,
+					     srgb_length);
+    if (status != COMAC_STATUS_READ_ERROR) {
+	comac_test_log (ctx, "An RGB profile was accepted for gray\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    status = comac_color_engine_set_profile (parsed,
+					     COMAC_COLORSPACE_CMYK,
+					     cmyk_profile,
+					     cmyk_length / 2);
+    if (status != COMAC_STATUS_READ_ERROR) {
+	comac_test_log (ctx, "A truncated profile was accepted\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+    if (check_conversions (ctx, builtin, parsed) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+
+CLEANUP:
+    comac_color_engine_destroy (builtin);
+    comac_color_engine_destroy (parsed);
+    free (cmyk_profile);
+    free (srgb_profile);
+
+    return result;
+}
+
+COMAC_TEST (color_engine,
+	    "Check color conversions with ICC profiles",
+	    "color", /* keywords */
+	    NULL,    /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
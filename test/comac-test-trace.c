@@ -882,6 +882,7 @@ matches_reference (struct slave *slave)
 	case COMAC_FORMAT_RGB16_565:
 	case COMAC_FORMAT_RGB96F:
 	case COMAC_FORMAT_RGBA128F:
+	case COMAC_FORMAT_CMYKA:
 	case COMAC_FORMAT_INVALID:
 	    assert (0);
 	}
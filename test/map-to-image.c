@@ -46,6 +46,7 @@ set_pixel_black (uint8_t *data, int stride, comac_format_t format, int x, int y)
 	break;
     case COMAC_FORMAT_RGBA128F:
     case COMAC_FORMAT_RGB96F:
+    case COMAC_FORMAT_CMYKA:
     case COMAC_FORMAT_RGB30:
     case COMAC_FORMAT_A8:
     case COMAC_FORMAT_A1:
@@ -0,0 +1,224 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+#include "comacint.h"
+#include "comac-output-stream-private.h"
+
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <string.h>
+
+/* Check that doubles written to output streams with %f and %g are
+ * formatted as with printf(), decimal point aside: rounded to nearest
+ * with ties to even on the exact binary value, with trailing zeros
+ * removed. Values that land close to halfway between two outputs are
+ * where a formatter of its own goes wrong.
+ */
+
+#define SIGNIFICANT_DIGITS_AFTER_DECIMAL 6
+#define FIXED_POINT_DECIMAL_DIGITS                                             \
+    ((int) (COMAC_FIXED_FRAC_BITS * 0.301029996 + 1))
+
+#define MAX_FAILURES 10
+
+/* The formatting of output streams before it stopped using snprintf(). */
+static void
+reference_dtostr (char *buffer, size_t size, double d, comac_bool_t limited)
+{
+    const char *decimal_point = localeconv ()->decimal_point;
+    size_t decimal_point_len = strlen (decimal_point);
+    int num_zeros, decimal_len;
+    char *p;
+
+    if (d == 0.0)
+	d = 0.0;
+
+    if (limited) {
+	snprintf (buffer, size, "%.*f", FIXED_POINT_DECIMAL_DIGITS, d);
+    } else if (fabs (d) >= 0.1) {
+	snprintf (buffer, size, "%f", d);
+    } else {
+	snprintf (buffer, size, "%.18f", d);
+	p = buffer;
+	if (*p == '+' || *p == '-')
+	    p++;
+	while (*p >= '0' && *p <= '9')
+	    p++;
+	if (strncmp (p, decimal_point, decimal_point_len) == 0)
+	    p += decimal_point_len;
+	num_zeros = 0;
+	while (*p++ == '0')
+	    num_zeros++;
+	if (num_zeros + SIGNIFICANT_DIGITS_AFTER_DECIMAL < 18) {
+	    snprintf (buffer,
+		      size,
+		      "%.*f",
+		      num_zeros + SIGNIFICANT_DIGITS_AFTER_DECIMAL,
+		      d);
+	}
+    }
+
+    p = buffer;
+    if (*p == '+' || *p == '-')
+	p++;
+    while (*p >= '0' && *p <= '9')
+	p++;
+    if (strncmp (p, decimal_point, decimal_point_len) == 0) {
+	*p = '.';
+	decimal_len = strlen (p + decimal_point_len);
+	memmove (p + 1, p + decimal_point_len, decimal_len);
+	p[1 + decimal_len] = 0;
+
+	for (p = p + decimal_len; *p == '0'; p--)
+	    *p = 0;
+	if (*p == '.')
+	    *p = 0;
+    }
+}
+
+static void
+check_value (comac_test_context_t *ctx, double d, int *failures)
+{
+    static const char *formats[] = {"%f", "%g"};
+    char expected[512];
+    comac_output_stream_t *stream;
+    unsigned char *data;
+    unsigned long length;
+    comac_status_t status;
+    int i;
+
+    for (i = 0; i < ARRAY_LENGTH (formats); i++) {
+	stream = _comac_memory_stream_create ();
+	_comac_output_stream_printf (stream, formats[i], d);
+	status = _comac_memory_stream_destroy (stream, &data, &length);
+	if (status) {
+	    if (++*failures <= MAX_FAILURES) {
+		comac_test_log (ctx,
+				"Failed to format %a: %s\n",
+				d,
+				comac_status_to_string (status));
+	    }
+	    continue;
+	}
+
+	reference_dtostr (expected, sizeof (expected), d, i == 1);
+	if (length != strlen (expected) ||
+	    memcmp (data, expected, length) != 0) {
+	    if (++*failures <= MAX_FAILURES) {
+		comac_test_log (ctx,
+				"%s of %a (%.17g) is \"%.*s\" instead of "
+				"\"%s\"\n",
+				formats[i],
+				d,
+				d,
+				(int) length,
+				data,
+				expected);
+	    }
+	}
+	free (data);
+    }
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    static const double values[] = {
+	0.0,
+	0.5,
+	1.5,
+	2.5,
+	0.1,
+	0.09999999999999999,
+	0.0000005,
+	0.00000015,
+	0.0625,
+	0.0005,
+	0.0015,
+	0.0025,
+	1.0000005,
+	2.0000025,
+	1e-18,
+	1e-19,
+	DBL_MIN,
+	5e-324,
+	999999.9999995,
+	4503599627.3704965,
+	4503599627370495.5,
+	1e15,
+	1e20,
+	DBL_MAX,
+    };
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    uint32_t seed = 1;
+    int failures = 0;
+    double d, scale;
+    int i, k;
+
+    for (i = 0; i < ARRAY_LENGTH (values); i++) {
+	check_value (ctx, values[i], &failures);
+	check_value (ctx, -values[i], &failures);
+    }
+    check_value (ctx, INFINITY, &failures);
+    check_value (ctx, -INFINITY, &failures);
+
+    /* Values closest to halfway between two outputs, for each number
+     * of decimal places that is printed. */
+    for (k = 0; k < 20000; k++) {
+	check_value (ctx, (k + 0.5) / 1000, &failures);
+	check_value (ctx, 1 + (k + 0.5) / 1e6, &failures);
+	check_value (ctx, 1000 + (k * 37 + 0.5) / 1e6, &failures);
+	for (i = 8; i <= 19; i++) {
+	    scale = pow (10, -i);
+	    check_value (ctx, (100000 + k + 0.5) * scale, &failures);
+	}
+    }
+
+    /* Values of all magnitudes that are printed in full. */
+    for (k = 0; k < 100000; k++) {
+	seed = seed * 1103515245 + 12345;
+	d = ldexp ((seed >> 8) + 1.0, (int) (seed % 90) - 90);
+	seed = seed * 1103515245 + 12345;
+	d += ldexp (seed >> 8, (int) (seed % 90) - 114);
+	check_value (ctx, k & 1 ? -d : d, &failures);
+    }
+
+    if (failures) {
+	comac_test_log (ctx, "%d values formatted incorrectly\n", failures);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    return result;
+}
+
+COMAC_TEST (output_stream_doubles,
+	    "Check the formatting of doubles in output streams",
+	    "api", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
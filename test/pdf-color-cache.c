@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+
+#include <stdio.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that converting the same solid colors again for a CMYK PDF
+ * uses the color cache of the surface instead of the callback, and
+ * that the observer reports it.
+ */
+
+static comac_status_t
+write_func (void *closure, const unsigned char *data, unsigned int length)
+{
+    return COMAC_STATUS_SUCCESS;
+}
+
+static void
+convert (comac_colorspace_t from_colorspace,
+	 const double *from_data,
+	 comac_colorspace_t to_colorspace,
+	 double *to_data,
+	 comac_rendering_intent_t intent,
+	 void *ctx)
+{
+    int *num_calls = ctx;
+
+    (*num_calls)++;
+    comac_default_color_convert_func (from_colorspace,
+				      from_data,
+				      to_colorspace,
+				      to_data,
+				      intent,
+				      NULL);
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_surface_t *surface, *observer;
+    comac_t *cr;
+    comac_status_t status;
+    unsigned int hits, misses;
+    int num_calls = 0;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    surface = comac_pdf_surface_create_for_stream2 (
+	write_func,
+	NULL,
+	COMAC_COLORSPACE_CMYK,
+	COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
+	convert,
+	&num_calls,
+	100,
+	100);
+    observer =
+	comac_surface_create_observer (surface, COMAC_SURFACE_OBSERVER_NORMAL);
+
+    cr = comac_create (observer);
+    for (i = 0; i < 10; i++) {
+	if (i % 2)
+	    comac_set_source_rgb (cr, 0.2, 0.4, 0.6);
+	else
+	    comac_set_source_rgb (cr, 1, 0.5, 0);
+	comac_rectangle (cr, 10 * i, 10, 5, 5);
+	comac_fill (cr);
+    }
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    if (status == COMAC_STATUS_SUCCESS) {
+	status =
+	    comac_surface_observer_get_color_cache_stats (observer,
+							  &hits,
+							  &misses);
+    }
+    comac_surface_destroy (observer);
+    comac_surface_destroy (surface);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	return COMAC_TEST_FAILURE;
+    }
+
+    if (misses != 2 || hits == 0 || num_calls != 2) {
+	comac_test_log (ctx,
+			"Expected the two colors to be converted once, "
+			"got %d conversions, %u hits and %u misses\n",
+			num_calls,
+			hits,
+			misses);
+	return COMAC_TEST_FAILURE;
+    }
+
+    return COMAC_TEST_SUCCESS;
+}
+
+COMAC_TEST (pdf_color_cache,
+	    "Check that PDF solid color conversions are cached",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
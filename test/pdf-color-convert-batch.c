@@ -0,0 +1,158 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <string.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that the gradient stops and the mesh colors of a CMYK PDF are
+ * each converted with a single call of the batch conversion callback,
+ * and that the converted gradient has four color components.
+ */
+
+static void
+draw (comac_t *cr)
+{
+    comac_pattern_t *pattern;
+
+    comac_set_source_rgb (cr, 0.2, 0.4, 0.6);
+    comac_rectangle (cr, 10, 10, 30, 30);
+    comac_fill (cr);
+
+    pattern = comac_pattern_create_linear (0, 0, 100, 0);
+    comac_pattern_add_color_stop_rgb (pattern, 0, 1, 0, 0);
+    comac_pattern_add_color_stop_rgb (pattern, 0.5, 0, 1, 0);
+    comac_pattern_add_color_stop_rgb (pattern, 1, 0, 0, 1);
+    comac_set_source (cr, pattern);
+    comac_pattern_destroy (pattern);
+    comac_rectangle (cr, 0, 50, 100, 20);
+    comac_fill (cr);
+
+    pattern = comac_pattern_create_mesh ();
+    comac_mesh_pattern_begin_patch (pattern);
+    comac_mesh_pattern_move_to (pattern, 0, 80);
+    comac_mesh_pattern_line_to (pattern, 100, 80);
+    comac_mesh_pattern_line_to (pattern, 100, 100);
+    comac_mesh_pattern_line_to (pattern, 0, 100);
+    comac_mesh_pattern_set_corner_color_rgb (pattern, 0, 1, 0, 0);
+    comac_mesh_pattern_set_corner_color_rgb (pattern, 1, 0, 1, 0);
+    comac_mesh_pattern_set_corner_color_rgb (pattern, 2, 0, 0, 1);
+    comac_mesh_pattern_set_corner_color_rgb (pattern, 3, 1, 1, 0);
+    comac_mesh_pattern_end_patch (pattern);
+    comac_set_source (cr, pattern);
+    comac_pattern_destroy (pattern);
+    comac_paint (cr);
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_conversions_t conversions;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_surface_t *surface;
+    comac_t *cr;
+    comac_status_t status;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    int i, found = 0;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    memset (&conversions, 0, sizeof (conversions));
+    surface = comac_pdf_surface_create_for_stream2 (
+	pdf_test_output_write,
+	&output,
+	COMAC_COLORSPACE_CMYK,
+	COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
+	pdf_test_convert,
+	&conversions,
+	100,
+	100);
+    /* Keep the functions out of compressed object streams */
+    comac_pdf_surface_restrict_to_version (surface, COMAC_PDF_VERSION_1_4);
+    comac_surface_set_color_conversion_batch_callback (surface,
+						       pdf_test_convert_batch,
+						       &conversions);
+
+    cr = comac_create (surface);
+    draw (cr);
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&output);
+	return COMAC_TEST_FAILURE;
+    }
+
+    if (conversions.single_calls != 0) {
+	comac_test_log (ctx,
+			"%d colors converted one at a time\n",
+			conversions.single_calls);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    for (i = 0; i < conversions.batch_calls &&
+		i < ARRAY_LENGTH (conversions.batch_sizes);
+	 i++) {
+	/* The three gradient stops and the four mesh corners */
+	if (conversions.batch_sizes[i] == 3 || conversions.batch_sizes[i] == 4)
+	    found++;
+    }
+    if (found != 2) {
+	comac_test_log (ctx,
+			"Expected the gradient and the mesh to be converted "
+			"in one call each, got %d batch calls\n",
+			conversions.batch_calls);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    /* The stop at 0.5 is pure green */
+    if (pdf_test_output_count (&output, "/C0 [ 1 0 1 0 ]") == 0) {
+	comac_test_log (ctx, "No CMYK color function in the output\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_color_convert_batch,
+	    "Check that PDF colors are converted in batches",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
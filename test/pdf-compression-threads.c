@@ -0,0 +1,242 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that compressing the streams of a PDF file in several threads
+ * gives a valid file that draws the same as compressing them in one,
+ * and that a large stream is indeed split into blocks, each of which
+ * ends with a sync flush.
+ */
+
+/* The size of the blocks compressed by each thread, THREADED_BLOCK_SIZE */
+#define BLOCK_SIZE (128 * 1024)
+
+/* An RGB image of 6 blocks */
+#define IMAGE_SIZE 512
+#define IMAGE_DATA_SIZE (IMAGE_SIZE * IMAGE_SIZE * 3)
+
+static void
+set_threads (comac_surface_t *surface, void *closure)
+{
+    comac_pdf_surface_set_compression_threads (surface, *(int *) closure);
+}
+
+static void
+draw_image (comac_surface_t *surface)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    int stride, x, y;
+    comac_t *cr;
+
+    image =
+	comac_image_surface_create (COMAC_FORMAT_RGB24, IMAGE_SIZE, IMAGE_SIZE);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data != NULL) {
+	for (y = 0; y < IMAGE_SIZE; y++) {
+	    row = (uint32_t *) (data + y * stride);
+	    for (x = 0; x < IMAGE_SIZE; x++)
+		row[x] = (x ^ y) * 0x010203;
+	}
+    }
+    comac_surface_mark_dirty (image);
+
+    cr = comac_create (surface);
+    comac_set_source_surface (cr, image, 0, 0);
+    comac_paint (cr);
+    comac_destroy (cr);
+    comac_surface_destroy (image);
+}
+
+static comac_status_t
+write_image (pdf_test_output_t *output, int num_threads)
+{
+    comac_surface_t *surface;
+    comac_status_t status;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   IMAGE_SIZE,
+						   IMAGE_SIZE);
+    comac_pdf_surface_set_compression_threads (surface, num_threads);
+    draw_image (surface);
+
+    comac_surface_finish (surface);
+    status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+/* The number of sync flushes, an empty stored block, in @data. */
+static int
+count_sync_flushes (const unsigned char *data, size_t length)
+{
+    static const unsigned char marker[] = {0x00, 0x00, 0xff, 0xff};
+    int count = 0;
+    size_t i;
+
+    for (i = 0; i + sizeof (marker) <= length; i++) {
+	if (memcmp (data + i, marker, sizeof (marker)) == 0)
+	    count++;
+    }
+
+    return count;
+}
+
+static comac_test_status_t
+check_blocks (comac_test_context_t *ctx, int num_threads)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc = NULL;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    unsigned char *data;
+    const char *error;
+    size_t length;
+    int id, count;
+
+    status = write_image (&output, num_threads);
+    if (status) {
+	comac_test_log (ctx,
+			"%d threads: failed to write pdf: %s\n",
+			num_threads,
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    doc = pdf_test_document_create (output.data, output.length);
+    error = pdf_test_document_get_error (doc);
+    id = pdf_test_document_find_object (doc, 1, "/Subtype /Image");
+    if (error || id == 0) {
+	comac_test_log (ctx,
+			"%d threads: invalid pdf: %s\n",
+			num_threads,
+			error ? error : "no image");
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    data = pdf_test_document_get_stream (doc, id, TRUE, &length);
+    free (data);
+    if (length != IMAGE_DATA_SIZE) {
+	comac_test_log (ctx,
+			"%d threads: image of %lu bytes instead of %d\n",
+			num_threads,
+			(unsigned long) length,
+			IMAGE_DATA_SIZE);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    /* Every block but the last ends with a sync flush. */
+    data = pdf_test_document_get_stream (doc, id, FALSE, &length);
+    count = count_sync_flushes (data, length);
+    free (data);
+    if (count < IMAGE_DATA_SIZE / BLOCK_SIZE - 1) {
+	comac_test_log (ctx,
+			"%d threads: %d sync flushes in the image, "
+			"expected %d blocks\n",
+			num_threads,
+			count,
+			IMAGE_DATA_SIZE / BLOCK_SIZE);
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t reference = PDF_TEST_OUTPUT_INIT;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    char name[32];
+    int num_threads;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    status = pdf_test_write_document (&reference, NULL, NULL);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&reference);
+	return COMAC_TEST_FAILURE;
+    }
+
+    /* 0 uses one thread per processor */
+    for (num_threads = 0; num_threads <= 4; num_threads += 2) {
+	snprintf (name, sizeof (name), "%d threads", num_threads);
+	status = pdf_test_write_document (&output, set_threads, &num_threads);
+	if (status) {
+	    comac_test_log (ctx,
+			    "%s: failed to write pdf: %s\n",
+			    name,
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	} else if (pdf_test_compare_outputs (ctx, name, &reference, &output) !=
+		   COMAC_TEST_SUCCESS) {
+	    result = COMAC_TEST_FAILURE;
+	}
+	pdf_test_output_fini (&output);
+    }
+
+    for (num_threads = 2; num_threads <= 4; num_threads += 2) {
+	if (check_blocks (ctx, num_threads) != COMAC_TEST_SUCCESS)
+	    result = COMAC_TEST_FAILURE;
+    }
+
+    pdf_test_output_fini (&reference);
+
+    return result;
+}
+
+COMAC_TEST (pdf_compression_threads,
+	    "Check PDF files compressed in several threads",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,294 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that PDF files written with each compression setting are
+ * valid and draw the same as with the default setting, and that each
+ * kind of stream is compressed with the level and strategy it was
+ * given. Those are told by the level that zlib records in the header
+ * of the stream: 0 for level 0 or 1 or for Huffman coding and RLE
+ * only, 1 for levels 2 to 5, 2 for level 6 and 3 for levels 7 to 9.
+ */
+
+typedef struct _compression_case {
+    const char *name;
+    comac_pdf_compression_t compression;
+    comac_bool_t per_stream; /* use the settings below instead */
+    comac_pdf_stream_type_t type;
+    int level;
+    comac_pdf_compression_strategy_t strategy;
+    int header_levels[3]; /* of content, image and font streams */
+} compression_case_t;
+
+static const compression_case_t cases[] = {
+    {"fast", COMAC_PDF_COMPRESSION_FAST, FALSE, 0, 0, 0, {0, 0, 0}},
+    {"small", COMAC_PDF_COMPRESSION_SMALL, FALSE, 0, 0, 0, {3, 3, 3}},
+    {"content rle",
+     COMAC_PDF_COMPRESSION_DEFAULT,
+     TRUE,
+     COMAC_PDF_STREAM_TYPE_CONTENT,
+     6,
+     COMAC_PDF_COMPRESSION_STRATEGY_RLE,
+     {0, 2, 2}},
+    {"image stored",
+     COMAC_PDF_COMPRESSION_DEFAULT,
+     TRUE,
+     COMAC_PDF_STREAM_TYPE_IMAGE,
+     0,
+     COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT,
+     {2, 0, 2}},
+    {"image filtered",
+     COMAC_PDF_COMPRESSION_DEFAULT,
+     TRUE,
+     COMAC_PDF_STREAM_TYPE_IMAGE,
+     4,
+     COMAC_PDF_COMPRESSION_STRATEGY_FILTERED,
+     {2, 1, 2}},
+    {"font huffman",
+     COMAC_PDF_COMPRESSION_DEFAULT,
+     TRUE,
+     COMAC_PDF_STREAM_TYPE_FONT,
+     9,
+     COMAC_PDF_COMPRESSION_STRATEGY_HUFFMAN_ONLY,
+     {2, 2, 0}},
+    {"invalid level",
+     COMAC_PDF_COMPRESSION_DEFAULT,
+     TRUE,
+     COMAC_PDF_STREAM_TYPE_CONTENT,
+     42,
+     COMAC_PDF_COMPRESSION_STRATEGY_DEFAULT,
+     {2, 2, 2}},
+};
+
+static const char *type_names[] = {"content", "image", "font"};
+
+static void
+set_compression (comac_surface_t *surface, void *closure)
+{
+    const compression_case_t *c = closure;
+
+    if (c->per_stream)
+	comac_pdf_surface_set_stream_compression (surface,
+						  c->type,
+						  c->level,
+						  c->strategy);
+    else
+	comac_pdf_surface_set_compression (surface, c->compression);
+}
+
+/* The object number that @key refers to in @object, or 0. */
+static int
+get_reference (const char *object, const char *key)
+{
+    const char *p = object ? strstr (object, key) : NULL;
+    int id;
+
+    if (p == NULL || sscanf (p + strlen (key), "%d 0 R", &id) != 1)
+	return 0;
+
+    return id;
+}
+
+static comac_test_status_t
+check_stream (comac_test_context_t *ctx,
+	      const compression_case_t *c,
+	      pdf_test_document_t *doc,
+	      int id,
+	      comac_pdf_stream_type_t type)
+{
+    const char *object = pdf_test_document_get_object (doc, id);
+    unsigned char *data;
+    size_t length;
+    int level = -1;
+
+    if (object == NULL || strstr (object, "/FlateDecode") == NULL) {
+	comac_test_log (ctx,
+			"%s: %s stream %d is not compressed\n",
+			c->name,
+			type_names[type],
+			id);
+	return COMAC_TEST_FAILURE;
+    }
+
+    data = pdf_test_document_get_stream (doc, id, FALSE, &length);
+    if (data != NULL && length >= 2)
+	level = data[1] >> 6;
+    free (data);
+
+    if (level != c->header_levels[type]) {
+	comac_test_log (ctx,
+			"%s: %s stream %d has level %d instead of %d\n",
+			c->name,
+			type_names[type],
+			id,
+			level,
+			c->header_levels[type]);
+	return COMAC_TEST_FAILURE;
+    }
+
+    return COMAC_TEST_SUCCESS;
+}
+
+/* Checks the page contents, the images and the streams of the fonts,
+ * as far as the fonts available have any. */
+static comac_test_status_t
+check_levels (comac_test_context_t *ctx,
+	      const compression_case_t *c,
+	      const pdf_test_output_t *output)
+{
+    static const char *font_keys[] = {"/FontFile ",
+				      "/FontFile2 ",
+				      "/FontFile3 ",
+				      "/ToUnicode "};
+    pdf_test_document_t *doc;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    const char *error, *page;
+    int i, k, id, ref, num_images = 0;
+
+    doc = pdf_test_document_create (output->data, output->length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "%s: invalid pdf: %s\n", c->name, error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    for (i = 0; i < pdf_test_document_get_num_pages (doc); i++) {
+	id = pdf_test_document_get_page (doc, i);
+	page = pdf_test_document_get_object (doc, id);
+	ref = get_reference (page, "/Contents ");
+	if (check_stream (ctx, c, doc, ref, COMAC_PDF_STREAM_TYPE_CONTENT))
+	    result = COMAC_TEST_FAILURE;
+    }
+
+    id = 0;
+    while ((id = pdf_test_document_find_object (doc,
+						id + 1,
+						"/Subtype /Image"))) {
+	num_images++;
+	if (check_stream (ctx, c, doc, id, COMAC_PDF_STREAM_TYPE_IMAGE))
+	    result = COMAC_TEST_FAILURE;
+    }
+    if (num_images == 0) {
+	comac_test_log (ctx, "%s: no image found\n", c->name);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    for (k = 0; k < ARRAY_LENGTH (font_keys); k++) {
+	id = 0;
+	while ((id = pdf_test_document_find_object (doc,
+						    id + 1,
+						    font_keys[k]))) {
+	    ref = get_reference (pdf_test_document_get_object (doc, id),
+				 font_keys[k]);
+	    if (check_stream (ctx, c, doc, ref, COMAC_PDF_STREAM_TYPE_FONT))
+		result = COMAC_TEST_FAILURE;
+	}
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t reference = PDF_TEST_OUTPUT_INIT;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const compression_case_t *c;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    status = pdf_test_write_document (&reference, NULL, NULL);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&reference);
+	return COMAC_TEST_FAILURE;
+    }
+
+    for (i = 0; i < ARRAY_LENGTH (cases); i++) {
+	c = &cases[i];
+	status = pdf_test_write_document (&output,
+					  set_compression,
+					  (void *) c);
+	if (status) {
+	    comac_test_log (ctx,
+			    "%s: failed to write pdf: %s\n",
+			    c->name,
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	} else if (pdf_test_compare_outputs (ctx,
+					     c->name,
+					     &reference,
+					     &output) != COMAC_TEST_SUCCESS) {
+	    result = COMAC_TEST_FAILURE;
+	} else if (check_levels (ctx, c, &output) != COMAC_TEST_SUCCESS) {
+	    result = COMAC_TEST_FAILURE;
+	}
+
+	/* Level 0 stores the image as it is. */
+	if (c->per_stream && c->level == 0 &&
+	    output.length <= reference.length) {
+	    comac_test_log (ctx,
+			    "%s: the image was compressed, %lu bytes written "
+			    "instead of more than %lu\n",
+			    c->name,
+			    (unsigned long) output.length,
+			    (unsigned long) reference.length);
+	    result = COMAC_TEST_FAILURE;
+	}
+
+	pdf_test_output_fini (&output);
+    }
+
+    pdf_test_output_fini (&reference);
+
+    return result;
+}
+
+COMAC_TEST (pdf_compression,
+	    "Check PDF files written with each compression setting",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,246 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "comac-test.h"
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that adjacent fills with the same graphics state are merged
+ * into one path painted by a single fill operator, that fills are not
+ * merged when they overlap or change the fill rule or the color, and
+ * that a save and restore with nothing drawn in between leaves no
+ * empty q/Q pair in the content stream.
+ */
+
+#define SIZE 200
+
+typedef struct _fill_case {
+    const char *name;
+    void (*draw) (comac_t *cr);
+    /* The number of each operator in the content stream of the page */
+    int re, f, f_even_odd, q;
+} fill_case_t;
+
+static void
+draw_disjoint (comac_t *cr)
+{
+    comac_rectangle (cr, 10, 10, 20, 20);
+    comac_fill (cr);
+    comac_rectangle (cr, 40, 10, 20, 20);
+    comac_fill (cr);
+    comac_rectangle (cr, 70, 10, 20, 20);
+    comac_fill (cr);
+}
+
+static void
+draw_overlapping (comac_t *cr)
+{
+    comac_rectangle (cr, 10, 10, 20, 20);
+    comac_fill (cr);
+    comac_rectangle (cr, 20, 20, 20, 20);
+    comac_fill (cr);
+}
+
+static void
+draw_fill_rules (comac_t *cr)
+{
+    comac_rectangle (cr, 10, 10, 20, 20);
+    comac_fill (cr);
+    comac_set_fill_rule (cr, COMAC_FILL_RULE_EVEN_ODD);
+    comac_rectangle (cr, 40, 10, 20, 20);
+    comac_fill (cr);
+}
+
+static void
+draw_colors (comac_t *cr)
+{
+    comac_rectangle (cr, 10, 10, 20, 20);
+    comac_fill (cr);
+    comac_set_source_rgb (cr, 0, 0, 1);
+    comac_rectangle (cr, 40, 10, 20, 20);
+    comac_fill (cr);
+}
+
+static void
+draw_empty_save (comac_t *cr)
+{
+    comac_save (cr);
+    comac_rectangle (cr, 0, 0, 50, 50);
+    comac_clip (cr);
+    comac_restore (cr);
+    comac_rectangle (cr, 10, 10, 20, 20);
+    comac_fill (cr);
+}
+
+/* Every page is drawn in a q/Q pair of its own. */
+static const fill_case_t cases[] = {
+    {"disjoint", draw_disjoint, 3, 1, 0, 1},
+    {"overlapping", draw_overlapping, 2, 2, 0, 1},
+    {"fill rules", draw_fill_rules, 2, 1, 1, 1},
+    {"colors", draw_colors, 2, 2, 0, 1},
+    {"empty save", draw_empty_save, 1, 1, 0, 1},
+};
+
+static int
+count_operator (const char *content, size_t length, const char *op)
+{
+    const char *p = content, *end = content + length;
+    size_t len = strlen (op);
+    int count = 0;
+
+    while (p < end) {
+	const char *token = p;
+
+	while (p < end && ! strchr (" \t\r\n", *p))
+	    p++;
+	if ((size_t) (p - token) == len && memcmp (token, op, len) == 0)
+	    count++;
+	while (p < end && strchr (" \t\r\n", *p))
+	    p++;
+    }
+
+    return count;
+}
+
+static comac_test_status_t
+check_page (comac_test_context_t *ctx,
+	    pdf_test_document_t *doc,
+	    int index,
+	    const fill_case_t *fill_case)
+{
+    const char *object, *contents;
+    unsigned char *content;
+    size_t length;
+    int id, re, f, f_even_odd, q;
+
+    id = pdf_test_document_get_page (doc, index);
+    object = pdf_test_document_get_object (doc, id);
+    contents = object ? strstr (object, "/Contents ") : NULL;
+    if (contents == NULL || sscanf (contents, "/Contents %d", &id) != 1) {
+	comac_test_log (ctx, "%s: page without contents\n", fill_case->name);
+	return COMAC_TEST_FAILURE;
+    }
+
+    content = pdf_test_document_get_stream (doc, id, TRUE, &length);
+    if (content == NULL) {
+	comac_test_log (ctx, "%s: cannot read the contents\n", fill_case->name);
+	return COMAC_TEST_FAILURE;
+    }
+
+    re = count_operator ((char *) content, length, "re");
+    f = count_operator ((char *) content, length, "f");
+    f_even_odd = count_operator ((char *) content, length, "f*");
+    q = count_operator ((char *) content, length, "q");
+    free (content);
+
+    if (re != fill_case->re || f != fill_case->f ||
+	f_even_odd != fill_case->f_even_odd || q != fill_case->q) {
+	comac_test_log (ctx,
+			"%s: found %d re, %d f, %d f* and %d q operators, "
+			"expected %d, %d, %d and %d\n",
+			fill_case->name,
+			re,
+			f,
+			f_even_odd,
+			q,
+			fill_case->re,
+			fill_case->f,
+			fill_case->f_even_odd,
+			fill_case->q);
+	return COMAC_TEST_FAILURE;
+    }
+
+    return COMAC_TEST_SUCCESS;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    pdf_test_document_t *doc;
+    comac_surface_t *surface;
+    comac_status_t status;
+    comac_t *cr;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   &output,
+						   SIZE,
+						   SIZE);
+    for (i = 0; i < ARRAY_LENGTH (cases); i++) {
+	cr = comac_create (surface);
+	comac_set_source_rgb (cr, 1, 0, 0);
+	cases[i].draw (cr);
+	comac_show_page (cr);
+	comac_destroy (cr);
+    }
+    comac_surface_finish (surface);
+    status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&output);
+	return COMAC_TEST_FAILURE;
+    }
+
+    doc = pdf_test_document_create (output.data, output.length);
+    if (pdf_test_document_get_error (doc)) {
+	comac_test_log (ctx,
+			"Invalid pdf: %s\n",
+			pdf_test_document_get_error (doc));
+	result = COMAC_TEST_FAILURE;
+    } else {
+	for (i = 0; i < ARRAY_LENGTH (cases); i++) {
+	    if (check_page (ctx, doc, i, &cases[i]) != COMAC_TEST_SUCCESS)
+		result = COMAC_TEST_FAILURE;
+	}
+    }
+    pdf_test_document_destroy (doc);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_fill_merge,
+	    "Check that adjacent PDF fills are merged",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
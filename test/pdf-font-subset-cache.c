@@ -0,0 +1,133 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <string.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that documents written with the font subset cache are the
+ * same as without it, both when the subsets are added to the cache and
+ * when they are found there, and that a document with other glyphs
+ * does not get the subsets of an earlier one.
+ */
+
+static comac_status_t
+write_pdf (pdf_test_output_t *output, const char *text, comac_bool_t cache)
+{
+    comac_surface_t *surface;
+    comac_t *cr;
+    comac_status_t status;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   200,
+						   200);
+    /* Keep the output the same from one document to the next */
+    comac_pdf_surface_set_metadata (surface,
+				    COMAC_PDF_METADATA_CREATE_DATE,
+				    "2026-01-01T00:00:00");
+    comac_pdf_surface_set_font_subset_cache (surface, cache);
+    cr = comac_create (surface);
+
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Sans",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_NORMAL);
+    comac_set_font_size (cr, 16);
+    comac_move_to (cr, 20, 40);
+    comac_show_text (cr, text);
+
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Serif",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_BOLD);
+    comac_move_to (cr, 20, 80);
+    comac_show_text (cr, text);
+    comac_show_page (cr);
+
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    /* The last document misses the cache, the third one hits it */
+    static const char *texts[] = {"Invoice 1", "Total", "Invoice 1", "Due"};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    int i, j;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (i = 0; i < ARRAY_LENGTH (texts); i++) {
+	pdf_test_output_t output[2] = {PDF_TEST_OUTPUT_INIT,
+					PDF_TEST_OUTPUT_INIT};
+
+	for (j = 0; j < 2; j++) {
+	    status = write_pdf (&output[j], texts[i], j);
+	    if (status) {
+		comac_test_log (ctx,
+				"Failed to write pdf: %s\n",
+				comac_status_to_string (status));
+		result = COMAC_TEST_FAILURE;
+	    }
+	}
+
+	if (result == COMAC_TEST_SUCCESS &&
+	    (output[0].length != output[1].length ||
+	     memcmp (output[0].data, output[1].data, output[0].length))) {
+	    comac_test_log (ctx,
+			    "Document %d differs with the font subset cache\n",
+			    i + 1);
+	    result = COMAC_TEST_FAILURE;
+	}
+
+	pdf_test_output_fini (&output[0]);
+	pdf_test_output_fini (&output[1]);
+	if (result != COMAC_TEST_SUCCESS)
+	    break;
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_font_subset_cache,
+	    "Check that the font subset cache does not change PDF output",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
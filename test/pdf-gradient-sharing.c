@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that gradients with the same stops share their function
+ * object, and that gradient patterns which differ only in their matrix
+ * share their shading object, while different gradients are not
+ * merged. The gradients are stroked, so that they are drawn through
+ * pattern objects rather than painted as shadings.
+ */
+
+typedef struct _gradient {
+    comac_bool_t radial;
+    double x; /* translation of the pattern matrix */
+    double r, g, b;
+} gradient_t;
+
+static const gradient_t gradients[] = {
+    {FALSE, 0, 1, 0, 0},
+    {FALSE, 0, 1, 0, 0},  /* the same */
+    {FALSE, 20, 1, 0, 0}, /* the same shading, moved */
+    {TRUE, 0, 1, 0, 0},	  /* the same function, another shading */
+    {FALSE, 0, 0, 1, 0},  /* another function and shading */
+};
+
+static comac_pattern_t *
+create_gradient (const gradient_t *gradient)
+{
+    comac_pattern_t *pattern;
+    comac_matrix_t matrix;
+
+    if (gradient->radial)
+	pattern = comac_pattern_create_radial (50, 50, 0, 50, 50, 50);
+    else
+	pattern = comac_pattern_create_linear (0, 0, 100, 0);
+    comac_pattern_add_color_stop_rgb (pattern,
+				      0,
+				      gradient->r,
+				      gradient->g,
+				      gradient->b);
+    comac_pattern_add_color_stop_rgb (pattern, 1, 0, 0, 1);
+
+    comac_matrix_init_translate (&matrix, gradient->x, 0);
+    comac_pattern_set_matrix (pattern, &matrix);
+
+    return pattern;
+}
+
+static comac_status_t
+write_pdf (pdf_test_output_t *output)
+{
+    comac_surface_t *surface;
+    comac_pattern_t *pattern;
+    comac_status_t status;
+    comac_t *cr;
+    int i, height = ARRAY_LENGTH (gradients) * 20;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   100,
+						   height);
+    cr = comac_create (surface);
+    comac_set_line_width (cr, 10);
+    for (i = 0; i < ARRAY_LENGTH (gradients); i++) {
+	pattern = create_gradient (&gradients[i]);
+	comac_set_source (cr, pattern);
+	comac_pattern_destroy (pattern);
+	comac_move_to (cr, 0, i * 20 + 10);
+	comac_line_to (cr, 100, i * 20 + 10);
+	comac_stroke (cr);
+    }
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+check_count (comac_test_context_t *ctx,
+	     pdf_test_document_t *doc,
+	     const char *str,
+	     int expected)
+{
+    int count = pdf_test_document_count_objects (doc, str);
+
+    if (count != expected) {
+	comac_test_log (ctx,
+			"Expected %d objects with %s, found %d\n",
+			expected,
+			str,
+			count);
+	return COMAC_TEST_FAILURE;
+    }
+
+    return COMAC_TEST_SUCCESS;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc = NULL;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const char *error;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    status = write_pdf (&output);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    doc = pdf_test_document_create (output.data, output.length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    /* Two sets of stops, three shadings and a pattern per fill */
+    if (check_count (ctx, doc, "/FunctionType 2", 2) ||
+	check_count (ctx, doc, "/ShadingType", 3) ||
+	check_count (ctx, doc, "/PatternType 2", ARRAY_LENGTH (gradients)))
+	result = COMAC_TEST_FAILURE;
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_gradient_sharing,
+	    "Check that identical PDF gradient objects are written once",
+	    "pdf, gradient", /* keywords */
+	    NULL,	     /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
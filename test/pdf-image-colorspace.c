@@ -0,0 +1,170 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <string.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that images painted on CMYK and gray PDF surfaces are written
+ * in the colorspace of the surface, and that a batch conversion
+ * callback sees every pixel of an image without being called once per
+ * pixel.
+ */
+
+#define WIDTH 40
+#define HEIGHT 30
+
+static comac_surface_t *
+create_image (void)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    int stride, x, y;
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24, WIDTH, HEIGHT);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    for (y = 0; y < HEIGHT; y++) {
+	uint32_t *row = (uint32_t *) (data + y * stride);
+
+	for (x = 0; x < WIDTH; x++)
+	    row[x] = (x * 255 / WIDTH) << 16 | (y * 255 / HEIGHT) << 8 | 0x80;
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+static comac_test_status_t
+check_image (comac_test_context_t *ctx,
+	     comac_colorspace_t colorspace,
+	     comac_bool_t use_batch,
+	     const char *expected)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_conversions_t conversions;
+    comac_surface_t *surface, *image;
+    comac_t *cr;
+    comac_status_t status;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+
+    memset (&conversions, 0, sizeof (conversions));
+    surface = comac_pdf_surface_create_for_stream2 (
+	pdf_test_output_write,
+	&output,
+	colorspace,
+	COMAC_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
+	use_batch ? pdf_test_convert : comac_default_color_convert_func,
+	&conversions,
+	WIDTH,
+	HEIGHT);
+    if (use_batch) {
+	comac_surface_set_color_conversion_batch_callback (
+	    surface,
+	    pdf_test_convert_batch,
+	    &conversions);
+    }
+
+    image = create_image ();
+    cr = comac_create (surface);
+    comac_set_source_surface (cr, image, 0, 0);
+    comac_paint (cr);
+    status = comac_status (cr);
+    comac_destroy (cr);
+    comac_surface_destroy (image);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&output);
+	return COMAC_TEST_FAILURE;
+    }
+
+    if (pdf_test_output_count (&output, expected) == 0 ||
+	pdf_test_output_count (&output, "/DeviceRGB") != 0) {
+	comac_test_log (ctx, "No image with %s in the output\n", expected);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    if (use_batch &&
+	(conversions.single_calls != 0 ||
+	 conversions.batch_colors != WIDTH * HEIGHT)) {
+	comac_test_log (ctx,
+			"Expected %d pixels converted in batches, "
+			"got %u in batches and %d one at a time\n",
+			WIDTH * HEIGHT,
+			conversions.batch_colors,
+			conversions.single_calls);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    if (check_image (ctx,
+		     COMAC_COLORSPACE_CMYK,
+		     FALSE,
+		     "/ColorSpace /DeviceCMYK"))
+	result = COMAC_TEST_FAILURE;
+    if (check_image (ctx,
+		     COMAC_COLORSPACE_CMYK,
+		     TRUE,
+		     "/ColorSpace /DeviceCMYK"))
+	result = COMAC_TEST_FAILURE;
+    if (check_image (ctx,
+		     COMAC_COLORSPACE_GRAY,
+		     TRUE,
+		     "/ColorSpace /DeviceGray"))
+	result = COMAC_TEST_FAILURE;
+
+    return result;
+}
+
+COMAC_TEST (pdf_image_colorspace,
+	    "Check that PDF images are converted to the surface colorspace",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,367 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+#include "comacint.h"
+#include "comac-image-surface-private.h"
+#include "comac-pdf-image-private.h"
+
+#include <string.h>
+
+/* Check the conversion of images to PDF image data against the
+ * per-pixel formulas it replaced: unpremultiplying with
+ * (c * 255 + a / 2) / a, narrowing to gray or 1-bit data and packing
+ * bits most significant first.
+ */
+
+static unsigned char
+unpremultiply (unsigned int c, unsigned int a)
+{
+    if (a == 0)
+	return 0;
+
+    return (c * 255 + a / 2) / a;
+}
+
+/* Returns an image with the pixel at (x, y) set by @pixel. */
+static comac_surface_t *
+create_image (comac_format_t format,
+	      int width,
+	      int height,
+	      uint32_t (*pixel) (int x, int y))
+{
+    comac_surface_t *surface;
+    unsigned char *data;
+    int stride, x, y;
+
+    surface = comac_image_surface_create (format, width, height);
+    comac_surface_flush (surface);
+    data = comac_image_surface_get_data (surface);
+    stride = comac_image_surface_get_stride (surface);
+    for (y = 0; y < height; y++) {
+	for (x = 0; x < width; x++) {
+	    if (format == COMAC_FORMAT_A8)
+		data[y * stride + x] = pixel (x, y);
+	    else
+		((uint32_t *) (data + y * stride))[x] = pixel (x, y);
+	}
+    }
+    comac_surface_mark_dirty (surface);
+
+    return surface;
+}
+
+/* Every value x up to every alpha y, in a different mix per channel. */
+static uint32_t
+premultiplied_pixel (int x, int y)
+{
+    uint32_t r = MIN (x, y);
+
+    return (uint32_t) y << 24 | r << 16 | (y - r) << 8 | r / 2;
+}
+
+static uint32_t
+gray_pixel (int x, int y)
+{
+    return 0xff000000 | x * 0x010101;
+}
+
+/* Opaque black and white and transparent pixels, on rows that do not
+ * end on a byte. */
+static uint32_t
+bilevel_pixel (int x, int y)
+{
+    switch ((x * 7 + y * 3) % 5) {
+    case 0:
+	return 0;
+    case 1:
+    case 2:
+	return 0xff000000;
+    default:
+	return 0xffffffff;
+    }
+}
+
+static uint32_t
+a8_pixel (int x, int y)
+{
+    return (x * 37 + y * 11) & 0xff;
+}
+
+static comac_test_status_t
+check_planes (comac_test_context_t *ctx,
+	      const char *name,
+	      comac_surface_t *surface,
+	      comac_image_color_t color,
+	      comac_image_transparency_t transparency,
+	      const unsigned char *color_data,
+	      unsigned long color_size,
+	      const unsigned char *alpha_data,
+	      unsigned long alpha_size)
+{
+    comac_pdf_image_planes_t planes;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    unsigned long i;
+
+    status = _comac_pdf_image_planes_init (&planes,
+					   (comac_image_surface_t *) surface,
+					   TRUE,
+					   TRUE);
+    if (status) {
+	comac_test_log (ctx,
+			"%s: failed to convert image: %s\n",
+			name,
+			comac_status_to_string (status));
+	return COMAC_TEST_FAILURE;
+    }
+
+    if (planes.color != color || planes.transparency != transparency) {
+	comac_test_log (ctx,
+			"%s: classified as color %d, transparency %d "
+			"instead of %d, %d\n",
+			name,
+			planes.color,
+			planes.transparency,
+			color,
+			transparency);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    if (planes.color_size != color_size) {
+	comac_test_log (ctx,
+			"%s: %lu bytes of color instead of %lu\n",
+			name,
+			planes.color_size,
+			color_size);
+	result = COMAC_TEST_FAILURE;
+    } else {
+	for (i = 0; i < color_size; i++) {
+	    if (planes.color_data[i] != color_data[i]) {
+		comac_test_log (ctx,
+				"%s: color byte %lu is %d instead of %d\n",
+				name,
+				i,
+				planes.color_data[i],
+				color_data[i]);
+		result = COMAC_TEST_FAILURE;
+		break;
+	    }
+	}
+    }
+
+    if (planes.alpha_size != alpha_size ||
+	(alpha_data == NULL) != (planes.alpha_data == NULL)) {
+	comac_test_log (ctx,
+			"%s: %lu bytes of alpha instead of %lu\n",
+			name,
+			planes.alpha_size,
+			alpha_size);
+	result = COMAC_TEST_FAILURE;
+    } else {
+	for (i = 0; i < alpha_size; i++) {
+	    if (planes.alpha_data[i] != alpha_data[i]) {
+		comac_test_log (ctx,
+				"%s: alpha byte %lu is %d instead of %d\n",
+				name,
+				i,
+				planes.alpha_data[i],
+				alpha_data[i]);
+		result = COMAC_TEST_FAILURE;
+		break;
+	    }
+	}
+    }
+
+CLEANUP:
+    _comac_pdf_image_planes_fini (&planes);
+
+    return result;
+}
+
+static comac_test_status_t
+check_premultiplied (comac_test_context_t *ctx)
+{
+    unsigned char color[256 * 256 * 3], alpha[256 * 256];
+    comac_surface_t *surface;
+    comac_test_status_t result;
+    uint32_t p;
+    int x, y, i;
+
+    for (y = 0; y < 256; y++) {
+	for (x = 0; x < 256; x++) {
+	    i = y * 256 + x;
+	    p = premultiplied_pixel (x, y);
+	    color[3 * i + 0] = unpremultiply ((p >> 16) & 0xff, y);
+	    color[3 * i + 1] = unpremultiply ((p >> 8) & 0xff, y);
+	    color[3 * i + 2] = unpremultiply (p & 0xff, y);
+	    alpha[i] = y;
+	}
+    }
+
+    surface = create_image (COMAC_FORMAT_ARGB32, 256, 256, premultiplied_pixel);
+    result = check_planes (ctx,
+			   "premultiplied",
+			   surface,
+			   COMAC_IMAGE_IS_COLOR,
+			   COMAC_IMAGE_HAS_ALPHA,
+			   color,
+			   sizeof (color),
+			   alpha,
+			   sizeof (alpha));
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+check_gray (comac_test_context_t *ctx)
+{
+    unsigned char color[256 * 2];
+    comac_surface_t *surface;
+    comac_test_status_t result;
+    int i;
+
+    for (i = 0; i < 256 * 2; i++)
+	color[i] = i % 256;
+
+    surface = create_image (COMAC_FORMAT_ARGB32, 256, 2, gray_pixel);
+    result = check_planes (ctx,
+			   "gray",
+			   surface,
+			   COMAC_IMAGE_IS_GRAYSCALE,
+			   COMAC_IMAGE_IS_OPAQUE,
+			   color,
+			   sizeof (color),
+			   NULL,
+			   0);
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+#define BILEVEL_WIDTH 21
+#define BILEVEL_HEIGHT 5
+#define BILEVEL_ROW_SIZE ((BILEVEL_WIDTH + 7) / 8)
+
+static comac_test_status_t
+check_bilevel (comac_test_context_t *ctx)
+{
+    unsigned char color[BILEVEL_ROW_SIZE * BILEVEL_HEIGHT];
+    unsigned char alpha[BILEVEL_ROW_SIZE * BILEVEL_HEIGHT];
+    comac_surface_t *surface;
+    comac_test_status_t result;
+    uint32_t p;
+    int x, y, i;
+
+    memset (color, 0, sizeof (color));
+    memset (alpha, 0, sizeof (alpha));
+    for (y = 0; y < BILEVEL_HEIGHT; y++) {
+	for (x = 0; x < BILEVEL_WIDTH; x++) {
+	    i = y * BILEVEL_ROW_SIZE + x / 8;
+	    p = bilevel_pixel (x, y);
+	    if (p & 0xff)
+		color[i] |= 0x80 >> (x % 8);
+	    if (p >> 24)
+		alpha[i] |= 0x80 >> (x % 8);
+	}
+    }
+
+    surface = create_image (COMAC_FORMAT_ARGB32,
+			    BILEVEL_WIDTH,
+			    BILEVEL_HEIGHT,
+			    bilevel_pixel);
+    result = check_planes (ctx,
+			   "bilevel",
+			   surface,
+			   COMAC_IMAGE_IS_MONOCHROME,
+			   COMAC_IMAGE_HAS_BILEVEL_ALPHA,
+			   color,
+			   sizeof (color),
+			   alpha,
+			   sizeof (alpha));
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+check_a8 (comac_test_context_t *ctx)
+{
+    unsigned char color[13 * 3], alpha[13 * 3];
+    comac_surface_t *surface;
+    comac_test_status_t result;
+    int x, y;
+
+    /* Only the alpha of A8 images is used. */
+    memset (color, 0, sizeof (color));
+    for (y = 0; y < 3; y++) {
+	for (x = 0; x < 13; x++)
+	    alpha[y * 13 + x] = a8_pixel (x, y);
+    }
+
+    surface = create_image (COMAC_FORMAT_A8, 13, 3, a8_pixel);
+    result = check_planes (ctx,
+			   "a8",
+			   surface,
+			   COMAC_IMAGE_IS_GRAYSCALE,
+			   COMAC_IMAGE_HAS_ALPHA,
+			   color,
+			   sizeof (color),
+			   alpha,
+			   sizeof (alpha));
+    comac_surface_destroy (surface);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    if (check_premultiplied (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_gray (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_bilevel (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+    if (check_a8 (ctx) != COMAC_TEST_SUCCESS)
+	result = COMAC_TEST_FAILURE;
+
+    return result;
+}
+
+COMAC_TEST (pdf_image_data,
+	    "Check the conversion of images to PDF image data",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that images with the same pixels drawn from different surfaces
+ * are written once when deduplication is enabled, and that images with
+ * different pixels are not merged.
+ */
+
+#define SIZE 32
+
+static comac_surface_t *
+create_image (comac_format_t format, int seed)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    int stride, x, y;
+
+    image = comac_image_surface_create (format, SIZE, SIZE);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data == NULL)
+	return image;
+
+    /* Translucent pixels are premultiplied, so the alpha is the
+     * largest component. */
+    for (y = 0; y < SIZE; y++) {
+	row = (uint32_t *) (data + y * stride);
+	for (x = 0; x < SIZE; x++)
+	    row[x] = 0x80000000 | ((x * 4) << 16) | ((y * 4) << 8) | seed;
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+/* Paints two copies of an opaque image, a different one and two copies
+ * of a translucent image, which also has a soft mask. */
+static comac_status_t
+write_pdf (pdf_test_output_t *output, comac_bool_t deduplicate)
+{
+    struct {
+	comac_format_t format;
+	int seed;
+    } images[] = {
+	{COMAC_FORMAT_RGB24, 1},
+	{COMAC_FORMAT_RGB24, 1},
+	{COMAC_FORMAT_RGB24, 2},
+	{COMAC_FORMAT_ARGB32, 3},
+	{COMAC_FORMAT_ARGB32, 3},
+    };
+    comac_surface_t *surface, *image;
+    comac_status_t status;
+    comac_t *cr;
+    int i;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   ARRAY_LENGTH (images) * SIZE,
+						   SIZE);
+    comac_pdf_surface_set_deduplicate_images (surface, deduplicate);
+
+    cr = comac_create (surface);
+    for (i = 0; i < ARRAY_LENGTH (images); i++) {
+	image = create_image (images[i].format, images[i].seed);
+	comac_set_source_surface (cr, image, i * SIZE, 0);
+	comac_paint (cr);
+	comac_surface_destroy (image);
+    }
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const char *error;
+    int deduplicate, num_images, expected;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (deduplicate = 0; deduplicate <= 1; deduplicate++) {
+	status = write_pdf (&output, deduplicate);
+	if (status) {
+	    comac_test_log (ctx,
+			    "Failed to write pdf: %s\n",
+			    comac_status_to_string (status));
+	    pdf_test_output_fini (&output);
+	    return COMAC_TEST_FAILURE;
+	}
+
+	doc = pdf_test_document_create (output.data, output.length);
+	error = pdf_test_document_get_error (doc);
+	if (error) {
+	    comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	    result = COMAC_TEST_FAILURE;
+	} else {
+	    /* Counting the soft masks of the translucent images */
+	    expected = deduplicate ? 2 + 2 : 3 + 2 * 2;
+	    num_images =
+		pdf_test_document_count_objects (doc, "/Subtype /Image");
+	    if (num_images != expected) {
+		comac_test_log (ctx,
+				"Expected %d images %s deduplication, "
+				"found %d\n",
+				expected,
+				deduplicate ? "with" : "without",
+				num_images);
+		result = COMAC_TEST_FAILURE;
+	    }
+	}
+
+	pdf_test_document_destroy (doc);
+	pdf_test_output_fini (&output);
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_image_dedup,
+	    "Check that identical PDF images are written once",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
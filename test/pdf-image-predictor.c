@@ -0,0 +1,117 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that images written with PNG predictors give a valid PDF file
+ * that draws the same as without them, and that images are described
+ * with /Predictor 15 only when predictors are enabled.
+ */
+
+static void
+set_predictor (comac_surface_t *surface, void *closure)
+{
+    comac_pdf_surface_set_image_predictor (surface, TRUE);
+}
+
+/* The number of images written with PNG predictors in @output */
+static int
+count_predictors (const pdf_test_output_t *output)
+{
+    pdf_test_document_t *doc;
+    const char *object;
+    int id, count = 0;
+
+    doc = pdf_test_document_create (output->data, output->length);
+    if (pdf_test_document_get_error (doc) == NULL) {
+	id = 0;
+	while ((id = pdf_test_document_find_object (doc,
+						    id + 1,
+						    "/Subtype /Image"))) {
+	    object = pdf_test_document_get_object (doc, id);
+	    if (strstr (object, "/Predictor 15"))
+		count++;
+	}
+    }
+    pdf_test_document_destroy (doc);
+
+    return count;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t reference = PDF_TEST_OUTPUT_INIT;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    status = pdf_test_write_document (&reference, NULL, NULL);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = pdf_test_write_document (&output, set_predictor, NULL);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    result = pdf_test_compare_outputs (ctx, "predictor", &reference, &output);
+    if (result != COMAC_TEST_SUCCESS)
+	goto CLEANUP;
+
+    if (count_predictors (&reference) != 0) {
+	comac_test_log (ctx, "Predictors are used by default\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    if (count_predictors (&output) == 0) {
+	comac_test_log (ctx, "Predictors are not used when enabled\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_output_fini (&reference);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_image_predictor,
+	    "Check PDF images written with PNG predictors",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
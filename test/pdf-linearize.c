@@ -0,0 +1,331 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that a linearized PDF file starts with the linearization
+ * dictionary, that the file length recorded in it is correct and that
+ * the final startxref points at the first page cross-reference table.
+ * The second page has a content stream larger than the stream buffer
+ * of the surface, whose /Length is an object of its own. Every entry
+ * of both cross-reference tables must point at its object, and the
+ * hint tables at the page and shared objects.
+ */
+
+#define NUM_PAGES 4
+#define NUM_RECTANGLES 8000
+
+typedef struct _bits {
+    const unsigned char *data;
+    size_t length;
+    size_t pos;
+} bits_t;
+
+static long long
+read_bits (bits_t *bits, int num_bits)
+{
+    long long value = 0;
+
+    while (num_bits--) {
+	if (bits->pos / 8 >= bits->length)
+	    return -1;
+	value <<= 1;
+	value |= (bits->data[bits->pos / 8] >> (7 - bits->pos % 8)) & 1;
+	bits->pos++;
+    }
+
+    return value;
+}
+
+static void
+draw_rectangles (comac_t *cr)
+{
+    unsigned int seed = 1;
+    int i;
+
+    /* Random numbers that deflate cannot shrink much */
+    for (i = 0; i < NUM_RECTANGLES; i++) {
+	double v[4];
+	int j;
+
+	for (j = 0; j < 4; j++) {
+	    seed = seed * 1103515245 + 12345;
+	    v[j] = (seed >> 8) % 20000 / 100.;
+	}
+	comac_rectangle (cr, v[0], v[1], v[2] / 10, v[3] / 10);
+    }
+    comac_set_source_rgb (cr, 1, 0.5, 0);
+    comac_fill (cr);
+}
+
+static comac_status_t
+write_pdf (pdf_test_output_t *output)
+{
+    comac_surface_t *surface, *image;
+    comac_t *cr;
+    comac_status_t status;
+    char text[32];
+    int page;
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24, 20, 20);
+    cr = comac_create (image);
+    comac_set_source_rgb (cr, 0, 0.5, 1);
+    comac_paint (cr);
+    comac_destroy (cr);
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   200,
+						   200);
+    comac_pdf_surface_set_linearize (surface, TRUE);
+    cr = comac_create (surface);
+
+    for (page = 0; page < NUM_PAGES; page++) {
+	if (page == 1)
+	    draw_rectangles (cr);
+
+	comac_select_font_face (cr,
+				COMAC_TEST_FONT_FAMILY " Sans",
+				COMAC_FONT_SLANT_NORMAL,
+				page % 2 ? COMAC_FONT_WEIGHT_BOLD
+					 : COMAC_FONT_WEIGHT_NORMAL);
+	comac_set_font_size (cr, 16);
+	comac_move_to (cr, 20, 40);
+	sprintf (text, "Page %d", page + 1);
+	comac_show_text (cr, text);
+
+	comac_set_source_surface (cr, image, 20 + 10 * page, 80);
+	comac_paint (cr);
+	comac_show_page (cr);
+    }
+
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+    comac_surface_destroy (image);
+
+    return status;
+}
+
+/* Whether object @id starts at @offset of a file without the hint
+ * stream, as offsets are given in the hint tables. */
+static comac_bool_t
+is_object_at (const pdf_test_output_t *output,
+	      long long offset,
+	      long long hint_offset,
+	      long long hint_length,
+	      int id)
+{
+    int object_id;
+
+    if (offset >= hint_offset)
+	offset += hint_length;
+    if (offset <= 0 || offset >= (long long) output->length)
+	return FALSE;
+
+    return sscanf ((const char *) output->data + offset,
+		   "%d 0 obj",
+		   &object_id) == 1 &&
+	   object_id == id;
+}
+
+static const char *
+check_hints (const pdf_test_output_t *output,
+	     pdf_test_document_t *doc,
+	     long long hint_offset,
+	     long long hint_length)
+{
+    unsigned char *hints;
+    size_t length;
+    bits_t bits;
+    long long offset, min_length, page_length[NUM_PAGES];
+    int i, id, object_bits, length_bits, shared_offset;
+    const char *error = NULL;
+
+    if (sscanf ((const char *) output->data + hint_offset,
+		"%d 0 obj",
+		&id) != 1 ||
+	sscanf (pdf_test_document_get_object (doc, id),
+		" << /Length %*d /S %d",
+		&shared_offset) != 1)
+	return "/H does not point at the hint stream";
+
+    hints = pdf_test_document_get_stream (doc, id, FALSE, &length);
+    if (hints == NULL)
+	return "the hint stream cannot be read";
+
+    /* The page offset hint table header */
+    bits.data = hints;
+    bits.length = length;
+    bits.pos = 32;
+    offset = read_bits (&bits, 32);
+    object_bits = read_bits (&bits, 16);
+    min_length = read_bits (&bits, 32);
+    length_bits = read_bits (&bits, 16);
+
+    /* The 36 byte header is followed by the number of objects of each
+     * page, then by their lengths. */
+    bits.pos = 36 * 8 + object_bits * NUM_PAGES;
+    bits.pos = (bits.pos + 7) & ~7;
+    for (i = 0; i < NUM_PAGES; i++)
+	page_length[i] = min_length + read_bits (&bits, length_bits);
+
+    /* Pages follow each other from the first page object */
+    for (i = 0; i < NUM_PAGES; i++) {
+	if (! is_object_at (output,
+			    offset,
+			    hint_offset,
+			    hint_length,
+			    pdf_test_document_get_page (doc, i)))
+	{
+	    error = "the page offset hint table does not match the pages";
+	    break;
+	}
+	offset += page_length[i];
+    }
+
+    /* The shared object hint table starts with the first shared
+     * object, if there is one. */
+    bits.pos = shared_offset * 8;
+    id = read_bits (&bits, 32);
+    offset = read_bits (&bits, 32);
+    if (error == NULL && id != 0 &&
+	! is_object_at (output, offset, hint_offset, hint_length, id))
+	error = "the shared object hint table does not match the objects";
+
+    free (hints);
+
+    return error;
+}
+
+static const char *
+check_output (const pdf_test_output_t *output, pdf_test_document_t *doc)
+{
+    const char *data = (const char *) output->data;
+    const char *p;
+    long long value, hint_offset, hint_length, end, main_xref;
+    int first_page;
+
+    /* The linearization dictionary must be the first object. */
+    p = strstr (data, "obj\n");
+    if (p == NULL || strncmp (p + 4, "<< /Linearized 1 ", 17) != 0)
+	return "the linearization dictionary is not the first object";
+
+    if (sscanf (p + 4,
+		"<< /Linearized 1 /L %lld /H [ %lld %lld ] /O %d /E %lld"
+		" /N %*d /T %lld",
+		&value,
+		&hint_offset,
+		&hint_length,
+		&first_page,
+		&end,
+		&main_xref) != 6)
+	return "the linearization dictionary cannot be read";
+
+    if (value != (long long) output->length)
+	return "/L does not match the file length";
+
+    if (pdf_test_document_get_num_pages (doc) != NUM_PAGES ||
+	first_page != pdf_test_document_get_page (doc, 0))
+	return "/O is not the first page";
+
+    /* The first page ends where the second page object starts */
+    if (! is_object_at (output,
+			end,
+			0,
+			0,
+			pdf_test_document_get_page (doc, 1)))
+	return "/E does not point at the end of the first page";
+
+    /* /T points at the end of the line before the first entry */
+    if (main_xref <= 0 || main_xref >= (long long) output->length ||
+	strncmp (data + main_xref, "\n0000000000 65535 f", 19) != 0)
+	return "/T does not point at the main xref";
+
+    /* The last startxref points at the first page cross-reference
+     * table, which directly follows the linearization dictionary. */
+    p = data + output->length;
+    while (p > data && strncmp (p, "startxref\n", 10) != 0)
+	p--;
+    if (sscanf (p + 10, "%lld", &value) != 1 || value <= 0 ||
+	value >= (long long) output->length ||
+	data + value != strstr (data, "xref\n"))
+	return "startxref does not point at the first page xref";
+
+    return check_hints (output, doc, hint_offset, hint_length);
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc;
+    comac_status_t status;
+    const char *error;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    status = write_pdf (&output);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&output);
+	return COMAC_TEST_FAILURE;
+    }
+
+    /* Reading the file checks the cross-reference tables */
+    doc = pdf_test_document_create (output.data, output.length);
+    error = pdf_test_document_get_error (doc);
+    if (error == NULL)
+	error = check_output (&output, doc);
+    if (error)
+	comac_test_log (ctx, "Invalid linearized pdf: %s\n", error);
+    pdf_test_document_destroy (doc);
+    pdf_test_output_fini (&output);
+    if (error)
+	return COMAC_TEST_FAILURE;
+
+    return COMAC_TEST_SUCCESS;
+}
+
+COMAC_TEST (pdf_linearize,
+	    "Check the structure of linearized PDF output",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "comac-test.h"
+#include "pdf-test-utils.h"
+#include "comacint.h"
+#include "comac-pdf-surface-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that groups and page surfaces whose memory streams are moved to
+ * a temporary file give the same file, byte for byte, as when they are
+ * held in memory. The file is written to disk so that the temporary
+ * files are copied to it with copy_file_range() or sendfile() where
+ * available.
+ */
+
+#define BASENAME "pdf-memory-spill.out"
+/* Below the size of every group and page surface of the file */
+#define LIMIT 16
+#define WIDTH 300
+#define HEIGHT 300
+
+static void
+draw_content (comac_t *cr, int seed)
+{
+    int i;
+
+    for (i = 0; i < 2000; i++) {
+	comac_rectangle (cr,
+			 (i * 37 + seed) % WIDTH,
+			 (i * 91 + seed) % HEIGHT,
+			 1 + i % 13,
+			 1 + i % 7);
+	comac_set_source_rgb (cr, (i % 5) / 4., (i % 3) / 2., (i % 7) / 6.);
+	comac_fill (cr);
+    }
+}
+
+/* A page whose content is drawn in a group painted through a soft
+ * mask */
+static void
+draw_page (comac_surface_t *surface, int seed)
+{
+    comac_pattern_t *mask;
+    comac_t *cr;
+
+    cr = comac_create (surface);
+    comac_push_group (cr);
+    draw_content (cr, seed);
+    comac_pop_group_to_source (cr);
+    mask = comac_pattern_create_linear (0, 0, WIDTH, 0);
+    comac_pattern_add_color_stop_rgba (mask, 0, 0, 0, 0, 1);
+    comac_pattern_add_color_stop_rgba (mask, 1, 0, 0, 0, .2);
+    comac_mask (cr, mask);
+    comac_pattern_destroy (mask);
+    comac_show_page (cr);
+    comac_destroy (cr);
+}
+
+static comac_status_t
+write_file (const char *filename, size_t limit)
+{
+    comac_surface_t *surface, *page;
+    comac_status_t status;
+
+    surface = comac_pdf_surface_create (filename, WIDTH, HEIGHT);
+    if (limit)
+	_comac_pdf_surface_set_memory_stream_limit (surface, limit);
+    comac_pdf_surface_set_metadata (surface,
+				    COMAC_PDF_METADATA_CREATE_DATE,
+				    "2026-01-01T00:00:00");
+
+    draw_page (surface, 0);
+
+    page = comac_pdf_surface_create_page (surface, WIDTH, HEIGHT);
+    draw_page (page, 1);
+    draw_page (page, 2);
+    comac_pdf_surface_append_page (surface, page);
+    comac_surface_destroy (page);
+
+    comac_surface_finish (surface);
+    status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t reference = PDF_TEST_OUTPUT_INIT;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    char *filename;
+    const char *path =
+	comac_test_mkdir (COMAC_TEST_OUTPUT_DIR) ? COMAC_TEST_OUTPUT_DIR : ".";
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    xasprintf (&filename, "%s/%s.pdf", path, BASENAME);
+
+    status = write_file (filename, 0);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = pdf_test_output_read_file (&reference, filename);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = write_file (filename, LIMIT);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = pdf_test_output_read_file (&output, filename);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write %s: %s\n",
+			filename,
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+    } else if (output.length != reference.length ||
+	       memcmp (output.data, reference.data, output.length)) {
+	comac_test_log (ctx,
+			"The file differs when the groups and pages are "
+			"moved to temporary files\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+    free (filename);
+    pdf_test_output_fini (&reference);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_memory_spill,
+	    "Check PDF groups and pages held in temporary files",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
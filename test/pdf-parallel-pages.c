@@ -0,0 +1,337 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that pages drawn on page surfaces in several threads, and
+ * appended to the document in another order than they were created
+ * in, give a valid document with the pages in the order they were
+ * appended.
+ */
+
+#define N_PAGES 6
+#define HEIGHT 100
+
+/* Page surface i is drawn with a width of WIDTH (i), which tells the
+ * pages apart in the document. The page drawn on the document itself
+ * has a width of WIDTH (N_PAGES). */
+#define WIDTH(i) (100 + (i))
+
+static const int append_order[N_PAGES] = {3, 0, 5, 1, 4, 2};
+
+typedef struct _page {
+    comac_surface_t *surface;
+    int index;
+    comac_status_t status;
+} page_t;
+
+static void
+draw_page (comac_t *cr, int index)
+{
+    char text[32];
+    int i;
+
+    for (i = 0; i < 50; i++) {
+	comac_set_source_rgb (cr, (index + 1) / 8., i / 50., 0.5);
+	comac_rectangle (cr, i * 2, i, 10, 10);
+	comac_fill (cr);
+    }
+
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Sans",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_NORMAL);
+    comac_set_font_size (cr, 12);
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_move_to (cr, 10, 90);
+    snprintf (text, sizeof (text), "Page %d", index);
+    comac_show_text (cr, text);
+
+    comac_show_page (cr);
+}
+
+static void *
+draw_thread (void *arg)
+{
+    page_t *page = arg;
+    comac_t *cr;
+
+    cr = comac_create (page->surface);
+    draw_page (cr, page->index);
+    page->status = comac_status (cr);
+    comac_destroy (cr);
+
+    return NULL;
+}
+
+/* The number of fonts in a document whose pages are all drawn on the
+ * document itself. */
+static int
+count_fonts (void)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc;
+    comac_surface_t *surface;
+    comac_t *cr;
+    int i, num_fonts = -1;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   &output,
+						   WIDTH (N_PAGES),
+						   HEIGHT);
+    cr = comac_create (surface);
+    for (i = 0; i <= N_PAGES; i++)
+	draw_page (cr, i);
+    comac_destroy (cr);
+    comac_surface_finish (surface);
+    if (comac_surface_status (surface) == COMAC_STATUS_SUCCESS) {
+	doc = pdf_test_document_create (output.data, output.length);
+	if (pdf_test_document_get_error (doc) == NULL)
+	    num_fonts = pdf_test_document_count_objects (doc, "/Type /Font");
+	pdf_test_document_destroy (doc);
+    }
+    comac_surface_destroy (surface);
+    pdf_test_output_fini (&output);
+
+    return num_fonts;
+}
+
+static comac_test_status_t
+check_document (comac_test_context_t *ctx,
+		const pdf_test_output_t *output,
+		int num_fonts)
+{
+    pdf_test_document_t *doc;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    const char *error, *object;
+    char media_box[64];
+    int i, width;
+
+    doc = pdf_test_document_create (output->data, output->length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    if (pdf_test_document_get_num_pages (doc) != N_PAGES + 1) {
+	comac_test_log (ctx,
+			"Expected %d pages, found %d\n",
+			N_PAGES + 1,
+			pdf_test_document_get_num_pages (doc));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    for (i = 0; i <= N_PAGES; i++) {
+	width = i == 0 ? WIDTH (N_PAGES) : WIDTH (append_order[i - 1]);
+	snprintf (media_box,
+		  sizeof (media_box),
+		  "/MediaBox [ 0 0 %d %d ]",
+		  width,
+		  HEIGHT);
+	object = pdf_test_document_get_object (
+	    doc,
+	    pdf_test_document_get_page (doc, i));
+	if (object == NULL || strstr (object, media_box) == NULL) {
+	    comac_test_log (ctx,
+			    "Page %d is not %d points wide: %s\n",
+			    i,
+			    width,
+			    object ? object : "(missing)");
+	    result = COMAC_TEST_FAILURE;
+	}
+    }
+
+    /* The glyphs of every page are subset into the fonts of the
+     * document, as when the pages are all drawn on it. */
+    if (pdf_test_document_count_objects (doc, "/Type /Font") !=
+	num_fonts) {
+	comac_test_log (ctx,
+			"Expected %d fonts, found %d\n",
+			num_fonts,
+			pdf_test_document_count_objects (doc, "/Type /Font"));
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+
+    return result;
+}
+
+/* Check that page surfaces that are still being drawn when their
+ * document is finished are set in error instead of writing to the
+ * document. */
+static comac_test_status_t
+check_finished_document (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_surface_t *document, *pages[2];
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    comac_t *cr;
+    int i;
+
+    document = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						    &output,
+						    WIDTH (N_PAGES),
+						    HEIGHT);
+    for (i = 0; i < 2; i++) {
+	pages[i] = comac_pdf_surface_create_page (document, WIDTH (i), HEIGHT);
+	cr = comac_create (pages[i]);
+	draw_page (cr, i);
+	comac_rectangle (cr, 10, 10, 20, 20);
+	comac_fill (cr);
+	comac_destroy (cr);
+    }
+
+    comac_surface_finish (document);
+    status = comac_surface_status (document);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+    }
+
+    comac_surface_show_page (pages[0]);
+    for (i = 0; i < 2; i++) {
+	status = comac_surface_status (pages[i]);
+	if (status != COMAC_STATUS_SURFACE_FINISHED) {
+	    comac_test_log (ctx,
+			    "Page surface %d of a finished document: %s\n",
+			    i,
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	}
+	comac_surface_destroy (pages[i]);
+    }
+    comac_surface_destroy (document);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_surface_t *document;
+    pthread_t threads[N_PAGES];
+    page_t pages[N_PAGES];
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    comac_t *cr;
+    int i, num_threads;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    document = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						    &output,
+						    WIDTH (N_PAGES),
+						    HEIGHT);
+
+    for (i = 0; i < N_PAGES; i++) {
+	pages[i].surface =
+	    comac_pdf_surface_create_page (document, WIDTH (i), HEIGHT);
+	pages[i].index = i;
+	pages[i].status = COMAC_STATUS_SUCCESS;
+    }
+
+    for (num_threads = 0; num_threads < N_PAGES; num_threads++) {
+	if (pthread_create (&threads[num_threads],
+			    NULL,
+			    draw_thread,
+			    &pages[num_threads]) != 0) {
+	    comac_test_log (ctx, "Failed to create a thread\n");
+	    result = COMAC_TEST_FAILURE;
+	    break;
+	}
+    }
+
+    /* Meanwhile, draw the first page on the document itself. */
+    cr = comac_create (document);
+    draw_page (cr, N_PAGES);
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    for (i = 0; i < num_threads; i++)
+	pthread_join (threads[i], NULL);
+
+    for (i = 0; i < N_PAGES; i++) {
+	if (status == COMAC_STATUS_SUCCESS)
+	    status = pages[i].status;
+    }
+
+    if (result == COMAC_TEST_SUCCESS) {
+	for (i = 0; i < N_PAGES; i++)
+	    comac_pdf_surface_append_page (document,
+					   pages[append_order[i]].surface);
+    }
+
+    for (i = 0; i < N_PAGES; i++)
+	comac_surface_destroy (pages[i].surface);
+
+    comac_surface_finish (document);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (document);
+    comac_surface_destroy (document);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+    }
+
+    if (result == COMAC_TEST_SUCCESS)
+	result = check_document (ctx, &output, count_fonts ());
+
+    pdf_test_output_fini (&output);
+
+    if (result == COMAC_TEST_SUCCESS)
+	result = check_finished_document (ctx);
+
+    return result;
+}
+
+COMAC_TEST (pdf_parallel_pages,
+	    "Check a document whose pages are drawn in several threads",
+	    "pdf, threads", /* keywords */
+	    NULL,           /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
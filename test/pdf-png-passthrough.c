@@ -0,0 +1,453 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that the data of 8-bit gray and RGB PNG images attached as
+ * mime data is copied to the PDF file as it is, with the PNG
+ * predictors, and that the images it cannot describe are drawn from
+ * their pixels instead.
+ */
+
+#define WIDTH 16
+#define HEIGHT 8
+
+#define PNG_GRAY 0
+#define PNG_RGB 2
+#define PNG_PALETTE 3
+#define PNG_RGB_ALPHA 6
+
+typedef enum {
+    IDAT_ONE,	  /* all the data in one IDAT chunk */
+    IDAT_SEVERAL, /* in IDAT chunks following each other */
+    IDAT_SPLIT,	  /* in IDAT chunks with another chunk between them */
+} idat_t;
+
+typedef struct _png_case {
+    const char *name;
+    int color_type;
+    comac_bool_t interlaced;
+    comac_bool_t trns;
+    idat_t idat;
+    comac_bool_t passthrough;
+} png_case_t;
+
+static const png_case_t cases[] = {
+    {"rgb", PNG_RGB, FALSE, FALSE, IDAT_ONE, TRUE},
+    {"rgb-idats", PNG_RGB, FALSE, FALSE, IDAT_SEVERAL, TRUE},
+    {"gray", PNG_GRAY, FALSE, FALSE, IDAT_ONE, TRUE},
+    {"rgba", PNG_RGB_ALPHA, FALSE, FALSE, IDAT_ONE, FALSE},
+    {"palette", PNG_PALETTE, FALSE, FALSE, IDAT_ONE, FALSE},
+    {"trns", PNG_RGB, FALSE, TRUE, IDAT_ONE, FALSE},
+    {"interlaced", PNG_RGB, TRUE, FALSE, IDAT_ONE, FALSE},
+    {"split-idat", PNG_RGB, FALSE, FALSE, IDAT_SPLIT, FALSE},
+};
+
+static int
+num_channels (int color_type)
+{
+    switch (color_type) {
+    case PNG_RGB:
+	return 3;
+    case PNG_RGB_ALPHA:
+	return 4;
+    default:
+	return 1;
+    }
+}
+
+static unsigned char
+pixel_value (int x, int y, int c)
+{
+    return (x * 16 + y * 32 + c * 64) & 0xff;
+}
+
+/* The rows of the image as a PNG decoder gives them, each starting
+ * with its filter type, which is None. The stored size of the rows
+ * is returned in @length. */
+static unsigned char *
+make_rows (const png_case_t *png, size_t *length)
+{
+    int channels = num_channels (png->color_type);
+    unsigned char *rows, *p;
+    int x, y, c;
+
+    *length = HEIGHT * (1 + WIDTH * channels);
+    rows = malloc (*length);
+    if (rows == NULL)
+	return NULL;
+
+    p = rows;
+    for (y = 0; y < HEIGHT; y++) {
+	*p++ = 0;
+	for (x = 0; x < WIDTH; x++) {
+	    for (c = 0; c < channels; c++)
+		*p++ = png->color_type == PNG_PALETTE ? (x + y) % 4
+						      : pixel_value (x, y, c);
+	}
+    }
+
+    return rows;
+}
+
+static unsigned char *
+write_be32 (unsigned char *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+
+    return p + 4;
+}
+
+static unsigned char *
+write_chunk (unsigned char *p,
+	     const char *type,
+	     const unsigned char *data,
+	     size_t length)
+{
+    unsigned char *start;
+
+    p = write_be32 (p, length);
+    start = p;
+    memcpy (p, type, 4);
+    if (length)
+	memcpy (p + 4, data, length);
+    p += 4 + length;
+
+    return write_be32 (p, crc32 (0, start, 4 + length));
+}
+
+/* Writes the PNG file of @png to @png_data, and its compressed data
+ * to @idat_data. */
+static comac_bool_t
+make_png (const png_case_t *png,
+	  unsigned char **png_data,
+	  size_t *png_length,
+	  unsigned char **idat_data,
+	  size_t *idat_length)
+{
+    static const unsigned char magic[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    static const unsigned char palette[12] =
+	{255, 0, 0, 0, 255, 0, 0, 0, 255, 255, 255, 255};
+    static const unsigned char trns[6] = {0, 0, 0, 0, 0, 0};
+    static const unsigned char text[] = "Comment\0between IDAT chunks";
+    unsigned char ihdr[13];
+    unsigned char *rows, *p;
+    uLongf compressed_length;
+    size_t rows_length, chunk_length, offset;
+
+    rows = make_rows (png, &rows_length);
+    if (rows == NULL)
+	return FALSE;
+
+    compressed_length = compressBound (rows_length);
+    *idat_data = malloc (compressed_length);
+    if (*idat_data == NULL) {
+	free (rows);
+	return FALSE;
+    }
+    if (compress (*idat_data, &compressed_length, rows, rows_length) != Z_OK) {
+	free (rows);
+	return FALSE;
+    }
+    free (rows);
+    *idat_length = compressed_length;
+
+    /* Room for every chunk, with up to three IDAT chunks split by two
+     * tEXt chunks */
+    *png_data = malloc (sizeof (magic) + 12 + sizeof (ihdr) + 12 +
+			sizeof (palette) + 12 + sizeof (trns) +
+			2 * (12 + sizeof (text)) + 3 * 12 + *idat_length +
+			12);
+    if (*png_data == NULL)
+	return FALSE;
+
+    write_be32 (ihdr, WIDTH);
+    write_be32 (ihdr + 4, HEIGHT);
+    ihdr[8] = 8;
+    ihdr[9] = png->color_type;
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = png->interlaced;
+
+    p = *png_data;
+    memcpy (p, magic, sizeof (magic));
+    p += sizeof (magic);
+    p = write_chunk (p, "IHDR", ihdr, sizeof (ihdr));
+    if (png->color_type == PNG_PALETTE)
+	p = write_chunk (p, "PLTE", palette, sizeof (palette));
+    if (png->trns)
+	p = write_chunk (p, "tRNS", trns, sizeof (trns));
+
+    if (png->idat == IDAT_ONE) {
+	p = write_chunk (p, "IDAT", *idat_data, *idat_length);
+    } else {
+	chunk_length = (*idat_length + 2) / 3;
+	for (offset = 0; offset < *idat_length; offset += chunk_length) {
+	    if (chunk_length > *idat_length - offset)
+		chunk_length = *idat_length - offset;
+	    if (offset && png->idat == IDAT_SPLIT)
+		p = write_chunk (p, "tEXt", text, sizeof (text) - 1);
+	    p = write_chunk (p, "IDAT", *idat_data + offset, chunk_length);
+	}
+    }
+
+    p = write_chunk (p, "IEND", NULL, 0);
+    *png_length = p - *png_data;
+
+    return TRUE;
+}
+
+/* An image surface with the pixels of @png, which the PDF surface uses
+ * when it cannot copy the PNG file. */
+static comac_surface_t *
+create_image (const png_case_t *png)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    int stride, x, y;
+    unsigned char r, g, b;
+
+    image = comac_image_surface_create (png->color_type == PNG_RGB_ALPHA
+					    ? COMAC_FORMAT_ARGB32
+					    : COMAC_FORMAT_RGB24,
+					WIDTH,
+					HEIGHT);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data == NULL)
+	return image;
+
+    for (y = 0; y < HEIGHT; y++) {
+	row = (uint32_t *) (data + y * stride);
+	for (x = 0; x < WIDTH; x++) {
+	    r = pixel_value (x, y, 0);
+	    if (png->color_type == PNG_GRAY) {
+		g = b = r;
+	    } else {
+		g = pixel_value (x, y, 1);
+		b = pixel_value (x, y, 2);
+	    }
+	    /* Opaque, so that premultiplying changes nothing */
+	    row[x] = 0xff000000 | (r << 16) | (g << 8) | b;
+	}
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+static comac_test_status_t
+check_image (comac_test_context_t *ctx,
+	     const png_case_t *png,
+	     const pdf_test_output_t *output,
+	     const unsigned char *idat_data,
+	     size_t idat_length)
+{
+    pdf_test_document_t *doc;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    unsigned char *stream = NULL, *rows = NULL;
+    size_t length, rows_length, row_length;
+    const char *error, *object;
+    comac_bool_t passthrough;
+    int id, y;
+
+    doc = pdf_test_document_create (output->data, output->length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "%s: invalid pdf: %s\n", png->name, error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    id = pdf_test_document_find_object (doc, 1, "/Subtype /Image");
+    object = pdf_test_document_get_object (doc, id);
+    stream = pdf_test_document_get_stream (doc, id, FALSE, &length);
+    if (id == 0 || object == NULL || stream == NULL) {
+	comac_test_log (ctx, "%s: no image found\n", png->name);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    /* The PNG data is copied as it is, and decodes to the rows of the
+     * image with the predictor. */
+    passthrough = strstr (object, "/Predictor 15") != NULL &&
+		  length == idat_length &&
+		  memcmp (stream, idat_data, length) == 0;
+    if (passthrough != png->passthrough) {
+	comac_test_log (ctx,
+			"%s: the PNG data is %s\n%s\n",
+			png->name,
+			passthrough ? "copied, not drawn again"
+				    : "drawn again, not copied",
+			object);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    if (! passthrough)
+	goto CLEANUP;
+
+    if (strstr (object,
+		png->color_type == PNG_GRAY ? "/ColorSpace /DeviceGray"
+					    : "/ColorSpace /DeviceRGB") ==
+	NULL) {
+	comac_test_log (ctx, "%s: wrong colorspace\n%s\n", png->name, object);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    free (stream);
+    stream = pdf_test_document_get_stream (doc, id, TRUE, &length);
+    rows = make_rows (png, &rows_length);
+    if (stream == NULL || rows == NULL) {
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    /* The rows without their filter types */
+    row_length = WIDTH * num_channels (png->color_type);
+    if (length != HEIGHT * row_length) {
+	comac_test_log (ctx, "%s: the image data differs\n", png->name);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+    for (y = 0; y < HEIGHT; y++) {
+	if (memcmp (stream + y * row_length,
+		    rows + y * (row_length + 1) + 1,
+		    row_length) != 0) {
+	    comac_test_log (ctx, "%s: row %d differs\n", png->name, y);
+	    result = COMAC_TEST_FAILURE;
+	    break;
+	}
+    }
+
+CLEANUP:
+    free (rows);
+    free (stream);
+    pdf_test_document_destroy (doc);
+
+    return result;
+}
+
+static comac_test_status_t
+test_png (comac_test_context_t *ctx, const png_case_t *png)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_surface_t *surface, *image;
+    unsigned char *png_data = NULL, *idat_data = NULL;
+    size_t png_length, idat_length;
+    comac_test_status_t result;
+    comac_status_t status;
+    comac_t *cr;
+
+    if (! make_png (png, &png_data, &png_length, &idat_data, &idat_length)) {
+	free (png_data);
+	free (idat_data);
+	return COMAC_TEST_NO_MEMORY;
+    }
+
+    image = create_image (png);
+    status = comac_surface_set_mime_data (image,
+					  COMAC_MIME_TYPE_PNG,
+					  png_data,
+					  png_length,
+					  free,
+					  png_data);
+    if (status) {
+	free (png_data);
+	free (idat_data);
+	comac_surface_destroy (image);
+	return comac_test_status_from_status (ctx, status);
+    }
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   &output,
+						   WIDTH,
+						   HEIGHT);
+    cr = comac_create (surface);
+    comac_set_source_surface (cr, image, 0, 0);
+    comac_paint (cr);
+    status = comac_status (cr);
+    comac_destroy (cr);
+    comac_surface_destroy (image);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    if (status) {
+	comac_test_log (ctx,
+			"%s: failed to write pdf: %s\n",
+			png->name,
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+    } else {
+	result = check_image (ctx, png, &output, idat_data, idat_length);
+    }
+
+    free (idat_data);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (i = 0; i < ARRAY_LENGTH (cases); i++) {
+	if (test_png (ctx, &cases[i]) != COMAC_TEST_SUCCESS)
+	    result = COMAC_TEST_FAILURE;
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_png_passthrough,
+	    "Check which PNG images are copied to PDF files as they are",
+	    "pdf, png", /* keywords */
+	    NULL,       /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
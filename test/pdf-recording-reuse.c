@@ -0,0 +1,167 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <stdlib.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that a recording surface painted many times is written to the
+ * PDF file as a single Form XObject, whatever filter it is painted
+ * with, and that a second form is written when some of the uses need
+ * a transparency group.
+ */
+
+#define NUM_PAGES 2
+#define NUM_PAINTS 20
+
+static comac_surface_t *
+create_symbol (void)
+{
+    comac_surface_t *recording;
+    comac_t *cr;
+
+    recording =
+	comac_recording_surface_create (COMAC_CONTENT_COLOR_ALPHA, NULL);
+    cr = comac_create (recording);
+
+    comac_set_source_rgb (cr, 1, 0, 0);
+    comac_arc (cr, 10, 10, 8, 0, 2 * M_PI);
+    comac_fill (cr);
+
+    comac_set_source_rgb (cr, 0, 0, 1);
+    comac_rectangle (cr, 5, 5, 10, 10);
+    comac_stroke (cr);
+
+    comac_destroy (cr);
+
+    return recording;
+}
+
+static comac_status_t
+write_pdf (comac_surface_t *symbol,
+	   comac_bool_t use_alpha,
+	   pdf_test_output_t *output)
+{
+    comac_surface_t *surface;
+    comac_t *cr;
+    comac_status_t status;
+    int page, i;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   250,
+						   250);
+    cr = comac_create (surface);
+
+    for (page = 0; page < NUM_PAGES; page++) {
+	for (i = 0; i < NUM_PAINTS; i++) {
+	    comac_save (cr);
+	    comac_translate (cr, (i % 5) * 50, (i / 5) * 50);
+	    comac_set_source_surface (cr, symbol, 0, 0);
+	    comac_pattern_set_filter (comac_get_source (cr),
+				      i % 2 ? COMAC_FILTER_FAST
+					    : COMAC_FILTER_GOOD);
+	    if (use_alpha && i % 2)
+		comac_paint_with_alpha (cr, 0.5);
+	    else
+		comac_paint (cr);
+	    comac_restore (cr);
+	}
+	comac_show_page (cr);
+    }
+
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+check_forms (comac_test_context_t *ctx,
+	     comac_surface_t *symbol,
+	     comac_bool_t use_alpha,
+	     int expected)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_status_t status;
+    int count;
+
+    status = write_pdf (symbol, use_alpha, &output);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf: %s\n",
+			comac_status_to_string (status));
+	pdf_test_output_fini (&output);
+	return COMAC_TEST_FAILURE;
+    }
+
+    count = pdf_test_output_count (&output, "/Subtype /Form");
+    pdf_test_output_fini (&output);
+    if (count != expected) {
+	comac_test_log (ctx,
+			"Expected %d Form XObjects %s alpha, found %d\n",
+			expected,
+			use_alpha ? "with" : "without",
+			count);
+	return COMAC_TEST_FAILURE;
+    }
+
+    return COMAC_TEST_SUCCESS;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_surface_t *symbol;
+    comac_test_status_t result;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    symbol = create_symbol ();
+
+    result = check_forms (ctx, symbol, FALSE, 1);
+    if (result == COMAC_TEST_SUCCESS)
+	result = check_forms (ctx, symbol, TRUE, 2);
+
+    comac_surface_destroy (symbol);
+
+    return result;
+}
+
+COMAC_TEST (pdf_recording_reuse,
+	    "Check that recording surfaces painted many times are written once",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,213 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that streams smaller than the stream buffer of the PDF surface
+ * are written with a direct /Length, and that larger ones are written
+ * with an indirect /Length whose object is valid, both with and without
+ * object streams.
+ */
+
+#define SIZE 300
+
+/* The size up to which streams are buffered, PDF_STREAM_BUFFER_SIZE */
+#define BUFFER_SIZE (64 * 1024)
+
+/* Noise, which does not compress below the size of the buffer */
+static comac_surface_t *
+create_noise_image (void)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    uint32_t noise = 1;
+    int stride, x, y;
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24, SIZE, SIZE);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data == NULL)
+	return image;
+
+    for (y = 0; y < SIZE; y++) {
+	row = (uint32_t *) (data + y * stride);
+	for (x = 0; x < SIZE; x++) {
+	    noise = noise * 1103515245 + 12345;
+	    row[x] = noise >> 8;
+	}
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+static comac_status_t
+write_pdf (pdf_test_output_t *output, comac_pdf_version_t version)
+{
+    comac_surface_t *surface, *image;
+    comac_status_t status;
+    comac_t *cr;
+    int i;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   SIZE,
+						   SIZE);
+    comac_pdf_surface_restrict_to_version (surface, version);
+
+    cr = comac_create (surface);
+    for (i = 0; i < 2; i++) {
+	image = create_noise_image ();
+	comac_set_source_surface (cr, image, 0, 0);
+	comac_paint_with_alpha (cr, 0.5);
+	comac_surface_destroy (image);
+
+	comac_set_source_rgb (cr, 1, 0, i);
+	comac_rectangle (cr, 10, 10, 50, 50);
+	comac_fill (cr);
+	comac_show_page (cr);
+    }
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+check_lengths (comac_test_context_t *ctx,
+	       const char *version,
+	       const pdf_test_output_t *output)
+{
+    pdf_test_document_t *doc;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    const char *error, *object;
+    unsigned char *data;
+    size_t length;
+    int id, n, num_large = 0;
+    comac_bool_t indirect;
+
+    /* Reading the file checks that every /Length is right. */
+    doc = pdf_test_document_create (output->data, output->length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "%s: invalid pdf: %s\n", version, error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    id = 0;
+    while ((id = pdf_test_document_find_object (doc, id + 1, "/Length"))) {
+	object = pdf_test_document_get_object (doc, id);
+	n = 0;
+	sscanf (strstr (object, "/Length"), "/Length %*d %*d R%n", &n);
+	indirect = n > 0;
+	data = pdf_test_document_get_stream (doc, id, FALSE, &length);
+	free (data);
+
+	if (length > BUFFER_SIZE)
+	    num_large++;
+	if (indirect != (length > BUFFER_SIZE)) {
+	    comac_test_log (ctx,
+			    "%s: stream %d of %lu bytes has %s /Length\n",
+			    version,
+			    id,
+			    (unsigned long) length,
+			    indirect ? "an indirect" : "a direct");
+	    result = COMAC_TEST_FAILURE;
+	}
+    }
+
+    /* Both images */
+    if (num_large != 2) {
+	comac_test_log (ctx,
+			"%s: expected 2 streams larger than %d bytes, "
+			"found %d\n",
+			version,
+			BUFFER_SIZE,
+			num_large);
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    static const comac_pdf_version_t versions[] = {COMAC_PDF_VERSION_1_4,
+						   COMAC_PDF_VERSION_1_7};
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const char *version;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (i = 0; i < ARRAY_LENGTH (versions); i++) {
+	version = comac_pdf_version_to_string (versions[i]);
+	status = write_pdf (&output, versions[i]);
+	if (status) {
+	    comac_test_log (ctx,
+			    "%s: failed to write pdf: %s\n",
+			    version,
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	} else if (check_lengths (ctx, version, &output) !=
+		   COMAC_TEST_SUCCESS) {
+	    result = COMAC_TEST_FAILURE;
+	}
+	pdf_test_output_fini (&output);
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_stream_length,
+	    "Check the direct and indirect lengths of PDF streams",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
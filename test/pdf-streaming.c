@@ -0,0 +1,257 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that a PDF file written in streaming mode is valid and draws
+ * the same as one written at once. The image drawn on every page is
+ * written once per page, under a different name on each. A recording
+ * surface without extents, which is otherwise written when the surface
+ * is finished, is in the output as soon as its page is shown.
+ */
+
+static void
+set_streaming (comac_surface_t *surface, void *closure)
+{
+    comac_pdf_surface_set_streaming (surface, TRUE);
+}
+
+/* Removes the numbers from the resource names in the NUL terminated
+ * @content, such as /x12 or /f-0-1, which depend on the order in which
+ * the objects are written. */
+static void
+strip_names (unsigned char *content)
+{
+    unsigned char *p, *q;
+
+    for (p = q = content; *p;) {
+	if (*p == '/') {
+	    *q++ = *p++;
+	    while (isalpha (*p))
+		*q++ = *p++;
+	    while (isdigit (*p) || *p == '-')
+		p++;
+	} else {
+	    *q++ = *p++;
+	}
+    }
+    *q = '\0';
+}
+
+static unsigned char *
+get_page_content (pdf_test_document_t *doc, int index)
+{
+    const char *object, *contents;
+    unsigned char *content;
+    size_t length;
+    int id;
+
+    object =
+	pdf_test_document_get_object (doc,
+				      pdf_test_document_get_page (doc, index));
+    contents = object ? strstr (object, "/Contents") : NULL;
+    if (contents == NULL || sscanf (contents, "/Contents %d", &id) != 1)
+	return NULL;
+
+    content = pdf_test_document_get_stream (doc, id, TRUE, &length);
+    if (content)
+	strip_names (content);
+
+    return content;
+}
+
+static comac_test_status_t
+compare_documents (comac_test_context_t *ctx,
+		   pdf_test_document_t *reference,
+		   pdf_test_document_t *doc)
+{
+    unsigned char *content[2], *image[2];
+    size_t length[2];
+    int i, id, num_images;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+
+    if (pdf_test_document_get_num_pages (doc) != PDF_TEST_DOCUMENT_PAGES) {
+	comac_test_log (ctx,
+			"Expected %d pages, found %d\n",
+			PDF_TEST_DOCUMENT_PAGES,
+			pdf_test_document_get_num_pages (doc));
+	return COMAC_TEST_FAILURE;
+    }
+
+    for (i = 0; i < PDF_TEST_DOCUMENT_PAGES; i++) {
+	content[0] = get_page_content (reference, i);
+	content[1] = get_page_content (doc, i);
+	if (content[0] == NULL || content[1] == NULL ||
+	    strcmp ((char *) content[0], (char *) content[1]) != 0) {
+	    comac_test_log (ctx, "Page %d has different contents\n", i);
+	    result = COMAC_TEST_FAILURE;
+	}
+	free (content[0]);
+	free (content[1]);
+    }
+
+    num_images = pdf_test_document_count_objects (doc, "/Subtype /Image");
+    if (num_images != PDF_TEST_DOCUMENT_PAGES) {
+	comac_test_log (ctx,
+			"Expected an image per page, found %d images\n",
+			num_images);
+	return COMAC_TEST_FAILURE;
+    }
+
+    id = pdf_test_document_find_object (reference, 1, "/Subtype /Image");
+    image[0] = pdf_test_document_get_stream (reference, id, TRUE, &length[0]);
+    id = 0;
+    while (result == COMAC_TEST_SUCCESS &&
+	   (id = pdf_test_document_find_object (doc,
+						id + 1,
+						"/Subtype /Image"))) {
+	image[1] = pdf_test_document_get_stream (doc, id, TRUE, &length[1]);
+	if (image[0] == NULL || image[1] == NULL || length[0] != length[1] ||
+	    memcmp (image[0], image[1], length[0]) != 0) {
+	    comac_test_log (ctx, "Image %d has different data\n", id);
+	    result = COMAC_TEST_FAILURE;
+	}
+	free (image[1]);
+    }
+    free (image[0]);
+
+    return result;
+}
+
+/* The number of forms written to the output by the time the first of
+ * two pages, which draw an unbounded recording surface, has been shown. */
+static int
+count_forms_after_show_page (comac_bool_t streaming)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_surface_t *surface, *recording;
+    comac_t *cr;
+    int i, count = -1;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   &output,
+						   PDF_TEST_DOCUMENT_WIDTH,
+						   PDF_TEST_DOCUMENT_HEIGHT);
+    comac_pdf_surface_set_streaming (surface, streaming);
+
+    recording = comac_recording_surface_create (COMAC_CONTENT_COLOR_ALPHA,
+						NULL);
+    cr = comac_create (recording);
+    comac_rectangle (cr, 10, 10, 50, 50);
+    comac_fill (cr);
+    comac_destroy (cr);
+
+    cr = comac_create (surface);
+    for (i = 0; i < 2; i++) {
+	comac_set_source_surface (cr, recording, i * 100, 0);
+	comac_paint (cr);
+	comac_show_page (cr);
+	if (i == 0)
+	    count = pdf_test_output_count (&output, "/Subtype /Form");
+    }
+    comac_destroy (cr);
+    comac_surface_destroy (recording);
+
+    comac_surface_finish (surface);
+    comac_surface_destroy (surface);
+    pdf_test_output_fini (&output);
+
+    return count;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output[2] = {PDF_TEST_OUTPUT_INIT,
+				   PDF_TEST_OUTPUT_INIT};
+    pdf_test_document_t *doc[2] = {NULL, NULL};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const char *error;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (i = 0; i < 2; i++) {
+	status = pdf_test_write_document (&output[i],
+					  i ? set_streaming : NULL,
+					  NULL);
+	if (status) {
+	    comac_test_log (ctx,
+			    "Failed to write pdf: %s\n",
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	    goto CLEANUP;
+	}
+
+	doc[i] = pdf_test_document_create (output[i].data, output[i].length);
+	error = pdf_test_document_get_error (doc[i]);
+	if (error) {
+	    comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	    result = COMAC_TEST_FAILURE;
+	    goto CLEANUP;
+	}
+    }
+
+    result = compare_documents (ctx, doc[0], doc[1]);
+
+    if (count_forms_after_show_page (TRUE) == 0) {
+	comac_test_log (ctx,
+			"An unbounded surface is not written with its page\n");
+	result = COMAC_TEST_FAILURE;
+    }
+    if (count_forms_after_show_page (FALSE) != 0) {
+	comac_test_log (ctx,
+			"An unbounded surface is written with its page "
+			"without streaming\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    for (i = 0; i < 2; i++) {
+	pdf_test_document_destroy (doc[i]);
+	pdf_test_output_fini (&output[i]);
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_streaming,
+	    "Check PDF files written in streaming mode",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that drawing on a PDF surface through an observer writes the
+ * same vector operations as drawing on the surface itself, without a
+ * fallback image.
+ */
+
+static void
+draw (comac_t *cr)
+{
+    comac_pattern_t *pattern;
+
+    comac_set_source_rgb (cr, 1, 0, 0);
+    comac_rectangle (cr, 10, 10, 40, 40);
+    comac_fill (cr);
+
+    comac_set_source_rgba (cr, 0, 0, 1, 0.5);
+    comac_set_line_width (cr, 4);
+    comac_arc (cr, 50, 50, 30, 0, 2 * M_PI);
+    comac_stroke (cr);
+
+    pattern = comac_pattern_create_linear (0, 0, 100, 0);
+    comac_pattern_add_color_stop_rgb (pattern, 0, 1, 1, 0);
+    comac_pattern_add_color_stop_rgb (pattern, 1, 0, 1, 1);
+    comac_set_source (cr, pattern);
+    comac_pattern_destroy (pattern);
+    comac_rectangle (cr, 0, 70, 100, 20);
+    comac_fill (cr);
+
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Sans",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_NORMAL);
+    comac_set_font_size (cr, 12);
+    comac_set_source_rgb (cr, 0, 0, 0);
+    comac_move_to (cr, 10, 65);
+    comac_show_text (cr, "Observed");
+}
+
+static comac_status_t
+write_pdf (pdf_test_output_t *output, comac_bool_t observe)
+{
+    comac_surface_t *surface, *observer = NULL;
+    comac_t *cr;
+    comac_status_t status;
+
+    surface =
+	comac_pdf_surface_create_for_stream (pdf_test_output_write,
+					     output,
+					     100,
+					     100);
+    if (observe) {
+	observer =
+	    comac_surface_create_observer (surface,
+					   COMAC_SURFACE_OBSERVER_NORMAL);
+	cr = comac_create (observer);
+    } else {
+	cr = comac_create (surface);
+    }
+
+    draw (cr);
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    if (observer)
+	comac_surface_destroy (observer);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t output[2] = {PDF_TEST_OUTPUT_INIT,
+				   PDF_TEST_OUTPUT_INIT};
+    pdf_test_document_t *doc[2] = {NULL, NULL};
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_status_t status;
+    const char *error = NULL;
+    int i;
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    for (i = 0; i < 2; i++) {
+	status = write_pdf (&output[i], i);
+	if (status) {
+	    comac_test_log (ctx,
+			    "Failed to write pdf: %s\n",
+			    comac_status_to_string (status));
+	    result = COMAC_TEST_FAILURE;
+	    goto CLEANUP;
+	}
+
+	doc[i] = pdf_test_document_create (output[i].data, output[i].length);
+	error = pdf_test_document_get_error (doc[i]);
+	if (error) {
+	    comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	    result = COMAC_TEST_FAILURE;
+	    goto CLEANUP;
+	}
+    }
+
+    if (pdf_test_document_count_objects (doc[1], "/Subtype /Image") != 0) {
+	comac_test_log (ctx, "The observed page has a fallback image\n");
+	result = COMAC_TEST_FAILURE;
+    }
+
+    error = pdf_test_document_compare (doc[0], doc[1]);
+    if (error) {
+	comac_test_log (ctx, "Observed page differs: %s\n", error);
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    for (i = 0; i < 2; i++) {
+	pdf_test_document_destroy (doc[i]);
+	pdf_test_output_fini (&output[i]);
+    }
+
+    return result;
+}
+
+COMAC_TEST (pdf_surface_observer,
+	    "Check that observing a PDF surface keeps its output vector",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,1380 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pdf-test-utils.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <comac-pdf.h>
+
+comac_status_t
+pdf_test_output_write (void *closure,
+		       const unsigned char *data,
+		       unsigned int length)
+{
+    pdf_test_output_t *output = closure;
+
+    if (output->length + length + 1 > output->size) {
+	size_t size = output->size ? 2 * output->size : 4096;
+	unsigned char *new_data;
+
+	while (size < output->length + length + 1)
+	    size *= 2;
+	new_data = realloc (output->data, size);
+	if (new_data == NULL)
+	    return COMAC_STATUS_WRITE_ERROR;
+
+	output->data = new_data;
+	output->size = size;
+    }
+
+    memcpy (output->data + output->length, data, length);
+    output->length += length;
+    output->data[output->length] = '\0';
+
+    return COMAC_STATUS_SUCCESS;
+}
+
+comac_status_t
+pdf_test_output_read_file (pdf_test_output_t *output, const char *filename)
+{
+    unsigned char buf[4096];
+    comac_status_t status = COMAC_STATUS_SUCCESS;
+    size_t length;
+    FILE *file;
+
+    file = fopen (filename, "rb");
+    if (file == NULL)
+	return COMAC_STATUS_FILE_NOT_FOUND;
+
+    while (status == COMAC_STATUS_SUCCESS &&
+	   (length = fread (buf, 1, sizeof (buf), file)) > 0)
+	status = pdf_test_output_write (output, buf, length);
+    if (status == COMAC_STATUS_SUCCESS && ferror (file))
+	status = COMAC_STATUS_READ_ERROR;
+    fclose (file);
+
+    return status;
+}
+
+void
+pdf_test_output_fini (pdf_test_output_t *output)
+{
+    free (output->data);
+    output->data = NULL;
+    output->length = 0;
+    output->size = 0;
+}
+
+static const unsigned char *
+find (const unsigned char *data, size_t length, const char *str)
+{
+    size_t len = strlen (str);
+    size_t i;
+
+    for (i = 0; i + len <= length; i++) {
+	if (memcmp (data + i, str, len) == 0)
+	    return data + i;
+    }
+
+    return NULL;
+}
+
+int
+pdf_test_output_count (const pdf_test_output_t *output, const char *str)
+{
+    const unsigned char *p = output->data;
+    const unsigned char *end = output->data + output->length;
+    int count = 0;
+
+    while (p && (p = find (p, end - p, str)) != NULL) {
+	count++;
+	p++;
+    }
+
+    return count;
+}
+
+void
+pdf_test_convert (comac_colorspace_t from_colorspace,
+		  const double *from_data,
+		  comac_colorspace_t to_colorspace,
+		  double *to_data,
+		  comac_rendering_intent_t intent,
+		  void *ctx)
+{
+    pdf_test_conversions_t *conversions = ctx;
+
+    conversions->single_calls++;
+    comac_default_color_convert_func (from_colorspace,
+				      from_data,
+				      to_colorspace,
+				      to_data,
+				      intent,
+				      NULL);
+}
+
+void
+pdf_test_convert_batch (comac_colorspace_t from_colorspace,
+			const void *from_data,
+			comac_colorspace_t to_colorspace,
+			void *to_data,
+			comac_color_layout_t layout,
+			unsigned int num_colors,
+			comac_rendering_intent_t intent,
+			void *ctx)
+{
+    pdf_test_conversions_t *conversions = ctx;
+
+    if (conversions->batch_calls < ARRAY_LENGTH (conversions->batch_sizes))
+	conversions->batch_sizes[conversions->batch_calls] = num_colors;
+    conversions->batch_calls++;
+    conversions->batch_colors += num_colors;
+    comac_default_color_convert_batch_func (from_colorspace,
+					    from_data,
+					    to_colorspace,
+					    to_data,
+					    layout,
+					    num_colors,
+					    intent,
+					    NULL);
+}
+
+typedef enum {
+    ENTRY_FREE,
+    ENTRY_OFFSET,
+    ENTRY_COMPRESSED
+} entry_type_t;
+
+typedef struct _entry {
+    comac_bool_t set; /* by the most recent section listing it */
+    entry_type_t type;
+    long long field2; /* offset, or object stream */
+    long long field3; /* index in the object stream */
+    char *text;
+} entry_t;
+
+struct _pdf_test_document {
+    unsigned char *data; /* NUL terminated */
+    size_t length;
+    entry_t *entries;
+    int num_entries;
+    int size;
+    int root;
+    int *pages;
+    int num_pages;
+    char error[256];
+};
+
+static void
+set_error (pdf_test_document_t *doc, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (doc->error[0])
+	return;
+
+    va_start (ap, fmt);
+    vsnprintf (doc->error, sizeof doc->error, fmt, ap);
+    va_end (ap);
+}
+
+static comac_bool_t
+is_space (int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\f' ||
+	   c == '\0';
+}
+
+static const char *
+skip_space (const char *p)
+{
+    while (*p && is_space (*p))
+	p++;
+
+    return p;
+}
+
+/* The value of @key in the dictionary @text, or %NULL. Nested
+ * dictionaries are searched as well. */
+static const char *
+lookup (const char *text, const char *key)
+{
+    size_t len = strlen (key);
+    const char *p = text;
+
+    while ((p = strstr (p, key)) != NULL) {
+	p += len;
+	if (! (*p >= 'A' && *p <= 'Z') && ! (*p >= 'a' && *p <= 'z') &&
+	    ! (*p >= '0' && *p <= '9'))
+	    return skip_space (p);
+    }
+
+    return NULL;
+}
+
+/* Parses "id gen R" at @p. */
+static comac_bool_t
+parse_ref (const char *p, int *id, const char **end)
+{
+    char *e;
+    long value;
+
+    value = strtol (p, &e, 10);
+    if (e == p || value <= 0)
+	return FALSE;
+    p = skip_space (e);
+    strtol (p, &e, 10);
+    if (e == p)
+	return FALSE;
+    p = skip_space (e);
+    if (*p != 'R')
+	return FALSE;
+
+    *id = value;
+    if (end)
+	*end = p + 1;
+
+    return TRUE;
+}
+
+static comac_bool_t
+lookup_ref (const char *text, const char *key, int *id)
+{
+    const char *p = lookup (text, key);
+
+    return p && parse_ref (p, id, NULL);
+}
+
+static comac_bool_t
+lookup_number (pdf_test_document_t *doc,
+	       const char *text,
+	       const char *key,
+	       long long *value)
+{
+    const char *p = lookup (text, key);
+    char *end;
+    int id;
+
+    if (p == NULL)
+	return FALSE;
+
+    if (doc && parse_ref (p, &id, NULL)) {
+	p = pdf_test_document_get_object (doc, id);
+	if (p == NULL)
+	    return FALSE;
+	p = skip_space (p);
+    }
+
+    *value = strtoll (p, &end, 10);
+
+    return end != p;
+}
+
+static entry_t *
+get_entry (pdf_test_document_t *doc, int id)
+{
+    if (id <= 0 || id >= doc->num_entries || ! doc->entries[id].set)
+	return NULL;
+
+    return &doc->entries[id];
+}
+
+static comac_bool_t
+set_entry (pdf_test_document_t *doc,
+	   long long id,
+	   entry_type_t type,
+	   long long field2,
+	   long long field3)
+{
+    entry_t *entries;
+
+    if (id < 0 || id > 10000000) {
+	set_error (doc, "object %lld in the xref is out of range", id);
+	return FALSE;
+    }
+
+    if (id >= doc->num_entries) {
+	entries = realloc (doc->entries, (id + 1) * sizeof (entry_t));
+	if (entries == NULL) {
+	    set_error (doc, "out of memory");
+	    return FALSE;
+	}
+	memset (entries + doc->num_entries,
+		0,
+		(id + 1 - doc->num_entries) * sizeof (entry_t));
+	doc->entries = entries;
+	doc->num_entries = id + 1;
+    }
+
+    /* Sections are read from the most recent update backwards */
+    if (! doc->entries[id].set) {
+	doc->entries[id].set = TRUE;
+	doc->entries[id].type = type;
+	doc->entries[id].field2 = field2;
+	doc->entries[id].field3 = field3;
+    }
+
+    return TRUE;
+}
+
+/* Reads "id gen obj" at @offset and returns a copy of the text of the
+ * object, stopping before the data of a stream. @stream is set to the
+ * start of the stream data, or 0. */
+static char *
+read_object (pdf_test_document_t *doc,
+	     long long offset,
+	     int *id,
+	     size_t *stream)
+{
+    const char *p, *start, *end, *s;
+    char *e, *text;
+    long value;
+
+    if (offset <= 0 || (size_t) offset >= doc->length)
+	return NULL;
+
+    p = (const char *) doc->data + offset;
+    value = strtol (p, &e, 10);
+    if (e == p || value <= 0)
+	return NULL;
+    p = skip_space (e);
+    strtol (p, &e, 10);
+    if (e == p || ! is_space (*e))
+	return NULL;
+    p = skip_space (e);
+    if (strncmp (p, "obj", 3) != 0)
+	return NULL;
+    start = p + 3;
+
+    end = (const char *) find ((const unsigned char *) start,
+			       doc->data + doc->length -
+				   (const unsigned char *) start,
+			       "endobj");
+    if (end == NULL)
+	return NULL;
+
+    *stream = 0;
+    s = (const char *) find ((const unsigned char *) start,
+			     end - start,
+			     "stream");
+    if (s) {
+	end = s;
+	s += strlen ("stream");
+	if (*s == '\r')
+	    s++;
+	if (*s == '\n')
+	    s++;
+	*stream = (const unsigned char *) s - doc->data;
+    }
+
+    text = malloc (end - start + 1);
+    if (text == NULL)
+	return NULL;
+    memcpy (text, start, end - start);
+    text[end - start] = '\0';
+    *id = value;
+
+    return text;
+}
+
+static unsigned char *
+inflate_data (const unsigned char *data, size_t length, size_t *out_length)
+{
+    z_stream zs;
+    unsigned char *out = NULL, *new_out;
+    size_t size = 4 * length + 1024;
+    int ret;
+
+    memset (&zs, 0, sizeof zs);
+    if (inflateInit (&zs) != Z_OK)
+	return NULL;
+
+    zs.next_in = (Bytef *) data;
+    zs.avail_in = length;
+    do {
+	new_out = realloc (out, size);
+	if (new_out == NULL) {
+	    ret = Z_MEM_ERROR;
+	    break;
+	}
+	out = new_out;
+	zs.next_out = out + zs.total_out;
+	zs.avail_out = size - zs.total_out;
+	ret = inflate (&zs, Z_NO_FLUSH);
+	size *= 2;
+    } while (ret == Z_OK);
+
+    *out_length = zs.total_out;
+    inflateEnd (&zs);
+    if (ret != Z_STREAM_END) {
+	free (out);
+	return NULL;
+    }
+
+    return out;
+}
+
+static int
+paeth (int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs (p - a), pb = abs (p - b), pc = abs (p - c);
+
+    if (pa <= pb && pa <= pc)
+	return a;
+
+    return pb <= pc ? b : c;
+}
+
+/* Undoes PNG predictors in place, dropping the filter type bytes. */
+static comac_bool_t
+undo_predictor (unsigned char *data,
+		size_t *length,
+		int colors,
+		int bits,
+		int columns)
+{
+    size_t bpp = (colors * bits + 7) / 8;
+    size_t row = ((size_t) colors * bits * columns + 7) / 8;
+    size_t num_rows, r, i;
+    unsigned char *in, *out, *prev;
+    int tag, left, up, up_left;
+
+    if (row == 0 || *length % (row + 1))
+	return FALSE;
+
+    /* Each row moves back by one byte per row above it, so it is only
+     * written over once it has been read. */
+    num_rows = *length / (row + 1);
+    for (r = 0; r < num_rows; r++) {
+	in = data + r * (row + 1);
+	out = data + r * row;
+	prev = r ? out - row : NULL;
+	tag = in[0];
+	for (i = 0; i < row; i++) {
+	    int c = in[i + 1];
+
+	    left = i >= bpp ? out[i - bpp] : 0;
+	    up = prev ? prev[i] : 0;
+	    up_left = prev && i >= bpp ? prev[i - bpp] : 0;
+	    switch (tag) {
+	    case 0: break;
+	    case 1: c += left; break;
+	    case 2: c += up; break;
+	    case 3: c += (left + up) / 2; break;
+	    case 4: c += paeth (left, up, up_left); break;
+	    default: return FALSE;
+	    }
+	    out[i] = c;
+	}
+    }
+    *length = num_rows * row;
+
+    return TRUE;
+}
+
+/* Reads the data of the stream object at @offset. */
+static unsigned char *
+read_stream (pdf_test_document_t *doc,
+	     long long offset,
+	     comac_bool_t decode,
+	     size_t *length)
+{
+    unsigned char *data, *decoded;
+    const char *p;
+    long long stream_length, value;
+    size_t start;
+    char *text;
+    int text_id, colors = 1, bits = 8, columns = 1;
+
+    text = read_object (doc, offset, &text_id, &start);
+    if (text == NULL || start == 0 ||
+	! lookup_number (doc, text, "/Length", &stream_length) ||
+	stream_length < 0 ||
+	(size_t) stream_length > doc->length - start)
+    {
+	free (text);
+	return NULL;
+    }
+
+    p = lookup (text, "/Filter");
+    if (decode && p && strncmp (p, "/FlateDecode", 12) == 0) {
+	data = inflate_data (doc->data + start, stream_length, length);
+	if (data && lookup_number (NULL, text, "/Predictor", &value) &&
+	    value >= 10)
+	{
+	    if (lookup_number (NULL, text, "/Colors", &value))
+		colors = value;
+	    if (lookup_number (NULL, text, "/BitsPerComponent", &value))
+		bits = value;
+	    if (lookup_number (NULL, text, "/Columns", &value))
+		columns = value;
+	    if (! undo_predictor (data, length, colors, bits, columns)) {
+		free (data);
+		data = NULL;
+	    }
+	}
+    } else {
+	data = malloc (stream_length + 1);
+	if (data) {
+	    memcpy (data, doc->data + start, stream_length);
+	    *length = stream_length;
+	}
+    }
+    free (text);
+
+    /* Callers may treat the data as a string */
+    if (data) {
+	decoded = realloc (data, *length + 1);
+	if (decoded == NULL) {
+	    free (data);
+	    return NULL;
+	}
+	data = decoded;
+	data[*length] = '\0';
+    }
+
+    return data;
+}
+
+static unsigned char *
+get_stream (pdf_test_document_t *doc,
+	    int id,
+	    comac_bool_t decode,
+	    size_t *length)
+{
+    entry_t *entry = get_entry (doc, id);
+
+    if (entry == NULL || entry->type != ENTRY_OFFSET)
+	return NULL;
+
+    return read_stream (doc, entry->field2, decode, length);
+}
+
+unsigned char *
+pdf_test_document_get_stream (pdf_test_document_t *doc,
+			      int id,
+			      comac_bool_t decode,
+			      size_t *length)
+{
+    return get_stream (doc, id, decode, length);
+}
+
+/* Reads the objects of object stream @id into their entries. */
+static comac_bool_t
+read_object_stream (pdf_test_document_t *doc, int id)
+{
+    unsigned char *data;
+    const char *text, *p;
+    char *e;
+    size_t length;
+    long long n, first;
+    long *ids, *offsets;
+    long i, end;
+    entry_t *entry;
+    comac_bool_t ok = FALSE;
+
+    text = pdf_test_document_get_object (doc, id);
+    if (text == NULL || strstr (text, "/Type /ObjStm") == NULL ||
+	! lookup_number (doc, text, "/N", &n) ||
+	! lookup_number (doc, text, "/First", &first) || n <= 0)
+	return FALSE;
+
+    data = get_stream (doc, id, TRUE, &length);
+    if (data == NULL)
+	return FALSE;
+
+    ids = malloc (n * sizeof (long));
+    offsets = malloc (n * sizeof (long));
+    if (ids == NULL || offsets == NULL)
+	goto BAIL;
+
+    p = (const char *) data;
+    for (i = 0; i < n; i++) {
+	ids[i] = strtol (p, &e, 10);
+	if (e == p)
+	    goto BAIL;
+	p = e;
+	offsets[i] = strtol (p, &e, 10);
+	if (e == p || offsets[i] < 0 || first + offsets[i] > (long) length)
+	    goto BAIL;
+	p = e;
+    }
+
+    for (i = 0; i < n; i++) {
+	entry = get_entry (doc, ids[i]);
+	if (entry == NULL || entry->type != ENTRY_COMPRESSED ||
+	    entry->field2 != id || entry->field3 != i || entry->text)
+	    continue;
+
+	end = i + 1 < n ? first + offsets[i + 1] : (long) length;
+	if (end < first + offsets[i])
+	    goto BAIL;
+	entry->text = malloc (end - first - offsets[i] + 1);
+	if (entry->text == NULL)
+	    goto BAIL;
+	memcpy (entry->text,
+		data + first + offsets[i],
+		end - first - offsets[i]);
+	entry->text[end - first - offsets[i]] = '\0';
+    }
+    ok = TRUE;
+
+BAIL:
+    free (ids);
+    free (offsets);
+    free (data);
+
+    return ok;
+}
+
+const char *
+pdf_test_document_get_object (pdf_test_document_t *doc, int id)
+{
+    entry_t *entry = get_entry (doc, id);
+    size_t stream;
+    int text_id;
+
+    if (entry == NULL || entry->type == ENTRY_FREE)
+	return NULL;
+
+    if (entry->text == NULL) {
+	if (entry->type == ENTRY_OFFSET) {
+	    entry->text = read_object (doc, entry->field2, &text_id, &stream);
+	    if (entry->text && text_id != id) {
+		free (entry->text);
+		entry->text = NULL;
+	    }
+	} else if (entry->field2 != id) {
+	    read_object_stream (doc, entry->field2);
+	}
+    }
+
+    return entry->text;
+}
+
+int
+pdf_test_document_find_object (pdf_test_document_t *doc,
+			       int id,
+			       const char *str)
+{
+    const char *text;
+
+    for (id = MAX (id, 1); id < doc->num_entries; id++) {
+	text = pdf_test_document_get_object (doc, id);
+	if (text && strstr (text, str))
+	    return id;
+    }
+
+    return 0;
+}
+
+int
+pdf_test_document_count_objects (pdf_test_document_t *doc, const char *str)
+{
+    int id = 0, count = 0;
+
+    while ((id = pdf_test_document_find_object (doc, id + 1, str)))
+	count++;
+
+    return count;
+}
+
+/* Reads a cross-reference table at @p and returns its trailer. */
+static char *
+read_xref_table (pdf_test_document_t *doc, const char *p)
+{
+    const char *trailer, *end;
+    char *e, *text;
+    long long first, count, offset, i;
+    char type;
+
+    p = skip_space (p + strlen ("xref"));
+    while (strncmp (p, "trailer", 7) != 0) {
+	first = strtoll (p, &e, 10);
+	if (e == p)
+	    return NULL;
+	p = e;
+	count = strtoll (p, &e, 10);
+	if (e == p || count < 0)
+	    return NULL;
+	p = skip_space (e);
+
+	for (i = 0; i < count; i++) {
+	    /* Each entry is "oooooooooo ggggg n" and a two byte EOL */
+	    if ((size_t) (p + 20 - (const char *) doc->data) > doc->length)
+		return NULL;
+	    offset = strtoll (p, &e, 10);
+	    if (e != p + 10)
+		return NULL;
+	    type = p[17];
+	    if (type != 'n' && type != 'f')
+		return NULL;
+	    if (! set_entry (doc,
+			     first + i,
+			     type == 'n' ? ENTRY_OFFSET : ENTRY_FREE,
+			     offset,
+			     0))
+		return NULL;
+	    p = skip_space (p + 18);
+	}
+    }
+
+    trailer = p;
+    end = strstr (trailer, "startxref");
+    if (end == NULL)
+	return NULL;
+
+    text = malloc (end - trailer + 1);
+    if (text) {
+	memcpy (text, trailer, end - trailer);
+	text[end - trailer] = '\0';
+    }
+
+    return text;
+}
+
+/* Reads a cross-reference stream at @offset and returns its
+ * dictionary. */
+static char *
+read_xref_stream (pdf_test_document_t *doc, long long offset)
+{
+    unsigned char *data = NULL;
+    const char *p;
+    char *text, *e;
+    size_t start, length, pos;
+    long long w[3], size, first, count, i, value[3];
+    int id, j, k;
+
+    text = read_object (doc, offset, &id, &start);
+    if (text == NULL)
+	return NULL;
+
+    if (strstr (text, "/Type /XRef") == NULL || start == 0 ||
+	! lookup_number (NULL, text, "/Size", &size))
+	goto FAIL;
+
+    p = lookup (text, "/W");
+    if (p == NULL || *p++ != '[')
+	goto FAIL;
+    for (j = 0; j < 3; j++) {
+	w[j] = strtoll (p, &e, 10);
+	if (e == p || w[j] < 0 || w[j] > 8)
+	    goto FAIL;
+	p = e;
+    }
+
+    data = read_stream (doc, offset, TRUE, &length);
+    if (data == NULL)
+	goto FAIL;
+
+    p = lookup (text, "/Index");
+    if (p && *p == '[')
+	p++;
+    pos = 0;
+    do {
+	if (p) {
+	    p = skip_space (p);
+	    if (*p == ']')
+		break;
+	    first = strtoll (p, &e, 10);
+	    if (e == p)
+		goto FAIL;
+	    p = e;
+	    count = strtoll (p, &e, 10);
+	    if (e == p)
+		goto FAIL;
+	    p = e;
+	} else {
+	    first = 0;
+	    count = size;
+	}
+
+	for (i = 0; i < count; i++) {
+	    if (pos + w[0] + w[1] + w[2] > length)
+		goto FAIL;
+	    for (j = 0; j < 3; j++) {
+		/* A missing type field defaults to 1 */
+		value[j] = j == 0 && w[j] == 0 ? 1 : 0;
+		for (k = 0; k < w[j]; k++)
+		    value[j] = value[j] << 8 | data[pos++];
+	    }
+	    if (value[0] > ENTRY_COMPRESSED)
+		goto FAIL;
+	    if (! set_entry (doc,
+			     first + i,
+			     (entry_type_t) value[0],
+			     value[1],
+			     value[2]))
+		goto FAIL;
+	}
+    } while (p);
+
+    free (data);
+
+    return text;
+
+FAIL:
+    free (data);
+    free (text);
+
+    return NULL;
+}
+
+/* Checks that the object of @entry is where the xref says, and that a
+ * stream is followed by "endstream" where its /Length says. */
+static void
+check_entry (pdf_test_document_t *doc, int id)
+{
+    entry_t *entry = &doc->entries[id];
+    const char *text, *p;
+    long long length;
+    size_t start;
+    char *object;
+    int object_id;
+
+    if (entry->type == ENTRY_OFFSET) {
+	object = read_object (doc, entry->field2, &object_id, &start);
+	if (object == NULL || object_id != id) {
+	    set_error (doc,
+		       "the xref entry of object %d points at %.12s",
+		       id,
+		       entry->field2 > 0 && (size_t) entry->field2 < doc->length
+			   ? (const char *) doc->data + entry->field2
+			   : "nothing");
+	    free (object);
+	    return;
+	}
+
+	if (start) {
+	    if (! lookup_number (doc, object, "/Length", &length) ||
+		length < 0 || (size_t) length > doc->length - start)
+	    {
+		set_error (doc, "object %d has no valid /Length", id);
+	    } else {
+		p = (const char *) doc->data + start + length;
+		p = skip_space (p);
+		if (strncmp (p, "endstream", 9) != 0)
+		    set_error (doc, "the /Length of object %d is wrong", id);
+	    }
+	}
+	free (object);
+    } else if (entry->type == ENTRY_COMPRESSED) {
+	text = pdf_test_document_get_object (doc, id);
+	if (text == NULL)
+	    set_error (doc, "object %d is not in its object stream", id);
+    }
+}
+
+static comac_bool_t
+add_pages (pdf_test_document_t *doc, int id, int depth)
+{
+    const char *text, *p;
+    int *pages, kid;
+
+    text = pdf_test_document_get_object (doc, id);
+    if (text == NULL || depth > 32) {
+	set_error (doc, "page tree node %d is missing", id);
+	return FALSE;
+    }
+
+    if (strstr (text, "/Type /Pages") == NULL) {
+	pages = realloc (doc->pages, (doc->num_pages + 1) * sizeof (int));
+	if (pages == NULL) {
+	    set_error (doc, "out of memory");
+	    return FALSE;
+	}
+	doc->pages = pages;
+	doc->pages[doc->num_pages++] = id;
+	return TRUE;
+    }
+
+    p = lookup (text, "/Kids");
+    if (p == NULL || *p++ != '[') {
+	set_error (doc, "page tree node %d has no /Kids", id);
+	return FALSE;
+    }
+
+    while (parse_ref (skip_space (p), &kid, &p)) {
+	if (! add_pages (doc, kid, depth + 1))
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+pdf_test_document_t *
+pdf_test_document_create (const unsigned char *data, size_t length)
+{
+    pdf_test_document_t *doc;
+    const unsigned char *p;
+    const char *text;
+    char *trailer, *e;
+    long long offset, size;
+    int i, pages, num_sections = 0;
+
+    doc = calloc (1, sizeof (pdf_test_document_t));
+    if (doc == NULL)
+	return NULL;
+
+    doc->data = malloc (length + 1);
+    if (doc->data == NULL) {
+	set_error (doc, "out of memory");
+	return doc;
+    }
+    memcpy (doc->data, data, length);
+    doc->data[length] = '\0';
+    doc->length = length;
+
+    /* The last startxref gives the most recent cross-reference section */
+    for (p = data + length; p > data; p--) {
+	if (p + 9 <= data + length && memcmp (p, "startxref", 9) == 0)
+	    break;
+    }
+    offset = 0;
+    if (p > data)
+	offset = strtoll ((const char *) doc->data + (p - data) + 9, &e, 10);
+    if (offset <= 0 || (size_t) offset >= length) {
+	set_error (doc, "no valid startxref");
+	return doc;
+    }
+
+    doc->size = -1;
+    while (offset) {
+	if (offset < 0 || (size_t) offset >= length || num_sections++ > 100) {
+	    set_error (doc, "xref offset %lld is not valid", offset);
+	    return doc;
+	}
+
+	if (strncmp ((const char *) doc->data + offset, "xref", 4) == 0)
+	    trailer = read_xref_table (doc, (const char *) doc->data + offset);
+	else
+	    trailer = read_xref_stream (doc, offset);
+	if (trailer == NULL) {
+	    set_error (doc, "no xref at offset %lld", offset);
+	    return doc;
+	}
+
+	if (doc->size < 0 && lookup_number (NULL, trailer, "/Size", &size))
+	    doc->size = size;
+	if (doc->root == 0)
+	    lookup_ref (trailer, "/Root", &doc->root);
+	if (! lookup_number (NULL, trailer, "/Prev", &offset))
+	    offset = 0;
+	free (trailer);
+    }
+
+    if (doc->root == 0) {
+	set_error (doc, "the trailer has no /Root");
+	return doc;
+    }
+    if (doc->num_entries > doc->size) {
+	set_error (doc,
+		   "the xref has %d entries for a /Size of %d",
+		   doc->num_entries,
+		   doc->size);
+	return doc;
+    }
+
+    for (i = 1; i < doc->num_entries && doc->error[0] == '\0'; i++)
+	check_entry (doc, i);
+    if (doc->error[0])
+	return doc;
+
+    text = pdf_test_document_get_object (doc, doc->root);
+    if (text == NULL || ! lookup_ref (text, "/Pages", &pages)) {
+	set_error (doc, "the catalog has no /Pages");
+	return doc;
+    }
+    add_pages (doc, pages, 0);
+
+    return doc;
+}
+
+void
+pdf_test_document_destroy (pdf_test_document_t *doc)
+{
+    int i;
+
+    if (doc == NULL)
+	return;
+
+    for (i = 0; i < doc->num_entries; i++)
+	free (doc->entries[i].text);
+    free (doc->entries);
+    free (doc->pages);
+    free (doc->data);
+    free (doc);
+}
+
+const char *
+pdf_test_document_get_error (const pdf_test_document_t *doc)
+{
+    if (doc == NULL)
+	return "out of memory";
+
+    return doc->error[0] ? doc->error : NULL;
+}
+
+int
+pdf_test_document_get_num_pages (const pdf_test_document_t *doc)
+{
+    return doc->num_pages;
+}
+
+int
+pdf_test_document_get_page (const pdf_test_document_t *doc, int index)
+{
+    if (index < 0 || index >= doc->num_pages)
+	return 0;
+
+    return doc->pages[index];
+}
+
+typedef struct _stream_data {
+    unsigned char *data;
+    size_t length;
+} stream_data_t;
+
+static int
+stream_data_compare (const void *a, const void *b)
+{
+    const stream_data_t *sa = a, *sb = b;
+
+    if (sa->length != sb->length)
+	return sa->length < sb->length ? -1 : 1;
+
+    return memcmp (sa->data, sb->data, sa->length);
+}
+
+/* The decoded data of the page content streams of @doc, in page order,
+ * followed by the other streams sorted by their data. Streams that
+ * only describe the file itself are left out. */
+static stream_data_t *
+get_streams (pdf_test_document_t *doc, int *num_streams)
+{
+    stream_data_t *streams;
+    const char *text, *p;
+    unsigned char *data, *new_data;
+    size_t length;
+    long long hint_offset = -1;
+    int i, n = 0, num_contents, id;
+    comac_bool_t *skip;
+
+    streams = calloc (doc->num_entries + 1, sizeof (stream_data_t));
+    skip = calloc (doc->num_entries + 1, sizeof (comac_bool_t));
+    if (streams == NULL || skip == NULL)
+	goto FAIL;
+
+    for (i = 0; i < doc->num_pages; i++) {
+	text = pdf_test_document_get_object (doc, doc->pages[i]);
+	p = text ? lookup (text, "/Contents") : NULL;
+	if (p && *p == '[')
+	    p++;
+
+	/* All the content streams of a page make a single entry */
+	while (p && parse_ref (skip_space (p), &id, &p)) {
+	    if (id >= doc->num_entries)
+		goto FAIL;
+	    data = get_stream (doc, id, TRUE, &length);
+	    if (data == NULL)
+		goto FAIL;
+	    new_data = realloc (streams[n].data, streams[n].length + length);
+	    if (new_data == NULL) {
+		free (data);
+		goto FAIL;
+	    }
+	    memcpy (new_data + streams[n].length, data, length);
+	    streams[n].data = new_data;
+	    streams[n].length += length;
+	    free (data);
+	    skip[id] = TRUE;
+	}
+	n++;
+    }
+    num_contents = n;
+
+    /* The hint stream of a linearized file */
+    id = pdf_test_document_find_object (doc, 1, "/Linearized");
+    if (id) {
+	p = lookup (pdf_test_document_get_object (doc, id), "/H");
+	if (p && *p == '[')
+	    hint_offset = strtoll (p + 1, NULL, 10);
+    }
+
+    for (id = 1; id < doc->num_entries; id++) {
+	entry_t *entry = &doc->entries[id];
+	size_t start;
+	char *object;
+	int object_id;
+
+	if (skip[id] || ! entry->set || entry->type != ENTRY_OFFSET ||
+	    entry->field2 == hint_offset)
+	    continue;
+
+	object = read_object (doc, entry->field2, &object_id, &start);
+	if (object == NULL)
+	    goto FAIL;
+	if (start == 0 || strstr (object, "/Type /XRef") ||
+	    strstr (object, "/Type /ObjStm") ||
+	    strstr (object, "/Linearized") ||
+	    strstr (object, "/Type /Metadata")) {
+	    free (object);
+	    continue;
+	}
+	free (object);
+
+	streams[n].data = get_stream (doc, id, TRUE, &streams[n].length);
+	if (streams[n].data == NULL)
+	    goto FAIL;
+	n++;
+    }
+
+    qsort (streams + num_contents,
+	   n - num_contents,
+	   sizeof (stream_data_t),
+	   stream_data_compare);
+    free (skip);
+    *num_streams = n;
+
+    return streams;
+
+FAIL:
+    if (streams) {
+	for (i = 0; i <= doc->num_entries; i++)
+	    free (streams[i].data);
+    }
+    free (streams);
+    free (skip);
+
+    return NULL;
+}
+
+static void
+free_streams (stream_data_t *streams, int num_streams)
+{
+    int i;
+
+    for (i = 0; i < num_streams; i++)
+	free (streams[i].data);
+    free (streams);
+}
+
+const char *
+pdf_test_document_compare (pdf_test_document_t *a, pdf_test_document_t *b)
+{
+    stream_data_t *streams_a, *streams_b;
+    const char *error = NULL;
+    int num_a, num_b, i;
+
+    if (a->num_pages != b->num_pages)
+	return "the documents have a different number of pages";
+
+    streams_a = get_streams (a, &num_a);
+    streams_b = get_streams (b, &num_b);
+    if (streams_a == NULL || streams_b == NULL) {
+	error = "the streams of a document could not be read";
+    } else if (num_a != num_b) {
+	error = "the documents have a different number of streams";
+    } else {
+	for (i = 0; i < num_a; i++) {
+	    if (stream_data_compare (&streams_a[i], &streams_b[i]) != 0) {
+		error = i < a->num_pages ? "a page has different contents"
+					 : "the documents have different "
+					   "fonts, images or patterns";
+		break;
+	    }
+	}
+    }
+
+    if (streams_a)
+	free_streams (streams_a, num_a);
+    if (streams_b)
+	free_streams (streams_b, num_b);
+
+    return error;
+}
+
+static comac_surface_t *
+create_sample_image (void)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    uint32_t noise = 1;
+    int stride, x, y;
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24,
+					PDF_TEST_DOCUMENT_WIDTH,
+					PDF_TEST_DOCUMENT_HEIGHT);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data == NULL)
+	return image;
+
+    /* Smooth gradients with some noise, large enough to be compressed
+     * in several blocks. */
+    for (y = 0; y < PDF_TEST_DOCUMENT_HEIGHT; y++) {
+	row = (uint32_t *) (data + y * stride);
+	for (x = 0; x < PDF_TEST_DOCUMENT_WIDTH; x++) {
+	    noise = noise * 1103515245 + 12345;
+	    row[x] = ((x * 255 / PDF_TEST_DOCUMENT_WIDTH) << 16) |
+		     ((y * 255 / PDF_TEST_DOCUMENT_HEIGHT) << 8) |
+		     ((noise >> 16) & 0x3f);
+	}
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+comac_status_t
+pdf_test_draw_document (comac_surface_t *surface)
+{
+    comac_surface_t *image;
+    comac_pattern_t *pattern;
+    comac_status_t status;
+    comac_t *cr;
+    int page, i;
+
+    image = create_sample_image ();
+    cr = comac_create (surface);
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Sans",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_NORMAL);
+    comac_set_font_size (cr, 20);
+
+    for (page = 0; page < PDF_TEST_DOCUMENT_PAGES; page++) {
+	comac_save (cr);
+	comac_scale (cr, 0.5, 0.5);
+	comac_set_source_surface (cr, image, page * 100, 0);
+	comac_paint (cr);
+	comac_restore (cr);
+
+	for (i = 0; i < 20; i++) {
+	    comac_set_source_rgb (cr, i / 20., 0.5, page);
+	    comac_rectangle (cr, 210 + i * 8, 10 + i * 4, 20, 20);
+	    comac_fill (cr);
+	}
+
+	comac_set_source_rgba (cr, 0, 0, 1, 0.5);
+	comac_set_line_width (cr, 4);
+	comac_arc (cr, 300, 200, 50 + page * 10, 0, 2 * M_PI);
+	comac_stroke (cr);
+
+	if (page % 2)
+	    pattern = comac_pattern_create_radial (100, 225, 0, 100, 225, 75);
+	else
+	    pattern = comac_pattern_create_linear (0, 150, 200, 150);
+	comac_pattern_add_color_stop_rgb (pattern, 0, 1, 1, 0);
+	comac_pattern_add_color_stop_rgb (pattern, 1, 0, 1, 1);
+	comac_set_source (cr, pattern);
+	comac_pattern_destroy (pattern);
+	comac_rectangle (cr, 0, 150, 200, 150);
+	comac_fill (cr);
+
+	comac_set_source_rgb (cr, 0, 0, 0);
+	comac_move_to (cr, 210, 280);
+	comac_show_text (cr, page % 2 ? "Second page" : "First page");
+
+	comac_show_page (cr);
+    }
+
+    status = comac_status (cr);
+    comac_destroy (cr);
+    comac_surface_destroy (image);
+
+    return status;
+}
+
+comac_status_t
+pdf_test_write_document (pdf_test_output_t *output,
+			 pdf_test_setup_func_t setup,
+			 void *closure)
+{
+    comac_surface_t *surface;
+    comac_status_t status;
+
+    surface = comac_pdf_surface_create_for_stream (pdf_test_output_write,
+						   output,
+						   PDF_TEST_DOCUMENT_WIDTH,
+						   PDF_TEST_DOCUMENT_HEIGHT);
+    if (setup)
+	setup (surface, closure);
+
+    status = pdf_test_draw_document (surface);
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+comac_test_status_t
+pdf_test_compare_outputs (comac_test_context_t *ctx,
+			  const char *name,
+			  const pdf_test_output_t *a,
+			  const pdf_test_output_t *b)
+{
+    pdf_test_document_t *doc_a, *doc_b;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    const char *error;
+
+    doc_a = pdf_test_document_create (a->data, a->length);
+    doc_b = pdf_test_document_create (b->data, b->length);
+
+    error = pdf_test_document_get_error (doc_a);
+    if (error) {
+	comac_test_log (ctx, "Invalid pdf: %s\n", error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    error = pdf_test_document_get_error (doc_b);
+    if (error) {
+	comac_test_log (ctx, "%s: invalid pdf: %s\n", name, error);
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    error = pdf_test_document_compare (doc_a, doc_b);
+    if (error) {
+	comac_test_log (ctx, "%s: %s\n", name, error);
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc_a);
+    pdf_test_document_destroy (doc_b);
+
+    return result;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PDF_TEST_UTILS_H
+#define PDF_TEST_UTILS_H
+
+#include "comac-test.h"
+
+/* Helpers shared by the tests that check the PDF files written by the
+ * PDF surface: an in-memory output, color conversion callbacks that
+ * count their calls and a reader for the files themselves.
+ */
+
+/* A file written to memory. Once something has been written, @data is
+ * terminated by a NUL byte that is not counted in @length. */
+typedef struct _pdf_test_output {
+    unsigned char *data;
+    size_t length;
+    size_t size;
+} pdf_test_output_t;
+
+#define PDF_TEST_OUTPUT_INIT {NULL, 0, 0}
+
+/* A comac_write_func_t appending to the pdf_test_output_t @closure */
+comac_status_t
+pdf_test_output_write (void *closure,
+		       const unsigned char *data,
+		       unsigned int length);
+
+/* Appends the contents of the file @filename to @output */
+comac_status_t
+pdf_test_output_read_file (pdf_test_output_t *output, const char *filename);
+
+void
+pdf_test_output_fini (pdf_test_output_t *output);
+
+/* The number of times @str is found in the output, binary data
+ * included. */
+int
+pdf_test_output_count (const pdf_test_output_t *output, const char *str);
+
+/* Counts the calls of the color conversion callbacks below, which
+ * otherwise do the default conversions. */
+typedef struct _pdf_test_conversions {
+    int single_calls;
+    int batch_calls;
+    unsigned int batch_colors;
+    unsigned int batch_sizes[8]; /* of the first batch calls */
+} pdf_test_conversions_t;
+
+/* A comac_color_convert_cb taking a pdf_test_conversions_t as @ctx */
+void
+pdf_test_convert (comac_colorspace_t from_colorspace,
+		  const double *from_data,
+		  comac_colorspace_t to_colorspace,
+		  double *to_data,
+		  comac_rendering_intent_t intent,
+		  void *ctx);
+
+/* A comac_color_convert_batch_cb taking a pdf_test_conversions_t as
+ * @ctx */
+void
+pdf_test_convert_batch (comac_colorspace_t from_colorspace,
+			const void *from_data,
+			comac_colorspace_t to_colorspace,
+			void *to_data,
+			comac_color_layout_t layout,
+			unsigned int num_colors,
+			comac_rendering_intent_t intent,
+			void *ctx);
+
+/* A PDF file read back, through its cross-reference tables or streams
+ * and the updates it may have. Reading it checks that every entry in
+ * use points at its object, that every stream /Length is right and
+ * that the page tree can be walked. */
+typedef struct _pdf_test_document pdf_test_document_t;
+
+pdf_test_document_t *
+pdf_test_document_create (const unsigned char *data, size_t length);
+
+void
+pdf_test_document_destroy (pdf_test_document_t *doc);
+
+/* Why the file could not be read, or %NULL if it could. */
+const char *
+pdf_test_document_get_error (const pdf_test_document_t *doc);
+
+int
+pdf_test_document_get_num_pages (const pdf_test_document_t *doc);
+
+/* The object number of the page at @index, counting from zero. */
+int
+pdf_test_document_get_page (const pdf_test_document_t *doc, int index);
+
+/* The text of object @id, without the data of a stream, or %NULL if
+ * the object is not in use. */
+const char *
+pdf_test_document_get_object (pdf_test_document_t *doc, int id);
+
+/* The number of the first object from @id onwards whose text contains
+ * @str, or 0 if there is none. */
+int
+pdf_test_document_find_object (pdf_test_document_t *doc,
+			       int id,
+			       const char *str);
+
+/* The number of objects whose text contains @str. */
+int
+pdf_test_document_count_objects (pdf_test_document_t *doc, const char *str);
+
+/* The data of stream @id to be freed with free(). Flate compressed
+ * data is decompressed and PNG predictors are undone when @decode is
+ * %TRUE; data compressed otherwise is returned as it is. */
+unsigned char *
+pdf_test_document_get_stream (pdf_test_document_t *doc,
+			      int id,
+			      comac_bool_t decode,
+			      size_t *length);
+
+/* Compares what two documents draw: the same number of pages with the
+ * same content streams, and the same fonts, images and other streams
+ * once decompressed, whatever their object numbers. Returns why they
+ * differ, or %NULL if they do not. */
+const char *
+pdf_test_document_compare (pdf_test_document_t *a, pdf_test_document_t *b);
+
+/* A sample document of PDF_TEST_DOCUMENT_PAGES pages with fills,
+ * strokes, gradients, text and a large image drawn on every page, to
+ * be written with different settings of the PDF surface. */
+#define PDF_TEST_DOCUMENT_WIDTH 400
+#define PDF_TEST_DOCUMENT_HEIGHT 300
+#define PDF_TEST_DOCUMENT_PAGES 2
+
+/* Draws the sample document on @surface, showing every page. */
+comac_status_t
+pdf_test_draw_document (comac_surface_t *surface);
+
+typedef void (*pdf_test_setup_func_t) (comac_surface_t *surface,
+				       void *closure);
+
+/* Writes the sample document to @output, after calling @setup, unless
+ * it is %NULL, on the PDF surface. */
+comac_status_t
+pdf_test_write_document (pdf_test_output_t *output,
+			 pdf_test_setup_func_t setup,
+			 void *closure);
+
+/* Reads two files back and compares them with
+ * pdf_test_document_compare(), logging why one cannot be read or why
+ * they differ. @name tells which settings @b was written with. */
+comac_test_status_t
+pdf_test_compare_outputs (comac_test_context_t *ctx,
+			  const char *name,
+			  const pdf_test_output_t *a,
+			  const pdf_test_output_t *b);
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "comac-test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that appending pages to a PDF file leaves the original bytes
+ * untouched, chains the new cross-reference section to the old one
+ * and extends the page tree. The file is restricted to PDF 1.4 so that
+ * the page tree is not hidden in a compressed object stream.
+ */
+
+#define BASENAME "pdf-update.out"
+#define NUM_PAGES 2
+
+static comac_status_t
+draw_pages (comac_surface_t *surface, int first)
+{
+    comac_t *cr;
+    comac_status_t status;
+    char text[32];
+    int page;
+
+    cr = comac_create (surface);
+    comac_select_font_face (cr,
+			    COMAC_TEST_FONT_FAMILY " Sans",
+			    COMAC_FONT_SLANT_NORMAL,
+			    COMAC_FONT_WEIGHT_NORMAL);
+    comac_set_font_size (cr, 16);
+
+    for (page = first; page < first + NUM_PAGES; page++) {
+	comac_move_to (cr, 20, 40);
+	sprintf (text, "Page %d", page + 1);
+	comac_show_text (cr, text);
+	comac_show_page (cr);
+    }
+
+    status = comac_status (cr);
+    comac_destroy (cr);
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static char *
+read_file (const char *filename, long *length)
+{
+    FILE *file;
+    char *data;
+
+    file = fopen (filename, "rb");
+    if (file == NULL)
+	return NULL;
+
+    fseek (file, 0, SEEK_END);
+    *length = ftell (file);
+    fseek (file, 0, SEEK_SET);
+
+    data = malloc (*length + 1);
+    if (data != NULL) {
+	if (fread (data, 1, *length, file) == (size_t) *length) {
+	    data[*length] = '\0';
+	} else {
+	    free (data);
+	    data = NULL;
+	}
+    }
+
+    fclose (file);
+    return data;
+}
+
+static comac_bool_t
+contains (const char *data, long length, const char *needle)
+{
+    size_t n = strlen (needle);
+    long i;
+
+    for (i = 0; i + (long) n <= length; i++) {
+	if (memcmp (data + i, needle, n) == 0)
+	    return TRUE;
+    }
+
+    return FALSE;
+}
+
+static long long
+last_startxref (const char *data, long length)
+{
+    const char *p = data + length;
+    long long value;
+
+    while (p > data && strncmp (p, "startxref\n", 10) != 0)
+	p--;
+    if (p == data || sscanf (p + 10, "%lld", &value) != 1)
+	return -1;
+
+    return value;
+}
+
+static const char *
+check_update (const char *old_data,
+	      long old_length,
+	      const char *data,
+	      long length)
+{
+    char prev[32];
+
+    if (length <= old_length || memcmp (old_data, data, old_length) != 0)
+	return "the original file was modified";
+
+    if (last_startxref (data, length) < old_length)
+	return "startxref does not point into the update";
+
+    sprintf (prev, "/Prev %lld", last_startxref (old_data, old_length));
+    if (! contains (data + old_length, length - old_length, prev))
+	return "the update does not refer to the original xref";
+
+    if (! contains (data + old_length, length - old_length, "/Count 4"))
+	return "the page tree was not extended";
+
+    return NULL;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    comac_surface_t *surface;
+    comac_status_t status;
+    char *filename, *old_data = NULL, *data = NULL;
+    long old_length, length;
+    const char *error = NULL;
+    const char *path =
+	comac_test_mkdir (COMAC_TEST_OUTPUT_DIR) ? COMAC_TEST_OUTPUT_DIR : ".";
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    xasprintf (&filename, "%s/%s.pdf", path, BASENAME);
+
+    surface = comac_pdf_surface_create (filename, 200, 200);
+    comac_pdf_surface_restrict_to_version (surface, COMAC_PDF_VERSION_1_4);
+    status = draw_pages (surface, 0);
+    if (status)
+	goto BAIL;
+
+    old_data = read_file (filename, &old_length);
+    if (old_data == NULL) {
+	error = "cannot read the original file";
+	goto BAIL;
+    }
+
+    surface = comac_pdf_surface_create_for_update (filename, 200, 200);
+    status = draw_pages (surface, NUM_PAGES);
+    if (status)
+	goto BAIL;
+
+    data = read_file (filename, &length);
+    if (data == NULL) {
+	error = "cannot read the updated file";
+	goto BAIL;
+    }
+
+    error = check_update (old_data, old_length, data, length);
+
+BAIL:
+    free (old_data);
+    free (data);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write pdf file %s: %s\n",
+			filename,
+			comac_status_to_string (status));
+	free (filename);
+	return COMAC_TEST_FAILURE;
+    }
+
+    if (error) {
+	comac_test_log (ctx, "Invalid update of %s: %s\n", filename, error);
+	free (filename);
+	return COMAC_TEST_FAILURE;
+    }
+
+    free (filename);
+    return COMAC_TEST_SUCCESS;
+}
+
+COMAC_TEST (pdf_update,
+	    "Check appending pages to an existing PDF file",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -0,0 +1,227 @@
+/*
+ * Copyright © 2026 The comac contributors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include "pdf-test-utils.h"
+#include "comacint.h"
+#include "comac-paginated-private.h"
+#include "comac-pdf-surface-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <comac.h>
+#include <comac-pdf.h>
+
+/* Check that a PDF file written to disk from a separate thread is valid
+ * and draws the same as one written to a stream, and that the thread
+ * does write the file once there is more output than fits in a buffer.
+ */
+
+#define BASENAME "pdf-write-thread.out"
+#define LARGE_BASENAME "pdf-write-thread-large.out"
+
+/* Noise, which is larger than two of the 1 MB buffers of the file
+ * stream even when compressed. */
+#define NOISE_SIZE 1024
+
+static comac_status_t
+write_file (const char *filename)
+{
+    comac_surface_t *surface;
+    comac_status_t status;
+
+    surface = comac_pdf_surface_create (filename,
+					PDF_TEST_DOCUMENT_WIDTH,
+					PDF_TEST_DOCUMENT_HEIGHT);
+    comac_pdf_surface_set_write_thread (surface, TRUE);
+
+    status = pdf_test_draw_document (surface);
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    return status;
+}
+
+static comac_surface_t *
+create_noise_image (void)
+{
+    comac_surface_t *image;
+    unsigned char *data;
+    uint32_t *row;
+    uint32_t noise = 1;
+    int stride, x, y;
+
+    image = comac_image_surface_create (COMAC_FORMAT_RGB24,
+					NOISE_SIZE,
+					NOISE_SIZE);
+    comac_surface_flush (image);
+    data = comac_image_surface_get_data (image);
+    stride = comac_image_surface_get_stride (image);
+    if (data == NULL)
+	return image;
+
+    for (y = 0; y < NOISE_SIZE; y++) {
+	row = (uint32_t *) (data + y * stride);
+	for (x = 0; x < NOISE_SIZE; x++) {
+	    noise = noise * 1103515245 + 12345;
+	    row[x] = noise >> 8;
+	}
+    }
+    comac_surface_mark_dirty (image);
+
+    return image;
+}
+
+/* Writes a page of noise to @filename and checks, before the file is
+ * finished, that buffers have been written by the writer thread. */
+static comac_test_status_t
+check_thread_writes (comac_test_context_t *ctx, const char *filename)
+{
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    pdf_test_document_t *doc = NULL;
+    comac_test_status_t result = COMAC_TEST_SUCCESS;
+    comac_surface_t *surface, *image;
+    comac_pdf_surface_t *pdf;
+    comac_status_t status;
+    unsigned long buffers;
+    const char *error;
+    comac_t *cr;
+
+    surface = comac_pdf_surface_create (filename, NOISE_SIZE, NOISE_SIZE);
+    comac_pdf_surface_set_write_thread (surface, TRUE);
+
+    image = create_noise_image ();
+    cr = comac_create (surface);
+    comac_set_source_surface (cr, image, 0, 0);
+    comac_paint (cr);
+    comac_show_page (cr);
+    status = comac_status (cr);
+    comac_destroy (cr);
+    comac_surface_destroy (image);
+
+    buffers = 0;
+    if (status == COMAC_STATUS_SUCCESS) {
+	pdf = (comac_pdf_surface_t *)
+	    _comac_paginated_surface_get_target (surface);
+	buffers = _comac_output_stream_get_thread_buffers (pdf->output);
+    }
+
+    comac_surface_finish (surface);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = comac_surface_status (surface);
+    comac_surface_destroy (surface);
+
+    if (status == COMAC_STATUS_SUCCESS)
+	status = pdf_test_output_read_file (&output, filename);
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write %s: %s\n",
+			filename,
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+	goto CLEANUP;
+    }
+
+    if (buffers == 0) {
+	comac_test_log (ctx,
+			"No buffers written by the writer thread after "
+			"%lu bytes\n",
+			(unsigned long) output.length);
+	result = COMAC_TEST_FAILURE;
+    }
+
+    doc = pdf_test_document_create (output.data, output.length);
+    error = pdf_test_document_get_error (doc);
+    if (error) {
+	comac_test_log (ctx, "%s: invalid pdf: %s\n", filename, error);
+	result = COMAC_TEST_FAILURE;
+    }
+
+CLEANUP:
+    pdf_test_document_destroy (doc);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+static comac_test_status_t
+preamble (comac_test_context_t *ctx)
+{
+    pdf_test_output_t reference = PDF_TEST_OUTPUT_INIT;
+    pdf_test_output_t output = PDF_TEST_OUTPUT_INIT;
+    comac_test_status_t result;
+    comac_status_t status;
+    char *filename;
+    const char *path =
+	comac_test_mkdir (COMAC_TEST_OUTPUT_DIR) ? COMAC_TEST_OUTPUT_DIR : ".";
+
+    if (! comac_test_is_target_enabled (ctx, "pdf"))
+	return COMAC_TEST_UNTESTED;
+
+    xasprintf (&filename, "%s/%s.pdf", path, BASENAME);
+
+    status = pdf_test_write_document (&reference, NULL, NULL);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = write_file (filename);
+    if (status == COMAC_STATUS_SUCCESS)
+	status = pdf_test_output_read_file (&output, filename);
+
+    if (status) {
+	comac_test_log (ctx,
+			"Failed to write %s: %s\n",
+			filename,
+			comac_status_to_string (status));
+	result = COMAC_TEST_FAILURE;
+    } else {
+	result = pdf_test_compare_outputs (ctx,
+					   "write thread",
+					   &reference,
+					   &output);
+    }
+
+    free (filename);
+
+    if (result == COMAC_TEST_SUCCESS) {
+	xasprintf (&filename, "%s/%s.pdf", path, LARGE_BASENAME);
+	result = check_thread_writes (ctx, filename);
+	free (filename);
+    }
+
+    pdf_test_output_fini (&reference);
+    pdf_test_output_fini (&output);
+
+    return result;
+}
+
+COMAC_TEST (pdf_write_thread,
+	    "Check PDF files written to disk from a separate thread",
+	    "pdf", /* keywords */
+	    NULL,  /* requirements */
+	    0,
+	    0,
+	    preamble,
+	    NULL)
@@ -69,6 +69,8 @@ format_to_string (comac_format_t format)
 	return "rgb96f";
     case COMAC_FORMAT_RGBA128F:
 	return "rgba128f";
+    case COMAC_FORMAT_CMYKA:
+	return "cmyka";
     case COMAC_FORMAT_INVALID:
     default:
 	return "???";
@@ -2971,6 +2971,9 @@ _image_read_raw (csi_t *ctx,
     case COMAC_FORMAT_RGBA128F:
 	instride = rowlen = 16 * width;
 	break;
+    case COMAC_FORMAT_CMYKA:
+	instride = rowlen = 5 * width;
+	break;
     }
     len = rowlen * height;
 
@@ -3072,6 +3075,7 @@ _image_read_raw (csi_t *ctx,
 		    break;
 		case COMAC_FORMAT_RGB96F:
 		case COMAC_FORMAT_RGBA128F:
+		case COMAC_FORMAT_CMYKA:
 		case COMAC_FORMAT_RGB30:
 		case COMAC_FORMAT_INVALID:
 		case COMAC_FORMAT_ARGB32:
@@ -3163,6 +3167,7 @@ _image_read_raw (csi_t *ctx,
 		break;
 	    case COMAC_FORMAT_RGBA128F:
 	    case COMAC_FORMAT_RGB96F:
+	    case COMAC_FORMAT_CMYKA:
 	    case COMAC_FORMAT_RGB30:
 	    case COMAC_FORMAT_INVALID:
 	    case COMAC_FORMAT_ARGB32:
@@ -3197,6 +3202,7 @@ _image_read_raw (csi_t *ctx,
 
 	    case COMAC_FORMAT_RGBA128F:
 	    case COMAC_FORMAT_RGB96F:
+	    case COMAC_FORMAT_CMYKA:
 	    case COMAC_FORMAT_RGB30:
 	    case COMAC_FORMAT_RGB24:
 	    case COMAC_FORMAT_INVALID:
@@ -6762,6 +6768,7 @@ static const csi_integer_constant_def_t _integer_constants[] = {
     {"RGB16_565", COMAC_FORMAT_RGB16_565},
     {"RGB24", COMAC_FORMAT_RGB24},
     {"ARGB32", COMAC_FORMAT_ARGB32},
+    {"CMYKA", COMAC_FORMAT_CMYKA},
     {"INVALID", COMAC_FORMAT_INVALID},
 
     {NULL, 0}};
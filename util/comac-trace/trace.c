@@ -1554,6 +1554,7 @@ _format_to_string (comac_format_t format)
 	return #name
     switch (format) {
 	f (INVALID);
+	f (CMYKA);
 	f (RGBA128F);
 	f (RGB96F);
 	f (ARGB32);
@@ -1573,6 +1574,7 @@ _format_to_content_string (comac_format_t format)
     switch (format) {
     case COMAC_FORMAT_INVALID:
 	return "INVALID";
+    case COMAC_FORMAT_CMYKA:
     case COMAC_FORMAT_RGBA128F:
     case COMAC_FORMAT_ARGB32:
 	return "COLOR_ALPHA";
@@ -1740,6 +1742,9 @@ static void COMAC_PRINTF_FORMAT (2, 3)
     case COMAC_FORMAT_RGBA128F:
 	len = 16 * width;
 	break;
+    case COMAC_FORMAT_CMYKA:
+	len = 5 * width;
+	break;
     }
 
     _trace_printf ("  /source ");
@@ -1765,6 +1770,7 @@ static void COMAC_PRINTF_FORMAT (2, 3)
     case COMAC_FORMAT_ARGB32:
     case COMAC_FORMAT_RGB96F:
     case COMAC_FORMAT_RGBA128F:
+    case COMAC_FORMAT_CMYKA:
 	for (row = height; row--;) {
 	    _write_data (&stream, data, len);
 	    data += stride;
@@ -1837,6 +1843,12 @@ static void COMAC_PRINTF_FORMAT (2, 3)
 	    data += stride;
 	}
 	break;
+    case COMAC_FORMAT_CMYKA:
+	for (row = height; row--;) {
+	    _write_data (&stream, data, len);
+	    data += stride;
+	}
+	break;
     case COMAC_FORMAT_INVALID:
     default:
 	break;